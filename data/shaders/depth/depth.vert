@@ -0,0 +1,31 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 InPosL;			// Vertex in local coordinate system, the only stream of the depth pre-pass
+
+// The first members of the UBO in textured.vert
+layout (std140, binding = 0) uniform UBO 
+{
+	// Camera 
+	mat4 projection;
+	mat4 view;
+} per_frame;
+
+layout(push_constant) uniform PushConsts {
+	 mat4 world;
+	 vec3 color;
+	 int textureIndex;
+} pushConsts;
+
+// The main pass tests the depth with VK_COMPARE_OP_EQUAL so the position must be computed exactly like in textured.vert
+invariant gl_Position;
+
+//
+// Depth pre-pass, no fragment shader
+//
+void main() 
+{
+	gl_Position = per_frame.projection * per_frame.view * pushConsts.world * vec4(InPosL.xyz, 1.0);
+}
@@ -0,0 +1 @@
+glslangvalidator -V depth.vert -o depth.vert.spv
\ No newline at end of file
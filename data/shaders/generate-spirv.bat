@@ -0,0 +1,10 @@
+@echo off
+rem Compiles the Vulkan shaders of every directory next to their sources, called by the pre-build event of Project Vulkan.vcxproj
+rem The opengl directory is skipped, its shaders are loaded as GLSL
+cd /d "%~dp0"
+
+for %%d in (colored depth hiz impostor starsphere terrain textured) do (
+	for %%f in (%%d\*.vert %%d\*.frag %%d\*.comp) do (
+		glslangValidator.exe -V %%f -o %%f.spv || exit /b 1
+	)
+)
@@ -0,0 +1,2 @@
+glslangvalidator -V hiz_cull.comp -o hiz_cull.comp.spv
+glslangvalidator -V hiz_reduce.comp -o hiz_reduce.comp.spv
\ No newline at end of file
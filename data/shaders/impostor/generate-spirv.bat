@@ -0,0 +1,2 @@
+glslangvalidator -V impostor.vert -o impostor.vert.spv
+glslangvalidator -V impostor.frag -o impostor.frag.spv
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (binding = 1) uniform sampler2D atlas;
+
+layout (location = 0) in vec2 InTex;
+
+layout (location = 0) out vec4 OutFragColor;
+
+void main() 
+{
+	// The atlas is cleared to alpha 0 and the objects are drawn with alpha 1
+	vec4 color = texture(atlas, InTex);
+	if (color.a < 0.5)
+		discard;
+
+	OutFragColor = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,67 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Instanced, see ImpostorInstance
+layout (location = 0) in vec3 InCenterW;		// Center of the bounding sphere in world coordinate system
+layout (location = 1) in float InRadius;
+layout (location = 2) in vec3 InAxisX;			// Rotation of the object
+layout (location = 3) in vec3 InAxisY;
+layout (location = 4) in vec3 InAxisZ;
+
+// The first members of the UBO in textured.vert
+layout (std140, binding = 0) uniform UBO 
+{
+	// Camera 
+	mat4 projection;
+	mat4 view;
+	
+	vec4 lightDir;
+	vec3 eyePos;
+} per_frame;
+
+// Same as in ImpostorRenderer.h
+#define IMPOSTOR_AZIMUTHS 8
+#define IMPOSTOR_ELEVATIONS 4
+#define IMPOSTOR_TILE_SIZE 128
+
+#define PI 3.14159265
+
+layout (location = 0) out vec2 OutTex;			// In the atlas
+
+// Two triangles, the quad is generated from gl_VertexIndex
+const vec2 corners[6] = vec2[](
+	vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+	vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+//
+// Camera facing billboard that shows the closest view of the object
+//
+void main() 
+{
+	// Direction to the eye in local coordinate system, the inverse of the rotation is the transpose
+	mat3 rotation = mat3(InAxisX, InAxisY, InAxisZ);
+	vec3 toEyeL = normalize(transpose(rotation) * (per_frame.eyePos - InCenterW));
+
+	// The view the direction is closest to, the same directions as GetViewDirection() in ImpostorRenderer.cpp
+	float azimuth = atan(toEyeL.x, toEyeL.z);
+	float elevation = asin(clamp(toEyeL.y, -1.0, 1.0));
+	int azimuthIndex = (int(round(azimuth * IMPOSTOR_AZIMUTHS / (2.0 * PI))) + IMPOSTOR_AZIMUTHS) % IMPOSTOR_AZIMUTHS;
+	int elevationIndex = clamp(int(floor((elevation + 0.5 * PI) * IMPOSTOR_ELEVATIONS / PI)), 0, IMPOSTOR_ELEVATIONS - 1);
+
+	// The same basis as glm::lookAt() when the views were rendered, the up axis of the mesh is up on screen
+	vec3 forwardL = -toEyeL;
+	vec3 upL = abs(toEyeL.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+	vec3 rightL = normalize(cross(forwardL, upL));
+	upL = cross(rightL, forwardL);
+
+	vec2 corner = corners[gl_VertexIndex];
+	vec3 posW = InCenterW + rotation * (rightL * corner.x + upL * corner.y) * InRadius;
+	gl_Position = per_frame.projection * per_frame.view * vec4(posW, 1.0);
+
+	// Half a texel inside the tile so the linear filtering doesn't read the neighbouring views
+	vec2 tileTex = clamp(corner * 0.5 + 0.5, 0.5 / IMPOSTOR_TILE_SIZE, 1.0 - 0.5 / IMPOSTOR_TILE_SIZE);
+	OutTex = (vec2(azimuthIndex, elevationIndex) + tileTex) / vec2(IMPOSTOR_AZIMUTHS, IMPOSTOR_ELEVATIONS);
+}
@@ -0,0 +1 @@
+glslangvalidator -V terrain.vert -o terrain.vert.spv
\ No newline at end of file
@@ -0,0 +1,101 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 InGridPos;		// xy = vertex in the shared patch grid, z = 1 for skirt vertices
+
+// Instanced, one instance per terrain node (see TerrainInstance)
+layout (location = 1) in vec2 InOrigin;		// First texel
+layout (location = 2) in float InStep;			// Texels between two vertices
+layout (location = 3) in float InSkirtDepth;
+
+//! Corresponds to the C++ class Material. Stores the ambient, diffuse and specular colors for a material.
+struct Material
+{
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular; // w = SpecPower
+};
+
+struct Light
+{
+	// Color
+	Material material;
+
+	vec3 pos;
+	float range;
+
+	vec3 dir;
+	float spot;
+
+	vec3 att;
+	float type;
+
+	vec3 intensity;
+	float id;
+};
+
+layout (std140, binding = 0) uniform UBO 
+{
+	// Camera 
+	mat4 projection;
+	mat4 view;
+	
+	vec4 lightDir;
+	vec3 eyePos;
+
+	float t;
+	
+	Light light[1];
+	float numLights;
+	bool useInstancing;
+	vec2 garbage;
+} per_frame;
+
+layout (binding = 2) uniform sampler2D samplerHeightmap;	// R32_SFLOAT, one height per texel
+
+layout(push_constant) uniform PushConsts {
+	 mat4 world;
+	 vec3 color;
+} pushConsts;
+
+layout (location = 0) out vec3 OutNormalW;		// Normal in world coordinate system
+layout (location = 1) out vec3 OutColor;
+layout (location = 2) out vec2 OutTex;
+layout (location = 3) out vec3 OutEyeDirW;		// Direction to the eye in world coordinate system
+layout (location = 4) out vec3 OutLightDirW;
+
+float Height(ivec2 texel, ivec2 size)
+{
+	return texelFetch(samplerHeightmap, clamp(texel, ivec2(0), size - 1), 0).r;
+}
+
+//
+// Same positions and normals as ChunkedTerrain::BuildVertices()
+//
+void main() 
+{
+	ivec2 size = textureSize(samplerHeightmap, 0);
+	int step = int(InStep);
+
+	// Patches that reach outside the heightmap get clamped to the edge
+	ivec2 texel = min(ivec2(InOrigin) + ivec2(InGridPos.xy) * step, size - 1);
+
+	float height = Height(texel, size);
+	float dx = Height(texel + ivec2(step, 0), size) - Height(texel - ivec2(step, 0), size);
+	float dz = Height(texel + ivec2(0, step), size) - Height(texel - ivec2(0, step), size);
+
+	vec3 pos = vec3(texel.x, height - InGridPos.z * InSkirtDepth, texel.y);
+	vec3 normal = normalize(vec3(dx, -2.0 * step, dz));
+
+	OutColor = pushConsts.color;
+	OutTex = vec2(texel) / vec2(size);
+
+	gl_Position = per_frame.projection * per_frame.view * pushConsts.world * vec4(pos, 1.0);
+
+	vec4 PosW = pushConsts.world * vec4(pos, 1.0);
+	OutNormalW = mat3(pushConsts.world) * normal;
+	OutLightDirW = per_frame.light[0].dir;
+	OutEyeDirW = per_frame.eyePos - PosW.xyz;
+}
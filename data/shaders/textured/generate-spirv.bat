@@ -1,2 +1,3 @@
 glslangvalidator -V textured.vert -o textured.vert.spv
-glslangvalidator -V textured.frag -o textured.frag.spv
\ No newline at end of file
+glslangvalidator -V textured.frag -o textured.frag.spv
+glslangvalidator -V textured_layers.frag -o textured_layers.frag.spv
\ No newline at end of file
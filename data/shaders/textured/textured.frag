@@ -3,21 +3,26 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-layout (binding = 1) uniform sampler2D samplerColorMap;
+// Must match MAX_MATERIAL_TEXTURES, the index is the same for the whole draw (dynamically uniform)
+layout (binding = 1) uniform sampler2D samplerColorMaps[16];
 
 layout (location = 0) in vec3 InNormalW;
 layout (location = 1) in vec3 InColor;
 layout (location = 2) in vec2 InTex;
 layout (location = 3) in vec3 InEyeDirW;
 layout (location = 4) in vec3 InLightDirW;
+layout (location = 5) flat in int InTextureIndex;
 
 layout (location = 0) out vec4 OutFragColor;
 
+// Set with VkSpecializationInfo, the colored shader variant is this shader without the texture
+layout (constant_id = 3) const bool TEXTURING = true;
+
 void main() 
 {
 	// Ambient factor
-	vec3 color = vec3(0.2f);
-	vec3 Color = vec3(1, 1, 1);	
+	vec3 Color = TEXTURING ? vec3(1, 1, 1) : InColor;
+	vec3 color = 0.2f * Color;
 
 	vec3 normal = normalize(InNormalW);
 	vec3 lightDir = normalize(InLightDirW);
@@ -34,5 +39,8 @@ void main()
 	vec3 specular = shade * Color;
 	color += specular;	
 
-	OutFragColor = texture(samplerColorMap, InTex) * vec4(color, 1.0f);
+	if (TEXTURING)
+		OutFragColor = texture(samplerColorMaps[InTextureIndex], InTex) * vec4(color, 1.0f);
+	else
+		OutFragColor = vec4(color, 1.0f);
 }
\ No newline at end of file
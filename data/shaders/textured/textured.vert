@@ -57,9 +57,19 @@ layout (std140, binding = 0) uniform UBO
 	vec2 garbage;
 } per_frame;
 
+// Size of per_frame.light
+#define MAX_LIGHTS 1
+
+// Set with VkSpecializationInfo for the shader variants, the uber shader (SPECIALIZED = false) reads the same settings
+// from the uniform buffer at runtime instead and the compiler can't remove the paths that aren't used
+layout (constant_id = 0) const bool SPECIALIZED = false;
+layout (constant_id = 1) const bool INSTANCING = false;
+layout (constant_id = 2) const int NUM_LIGHTS = 1;
+
 layout(push_constant) uniform PushConsts {
 	 mat4 world;	// Model View Projection
 	 vec3 color;	// Color
+	 int textureIndex;	// Into the material texture array
 } pushConsts;
 
 layout (location = 0) out vec3 OutNormalW;		// Normal in world coordinate system
@@ -67,6 +77,10 @@ layout (location = 1) out vec3 OutColor;
 layout (location = 2) out vec2 OutTex;
 layout (location = 3) out vec3 OutEyeDirW;		// Direction to the eye in world coordinate system
 layout (location = 4) out vec3 OutLightDirW;
+layout (location = 5) flat out int OutTextureIndex;
+
+// Same as depth.vert, the main pass after the depth pre-pass only draws the fragments with the same depth
+invariant gl_Position;
 
 //
 // w/ Instancing
@@ -77,7 +91,10 @@ void main()
 
 	vec3 pos = InPosL;
 
-	if(per_frame.useInstancing) {
+	bool useInstancing = SPECIALIZED ? INSTANCING : per_frame.useInstancing;
+	int numLights = SPECIALIZED ? NUM_LIGHTS : int(per_frame.numLights);
+
+	if(useInstancing) {
 		pos = pos * InInstanceScale + InInstancePosW;
 		OutColor = InInstanceColor;
 	}
@@ -85,11 +102,17 @@ void main()
 		OutColor = vec3(1, 1, 0);
 
 	OutTex = InTex;
+	OutTextureIndex = pushConsts.textureIndex;
 
 	gl_Position = per_frame.projection * per_frame.view * pushConsts.world * vec4(pos.xyz, 1.0);
 	
     vec4 PosW = pushConsts.world  * vec4(pos, 1.0);
     OutNormalW = mat3(pushConsts.world ) * InNormalL;
-	OutLightDirW = per_frame.light[0].dir; //per_frame.lightDir.xyz;
+
+	// The directions are normalized in the fragment shader
+	OutLightDirW = vec3(0.0);
+	for (int i = 0; i < min(numLights, MAX_LIGHTS); i++)
+		OutLightDirW += per_frame.light[i].dir; //per_frame.lightDir.xyz;
+
     OutEyeDirW = per_frame.eyePos - PosW.xyz;	
 }
\ No newline at end of file
@@ -0,0 +1,684 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace VulkanLib
+{
+	// The texels of one block split into one float array per channel so 4 texels can be processed at a time
+	struct BlockTexels
+	{
+		alignas(16) float r[16];
+		alignas(16) float g[16];
+		alignas(16) float b[16];
+		alignas(16) float a[16];
+	};
+
+	static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	static void LoadBlockTexels(const uint8_t* texels, BlockTexels& block)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			block.r[i] = texels[i * 4 + 0];
+			block.g[i] = texels[i * 4 + 1];
+			block.b[i] = texels[i * 4 + 2];
+			block.a[i] = texels[i * 4 + 3];
+		}
+	}
+
+	static uint16_t PackRGB565(float r, float g, float b)
+	{
+		int r5 = std::min(std::max((int)(r * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g6 = std::min(std::max((int)(g * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b5 = std::min(std::max((int)(b * 31.0f / 255.0f + 0.5f), 0), 31);
+		return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+	}
+
+	// Expands to 8 bits the same way as the hardware, by replicating the high bits
+	static void UnpackRGB565(uint16_t color, float* rgb)
+	{
+		int r = (color >> 11) & 31;
+		int g = (color >> 5) & 63;
+		int b = color & 31;
+		rgb[0] = (float)((r << 3) | (r >> 2));
+		rgb[1] = (float)((g << 2) | (g >> 4));
+		rgb[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	// Projects the texels on the line from e0 to e1 and rounds to the closest of numSteps + 1 evenly spaced points
+	// steps[i] = 0 means e0 and numSteps means e1
+	static void ProjectOnEndpoints(const BlockTexels& block, const float* e0, const float* e1, int numSteps, int* steps)
+	{
+		float dir[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+		float lengthSq = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+		if (lengthSq < 1.0f)
+		{
+			memset(steps, 0, 16 * sizeof(int));
+			return;
+		}
+
+		const __m128 dirR = _mm_set1_ps(dir[0]);
+		const __m128 dirG = _mm_set1_ps(dir[1]);
+		const __m128 dirB = _mm_set1_ps(dir[2]);
+		const __m128 e0R = _mm_set1_ps(e0[0]);
+		const __m128 e0G = _mm_set1_ps(e0[1]);
+		const __m128 e0B = _mm_set1_ps(e0[2]);
+		const __m128 scale = _mm_set1_ps(numSteps / lengthSq);
+		const __m128 maxStep = _mm_set1_ps((float)numSteps);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128 dot = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.r + i), e0R), dirR);
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.g + i), e0G), dirG));
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.b + i), e0B), dirB));
+
+			__m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dot, scale), zero), maxStep);
+			_mm_storeu_si128((__m128i*)(steps + i), _mm_cvtps_epi32(t));		// Rounds to nearest
+		}
+	}
+
+	// Picks the indices for two 565 endpoints in the 4 color mode and returns the squared error
+	static float FitBC1Indices(const BlockTexels& block, uint16_t color0, uint16_t color1, uint32_t& indices)
+	{
+		float palette[4][3];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		// Step 0 is color0, 1 and 2 are the interpolated colors and 3 is color1
+		static const uint32_t stepToIndex[4] = { 0, 2, 3, 1 };
+
+		int steps[16];
+		ProjectOnEndpoints(block, palette[0], palette[1], 3, steps);
+
+		float error = 0.0f;
+		indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t index = stepToIndex[steps[i]];
+			indices |= index << (i * 2);
+
+			float dr = block.r[i] - palette[index][0];
+			float dg = block.g[i] - palette[index][1];
+			float db = block.b[i] - palette[index][2];
+			error += dr * dr + dg * dg + db * db;
+		}
+
+		return error;
+	}
+
+	// Least squares fit of the endpoints to the current indices, returns false if the indices don't define a line
+	static bool RefineBC1Endpoints(const BlockTexels& block, uint32_t indices, float* e0, float* e1)
+	{
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };		// Weight of color0
+
+		float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+		float alphaX[3] = { 0.0f, 0.0f, 0.0f };
+		float betaX[3] = { 0.0f, 0.0f, 0.0f };
+
+		for (int i = 0; i < 16; i++)
+		{
+			float alpha = weights[(indices >> (i * 2)) & 3];
+			float beta = 1.0f - alpha;
+			float texel[3] = { block.r[i], block.g[i], block.b[i] };
+
+			alpha2 += alpha * alpha;
+			beta2 += beta * beta;
+			alphaBeta += alpha * beta;
+			for (int c = 0; c < 3; c++)
+			{
+				alphaX[c] += alpha * texel[c];
+				betaX[c] += beta * texel[c];
+			}
+		}
+
+		float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+		if (fabsf(det) < 1e-4f)
+			return false;
+
+		for (int c = 0; c < 3; c++)
+		{
+			e0[c] = std::min(std::max((alphaX[c] * beta2 - betaX[c] * alphaBeta) / det, 0.0f), 255.0f);
+			e1[c] = std::min(std::max((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det, 0.0f), 255.0f);
+		}
+
+		return true;
+	}
+
+	// 3 color mode where index 3 is transparent black, used when some texels have alpha below 128
+	static void CompressBC1PunchThrough(const BlockTexels& block, uint8_t* out)
+	{
+		float minColor[3] = { 255.0f, 255.0f, 255.0f };
+		float maxColor[3] = { 0.0f, 0.0f, 0.0f };
+		bool anyOpaque = false;
+
+		for (int i = 0; i < 16; i++)
+		{
+			if (block.a[i] < 128.0f)
+				continue;
+
+			float texel[3] = { block.r[i], block.g[i], block.b[i] };
+			for (int c = 0; c < 3; c++)
+			{
+				minColor[c] = std::min(minColor[c], texel[c]);
+				maxColor[c] = std::max(maxColor[c], texel[c]);
+			}
+			anyOpaque = true;
+		}
+
+		uint16_t color0 = anyOpaque ? PackRGB565(minColor[0], minColor[1], minColor[2]) : 0;
+		uint16_t color1 = anyOpaque ? PackRGB565(maxColor[0], maxColor[1], maxColor[2]) : 0;
+		if (color0 > color1)
+			std::swap(color0, color1);
+
+		float e0[3], e1[3];
+		UnpackRGB565(color0, e0);
+		UnpackRGB565(color1, e1);
+
+		// Step 0 is color0, 1 is the average and 2 is color1
+		static const uint32_t stepToIndex[3] = { 0, 2, 1 };
+
+		int steps[16];
+		ProjectOnEndpoints(block, e0, e1, 2, steps);
+
+		uint32_t indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			uint32_t index = (block.a[i] < 128.0f) ? 3 : stepToIndex[steps[i]];
+			indices |= index << (i * 2);
+		}
+
+		memcpy(out + 0, &color0, 2);
+		memcpy(out + 2, &color1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	static void CompressBC1Color(const uint8_t* texels, const BlockTexels& block, uint8_t* out)
+	{
+		// Bounding box of the block, 4 texels in each register
+		__m128i minTexels = _mm_loadu_si128((const __m128i*)texels);
+		__m128i maxTexels = minTexels;
+		for (int i = 1; i < 4; i++)
+		{
+			__m128i row = _mm_loadu_si128((const __m128i*)(texels + i * 16));
+			minTexels = _mm_min_epu8(minTexels, row);
+			maxTexels = _mm_max_epu8(maxTexels, row);
+		}
+
+		minTexels = _mm_min_epu8(minTexels, _mm_shuffle_epi32(minTexels, _MM_SHUFFLE(1, 0, 3, 2)));
+		minTexels = _mm_min_epu8(minTexels, _mm_shuffle_epi32(minTexels, _MM_SHUFFLE(2, 3, 0, 1)));
+		maxTexels = _mm_max_epu8(maxTexels, _mm_shuffle_epi32(maxTexels, _MM_SHUFFLE(1, 0, 3, 2)));
+		maxTexels = _mm_max_epu8(maxTexels, _mm_shuffle_epi32(maxTexels, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		uint32_t minPacked = (uint32_t)_mm_cvtsi128_si32(minTexels);
+		uint32_t maxPacked = (uint32_t)_mm_cvtsi128_si32(maxTexels);
+
+		float minColor[3], maxColor[3], center[3];
+		for (int c = 0; c < 3; c++)
+		{
+			minColor[c] = (float)((minPacked >> (c * 8)) & 0xff);
+			maxColor[c] = (float)((maxPacked >> (c * 8)) & 0xff);
+			center[c] = (minColor[c] + maxColor[c]) * 0.5f;
+
+			// Inset the box a bit since the endpoints are rarely hit exactly
+			float inset = (maxColor[c] - minColor[c]) / 16.0f;
+			minColor[c] += inset;
+			maxColor[c] -= inset;
+		}
+
+		// The box has 4 diagonals, the signs of the red/green and blue/green covariance tell which one the texels follow
+		float covarianceRG = 0.0f, covarianceBG = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float dg = block.g[i] - center[1];
+			covarianceRG += (block.r[i] - center[0]) * dg;
+			covarianceBG += (block.b[i] - center[2]) * dg;
+		}
+
+		if (covarianceRG < 0.0f)
+			std::swap(minColor[0], maxColor[0]);
+		if (covarianceBG < 0.0f)
+			std::swap(minColor[2], maxColor[2]);
+
+		uint16_t color0 = PackRGB565(maxColor[0], maxColor[1], maxColor[2]);
+		uint16_t color1 = PackRGB565(minColor[0], minColor[1], minColor[2]);
+		uint32_t indices;
+		float error = FitBC1Indices(block, color0, color1, indices);
+
+		// One least squares refinement, only kept if it lowers the error
+		float e0[3], e1[3];
+		if (color0 != color1 && RefineBC1Endpoints(block, indices, e0, e1))
+		{
+			uint16_t refined0 = PackRGB565(e0[0], e0[1], e0[2]);
+			uint16_t refined1 = PackRGB565(e1[0], e1[1], e1[2]);
+			uint32_t refinedIndices;
+			float refinedError = FitBC1Indices(block, refined0, refined1, refinedIndices);
+
+			if (refinedError < error)
+			{
+				color0 = refined0;
+				color1 = refined1;
+				indices = refinedIndices;
+			}
+		}
+
+		// The 4 color mode requires color0 > color1, swapping the endpoints swaps index 0 with 1 and 2 with 3
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+			indices ^= 0x55555555;
+		}
+		else if (color0 == color1)
+		{
+			indices = 0;
+		}
+
+		memcpy(out + 0, &color0, 2);
+		memcpy(out + 2, &color1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	// BC4 block with alpha0 = max and alpha1 = min, which selects the mode with 6 interpolated values
+	static void CompressBC3Alpha(const BlockTexels& block, uint8_t* out)
+	{
+		float minAlpha = 255.0f, maxAlpha = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			minAlpha = std::min(minAlpha, block.a[i]);
+			maxAlpha = std::max(maxAlpha, block.a[i]);
+		}
+
+		out[0] = (uint8_t)maxAlpha;
+		out[1] = (uint8_t)minAlpha;
+
+		uint64_t indices = 0;
+		if (maxAlpha > minAlpha)
+		{
+			float scale = 7.0f / (maxAlpha - minAlpha);
+			for (int i = 0; i < 16; i++)
+			{
+				// Step 7 is alpha0 and step 0 is alpha1, the interpolated values are stored in the opposite order
+				int step = (int)((block.a[i] - minAlpha) * scale + 0.5f);
+				uint64_t index = (step == 7) ? 0 : (step == 0) ? 1 : 8 - step;
+				indices |= index << (i * 3);
+			}
+		}
+
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (uint8_t)(indices >> (i * 8));
+	}
+
+	// Mode 6 endpoints, 7 bits per channel and a p-bit that is shared by the channels of an endpoint
+	struct BC7Endpoints
+	{
+		int quantized[2][4];
+		int pBit[2];
+	};
+
+	static void QuantizeBC7Endpoint(const float* endpoint, int pBit, int* quantized)
+	{
+		for (int c = 0; c < 4; c++)
+			quantized[c] = std::min(std::max((int)((endpoint[c] - pBit) * 0.5f + 0.5f), 0), 127);
+	}
+
+	// Finds the closest of the 16 palette entries for every texel and returns the squared error
+	static float FitBC7Indices(const BlockTexels& block, const BC7Endpoints& endpoints, int* indices)
+	{
+		alignas(16) float palette[4][16];
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = (endpoints.quantized[0][c] << 1) | endpoints.pBit[0];
+			int e1 = (endpoints.quantized[1][c] << 1) | endpoints.pBit[1];
+			for (int i = 0; i < 16; i++)
+				palette[c][i] = (float)(((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+		}
+
+		__m128 totalError = _mm_setzero_ps();
+
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128 r = _mm_load_ps(block.r + i);
+			__m128 g = _mm_load_ps(block.g + i);
+			__m128 b = _mm_load_ps(block.b + i);
+			__m128 a = _mm_load_ps(block.a + i);
+
+			__m128 bestError = _mm_set1_ps(1e30f);
+			__m128i bestIndex = _mm_setzero_si128();
+
+			for (int p = 0; p < 16; p++)
+			{
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[0][p]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[1][p]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[2][p]));
+				__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette[3][p]));
+				__m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+
+				__m128i better = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+				bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(p)), _mm_andnot_si128(better, bestIndex));
+				bestError = _mm_min_ps(error, bestError);
+			}
+
+			_mm_storeu_si128((__m128i*)(indices + i), bestIndex);
+			totalError = _mm_add_ps(totalError, bestError);
+		}
+
+		alignas(16) float errors[4];
+		_mm_store_ps(errors, totalError);
+		return errors[0] + errors[1] + errors[2] + errors[3];
+	}
+
+	// Tries all 4 p-bit combinations for the endpoints and keeps the one with the lowest error
+	static float FitBC7Endpoints(const BlockTexels& block, const float* e0, const float* e1, BC7Endpoints& best, int* bestIndices)
+	{
+		float bestError = 1e30f;
+
+		for (int p = 0; p < 4; p++)
+		{
+			BC7Endpoints endpoints;
+			endpoints.pBit[0] = p & 1;
+			endpoints.pBit[1] = p >> 1;
+			QuantizeBC7Endpoint(e0, endpoints.pBit[0], endpoints.quantized[0]);
+			QuantizeBC7Endpoint(e1, endpoints.pBit[1], endpoints.quantized[1]);
+
+			int indices[16];
+			float error = FitBC7Indices(block, endpoints, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best = endpoints;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+
+		return bestError;
+	}
+
+	// Least squares fit of the endpoints to the current indices, returns false if the indices don't define a line
+	static bool RefineBC7Endpoints(const BlockTexels& block, const int* indices, float* e0, float* e1)
+	{
+		float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+		float alphaX[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float betaX[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		for (int i = 0; i < 16; i++)
+		{
+			float beta = BC7_WEIGHTS[indices[i]] / 64.0f;
+			float alpha = 1.0f - beta;
+			float texel[4] = { block.r[i], block.g[i], block.b[i], block.a[i] };
+
+			alpha2 += alpha * alpha;
+			beta2 += beta * beta;
+			alphaBeta += alpha * beta;
+			for (int c = 0; c < 4; c++)
+			{
+				alphaX[c] += alpha * texel[c];
+				betaX[c] += beta * texel[c];
+			}
+		}
+
+		float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+		if (fabsf(det) < 1e-4f)
+			return false;
+
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = std::min(std::max((alphaX[c] * beta2 - betaX[c] * alphaBeta) / det, 0.0f), 255.0f);
+			e1[c] = std::min(std::max((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det, 0.0f), 255.0f);
+		}
+
+		return true;
+	}
+
+	// Writes the lowest count bits of value starting at bit, the block is little endian
+	static void WriteBits(uint8_t* block, int& bit, uint32_t value, int count)
+	{
+		for (int i = 0; i < count; i++, bit++)
+		{
+			if (value & (1u << i))
+				block[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+		}
+	}
+
+	BlockCompressor::BlockCompressor(int numThreads)
+	{
+		mNumThreads = numThreads;
+
+		if (mNumThreads <= 0)
+			mNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		// The calling thread does the work itself when there only is one thread
+		if (mNumThreads > 1)
+			mThreadPool.setThreadCount(mNumThreads);
+	}
+
+	bool BlockCompressor::IsSupported(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool BlockCompressor::Compress(const uint8_t* texels, uint32_t width, uint32_t height, VkFormat format, std::vector<uint8_t>& blocks)
+	{
+		if (!IsSupported(format))
+			return false;
+
+		const bool bc1 = (format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK);
+		const bool punchThroughAlpha = (format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK);
+		const bool bc7 = (format == VK_FORMAT_BC7_UNORM_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK);
+		const uint32_t blockBytes = bc1 ? 8 : 16;
+
+		const uint32_t blocksX = (width + 3) / 4;
+		const uint32_t blocksY = (height + 3) / 4;
+		blocks.resize(blocksX * blocksY * blockBytes);
+
+		ParallelRows(blocksY, [&](int firstRow, int lastRow) {
+			uint8_t blockTexels[64];
+
+			for (int by = firstRow; by < lastRow; by++)
+			{
+				for (uint32_t bx = 0; bx < blocksX; bx++)
+				{
+					for (uint32_t y = 0; y < 4; y++)
+					{
+						uint32_t texelY = std::min(by * 4 + y, height - 1);
+						for (uint32_t x = 0; x < 4; x++)
+						{
+							uint32_t texelX = std::min(bx * 4 + x, width - 1);
+							memcpy(blockTexels + (y * 4 + x) * 4, texels + (texelY * width + texelX) * 4, 4);
+						}
+					}
+
+					uint8_t* block = &blocks[(by * blocksX + bx) * blockBytes];
+					if (bc1)
+						CompressBlockBC1(blockTexels, block, punchThroughAlpha);
+					else if (bc7)
+						CompressBlockBC7(blockTexels, block);
+					else
+						CompressBlockBC3(blockTexels, block);
+				}
+			}
+		});
+
+		return true;
+	}
+
+	void BlockCompressor::CompressBlockBC1(const uint8_t* texels, uint8_t* block, bool punchThroughAlpha)
+	{
+		BlockTexels blockTexels;
+		LoadBlockTexels(texels, blockTexels);
+
+		if (punchThroughAlpha)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				if (blockTexels.a[i] < 128.0f)
+				{
+					CompressBC1PunchThrough(blockTexels, block);
+					return;
+				}
+			}
+		}
+
+		CompressBC1Color(texels, blockTexels, block);
+	}
+
+	void BlockCompressor::CompressBlockBC3(const uint8_t* texels, uint8_t* block)
+	{
+		BlockTexels blockTexels;
+		LoadBlockTexels(texels, blockTexels);
+
+		CompressBC3Alpha(blockTexels, block);
+		CompressBC1Color(texels, blockTexels, block + 8);
+	}
+
+	void BlockCompressor::CompressBlockBC7(const uint8_t* texels, uint8_t* block)
+	{
+		BlockTexels blockTexels;
+		LoadBlockTexels(texels, blockTexels);
+
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			mean[0] += blockTexels.r[i];
+			mean[1] += blockTexels.g[i];
+			mean[2] += blockTexels.b[i];
+			mean[3] += blockTexels.a[i];
+		}
+		for (int c = 0; c < 4; c++)
+			mean[c] /= 16.0f;
+
+		// Principal axis of the texels from the covariance matrix with power iteration
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float d[4] = { blockTexels.r[i] - mean[0], blockTexels.g[i] - mean[1], blockTexels.b[i] - mean[2], blockTexels.a[i] - mean[3] };
+			for (int row = 0; row < 4; row++)
+				for (int col = 0; col < 4; col++)
+					covariance[row][col] += d[row] * d[col];
+		}
+
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int row = 0; row < 4; row++)
+				for (int col = 0; col < 4; col++)
+					next[row] += covariance[row][col] * axis[col];
+
+			float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+			if (length < 1e-6f)
+				break;
+
+			for (int c = 0; c < 4; c++)
+				axis[c] = next[c] / length;
+		}
+
+		float minT = 0.0f, maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (blockTexels.r[i] - mean[0]) * axis[0] + (blockTexels.g[i] - mean[1]) * axis[1] + (blockTexels.b[i] - mean[2]) * axis[2] + (blockTexels.a[i] - mean[3]) * axis[3];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		float e0[4], e1[4];
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+			e1[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+		}
+
+		BC7Endpoints endpoints;
+		int indices[16];
+		float error = FitBC7Endpoints(blockTexels, e0, e1, endpoints, indices);
+
+		for (int iteration = 0; iteration < BC7_REFINE_ITERATIONS && error > 0.0f; iteration++)
+		{
+			if (!RefineBC7Endpoints(blockTexels, indices, e0, e1))
+				break;
+
+			BC7Endpoints refined;
+			int refinedIndices[16];
+			float refinedError = FitBC7Endpoints(blockTexels, e0, e1, refined, refinedIndices);
+			if (refinedError >= error)
+				break;
+
+			error = refinedError;
+			endpoints = refined;
+			memcpy(indices, refinedIndices, sizeof(indices));
+		}
+
+		// The highest bit of the first index isn't stored so it must be 0, swapping the endpoints inverts the indices
+		if (indices[0] & 8)
+		{
+			std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+			std::swap(endpoints.pBit[0], endpoints.pBit[1]);
+			for (int i = 0; i < 16; i++)
+				indices[i] = 15 - indices[i];
+		}
+
+		memset(block, 0, 16);
+		int bit = 0;
+		WriteBits(block, bit, 1 << 6, 7);		// Mode 6
+
+		for (int c = 0; c < 4; c++)
+		{
+			WriteBits(block, bit, endpoints.quantized[0][c], 7);
+			WriteBits(block, bit, endpoints.quantized[1][c], 7);
+		}
+
+		WriteBits(block, bit, endpoints.pBit[0], 1);
+		WriteBits(block, bit, endpoints.pBit[1], 1);
+
+		WriteBits(block, bit, indices[0], 3);
+		for (int i = 1; i < 16; i++)
+			WriteBits(block, bit, indices[i], 4);
+	}
+
+	void BlockCompressor::ParallelRows(int numRows, std::function<void(int firstRow, int lastRow)> job)
+	{
+		if (mNumThreads == 1 || numRows < mNumThreads)
+		{
+			job(0, numRows);
+			return;
+		}
+
+		int rowsPerThread = (numRows + mNumThreads - 1) / mNumThreads;
+		for (int t = 0; t < mNumThreads; t++)
+		{
+			int firstRow = t * rowsPerThread;
+			int lastRow = std::min(firstRow + rowsPerThread, numRows);
+
+			if (firstRow < lastRow)
+				mThreadPool.threads[t]->addJob([=] { job(firstRow, lastRow); });
+		}
+
+		mThreadPool.wait();
+	}
+
+	int BlockCompressor::GetNumThreads()
+	{
+		return mNumThreads;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <vulkan/vulkan.h>
+#include "ThreadPool.h"
+
+#define BC7_REFINE_ITERATIONS 2		// Least squares endpoint refinements per block in BC7
+
+namespace VulkanLib
+{
+	/*
+		CPU block compressor for BC1, BC3 and BC7
+
+		BC1 and BC3 are the fast mode, the color endpoints are the inset bounding box of the block with the diagonal
+		picked from the sign of the covariance, refined once with least squares. The indices are found by projecting
+		the texels on the endpoint axis with SSE. BC3 stores the alpha as a BC4 block with the min and max alpha.
+
+		BC7 is the quality mode and only uses mode 6, one RGBA subset with 7.7.7.7 endpoints, a p-bit per endpoint and
+		4 bit indices. The endpoints start from the principal axis of the block and are refined with least squares,
+		every p-bit combination is tried and the palette search is done on 4 texels at a time with SSE.
+
+		The block rows are split across the worker threads. A block only depends on its own texels so the result is
+		the same no matter how many threads are used.
+	*/
+	class BlockCompressor
+	{
+	public:
+		BlockCompressor(int numThreads = 0);		// 0 = one thread per hardware thread
+
+		// The texels are RGBA8, tightly packed and the top row first. Partial blocks at the edges repeat the edge texels
+		// Returns false if the format isn't BC1, BC3 or BC7
+		bool Compress(const uint8_t* texels, uint32_t width, uint32_t height, VkFormat format, std::vector<uint8_t>& blocks);
+
+		static bool IsSupported(VkFormat format);
+
+		// One 4x4 block, the 16 texels are RGBA8 in row order
+		static void CompressBlockBC1(const uint8_t* texels, uint8_t* block, bool punchThroughAlpha);
+		static void CompressBlockBC3(const uint8_t* texels, uint8_t* block);
+		static void CompressBlockBC7(const uint8_t* texels, uint8_t* block);
+
+		int GetNumThreads();
+	private:
+		// Splits [0, numRows) into one contiguous range per thread and waits for all of them
+		void ParallelRows(int numRows, std::function<void(int firstRow, int lastRow)> job);
+
+		ThreadPool	mThreadPool;
+		int			mNumThreads;
+	};
+}	// VulkanLib namespace
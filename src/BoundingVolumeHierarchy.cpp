@@ -0,0 +1,342 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <numeric>
+#include <emmintrin.h>
+
+namespace VulkanLib
+{
+	static float SurfaceArea(const BoundingBox& box)
+	{
+		if (box.min.x > box.max.x)
+			return 0.0f;
+
+		vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	BoundingVolumeHierarchy::BoundingVolumeHierarchy(int numThreads)
+	{
+		mNumThreads = numThreads;
+
+		if (mNumThreads <= 0)
+			mNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		// The calling thread builds the whole tree when there only is one thread
+		if (mNumThreads > 1)
+			mThreadPool.setThreadCount(mNumThreads);
+
+		// Deep enough to give every thread about 4 subtrees, every level has up to 4 times more nodes
+		mParallelDepth = 1;
+		while ((1 << (2 * mParallelDepth)) < 4 * mNumThreads)
+			mParallelDepth++;
+	}
+
+	void BoundingVolumeHierarchy::Build(const std::vector<BoundingBox>& bounds)
+	{
+		mBounds = bounds;
+		mNodes.clear();
+		mObjectIndices.resize(bounds.size());
+		mCentroids.resize(bounds.size());
+
+		std::iota(mObjectIndices.begin(), mObjectIndices.end(), 0);
+		for (size_t i = 0; i < bounds.size(); i++)
+			mCentroids[i] = bounds[i].GetCenter();
+
+		if (bounds.size() == 0)
+			return;
+
+		// The top levels are built here, the subtrees below mParallelDepth are only recorded
+		std::vector<Subtree> deferred;
+		BuildNode(mNodes, 0, bounds.size(), 0, mNumThreads > 1 ? &deferred : nullptr);
+
+		// The largest subtrees first so the threads finish at about the same time
+		std::sort(deferred.begin(), deferred.end(), [](const Subtree& a, const Subtree& b) { return a.count > b.count; });
+
+		// The subtrees own disjoint ranges of mObjectIndices so the threads never touch the same data
+		std::vector<std::vector<BVHNode>> subtreeNodes(deferred.size());
+		for (size_t i = 0; i < deferred.size(); i++)
+		{
+			Subtree subtree = deferred[i];
+			std::vector<BVHNode>* nodes = &subtreeNodes[i];
+			mThreadPool.threads[i % mNumThreads]->addJob([=] { BuildNode(*nodes, subtree.first, subtree.count, mParallelDepth, nullptr); });
+		}
+
+		mThreadPool.wait();
+
+		// Append the subtrees, their child indices are local to their own node array
+		for (size_t i = 0; i < deferred.size(); i++)
+		{
+			int offset = mNodes.size();
+
+			for (BVHNode node : subtreeNodes[i])
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					if (node.child[c] != -1)
+						node.child[c] += offset;
+				}
+
+				mNodes.push_back(node);
+			}
+
+			mNodes[deferred[i].parent].child[deferred[i].slot] = offset;
+		}
+	}
+
+	int BoundingVolumeHierarchy::BuildNode(std::vector<BVHNode>& nodes, uint32_t first, uint32_t count, int depth, std::vector<Subtree>* deferred)
+	{
+		// Split the range up to 3 times to get 4 children, always the child with the most objects
+		uint32_t childFirst[4] = { first };
+		uint32_t childCount[4] = { count };
+		int numChildren = 1;
+
+		while (numChildren < 4)
+		{
+			int largest = -1;
+			for (int i = 0; i < numChildren; i++)
+			{
+				if (childCount[i] > BVH_MAX_LEAF_SIZE && (largest == -1 || childCount[i] > childCount[largest]))
+					largest = i;
+			}
+
+			if (largest == -1)
+				break;
+
+			uint32_t leftCount;
+			Split(childFirst[largest], childCount[largest], leftCount);
+
+			childFirst[numChildren] = childFirst[largest] + leftCount;
+			childCount[numChildren] = childCount[largest] - leftCount;
+			childCount[largest] = leftCount;
+			numChildren++;
+		}
+
+		// In range order, then every child ends where the next one starts
+		for (int i = 1; i < numChildren; i++)
+		{
+			for (int j = i; j > 0 && childFirst[j] < childFirst[j - 1]; j--)
+			{
+				std::swap(childFirst[j], childFirst[j - 1]);
+				std::swap(childCount[j], childCount[j - 1]);
+			}
+		}
+
+		int nodeIndex = nodes.size();
+		nodes.push_back(BVHNode());
+
+		for (int i = 0; i < 4; i++)
+		{
+			BVHNode& node = nodes[nodeIndex];
+			BoundingBox bounds = (i < numChildren) ? GetRangeBounds(childFirst[i], childCount[i]) : BoundingBox(vec3(0.0f), vec3(0.0f));
+
+			node.minX[i] = bounds.min.x;
+			node.minY[i] = bounds.min.y;
+			node.minZ[i] = bounds.min.z;
+			node.maxX[i] = bounds.max.x;
+			node.maxY[i] = bounds.max.y;
+			node.maxZ[i] = bounds.max.z;
+			node.child[i] = -1;
+			node.first[i] = (i < numChildren) ? childFirst[i] : first + count;
+		}
+
+		for (int i = 0; i < numChildren; i++)
+		{
+			if (childCount[i] <= BVH_MAX_LEAF_SIZE)
+				continue;
+
+			if (deferred != nullptr && depth + 1 >= mParallelDepth)
+			{
+				Subtree subtree = { nodeIndex, i, childFirst[i], childCount[i] };
+				deferred->push_back(subtree);
+				continue;
+			}
+
+			// The recursion can reallocate the node array so the node is accessed by index afterwards
+			int child = BuildNode(nodes, childFirst[i], childCount[i], depth + 1, deferred);
+			nodes[nodeIndex].child[i] = child;
+		}
+
+		return nodeIndex;
+	}
+
+	bool BoundingVolumeHierarchy::Split(uint32_t first, uint32_t count, uint32_t& leftCount)
+	{
+		uint32_t* indices = mObjectIndices.data() + first;
+
+		BoundingBox centroidBounds;
+		for (uint32_t i = 0; i < count; i++)
+			centroidBounds.Add(mCentroids[indices[i]]);
+
+		vec3 size = centroidBounds.max - centroidBounds.min;
+		int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+
+		// All the centroids in the same point, any split is as good as the other
+		if (size[axis] <= 0.0f)
+		{
+			leftCount = count / 2;
+			return false;
+		}
+
+		const float minCentroid = centroidBounds.min[axis];
+		const float scale = BVH_NUM_BINS / size[axis];
+
+		auto getBin = [&](uint32_t object) {
+			return std::min((int)((mCentroids[object][axis] - minCentroid) * scale), BVH_NUM_BINS - 1);
+		};
+
+		BoundingBox binBounds[BVH_NUM_BINS];
+		uint32_t binCounts[BVH_NUM_BINS] = { 0 };
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			int bin = getBin(indices[i]);
+			binBounds[bin].Add(mBounds[indices[i]]);
+			binCounts[bin]++;
+		}
+
+		// Sweep from the right to get the area and count on the right side of every bin boundary
+		float rightAreas[BVH_NUM_BINS];
+		uint32_t rightCounts[BVH_NUM_BINS];
+		BoundingBox rightBounds;
+		uint32_t rightCount = 0;
+
+		for (int bin = BVH_NUM_BINS - 1; bin > 0; bin--)
+		{
+			rightBounds.Add(binBounds[bin]);
+			rightCount += binCounts[bin];
+			rightAreas[bin] = SurfaceArea(rightBounds);
+			rightCounts[bin] = rightCount;
+		}
+
+		// Then from the left, the split is between bin and bin + 1
+		BoundingBox leftBounds;
+		uint32_t sweepCount = 0;
+		float bestCost = FLT_MAX;
+		int bestSplit = -1;
+
+		for (int bin = 0; bin < BVH_NUM_BINS - 1; bin++)
+		{
+			leftBounds.Add(binBounds[bin]);
+			sweepCount += binCounts[bin];
+
+			if (sweepCount == 0 || rightCounts[bin + 1] == 0)
+				continue;
+
+			float cost = SurfaceArea(leftBounds) * sweepCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = bin;
+			}
+		}
+
+		if (bestSplit != -1)
+		{
+			uint32_t* middle = std::partition(indices, indices + count, [&](uint32_t object) { return getBin(object) <= bestSplit; });
+			leftCount = middle - indices;
+			return true;
+		}
+
+		// Every centroid ended up in one bin, split at the median instead
+		leftCount = count / 2;
+		std::nth_element(indices, indices + leftCount, indices + count, [&](uint32_t a, uint32_t b) {
+			return mCentroids[a][axis] < mCentroids[b][axis];
+		});
+
+		return false;
+	}
+
+	BoundingBox BoundingVolumeHierarchy::GetRangeBounds(uint32_t first, uint32_t count) const
+	{
+		BoundingBox bounds;
+		for (uint32_t i = first; i < first + count; i++)
+			bounds.Add(mBounds[mObjectIndices[i]]);
+
+		return bounds;
+	}
+
+	void BoundingVolumeHierarchy::CullFrustum(const Frustum& frustum, std::vector<int>& visible) const
+	{
+		visible.clear();
+
+		auto nodeTest = [&frustum](const BVHNode& node, int& outside, int& inside)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			int intersecting = 0;
+
+			for (int p = 0; p < Frustum::NUM_PLANES && outside != 0xf; p++)
+			{
+				const vec4& plane = frustum.planes[p];
+				const __m128 normalX = _mm_set1_ps(plane.x);
+				const __m128 normalY = _mm_set1_ps(plane.y);
+				const __m128 normalZ = _mm_set1_ps(plane.z);
+				const __m128 planeDistance = _mm_set1_ps(plane.w);
+
+				// The corner furthest along the normal decides if a box is outside, the nearest corner if it's inside
+				__m128 farX = _mm_loadu_ps(plane.x >= 0.0f ? node.maxX : node.minX);
+				__m128 farY = _mm_loadu_ps(plane.y >= 0.0f ? node.maxY : node.minY);
+				__m128 farZ = _mm_loadu_ps(plane.z >= 0.0f ? node.maxZ : node.minZ);
+				__m128 nearX = _mm_loadu_ps(plane.x >= 0.0f ? node.minX : node.maxX);
+				__m128 nearY = _mm_loadu_ps(plane.y >= 0.0f ? node.minY : node.maxY);
+				__m128 nearZ = _mm_loadu_ps(plane.z >= 0.0f ? node.minZ : node.maxZ);
+
+				__m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, farX), _mm_mul_ps(normalY, farY)), _mm_add_ps(_mm_mul_ps(normalZ, farZ), planeDistance));
+				__m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, nearX), _mm_mul_ps(normalY, nearY)), _mm_add_ps(_mm_mul_ps(normalZ, nearZ), planeDistance));
+
+				outside |= _mm_movemask_ps(_mm_cmplt_ps(farDistance, zero));
+				intersecting |= _mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero));
+			}
+
+			inside = ~intersecting & 0xf;
+		};
+
+		auto objectTest = [&](int object) {
+			return frustum.Intersects(mBounds[object]);
+		};
+
+		Traverse(nodeTest, objectTest, visible);
+	}
+
+	const std::vector<uint32_t>& BoundingVolumeHierarchy::GetObjectIndices() const
+	{
+		return mObjectIndices;
+	}
+
+	const BoundingBox& BoundingVolumeHierarchy::GetBounds(int object) const
+	{
+		return mBounds[object];
+	}
+
+	int BoundingVolumeHierarchy::GetNumNodes() const
+	{
+		return mNodes.size();
+	}
+
+	int BoundingVolumeHierarchy::GetNumObjects() const
+	{
+		return mBounds.size();
+	}
+
+	int BoundingVolumeHierarchy::GetDepth() const
+	{
+		return mNodes.size() != 0 ? GetNodeDepth(0) : 0;
+	}
+
+	int BoundingVolumeHierarchy::GetNumThreads() const
+	{
+		return mNumThreads;
+	}
+
+	int BoundingVolumeHierarchy::GetNodeDepth(int node) const
+	{
+		int depth = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (mNodes[node].child[i] != -1)
+				depth = std::max(depth, GetNodeDepth(mNodes[node].child[i]));
+		}
+
+		return depth + 1;
+	}
+}	// VulkanLib namespace
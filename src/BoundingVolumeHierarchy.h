@@ -0,0 +1,144 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+#define BVH_MAX_LEAF_SIZE 4		// Objects in a leaf
+#define BVH_NUM_BINS 16			// SAH candidates per split
+
+namespace VulkanLib
+{
+	/*
+		4-wide BVH node, the bounds of the 4 children are stored in SoA layout so they can be tested with SSE together
+		128 bytes so a node is two cache lines when the node array starts on a cache line
+
+		The children are sorted by their first object and their ranges follow each other, so the objects of child i
+		end where child i + 1 starts. The last child ends where the node itself ends, which the traversal knows from
+		the parent. Empty slots start at the end of the node and own no objects.
+	*/
+	struct BVHNode
+	{
+		float		minX[4], minY[4], minZ[4];
+		float		maxX[4], maxY[4], maxZ[4];
+		int32_t		child[4];		// Node index, -1 for leaves and empty slots
+		uint32_t	first[4];		// The objects of the whole subtree start at GetObjectIndices()[first]
+	};
+
+	static_assert(sizeof(BVHNode) == 128, "BVHNode must be two cache lines");
+
+	/*
+		Bounding volume hierarchy over the world space bounds of scene objects
+
+		Build() splits the objects top-down with a binned surface area heuristic. Each split sorts the object centroids
+		into BVH_NUM_BINS bins along the longest axis and picks the bin boundary with the lowest
+		area(left) * count(left) + area(right) * count(right). A node is split up to 3 times so it gets 4 children.
+
+		The first levels are built on the calling thread, the subtrees below them are built in parallel on the worker
+		threads into their own node arrays and then appended. The object indices are partitioned in place so every
+		subtree owns a contiguous range of them, that makes a whole subtree accept a single range copy.
+
+		Traverse() walks the tree with a node test that classifies the 4 children as outside, inside or intersecting.
+		Outside subtrees are skipped, inside subtrees are accepted without visiting them and only the leaves that
+		intersect test their objects one by one. CullFrustum() uses it with the frustum planes, other culling tests
+		(occlusion) can plug in their own node and object tests.
+
+		The tree is static, it's rebuilt when the objects move. The renderer culls with FrustumCuller and LooseOctree
+		since its objects move, the BVH is only used by the benchmark.
+	*/
+	class BoundingVolumeHierarchy
+	{
+	public:
+		BoundingVolumeHierarchy(int numThreads = 0);		// 0 = one thread per hardware thread
+
+		void Build(const std::vector<BoundingBox>& bounds);
+
+		// The indices of the objects that are at least partially inside
+		void CullFrustum(const Frustum& frustum, std::vector<int>& visible) const;
+
+		// NodeTest(const BVHNode& node, int& outside, int& inside) sets bit i for child i
+		// ObjectTest(int object) returns true if the object is accepted
+		template<typename NodeTest, typename ObjectTest>
+		void Traverse(NodeTest nodeTest, ObjectTest objectTest, std::vector<int>& objects) const;
+
+		const std::vector<uint32_t>& GetObjectIndices() const;
+		const BoundingBox& GetBounds(int object) const;
+
+		int GetNumNodes() const;
+		int GetNumObjects() const;
+		int GetDepth() const;
+		int GetNumThreads() const;
+
+	private:
+		struct Subtree
+		{
+			int			parent;		// Node and child slot that will point to the subtree
+			int			slot;
+			uint32_t	first;
+			uint32_t	count;
+		};
+
+		int BuildNode(std::vector<BVHNode>& nodes, uint32_t first, uint32_t count, int depth, std::vector<Subtree>* deferred);
+		bool Split(uint32_t first, uint32_t count, uint32_t& leftCount);
+		BoundingBox GetRangeBounds(uint32_t first, uint32_t count) const;
+		int GetNodeDepth(int node) const;
+
+		std::vector<BVHNode>		mNodes;				// mNodes[0] is the root
+		std::vector<uint32_t>		mObjectIndices;
+		std::vector<BoundingBox>	mBounds;			// By object index
+		std::vector<vec3>			mCentroids;
+
+		ThreadPool					mThreadPool;
+		int							mNumThreads;
+		int							mParallelDepth;		// The subtrees below this depth are built on the worker threads
+	};
+
+	template<typename NodeTest, typename ObjectTest>
+	void BoundingVolumeHierarchy::Traverse(NodeTest nodeTest, ObjectTest objectTest, std::vector<int>& objects) const
+	{
+		if (mNodes.size() == 0)
+			return;
+
+		// The node index and where its objects end
+		std::vector<std::pair<int, uint32_t>> stack;
+		stack.reserve(64);
+		stack.push_back(std::make_pair(0, (uint32_t)mObjectIndices.size()));
+
+		while (stack.size() != 0)
+		{
+			const BVHNode& node = mNodes[stack.back().first];
+			uint32_t nodeEnd = stack.back().second;
+			stack.pop_back();
+
+			int outside = 0, inside = 0;
+			nodeTest(node, outside, inside);
+
+			for (int i = 0; i < 4; i++)
+			{
+				uint32_t end = (i < 3) ? node.first[i + 1] : nodeEnd;
+				if (node.first[i] == end || (outside & (1 << i)))
+					continue;
+
+				if (inside & (1 << i))
+				{
+					// The whole subtree is accepted
+					for (uint32_t j = node.first[i]; j < end; j++)
+						objects.push_back(mObjectIndices[j]);
+				}
+				else if (node.child[i] != -1)
+				{
+					stack.push_back(std::make_pair(node.child[i], end));
+				}
+				else
+				{
+					for (uint32_t j = node.first[i]; j < end; j++)
+					{
+						if (objectTest(mObjectIndices[j]))
+							objects.push_back(mObjectIndices[j]);
+					}
+				}
+			}
+		}
+	}
+}	// VulkanLib namespace
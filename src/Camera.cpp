@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include "../external/glm/glm/gtc/matrix_transform.hpp"
+#include <cfloat>
 
 namespace VulkanLib
 {
@@ -195,4 +196,18 @@ namespace VulkanLib
 	{
 		return mYaw;
 	}
+
+	float Camera::GetFieldOfView()
+	{
+		return mFov;
+	}
+
+	float Camera::GetProjectedSize(vec3 center, float radius, float viewportHeight)
+	{
+		float distance = glm::length(center - mPosition);
+		if (distance <= radius)
+			return FLT_MAX;
+
+		return radius * viewportHeight / (distance * tanf(glm::radians(mFov) * 0.5f));
+	}
 }	// VulkanLib namespace
\ No newline at end of file
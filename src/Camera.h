@@ -29,6 +29,8 @@ namespace VulkanLib
 		vec3 GetPosition();
 		float GetPitch();
 		float GetYaw();
+		float GetFieldOfView();		// Vertical, degrees
+		float GetProjectedSize(vec3 center, float radius, float viewportHeight);	// Diameter in pixels of a sphere, FLT_MAX if the camera is inside it
 		void AddOrientation(float yaw, float pitch);
 		void SetOrientation(float yaw, float pitch);
 		void LookAt(vec3 target);
@@ -0,0 +1,538 @@
+#include "ChunkedTerrain.h"
+#include "VulkanBase.h"
+#include "StaticModel.h"
+#include "Camera.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+#define SKIRT_MARGIN 0.5f		// Extra skirt depth on top of the error of the next level, local units
+
+namespace VulkanLib
+{
+	static const int PATCH_VERTICES = ChunkedTerrain::PATCH_SIZE + 1;
+	static const int GRID_VERTICES = PATCH_VERTICES * PATCH_VERTICES;
+	static const int VERTICES_PER_NODE = GRID_VERTICES + 4 * PATCH_VERTICES;		// Grid + one skirt row per edge
+
+	// Grid index of vertex i along edge 0 = top, 1 = bottom, 2 = left, 3 = right
+	static int EdgeVertex(int edge, int i)
+	{
+		const int last = ChunkedTerrain::PATCH_SIZE;
+
+		switch (edge)
+		{
+		case 0: return i;
+		case 1: return i + last * PATCH_VERTICES;
+		case 2: return i * PATCH_VERTICES;
+		default: return last + i * PATCH_VERTICES;
+		}
+	}
+
+	ChunkedTerrain::ChunkedTerrain(TerrainMode mode)
+	{
+		mMode = mode;
+	}
+
+	void ChunkedTerrain::Cleanup(VkDevice device)
+	{
+		vkDestroyBuffer(device, mVertices.buffer, nullptr);
+		vkFreeMemory(device, mVertices.memory, nullptr);
+		vkDestroyBuffer(device, mIndices.buffer, nullptr);
+		vkFreeMemory(device, mIndices.memory, nullptr);
+
+		if (mMode == TERRAIN_MODE_GPU_DISPLACED)
+		{
+			vkUnmapMemory(device, mInstances.memory);
+			vkDestroyBuffer(device, mInstances.buffer, nullptr);
+			vkFreeMemory(device, mInstances.memory, nullptr);
+
+			vkDestroyImageView(device, mHeightmap.view, nullptr);
+			vkDestroyImage(device, mHeightmap.image, nullptr);
+			vkDestroySampler(device, mHeightmap.sampler, nullptr);
+			vkFreeMemory(device, mHeightmap.deviceMemory, nullptr);
+		}
+	}
+
+	bool ChunkedTerrain::Init(VulkanBase* vulkanBase, std::string filename)
+	{
+		HeightField heightField;
+		if (!TerrainBuilder::LoadHeightField(filename, heightField))
+			return false;
+
+		Build(vulkanBase, heightField);
+
+		return true;
+	}
+
+	void ChunkedTerrain::Build(VulkanBase* vulkanBase, const HeightField& heightField)
+	{
+		assert(heightField.width > 1 && heightField.height > 1);
+
+		// The root is the first level where a single patch covers the whole heightmap
+		int rootLevel = 0;
+		while ((PATCH_SIZE << rootLevel) < std::max(heightField.width, heightField.height) - 1)
+			rootLevel++;
+
+		mDevice = vulkanBase->GetDevice();
+		mNodes.clear();
+		mRootNode = BuildNode(heightField, rootLevel, 0, 0);
+		BuildSkirts();
+		mIsSelected.assign(mNodes.size(), false);
+
+		std::vector<uint32_t> indices;
+		BuildIndices(indices);
+		mIndexCount = indices.size();
+
+		vulkanBase->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indices.size() * sizeof(uint32_t), indices.data(), &mIndices.buffer, &mIndices.memory);
+		mMemoryUsage = indices.size() * sizeof(uint32_t);
+
+		if (mMode == TERRAIN_MODE_VERTEX_BUFFERS)
+		{
+			std::vector<Vertex> vertices;
+			vertices.reserve(mNodes.size() * VERTICES_PER_NODE);
+			BuildVertices(heightField, mRootNode, vertices);
+			mVertexCount = vertices.size();
+
+			// Same split position and attribute streams as the static models
+			std::vector<uint8_t> vertexData;
+			mAttributeOffset = StaticModel::SplitStreams(vertices, vertexData);
+
+			vulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexData.size(), vertexData.data(), &mVertices.buffer, &mVertices.memory);
+			mMemoryUsage += vertexData.size();
+		}
+		else
+		{
+			std::vector<vec3> vertices;
+			BuildPatch(vertices);
+			mVertexCount = vertices.size();
+
+			vulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertices.size() * sizeof(vec3), vertices.data(), &mVertices.buffer, &mVertices.memory);
+
+			// Room for every node, the buffer stays mapped and is rewritten in Update()
+			VkDeviceSize instanceBufferSize = mNodes.size() * sizeof(TerrainInstance);
+			vulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, instanceBufferSize, nullptr, &mInstances.buffer, &mInstances.memory);
+			VulkanDebug::ErrorCheck(vkMapMemory(mDevice, mInstances.memory, 0, instanceBufferSize, 0, (void**)&mMappedInstances));
+
+			VkDeviceSize heightmapSize = heightField.heights.size() * sizeof(float);
+			vulkanBase->CreateTexture(heightField.heights.data(), heightmapSize, heightField.width, heightField.height, VK_FORMAT_R32_SFLOAT, VK_FILTER_NEAREST, &mHeightmap);
+
+			mMemoryUsage += vertices.size() * sizeof(vec3) + instanceBufferSize + heightmapSize;
+		}
+	}
+
+	// Creates the node and its subtree, the children are built first since the error and bounds include them
+	int ChunkedTerrain::BuildNode(const HeightField& heightField, int level, int x, int z)
+	{
+		if (x >= heightField.width - 1 || z >= heightField.height - 1)
+			return -1;
+
+		const int step = 1 << level;
+
+		Node node;
+		node.level = level;
+		node.x = x;
+		node.z = z;
+		node.step = step;
+		node.error = 0.0f;
+		node.skirtDepth = 0.0f;
+		node.vertexOffset = 0;
+		for (int i = 0; i < 4; i++)
+			node.children[i] = -1;
+
+		int nodeIndex = mNodes.size();
+		mNodes.push_back(node);
+
+		BoundingBox bounds;
+		float childError = 0.0f;
+
+		if (level > 0)
+		{
+			const int childSize = PATCH_SIZE * step / 2;
+
+			for (int i = 0; i < 4; i++)
+			{
+				int child = BuildNode(heightField, level - 1, x + (i % 2) * childSize, z + (i / 2) * childSize);
+				mNodes[nodeIndex].children[i] = child;
+
+				if (child != -1)
+				{
+					childError = std::max(childError, mNodes[child].error);
+					bounds.Add(mNodes[child].bounds);
+				}
+			}
+		}
+
+		// Compare the patch against the heights of the next level, a leaf matches the heightmap exactly
+		// The interpolation follows the triangulation, the diagonal of each quad goes from (1, 0) to (0, 1)
+		const int sampleStep = std::max(step / 2, 1);
+		const int lastX = std::min(x + PATCH_SIZE * step, heightField.width - 1);
+		const int lastZ = std::min(z + PATCH_SIZE * step, heightField.height - 1);
+		float deviation = 0.0f;
+
+		for (int sz = z; sz <= lastZ; sz += sampleStep)
+		{
+			for (int sx = x; sx <= lastX; sx += sampleStep)
+			{
+				float height = heightField.Get(sx, sz);
+				bounds.Add(vec3((float)sx, height, (float)sz));
+
+				if (level == 0)
+					continue;
+
+				int cellX = std::min((sx - x) / step, PATCH_SIZE - 1);
+				int cellZ = std::min((sz - z) / step, PATCH_SIZE - 1);
+				int x0 = x + cellX * step;
+				int z0 = z + cellZ * step;
+				float u = (sx - x0) / (float)step;
+				float v = (sz - z0) / (float)step;
+
+				float h00 = heightField.Get(x0, z0);
+				float h10 = heightField.Get(x0 + step, z0);
+				float h01 = heightField.Get(x0, z0 + step);
+				float h11 = heightField.Get(x0 + step, z0 + step);
+
+				float interpolated;
+				if (u + v <= 1.0f)
+					interpolated = h00 + u * (h10 - h00) + v * (h01 - h00);
+				else
+					interpolated = h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+
+				deviation = std::max(deviation, fabsf(height - interpolated));
+			}
+		}
+
+		// The error of the children is added since they in turn only approximate the level below them
+		mNodes[nodeIndex].error = (level > 0) ? deviation + childError : 0.0f;
+		mNodes[nodeIndex].bounds = bounds;
+
+		return nodeIndex;
+	}
+
+	void ChunkedTerrain::BuildSkirts()
+	{
+		// The largest error of every level
+		int rootLevel = mNodes[mRootNode].level;
+		std::vector<float> levelErrors(rootLevel + 2, 0.0f);
+		for (auto& node : mNodes)
+			levelErrors[node.level] = std::max(levelErrors[node.level], node.error);
+
+		levelErrors[rootLevel + 1] = levelErrors[rootLevel];
+
+		// The gap to a coarser neighbour is at most the error of that neighbour, RestrictSelection() keeps the selected
+		// neighbours at most one level apart so the largest error of the next level is deep enough
+		for (auto& node : mNodes)
+		{
+			node.skirtDepth = levelErrors[node.level + 1] + SKIRT_MARGIN;
+			node.bounds.min.y -= node.skirtDepth;
+		}
+	}
+
+	void ChunkedTerrain::BuildVertices(const HeightField& heightField, int nodeIndex, std::vector<Vertex>& vertices)
+	{
+		Node& node = mNodes[nodeIndex];
+		node.vertexOffset = vertices.size();
+
+		const int step = node.step;
+
+		for (int j = 0; j < PATCH_VERTICES; j++)
+		{
+			for (int i = 0; i < PATCH_VERTICES; i++)
+			{
+				// Patches that reach outside the heightmap get clamped to the edge
+				int tx = std::min(node.x + i * step, heightField.width - 1);
+				int tz = std::min(node.z + j * step, heightField.height - 1);
+
+				// Same orientation as TerrainBuilder, but the central differences span the distance between the patch vertices
+				float dx = heightField.Get(tx + step, tz) - heightField.Get(tx - step, tz);
+				float dz = heightField.Get(tx, tz + step) - heightField.Get(tx, tz - step);
+
+				vec3 pos = vec3((float)tx, heightField.Get(tx, tz), (float)tz);
+				vec3 normal = glm::normalize(vec3(dx, -2.0f * step, dz));
+				vec2 uv = vec2(tx / (float)heightField.width, tz / (float)heightField.height);
+
+				vertices.push_back(Vertex(pos, normal, uv, vec3(0, 0, 0), vec3(1.0, 1.0, 1.0)));
+			}
+		}
+
+		for (int edge = 0; edge < 4; edge++)
+		{
+			for (int i = 0; i < PATCH_VERTICES; i++)
+			{
+				Vertex vertex = vertices[node.vertexOffset + EdgeVertex(edge, i)];
+				vertex.Pos.y -= node.skirtDepth;
+				vertices.push_back(vertex);
+			}
+		}
+
+		for (int i = 0; i < 4; i++)
+		{
+			if (node.children[i] != -1)
+				BuildVertices(heightField, node.children[i], vertices);
+		}
+	}
+
+	// Grid coordinates of the shared patch, z = 1 for the skirt vertices
+	// Same vertex order as BuildVertices() so the index buffer works for both modes
+	void ChunkedTerrain::BuildPatch(std::vector<vec3>& vertices)
+	{
+		for (int j = 0; j < PATCH_VERTICES; j++)
+			for (int i = 0; i < PATCH_VERTICES; i++)
+				vertices.push_back(vec3((float)i, (float)j, 0.0f));
+
+		for (int edge = 0; edge < 4; edge++)
+		{
+			for (int i = 0; i < PATCH_VERTICES; i++)
+			{
+				vec3 vertex = vertices[EdgeVertex(edge, i)];
+				vertex.z = 1.0f;
+				vertices.push_back(vertex);
+			}
+		}
+	}
+
+	// The same indices are used by every node, the vertex offset of the draw call selects the node
+	void ChunkedTerrain::BuildIndices(std::vector<uint32_t>& indices)
+	{
+		for (int z = 0; z < PATCH_SIZE; z++)
+		{
+			for (int x = 0; x < PATCH_SIZE; x++)
+			{
+				uint32_t base = x + z * PATCH_VERTICES;
+				indices.push_back(base);
+				indices.push_back(base + PATCH_VERTICES);
+				indices.push_back(base + 1);
+				indices.push_back(base + 1);
+				indices.push_back(base + PATCH_VERTICES);
+				indices.push_back(base + PATCH_VERTICES + 1);
+			}
+		}
+
+		// The skirts use both windings since they can be seen from either side
+		for (int edge = 0; edge < 4; edge++)
+		{
+			for (int i = 0; i < PATCH_SIZE; i++)
+			{
+				uint32_t a = EdgeVertex(edge, i);
+				uint32_t b = EdgeVertex(edge, i + 1);
+				uint32_t c = GRID_VERTICES + edge * PATCH_VERTICES + i;
+				uint32_t d = c + 1;
+
+				uint32_t quad[12] = { a, c, b, b, c, d, a, b, c, b, d, c };
+				indices.insert(indices.end(), quad, quad + 12);
+			}
+		}
+	}
+
+	void ChunkedTerrain::Update(Camera* camera, const mat4& world, float viewportHeight)
+	{
+		mSelectedNodes.clear();
+		mNumCulledNodes = 0;
+
+		if (mRootNode == -1)
+			return;
+
+		mat4 view = camera->GetView();
+		mFrustum.Extract(camera->GetProjection() * view);
+		mEyePosition = vec3(glm::inverse(view)[3]);
+		mWorld = world;
+		mErrorScale = glm::length(vec3(world[1]));
+		mPixelsPerUnit = viewportHeight / (2.0f * tanf(glm::radians(camera->GetFieldOfView()) * 0.5f));
+
+		SelectNode(mRootNode, false);
+		RestrictSelection();
+
+		if (mMode == TERRAIN_MODE_GPU_DISPLACED)
+		{
+			for (int i = 0; i < mSelectedNodes.size(); i++)
+			{
+				const Node& node = mNodes[mSelectedNodes[i]];
+				mMappedInstances[i].origin = vec2((float)node.x, (float)node.z);
+				mMappedInstances[i].step = (float)node.step;
+				mMappedInstances[i].skirtDepth = node.skirtDepth;
+			}
+		}
+	}
+
+	// Selects the node if its error is small enough on the screen, otherwise tries the children
+	// Once a node is completely inside the frustum its subtree doesn't need to be tested anymore
+	void ChunkedTerrain::SelectNode(int nodeIndex, bool insideFrustum)
+	{
+		const Node& node = mNodes[nodeIndex];
+		BoundingBox bounds = node.bounds.Transform(mWorld);
+
+		if (!insideFrustum)
+		{
+			FrustumResult result = mFrustum.TestBox(bounds);
+
+			if (result == FRUSTUM_OUTSIDE)
+			{
+				mNumCulledNodes++;
+				return;
+			}
+
+			insideFrustum = (result == FRUSTUM_INSIDE);
+		}
+
+		// Distance to the closest point of the bounding box
+		vec3 closest = glm::clamp(mEyePosition, bounds.min, bounds.max);
+		float distance = std::max(glm::length(closest - mEyePosition), 0.001f);
+		float screenError = node.error * mErrorScale * mPixelsPerUnit / distance;
+
+		if (node.level == 0 || screenError <= mMaxScreenError)
+		{
+			mSelectedNodes.push_back(nodeIndex);
+			mIsSelected[nodeIndex] = true;
+			return;
+		}
+
+		for (int i = 0; i < 4; i++)
+		{
+			if (node.children[i] != -1)
+				SelectNode(node.children[i], insideFrustum);
+		}
+	}
+
+	// Splits the selected nodes that are more than one level coarser than a selected neighbour, the skirts are only
+	// deep enough for one level of difference
+	void ChunkedTerrain::RestrictSelection()
+	{
+		std::vector<int> pending = mSelectedNodes;
+
+		while (pending.size() != 0)
+		{
+			int nodeIndex = pending.back();
+			pending.pop_back();
+
+			if (!mIsSelected[nodeIndex])
+				continue;
+
+			// A coarser neighbour covers the whole edge, so the texel just outside the middle of every edge finds it
+			const Node& node = mNodes[nodeIndex];
+			int size = PATCH_SIZE * node.step;
+			int half = size / 2;
+			int edgeTexels[4][2] = { { node.x + half, node.z - 1 }, { node.x + half, node.z + size }, { node.x - 1, node.z + half }, { node.x + size, node.z + half } };
+
+			for (int edge = 0; edge < 4; edge++)
+			{
+				int neighbourIndex = FindSelectedNode(edgeTexels[edge][0], edgeTexels[edge][1]);
+				if (neighbourIndex == -1 || mNodes[neighbourIndex].level <= node.level + 1)
+					continue;
+
+				// The children that are outside the frustum are left out, they have no neighbours to match
+				mIsSelected[neighbourIndex] = false;
+				for (int i = 0; i < 4; i++)
+				{
+					int child = mNodes[neighbourIndex].children[i];
+					if (child != -1 && mFrustum.TestBox(mNodes[child].bounds.Transform(mWorld)) != FRUSTUM_OUTSIDE)
+					{
+						mIsSelected[child] = true;
+						mSelectedNodes.push_back(child);
+						pending.push_back(child);
+					}
+				}
+
+				// The children can still be too coarse
+				pending.push_back(nodeIndex);
+				break;
+			}
+		}
+
+		// The split nodes were appended, the ones they replaced are removed
+		auto removed = std::remove_if(mSelectedNodes.begin(), mSelectedNodes.end(), [&](int nodeIndex) { return !mIsSelected[nodeIndex]; });
+		mSelectedNodes.erase(removed, mSelectedNodes.end());
+
+		for (int nodeIndex : mSelectedNodes)
+			mIsSelected[nodeIndex] = false;
+	}
+
+	int ChunkedTerrain::FindSelectedNode(int x, int z)
+	{
+		int nodeIndex = mRootNode;
+
+		while (nodeIndex != -1 && !mIsSelected[nodeIndex])
+		{
+			const Node& node = mNodes[nodeIndex];
+			int size = PATCH_SIZE * node.step;
+			if (x < node.x || z < node.z || x >= node.x + size || z >= node.z + size || node.level == 0)
+				return -1;
+
+			int half = size / 2;
+			nodeIndex = node.children[(x >= node.x + half ? 1 : 0) + (z >= node.z + half ? 2 : 0)];
+		}
+
+		return nodeIndex;
+	}
+
+	void ChunkedTerrain::Draw(VkCommandBuffer commandBuffer)
+	{
+		if (mSelectedNodes.size() == 0)
+			return;
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindIndexBuffer(commandBuffer, mIndices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		if (mMode == TERRAIN_MODE_GPU_DISPLACED)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mVertices.buffer, offsets);
+			vkCmdBindVertexBuffers(commandBuffer, 1, 1, &mInstances.buffer, offsets);
+			vkCmdDrawIndexed(commandBuffer, mIndexCount, mSelectedNodes.size(), 0, 0, 0);
+		}
+		else
+		{
+			// Binding 0 : Positions, binding 1 : Attributes
+			VkBuffer buffers[VERTEX_STREAM_COUNT] = { mVertices.buffer, mVertices.buffer };
+			VkDeviceSize streamOffsets[VERTEX_STREAM_COUNT] = { 0, mAttributeOffset };
+			vkCmdBindVertexBuffers(commandBuffer, VERTEX_STREAM_POSITION, VERTEX_STREAM_COUNT, buffers, streamOffsets);
+
+			for (int nodeIndex : mSelectedNodes)
+				vkCmdDrawIndexed(commandBuffer, mIndexCount, 1, 0, mNodes[nodeIndex].vertexOffset, 0);
+		}
+	}
+
+	TerrainMode ChunkedTerrain::GetMode()
+	{
+		return mMode;
+	}
+
+	vkTools::VulkanTexture& ChunkedTerrain::GetHeightmapTexture()
+	{
+		return mHeightmap;
+	}
+
+	size_t ChunkedTerrain::GetMemoryUsage()
+	{
+		return mMemoryUsage;
+	}
+
+	void ChunkedTerrain::SetMaxScreenError(float pixels)
+	{
+		mMaxScreenError = pixels;
+	}
+
+	int ChunkedTerrain::GetNumNodes()
+	{
+		return mNodes.size();
+	}
+
+	int ChunkedTerrain::GetNumSelectedNodes()
+	{
+		return mSelectedNodes.size();
+	}
+
+	int ChunkedTerrain::GetNumCulledNodes()
+	{
+		return mNumCulledNodes;
+	}
+
+	int ChunkedTerrain::GetNumVertices()
+	{
+		return mVertexCount;
+	}
+
+	int ChunkedTerrain::GetNumSelectedTriangles()
+	{
+		return mSelectedNodes.size() * (mIndexCount / 3);
+	}
+}	// VulkanLib namespace
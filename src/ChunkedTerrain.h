@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include "base/vulkanTextureLoader.hpp"
+#include "TerrainBuilder.h"
+#include "Frustum.h"
+#include "VertexDescription.h"
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	class VulkanBase;
+	class Camera;
+	struct Vertex;
+
+	enum TerrainMode
+	{
+		TERRAIN_MODE_VERTEX_BUFFERS,		// Every node has its own vertices in one big vertex buffer
+		TERRAIN_MODE_GPU_DISPLACED			// One shared grid patch, the vertex shader reads the heights from a texture
+	};
+
+	// Per instance data in TERRAIN_MODE_GPU_DISPLACED, one instance for each selected node
+	struct TerrainInstance
+	{
+		vec2 origin;		// First texel
+		float step;			// Texels between two vertices
+		float skirtDepth;
+	};
+
+	typedef VertexLayout<TerrainInstance,
+		VERTEX_MEMBER(TerrainInstance, origin),
+		VERTEX_MEMBER(TerrainInstance, step),
+		VERTEX_MEMBER(TerrainInstance, skirtDepth)> TerrainInstanceLayout;
+
+	/*
+		Quadtree of fixed size terrain patches with continuous level of detail
+
+		Every node is a patch of PATCH_SIZE x PATCH_SIZE quads, the root covers the whole heightmap and every level
+		below halves the distance between the vertices. Each node stores how much its patch differs from the full
+		resolution terrain (the geometric error), which is projected to pixels every frame to select the coarsest
+		nodes that are still accurate enough. Nodes outside the view frustum are culled together with their subtree.
+
+		Cracks between neighbouring patches of different levels are hidden with skirts, vertical strips along the
+		patch edges that reach below the largest possible gap. The selection splits nodes until no selected node is
+		more than one level coarser than its neighbours, so the gap is at most the error of the next level up.
+
+		All patches share one index buffer, so drawing a node is a single vkCmdDrawIndexed() with a vertex offset.
+
+		In TERRAIN_MODE_GPU_DISPLACED no per node vertices are stored at all. The shared patch only has the grid
+		coordinates, and the heightmap is a R32_SFLOAT texture that the vertex shader (data/shaders/terrain) displaces
+		and computes the normals from. The selected nodes are written to an instance buffer every frame and drawn
+		with a single instanced draw call, so changing the resolution never touches the vertex buffers.
+	*/
+	class ChunkedTerrain
+	{
+	public:
+		static const int PATCH_SIZE = 32;		// Quads per patch side
+
+		ChunkedTerrain(TerrainMode mode = TERRAIN_MODE_VERTEX_BUFFERS);
+
+		void Cleanup(VkDevice device);
+
+		// Loads the heightmap from a .tga file and builds the quadtree and its buffers
+		bool Init(VulkanBase* vulkanBase, std::string filename);
+		void Build(VulkanBase* vulkanBase, const HeightField& heightField);
+
+		// Selects the nodes to draw this frame
+		void Update(Camera* camera, const mat4& world, float viewportHeight);
+
+		// Binds the terrain buffers and draws the selected nodes
+		// The pipeline, descriptor sets and push constants must already be bound
+		void Draw(VkCommandBuffer commandBuffer);
+
+		TerrainMode GetMode();
+		vkTools::VulkanTexture& GetHeightmapTexture();		// Only in TERRAIN_MODE_GPU_DISPLACED
+		size_t GetMemoryUsage();							// Bytes of GPU memory used by the buffers and textures
+
+		void SetMaxScreenError(float pixels);
+
+		int GetNumNodes();
+		int GetNumSelectedNodes();
+		int GetNumCulledNodes();
+		int GetNumVertices();
+		int GetNumSelectedTriangles();
+
+	private:
+		struct Node
+		{
+			int level;				// 0 = full resolution
+			int x, z;				// First texel
+			int step;				// Texels between two vertices
+			float error;			// Largest height difference to the full resolution terrain (local units)
+			float skirtDepth;
+			BoundingBox bounds;		// Local space, includes the whole subtree
+			int children[4];		// -1 if the child is outside the heightmap
+			int32_t vertexOffset;
+		};
+
+		int BuildNode(const HeightField& heightField, int level, int x, int z);
+		void BuildSkirts();
+		void BuildVertices(const HeightField& heightField, int nodeIndex, std::vector<Vertex>& vertices);
+		void BuildPatch(std::vector<vec3>& vertices);
+		void BuildIndices(std::vector<uint32_t>& indices);
+		void SelectNode(int nodeIndex, bool insideFrustum);
+		void RestrictSelection();
+		int FindSelectedNode(int x, int z);		// The selected node that contains the texel, -1 if none
+
+		TerrainMode			mMode;
+		VkDevice			mDevice = VK_NULL_HANDLE;
+
+		std::vector<Node>	mNodes;
+		std::vector<int>	mSelectedNodes;
+		std::vector<bool>	mIsSelected;			// Indexed like mNodes
+		int					mRootNode = -1;
+		int					mNumCulledNodes = 0;
+		uint32_t			mIndexCount = 0;
+		uint32_t			mVertexCount = 0;
+		float				mMaxScreenError = 2.0f;	// Pixels
+
+		// Per frame selection state
+		Frustum				mFrustum;
+		vec3				mEyePosition;
+		mat4				mWorld;
+		float				mErrorScale;			// Local error -> world error
+		float				mPixelsPerUnit;			// World error at distance 1 -> pixels
+
+		struct {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		} mVertices, mIndices, mInstances;
+
+		VkDeviceSize			mAttributeOffset = 0;	// Only in TERRAIN_MODE_VERTEX_BUFFERS, see StaticModel::SplitStreams()
+
+		TerrainInstance*		mMappedInstances = nullptr;
+		vkTools::VulkanTexture	mHeightmap = {};
+		size_t					mMemoryUsage = 0;
+	};
+}	// VulkanLib namespace
@@ -50,12 +50,12 @@ namespace VulkanLib
 		mWriteDescriptorSets.push_back(writeDescriptorSet);
 	}
 
-	void DescriptorSet::BindCombinedImage(uint32_t binding, VkDescriptorImageInfo* imageInfo)
+	void DescriptorSet::BindCombinedImage(uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t count)
 	{
 		VkWriteDescriptorSet writeDescriptorSet = {};
 		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		writeDescriptorSet.dstSet = descriptorSet;
-		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.descriptorCount = count;
 		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		writeDescriptorSet.pImageInfo = imageInfo;
 		writeDescriptorSet.dstBinding = binding;				// Binds this combined image to binding point 1
@@ -63,14 +63,49 @@ namespace VulkanLib
 		mWriteDescriptorSets.push_back(writeDescriptorSet);
 	}
 
+	void DescriptorSet::BindStorageBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo)
+	{
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSet.pBufferInfo = bufferInfo;
+		writeDescriptorSet.dstBinding = binding;
+
+		mWriteDescriptorSets.push_back(writeDescriptorSet);
+	}
+
+	void DescriptorSet::BindStorageImage(uint32_t binding, VkDescriptorImageInfo* imageInfo)
+	{
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writeDescriptorSet.pImageInfo = imageInfo;
+		writeDescriptorSet.dstBinding = binding;
+
+		mWriteDescriptorSets.push_back(writeDescriptorSet);
+	}
+
 	void DescriptorSet::UpdateUniformBuffer(uint32_t binding, VkDescriptorBufferInfo * bufferInfo)
 	{
 		// [TODO]
 	}
 
-	void DescriptorSet::UpdateCombinedImage(uint32_t binding, VkDescriptorImageInfo * imageInfo)
+	void DescriptorSet::UpdateCombinedImage(VkDevice device, uint32_t binding, VkDescriptorImageInfo * imageInfo, uint32_t count)
 	{
-		// [TODO]
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.descriptorCount = count;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writeDescriptorSet.pImageInfo = imageInfo;
+		writeDescriptorSet.dstBinding = binding;
+
+		// Only this binding is written, the writes from UpdateDescriptorSets() may point to data that is gone
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
 	}
 
 	std::vector<VkDescriptorSetLayoutBinding> DescriptorSet::GetLayoutBindings()
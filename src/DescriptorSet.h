@@ -21,10 +21,12 @@ namespace VulkanLib
 		void UpdateDescriptorSets(VkDevice device);
 
 		void BindUniformBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
-		void BindCombinedImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
+		void BindCombinedImage(uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t count = 1);	// imageInfo points to count elements for arrays
+		void BindStorageBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
+		void BindStorageImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);		// The image must be in VK_IMAGE_LAYOUT_GENERAL when used
 
 		void UpdateUniformBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
-		void UpdateCombinedImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);	// Will be used for changing the texture
+		void UpdateCombinedImage(VkDevice device, uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t count = 1);	// Changes the texture right away, the set can't be in use
 
 		std::vector<VkDescriptorSetLayoutBinding> GetLayoutBindings();
 		// Add more binding function when needed...	
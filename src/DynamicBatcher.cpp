@@ -0,0 +1,223 @@
+#include "DynamicBatcher.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+#define DYNAMIC_BATCH_MIN_VERTICES 4096		// The first size of the buffer
+
+namespace VulkanLib
+{
+	DynamicBatcher::DynamicBatcher()
+	{
+	}
+
+	bool DynamicBatcher::CreateMesh(StaticModel* model, DynamicBatchMesh& mesh)
+	{
+		if (model->GetNumVertics() > DYNAMIC_BATCH_MAX_VERTICES)
+			return false;
+
+		for (auto& part : model->mMeshes)
+		{
+			uint32_t firstVertex = mesh.positions.size();
+			for (auto& vertex : part.vertices)
+			{
+				VertexPosition position;
+				position.Pos = vertex.Pos;
+				mesh.positions.push_back(position);
+
+				VertexAttributes attributes;
+				attributes.Color = vertex.Color;
+				attributes.Normal = vertex.Normal;
+				attributes.Tex = vertex.Tex;
+				attributes.Tangent = vertex.Tangent;
+				mesh.attributes.push_back(attributes);
+			}
+
+			for (auto index : part.indices)
+				mesh.indices.push_back(firstVertex + index);
+		}
+
+		return true;
+	}
+
+	bool DynamicBatcher::ShouldBatch(const DynamicBatchMesh& mesh, int numVisible)
+	{
+		// All the copies are transformed every frame and together they save all their draws but one
+		float batchCost = (float)numVisible * mesh.positions.size();
+		float savedCost = (float)(numVisible - 1) * DYNAMIC_BATCH_DRAW_COST;
+
+		return mesh.positions.size() <= DYNAMIC_BATCH_MAX_VERTICES && batchCost < savedCost;
+	}
+
+	void DynamicBatcher::Init(VulkanBase* vulkanBase)
+	{
+		mVulkanBase = vulkanBase;
+	}
+
+	void DynamicBatcher::Cleanup()
+	{
+		if (mMapped != nullptr)
+		{
+			vkUnmapMemory(mVulkanBase->GetDevice(), mMemory);
+			vkDestroyBuffer(mVulkanBase->GetDevice(), mBuffer, nullptr);
+			vkFreeMemory(mVulkanBase->GetDevice(), mMemory, nullptr);
+			mMapped = nullptr;
+		}
+
+		mVertexCapacity = 0;
+		mIndexCapacity = 0;
+		mInstances.clear();
+		mBatches.clear();
+	}
+
+	void DynamicBatcher::Begin()
+	{
+		mInstances.clear();
+		mBatches.clear();
+		mNumVertices = 0;
+	}
+
+	void DynamicBatcher::Add(const DynamicBatchMesh* mesh, int material, const mat4& world)
+	{
+		Instance instance;
+		instance.mesh = mesh;
+		instance.material = material;
+		instance.world = world;
+		mInstances.push_back(instance);
+	}
+
+	void DynamicBatcher::Build()
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		// The objects of a material have to be next to each other in the index buffer
+		std::stable_sort(mInstances.begin(), mInstances.end(), [](const Instance& a, const Instance& b) {
+			return a.material < b.material;
+		});
+
+		uint32_t numVertices = 0;
+		uint32_t numIndices = 0;
+		for (auto& instance : mInstances)
+		{
+			numVertices += instance.mesh->positions.size();
+			numIndices += instance.mesh->indices.size();
+		}
+
+		Reserve(numVertices, numIndices);
+
+		VertexPosition* positions = (VertexPosition*)mMapped;
+		VertexAttributes* attributes = (VertexAttributes*)(mMapped + mAttributeOffset);
+		uint32_t* indices = (uint32_t*)(mMapped + mIndexOffset);
+		uint32_t vertex = 0;
+		uint32_t index = 0;
+
+		for (auto& instance : mInstances)
+		{
+			const DynamicBatchMesh& mesh = *instance.mesh;
+
+			if (mBatches.size() == 0 || mBatches.back().material != instance.material)
+				mBatches.push_back({ instance.material, index, 0 });
+
+			// The columns of the world matrix, every vertex is x * c0 + y * c1 + z * c2 + c3
+			// The normals and the tangents use mat3(world) like textured.vert does
+			const __m128 c0 = _mm_loadu_ps(&instance.world[0][0]);
+			const __m128 c1 = _mm_loadu_ps(&instance.world[1][0]);
+			const __m128 c2 = _mm_loadu_ps(&instance.world[2][0]);
+			const __m128 c3 = _mm_loadu_ps(&instance.world[3][0]);
+			float result[4];
+
+			for (uint32_t i = 0; i < mesh.positions.size(); i++)
+			{
+				const vec3& pos = mesh.positions[i].Pos;
+				__m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(pos.x)), _mm_mul_ps(c1, _mm_set1_ps(pos.y))),
+					_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(pos.z)), c3));
+				_mm_storeu_ps(result, p);
+				positions[vertex + i].Pos = vec3(result[0], result[1], result[2]);
+
+				const VertexAttributes& source = mesh.attributes[i];
+				VertexAttributes& target = attributes[vertex + i];
+
+				__m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(source.Normal.x)), _mm_mul_ps(c1, _mm_set1_ps(source.Normal.y))),
+					_mm_mul_ps(c2, _mm_set1_ps(source.Normal.z)));
+				_mm_storeu_ps(result, n);
+				target.Normal = vec3(result[0], result[1], result[2]);
+
+				__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(source.Tangent.x)), _mm_mul_ps(c1, _mm_set1_ps(source.Tangent.y))),
+					_mm_mul_ps(c2, _mm_set1_ps(source.Tangent.z)));
+				_mm_storeu_ps(result, t);
+				target.Tangent = vec4(result[0], result[1], result[2], source.Tangent.w);
+
+				target.Color = source.Color;
+				target.Tex = source.Tex;
+			}
+
+			for (uint32_t i = 0; i < mesh.indices.size(); i++)
+				indices[index + i] = vertex + mesh.indices[i];
+
+			vertex += mesh.positions.size();
+			index += mesh.indices.size();
+			mBatches.back().numIndices += mesh.indices.size();
+		}
+
+		mNumVertices = vertex;
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mBuildTime = std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	void DynamicBatcher::BindStreams(VkCommandBuffer commandBuffer, VertexDescription& vertexDescription)
+	{
+		// Same as StaticModel::BindStreams(), the streams have consecutive bindings
+		VkBuffer buffers[VERTEX_STREAM_COUNT] = { mBuffer, mBuffer };
+		VkDeviceSize offsets[VERTEX_STREAM_COUNT] = { 0, mAttributeOffset };
+		uint32_t numStreams = vertexDescription.HasBinding(VERTEX_STREAM_ATTRIBUTES) ? 2 : 1;
+
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_STREAM_POSITION, numStreams, buffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, mBuffer, mIndexOffset, VK_INDEX_TYPE_UINT32);
+	}
+
+	const std::vector<DynamicBatch>& DynamicBatcher::GetBatches() const
+	{
+		return mBatches;
+	}
+
+	DynamicBatchStats DynamicBatcher::GetStats() const
+	{
+		DynamicBatchStats stats = {};
+		stats.numObjects = mInstances.size();
+		stats.numVertices = mNumVertices;
+		stats.numDraws = mBatches.size();
+		stats.buildTime = mBuildTime;
+		return stats;
+	}
+
+	void DynamicBatcher::Reserve(uint32_t numVertices, uint32_t numIndices)
+	{
+		if (numVertices <= mVertexCapacity && numIndices <= mIndexCapacity)
+			return;
+
+		// The last frame is finished before the next one is recorded, so the old buffer isn't in use
+		if (mMapped != nullptr)
+		{
+			vkUnmapMemory(mVulkanBase->GetDevice(), mMemory);
+			vkDestroyBuffer(mVulkanBase->GetDevice(), mBuffer, nullptr);
+			vkFreeMemory(mVulkanBase->GetDevice(), mMemory, nullptr);
+		}
+
+		mVertexCapacity = std::max(numVertices, std::max(2 * mVertexCapacity, (uint32_t)DYNAMIC_BATCH_MIN_VERTICES));
+		mIndexCapacity = std::max(numIndices, std::max(2 * mIndexCapacity, (uint32_t)DYNAMIC_BATCH_MIN_VERTICES));
+
+		// Both the attribute and the index stream start 16 byte aligned
+		mAttributeOffset = (mVertexCapacity * sizeof(VertexPosition) + 15) & ~(VkDeviceSize)15;
+		mIndexOffset = (mAttributeOffset + mVertexCapacity * sizeof(VertexAttributes) + 15) & ~(VkDeviceSize)15;
+		VkDeviceSize bufferSize = mIndexOffset + mIndexCapacity * sizeof(uint32_t);
+
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			bufferSize, nullptr, &mBuffer, &mMemory);
+
+		VulkanDebug::ErrorCheck(vkMapMemory(mVulkanBase->GetDevice(), mMemory, 0, bufferSize, 0, (void**)&mMapped));
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,115 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "VertexDescription.h"
+#include "StaticModel.h"
+
+#define DYNAMIC_BATCH_MAX_VERTICES 300		// Larger meshes are always drawn on their own
+#define DYNAMIC_BATCH_DRAW_COST 400.0f		// The CPU time of recording one draw in the time of transforming one vertex
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	class VulkanBase;
+
+	// The vertices of a small mesh in the layout of the streams, all its meshes in one
+	struct DynamicBatchMesh
+	{
+		std::vector<VertexPosition>		positions;
+		std::vector<VertexAttributes>	attributes;
+		std::vector<uint32_t>			indices;
+	};
+
+	// The objects of one material, one vkCmdDrawIndexed()
+	struct DynamicBatch
+	{
+		int						material;			// From Add()
+		uint32_t				firstIndex;
+		uint32_t				numIndices;
+	};
+
+	struct DynamicBatchStats
+	{
+		int						numObjects;
+		int						numVertices;		// Transformed in the last frame
+		int						numDraws;
+		double					buildTime;			// Milliseconds
+	};
+
+	/*
+		Draws small moving meshes of the same material together by transforming their vertices on the CPU every frame
+
+		Recording a draw costs more than transforming a few hundred vertices, so small meshes are cheaper to transform
+		to world space and append to one vertex buffer than to draw one by one. Every recording thread has its own
+		DynamicBatcher: Add() queues the visible objects, Build() transforms them with SSE into a mapped buffer and
+		the objects of every material become one draw with an identity world matrix. That is one draw per material per
+		thread, a material with objects on every thread still takes one draw on each of them.
+
+		ShouldBatch() is the cost model: meshes above DYNAMIC_BATCH_MAX_VERTICES are never batched and the others only
+		when transforming all their visible copies is cheaper than the draws it saves, DYNAMIC_BATCH_DRAW_COST vertices
+		per draw. A mesh with a single visible copy saves nothing and is drawn on its own.
+
+		The only alternative it weighs is drawing the copies one by one. Instancing is a separate mode of the renderer
+		that draws every object and dynamic batching is off with it, so the basic pipeline has no instanced draw per mesh
+		to compare against.
+
+		The buffer is rewritten every frame, the last frame must be finished before Build() is called.
+	*/
+	class DynamicBatcher
+	{
+	public:
+		DynamicBatcher();
+
+		// Returns false if the mesh has too many vertices to be batched
+		static bool CreateMesh(StaticModel* model, DynamicBatchMesh& mesh);
+
+		// True if transforming numVisible copies of the mesh is cheaper than drawing them
+		static bool ShouldBatch(const DynamicBatchMesh& mesh, int numVisible);
+
+		void Init(VulkanBase* vulkanBase);
+		void Cleanup();
+
+		// Called once per frame before Add()
+		void Begin();
+		void Add(const DynamicBatchMesh* mesh, int material, const mat4& world);
+
+		// Transforms the vertices of the objects into the buffer, sorted by material
+		void Build();
+
+		// Binds the streams the pipeline reads and the index buffer
+		void BindStreams(VkCommandBuffer commandBuffer, VertexDescription& vertexDescription);
+
+		const std::vector<DynamicBatch>& GetBatches() const;
+		DynamicBatchStats GetStats() const;
+
+	private:
+		struct Instance
+		{
+			const DynamicBatchMesh*	mesh;
+			int					material;
+			mat4				world;
+		};
+
+		void Reserve(uint32_t numVertices, uint32_t numIndices);
+
+		VulkanBase*				mVulkanBase = nullptr;
+
+		std::vector<Instance>	mInstances;
+		std::vector<DynamicBatch> mBatches;
+
+		// Host coherent and mapped, the positions, the attributes and the indices one after another
+		VkBuffer				mBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory			mMemory = VK_NULL_HANDLE;
+		uint8_t*				mMapped = nullptr;
+		uint32_t				mVertexCapacity = 0;
+		uint32_t				mIndexCapacity = 0;
+		VkDeviceSize			mAttributeOffset = 0;
+		VkDeviceSize			mIndexOffset = 0;
+
+		int						mNumVertices = 0;
+		double					mBuildTime = 0.0;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,83 @@
+#include "Frustum.h"
+
+namespace VulkanLib
+{
+	void BoundingBox::Add(vec3 point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void BoundingBox::Add(const BoundingBox& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	vec3 BoundingBox::GetCenter() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	vec3 BoundingBox::GetExtents() const
+	{
+		return (max - min) * 0.5f;
+	}
+
+	BoundingBox BoundingBox::Transform(const mat4& matrix) const
+	{
+		// Arvo's method, transforms the center and the extents instead of all the 8 corners
+		vec3 center = vec3(matrix * vec4(GetCenter(), 1.0f));
+		vec3 extents = GetExtents();
+		mat3 absolute = mat3(glm::abs(vec3(matrix[0])), glm::abs(vec3(matrix[1])), glm::abs(vec3(matrix[2])));
+		vec3 newExtents = absolute * extents;
+
+		return BoundingBox(center - newExtents, center + newExtents);
+	}
+
+	void Frustum::Extract(const mat4& viewProjection)
+	{
+		// glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		vec4 row0 = vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		vec4 row1 = vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		vec4 row2 = vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		vec4 row3 = vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		planes[LEFT] = row3 + row0;
+		planes[RIGHT] = row3 - row0;
+		planes[BOTTOM] = row3 + row1;
+		planes[TOP] = row3 - row1;
+		planes[NEAR_PLANE] = row3 + row2;		// [NOTE] Assumes -1..1 clip depth, with 0..1 this plane is a bit too far back which only makes the test more conservative
+		planes[FAR_PLANE] = row3 - row2;
+
+		for (int i = 0; i < NUM_PLANES; i++)
+			planes[i] /= glm::length(vec3(planes[i]));
+	}
+
+	FrustumResult Frustum::TestBox(const BoundingBox& box) const
+	{
+		vec3 center = box.GetCenter();
+		vec3 extents = box.GetExtents();
+		FrustumResult result = FRUSTUM_INSIDE;
+
+		for (int i = 0; i < NUM_PLANES; i++)
+		{
+			vec3 normal = vec3(planes[i]);
+			float distance = glm::dot(normal, center) + planes[i].w;
+			float radius = glm::dot(extents, glm::abs(normal));		// Projected radius of the box on the plane normal
+
+			if (distance < -radius)
+				return FRUSTUM_OUTSIDE;
+
+			if (distance < radius)
+				result = FRUSTUM_INTERSECT;
+		}
+
+		return result;
+	}
+
+	bool Frustum::Intersects(const BoundingBox& box) const
+	{
+		return TestBox(box) != FRUSTUM_OUTSIDE;
+	}
+}	// VulkanLib namespace
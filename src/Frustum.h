@@ -0,0 +1,59 @@
+#pragma once
+#include <cfloat>
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	struct BoundingBox
+	{
+		BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {}
+		BoundingBox(vec3 min, vec3 max) : min(min), max(max) {}
+
+		void Add(vec3 point);
+		void Add(const BoundingBox& box);
+
+		vec3 GetCenter() const;
+		vec3 GetExtents() const;		// Half size
+
+		// Transforms the 8 corners and returns the box that encloses them
+		BoundingBox Transform(const mat4& matrix) const;
+
+		vec3 min;
+		vec3 max;
+	};
+
+	struct BoundingSphere
+	{
+		BoundingSphere() : center(0.0f), radius(0.0f) {}
+		BoundingSphere(vec3 center, float radius) : center(center), radius(radius) {}
+
+		vec3 center;
+		float radius;
+	};
+
+	enum FrustumResult
+	{
+		FRUSTUM_OUTSIDE,
+		FRUSTUM_INTERSECT,
+		FRUSTUM_INSIDE
+	};
+
+	/*
+		The 6 planes of a view frustum, extracted from a projection * view matrix
+		The plane normals point into the frustum
+	*/
+	class Frustum
+	{
+	public:
+		enum Planes { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, NUM_PLANES };
+
+		void Extract(const mat4& viewProjection);
+
+		FrustumResult TestBox(const BoundingBox& box) const;
+		bool Intersects(const BoundingBox& box) const;
+
+		vec4 planes[NUM_PLANES];	// xyz = normal, w = distance
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,168 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace VulkanLib
+{
+	FrustumCuller::FrustumCuller()
+	{
+
+	}
+
+	void FrustumCuller::Resize(int numObjects)
+	{
+		int paddedSize = (numObjects + 3) & ~3;
+
+		mNumObjects = numObjects;
+		mCenterX.resize(paddedSize, 0.0f);
+		mCenterY.resize(paddedSize, 0.0f);
+		mCenterZ.resize(paddedSize, 0.0f);
+		mExtentX.resize(paddedSize, 0.0f);
+		mExtentY.resize(paddedSize, 0.0f);
+		mExtentZ.resize(paddedSize, 0.0f);
+		mLastPlane.resize(paddedSize, 0);
+		mBlockBounds.resize((numObjects + CULL_BLOCK_SIZE - 1) / CULL_BLOCK_SIZE);
+	}
+
+	void FrustumCuller::SetBounds(int index, const BoundingBox& localBox, const mat4& world)
+	{
+		BoundingBox box = localBox.Transform(world);
+		vec3 center = box.GetCenter();
+		vec3 extents = box.GetExtents();
+
+		mCenterX[index] = center.x;
+		mCenterY[index] = center.y;
+		mCenterZ[index] = center.z;
+		mExtentX[index] = extents.x;
+		mExtentY[index] = extents.y;
+		mExtentZ[index] = extents.z;
+
+		BoundingBox& blockBounds = mBlockBounds[index / CULL_BLOCK_SIZE];
+		if (index % CULL_BLOCK_SIZE == 0)
+			blockBounds = box;
+		else
+			blockBounds.Add(box);
+	}
+
+	uint32_t FrustumCuller::GetMortonCode(vec3 point, const BoundingBox& bounds)
+	{
+		// 10 bits per axis, the bits of x, y and z are interleaved
+		vec3 normalized = glm::clamp((point - bounds.min) / glm::max(bounds.max - bounds.min, vec3(0.0001f)), vec3(0.0f), vec3(1.0f));
+		uint32_t code = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			uint32_t value = std::min((uint32_t)(normalized[axis] * 1024.0f), 1023u);
+
+			// Spreads the 10 bits so there are two zero bits between them
+			value = (value | (value << 16)) & 0x030000FF;
+			value = (value | (value << 8)) & 0x0300F00F;
+			value = (value | (value << 4)) & 0x030C30C3;
+			value = (value | (value << 2)) & 0x09249249;
+
+			code |= value << (2 - axis);
+		}
+
+		return code;
+	}
+
+	int FrustumCuller::Cull(const Frustum& frustum, std::vector<int>& visible)
+	{
+		visible.clear();
+
+		for (int first = 0; first < mNumObjects; first += CULL_BLOCK_SIZE)
+		{
+			int last = std::min(first + CULL_BLOCK_SIZE, mNumObjects);
+			FrustumResult result = frustum.TestBox(mBlockBounds[first / CULL_BLOCK_SIZE]);
+
+			if (result == FRUSTUM_INSIDE)
+			{
+				for (int i = first; i < last; i++)
+					visible.push_back(i);
+			}
+			else if (result == FRUSTUM_INTERSECT)
+			{
+				CullBlock(frustum, first, last, visible);
+			}
+		}
+
+		mNumVisible = visible.size();
+		return mNumVisible;
+	}
+
+	void FrustumCuller::CullBlock(const Frustum& frustum, int first, int last, std::vector<int>& visible)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));		// The sign bit cleared gives the absolute value
+
+		for (int i = first; i < last; i += 4)
+		{
+			const int lanes = (1 << std::min(4, last - i)) - 1;		// The padding lanes are ignored
+
+			__m128 centerX = _mm_loadu_ps(&mCenterX[i]);
+			__m128 centerY = _mm_loadu_ps(&mCenterY[i]);
+			__m128 centerZ = _mm_loadu_ps(&mCenterZ[i]);
+			__m128 extentX = _mm_loadu_ps(&mExtentX[i]);
+			__m128 extentY = _mm_loadu_ps(&mExtentY[i]);
+			__m128 extentZ = _mm_loadu_ps(&mExtentZ[i]);
+
+			// First the plane that rejected each box last time, every lane gets its own plane
+			const vec4& plane0 = frustum.planes[mLastPlane[i + 0]];
+			const vec4& plane1 = frustum.planes[mLastPlane[i + 1]];
+			const vec4& plane2 = frustum.planes[mLastPlane[i + 2]];
+			const vec4& plane3 = frustum.planes[mLastPlane[i + 3]];
+
+			__m128 normalX = _mm_setr_ps(plane0.x, plane1.x, plane2.x, plane3.x);
+			__m128 normalY = _mm_setr_ps(plane0.y, plane1.y, plane2.y, plane3.y);
+			__m128 normalZ = _mm_setr_ps(plane0.z, plane1.z, plane2.z, plane3.z);
+			__m128 distance = _mm_setr_ps(plane0.w, plane1.w, plane2.w, plane3.w);
+
+			distance = _mm_add_ps(distance, _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, centerX), _mm_mul_ps(normalY, centerY)), _mm_mul_ps(normalZ, centerZ)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(normalX, absMask), extentX), _mm_mul_ps(_mm_and_ps(normalY, absMask), extentY)), _mm_mul_ps(_mm_and_ps(normalZ, absMask), extentZ));
+
+			int outside = _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) & lanes;
+
+			// Then all the planes until every box is rejected
+			for (int p = 0; p < Frustum::NUM_PLANES && outside != lanes; p++)
+			{
+				const vec4& plane = frustum.planes[p];
+
+				distance = _mm_add_ps(_mm_set1_ps(plane.w), _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), centerX), _mm_mul_ps(_mm_set1_ps(plane.y), centerY)), _mm_mul_ps(_mm_set1_ps(plane.z), centerZ)));
+				radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(plane.x)), extentX), _mm_mul_ps(_mm_set1_ps(fabsf(plane.y)), extentY)), _mm_mul_ps(_mm_set1_ps(fabsf(plane.z)), extentZ));
+
+				int rejected = _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) & lanes & ~outside;
+
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if (rejected & (1 << lane))
+						mLastPlane[i + lane] = p;
+				}
+
+				outside |= rejected;
+			}
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if ((lanes & ~outside) & (1 << lane))
+					visible.push_back(i + lane);
+			}
+		}
+	}
+
+	int FrustumCuller::GetNumObjects()
+	{
+		return mNumObjects;
+	}
+
+	int FrustumCuller::GetNumVisible()
+	{
+		return mNumVisible;
+	}
+
+	int FrustumCuller::GetNumCulled()
+	{
+		return mNumObjects - mNumVisible;
+	}
+}	// VulkanLib namespace
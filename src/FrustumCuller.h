@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Frustum.h"
+
+#define CULL_BLOCK_SIZE 64		// Objects per block, must be a multiple of 4
+
+namespace VulkanLib
+{
+	/*
+		Culls a list of world space bounding boxes against a view frustum
+
+		The boxes are stored as center and extents in SoA layout (all center x, all center y...) so one SSE register
+		holds the same component of 4 boxes and each plane test is done for 4 boxes at once. A box is outside when its
+		center is further behind a plane than the radius of the box projected on the plane normal.
+
+		The culling is hierarchical, each block of CULL_BLOCK_SIZE objects has a box around all of them that is tested
+		first. Blocks that are outside are skipped and blocks that are inside are visible without testing the objects.
+		The block boxes are grown by SetBounds() so they cost no extra pass, and they are only tight when neighbouring
+		indices are close in space: the objects should be ordered along GetMortonCode() before they are added.
+
+		The plane that rejected a box is remembered, since the camera and the objects move little between frames it
+		most likely rejects the box again. It's tested before the other planes so most of the culled boxes only need
+		one plane test.
+
+		Every recording thread has its own FrustumCuller so they can cull in parallel.
+	*/
+	class FrustumCuller
+	{
+	public:
+		FrustumCuller();
+
+		void Resize(int numObjects);
+
+		// The local box is transformed to world space with Arvo's method, see BoundingBox::Transform()
+		// Must be called for every object in index order before Cull(), the first object of a block restarts its box
+		void SetBounds(int index, const BoundingBox& localBox, const mat4& world);
+
+		// 30 bit Morton code of the point inside the bounds, sorting by it keeps objects that are close in space together
+		static uint32_t GetMortonCode(vec3 point, const BoundingBox& bounds);
+
+		// Writes the indices of the boxes that are at least partially inside, returns the number of visible boxes
+		int Cull(const Frustum& frustum, std::vector<int>& visible);
+
+		int GetNumObjects();
+		int GetNumVisible();		// From the last Cull()
+		int GetNumCulled();
+
+	private:
+		void CullBlock(const Frustum& frustum, int first, int last, std::vector<int>& visible);
+
+		int						mNumObjects = 0;
+		int						mNumVisible = 0;
+
+		// Padded to a multiple of 4, the padding is never visible
+		std::vector<float>		mCenterX, mCenterY, mCenterZ;
+		std::vector<float>		mExtentX, mExtentY, mExtentZ;
+		std::vector<uint8_t>	mLastPlane;		// The plane that rejected the box in an earlier Cull()
+		std::vector<BoundingBox> mBlockBounds;	// One per CULL_BLOCK_SIZE objects
+	};
+}	// VulkanLib namespace
@@ -5,9 +5,25 @@
 #include "OpenGLRenderer.h"
 #include "Camera.h"
 #include "Object.h"
+#include "StaticModel.h"
+#include "TerrainBuilder.h"
+#include "HeightmapStreamer.h"
+#include "BoundingVolumeHierarchy.h"
+#include "FrustumCuller.h"
+#include "LooseOctree.h"
+#include "SceneQuery.h"
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+#include "TransformSystem.h"
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+#include <random>
+#include <functional>
 
 namespace VulkanLib
 {
@@ -49,6 +65,628 @@ namespace VulkanLib
 		fout.close();
 	}
 
+	// Measures how long it takes to build a 4096x4096 terrain with different number of threads
+	// The resulting vertices are hashed to verify that the output is identical for every thread count
+	void Game::RunTerrainBenchmark()
+	{
+		const int size = 4096;
+
+		// Synthetic heightmap so the benchmark doesn't depend on a huge file
+		HeightField heightField;
+		heightField.width = heightField.height = size;
+		heightField.heights.resize(size * size);
+		for (int z = 0; z < size; z++)
+			for (int x = 0; x < size; x++)
+				heightField.heights[x + z * size] = 40.0f * sinf(x * 0.01f) * cosf(z * 0.013f) + 3.0f * sinf((x + z) * 0.1f);
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: Terrain build " << size << "x" << size << std::endl;
+
+		std::vector<int> threadCounts = { 1, 2, 4, (int)std::thread::hardware_concurrency() };
+		uint64_t referenceHash = 0;
+
+		for (int numThreads : threadCounts)
+		{
+			TerrainBuilder builder(numThreads);
+			Mesh mesh;
+
+			auto begin = std::chrono::high_resolution_clock::now();
+			builder.BuildMesh(heightField, mesh);
+			auto end = std::chrono::high_resolution_clock::now();
+			double buildTime = std::chrono::duration<double, std::milli>(end - begin).count();
+
+			// FNV-1a over the raw vertex and index data
+			uint64_t hash = 14695981039346656037ull;
+			const uint8_t* bytes = (const uint8_t*)mesh.vertices.data();
+			for (size_t i = 0; i < mesh.vertices.size() * sizeof(Vertex); i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			bytes = (const uint8_t*)mesh.indices.data();
+			for (size_t i = 0; i < mesh.indices.size() * sizeof(uint32_t); i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+			if (numThreads == threadCounts[0])
+				referenceHash = hash;
+
+			fout << "Threads: " << builder.GetNumThreads() << " Build time: " << buildTime << " ms";
+			fout << " Identical: " << (hash == referenceHash ? "yes" : "NO") << std::endl;
+		}
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Streams a 16384x16384 tiled heightmap along a path across the terrain with a fixed memory budget
+	// The file is about 550 MB and is generated the first time, the budget only allows a fraction of it to be loaded
+	void Game::RunTerrainStreamingBenchmark()
+	{
+		const int size = 16384;
+		const std::string filename = "data/textures/streaming-test.thm";
+		const size_t memoryBudget = 64 * 1024 * 1024;
+		const float radius = 1500.0f;
+		const int numSteps = 1000;
+
+		auto heightFunction = [](int x, int z) {
+			return 40.0f * sinf(x * 0.01f) * cosf(z * 0.013f) + 3.0f * sinf((x + z) * 0.1f);
+		};
+
+		HeightmapStreamer streamer;
+		if (!streamer.Open(filename, memoryBudget))
+		{
+			TiledHeightmap::Write(filename, size, size, 256, HEIGHT_FORMAT_UINT16, heightFunction);
+			if (!streamer.Open(filename, memoryBudget))
+				return;
+		}
+
+		double maxError = 0.0;
+		size_t peakBytes = 0;
+		int maxPending = 0;
+
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		for (int step = 0; step <= numSteps; step++)
+		{
+			vec2 position = vec2(size - 1) * (step / (float)numSteps);
+			streamer.Update(position, radius);
+			maxPending = std::max(maxPending, streamer.GetNumPendingTiles());
+			streamer.WaitForRequests();
+
+			// The terrain under the camera must be loaded and match the source within the 16-bit quantization
+			float height;
+			if (streamer.GetHeight((int)position.x, (int)position.y, height))
+				maxError = std::max(maxError, (double)fabsf(height - heightFunction((int)position.x, (int)position.y)));
+			else
+				maxError = FLT_MAX;
+
+			peakBytes = std::max(peakBytes, streamer.GetResidentBytes());
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		double totalTime = std::chrono::duration<double, std::milli>(end - begin).count();
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: Terrain streaming " << size << "x" << size << " [" << memoryBudget / (1024 * 1024) << " MB budget]" << std::endl;
+		fout << "Total time: " << totalTime << " ms [" << numSteps << " steps]" << std::endl;
+		fout << "Tiles loaded: " << streamer.GetNumLoadedTiles() << " Tiles evicted: " << streamer.GetNumEvictedTiles() << " Max pending: " << maxPending << std::endl;
+		fout << "Peak resident: " << peakBytes / 1024 << " KB Heightmap data: " << (size_t)size * size * sizeof(uint16_t) / 1024 << " KB" << std::endl;
+		fout << "Max height error: " << maxError << std::endl;
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Builds a BVH over 10k, 100k and 1M random boxes and culls them from a camera that turns around
+	// The traversal is compared with the flat FrustumCuller and the visible objects must be the same
+	void Game::RunBVHBenchmark()
+	{
+		const int numFrames = 100;
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: BVH [" << numFrames << " frames]" << std::endl;
+
+		for (int numObjects : { 10000, 100000, 1000000 })
+		{
+			// Same density for every size, about one object per 8000 units^3
+			std::mt19937 random(numObjects);
+			float worldSize = 10.0f * powf((float)numObjects, 1.0f / 3.0f);
+			std::uniform_real_distribution<float> position(-worldSize, worldSize);
+			std::uniform_real_distribution<float> extents(0.5f, 3.0f);
+
+			std::vector<BoundingBox> bounds(numObjects);
+			for (auto& box : bounds)
+			{
+				vec3 center = vec3(position(random), position(random), position(random));
+				vec3 size = vec3(extents(random), extents(random), extents(random));
+				box = BoundingBox(center - size, center + size);
+			}
+
+			FrustumCuller culler;
+			culler.Resize(numObjects);
+			for (int i = 0; i < numObjects; i++)
+				culler.SetBounds(i, bounds[i], mat4(1.0f));
+
+			for (int numThreads : { 1, (int)std::thread::hardware_concurrency() })
+			{
+				BoundingVolumeHierarchy bvh(numThreads);
+
+				auto begin = std::chrono::high_resolution_clock::now();
+				bvh.Build(bounds);
+				auto end = std::chrono::high_resolution_clock::now();
+				double buildTime = std::chrono::duration<double, std::milli>(end - begin).count();
+
+				double bvhTime = 0.0, flatTime = 0.0;
+				bool identical = true;
+				std::vector<int> bvhVisible, flatVisible;
+
+				for (int frame = 0; frame < numFrames; frame++)
+				{
+					float angle = glm::two_pi<float>() * frame / numFrames;
+					mat4 view = glm::lookAt(vec3(0.0f), vec3(cosf(angle), 0.2f, sinf(angle)), vec3(0, 1, 0));
+					Frustum frustum;
+					frustum.Extract(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize) * view);
+
+					begin = std::chrono::high_resolution_clock::now();
+					bvh.CullFrustum(frustum, bvhVisible);
+					end = std::chrono::high_resolution_clock::now();
+					bvhTime += std::chrono::duration<double, std::milli>(end - begin).count();
+
+					begin = std::chrono::high_resolution_clock::now();
+					culler.Cull(frustum, flatVisible);
+					end = std::chrono::high_resolution_clock::now();
+					flatTime += std::chrono::duration<double, std::milli>(end - begin).count();
+
+					// The BVH returns the objects in leaf order, the flat culler in index order
+					std::sort(bvhVisible.begin(), bvhVisible.end());
+					std::sort(flatVisible.begin(), flatVisible.end());
+					identical = identical && bvhVisible == flatVisible;
+				}
+
+				fout << "Objects: " << numObjects << " Threads: " << bvh.GetNumThreads() << " Build time: " << buildTime << " ms";
+				fout << " [" << bvh.GetNumNodes() << " nodes, depth " << bvh.GetDepth() << "]" << std::endl;
+				fout << "Cull time: BVH " << bvhTime / numFrames << " ms, flat " << flatTime / numFrames << " ms";
+				fout << " Visible: " << bvhVisible.size() << " Identical: " << (identical ? "yes" : "NO") << std::endl;
+			}
+		}
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Rotates every object of a grid with about 100k objects every frame and rebuilds their world matrices
+	// The reference is the old rebuild with glm::rotate() in every setter, then TransformSystem::Update() on one and all hardware threads
+	void Game::RunTransformBenchmark()
+	{
+		const int numFrames = 100;
+		const int size = 47;
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: Transforms [" << numFrames << " frames]" << std::endl;
+
+		std::vector<Object*> objects;
+		for (int x = 0; x < size; x++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int z = 0; z < size; z++)
+				{
+					Object* object = new Object(glm::vec3(x * 150, -100 - y * 150, z * 150));
+					object->SetScale(glm::vec3(3.0f));
+					objects.push_back(object);
+				}
+			}
+		}
+
+		// Summed so the compiler can't skip the matrices
+		float checksum = 0.0f;
+
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		for (int frame = 0; frame < numFrames; frame++)
+		{
+			for (auto object : objects)
+			{
+				vec3 rotation = object->GetRotation() + vec3(1.0f, 2.0f, 3.0f);
+				mat4 world;
+				world = glm::translate(world, object->GetPosition());
+				world = glm::rotate(world, glm::radians(rotation.x), vec3(1.0f, 0.0f, 0.0f));
+				world = glm::rotate(world, glm::radians(rotation.y), vec3(0.0f, 1.0f, 0.0f));
+				world = glm::rotate(world, glm::radians(rotation.z), vec3(0.0f, 0.0f, 1.0f));
+				world = glm::scale(world, object->GetScale());
+				checksum += world[3][0];
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		fout << "Objects: " << objects.size() << " glm::rotate(): " << std::chrono::duration<double, std::milli>(end - begin).count() / numFrames << " ms per frame" << std::endl;
+
+		for (int numThreads : { 1, (int)std::thread::hardware_concurrency() })
+		{
+			ThreadPool threadPool;
+			threadPool.setThreadCount(numThreads);
+
+			double setTime = 0.0;
+			double updateTime = 0.0;
+
+			for (int frame = 0; frame < numFrames; frame++)
+			{
+				begin = std::chrono::high_resolution_clock::now();
+
+				for (auto object : objects)
+					object->AddRotation(1.0f, 2.0f, 3.0f);
+
+				end = std::chrono::high_resolution_clock::now();
+				setTime += std::chrono::duration<double, std::milli>(end - begin).count();
+
+				TransformSystem::GetDefault().Update(numThreads > 1 ? &threadPool : nullptr);
+				updateTime += TransformSystem::GetDefault().GetStats().updateTime;
+				checksum += objects[frame]->GetWorldMatrix()[3][0];
+			}
+
+			fout << "Objects: " << objects.size() << " Threads: " << numThreads << " AddRotation(): " << setTime / numFrames << " ms, Update(): " << updateTime / numFrames << " ms per frame" << std::endl;
+		}
+
+		fout << "Checksum: " << checksum << std::endl;
+
+		for (auto object : objects)
+			delete object;
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Queries per second of the scene queries on the low detail grid (1000 objects) and the same grid with about 100k objects
+	// The queries are split over the threads and run at the same time through the same SceneQuery
+	void Game::RunSceneQueryBenchmark()
+	{
+		const int numQueries = 100000;
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: Scene queries [" << numQueries << " queries]" << std::endl;
+
+		// A cube with 12 triangles, the objects are rotated so the exact ray casts don't only hit the bounds
+		Mesh mesh;
+		for (int i = 0; i < 8; i++)
+			mesh.vertices.push_back(Vertex(vec3(i & 1 ? 10.0f : -10.0f, i & 2 ? 10.0f : -10.0f, i & 4 ? 10.0f : -10.0f)));
+
+		const unsigned int faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+		mesh.indices.assign(faces, faces + 36);
+
+		StaticModel cube;
+		cube.AddMesh(mesh);
+		cube.ComputeBounds();
+
+		// Axis-aligned rays have direction components that are 0, the origins are on the planes of the box and outside them
+		BoundingBox unitBox = BoundingBox(vec3(0.0f), vec3(1.0f));
+		struct AxisRay { Ray ray; bool hit; float distance; };
+		AxisRay axisRays[] = {
+			{ Ray(vec3(-1.0f, 0.0f, 0.5f), vec3(1, 0, 0)), true, 1.0f },
+			{ Ray(vec3(-1.0f, 1.0f, 1.0f), vec3(1, 0, 0)), true, 1.0f },
+			{ Ray(vec3(0.5f, 3.0f, 0.0f), vec3(0, -1, 0)), true, 2.0f },
+			{ Ray(vec3(0.5f, 0.5f, 0.5f), vec3(0, 0, 1)), true, 0.0f },
+			{ Ray(vec3(-1.0f, 1.5f, 0.5f), vec3(1, 0, 0)), false, 0.0f },
+			{ Ray(vec3(0.5f, 0.5f, -3.0f), vec3(0, 0, -1)), false, 0.0f },
+			{ Ray(vec3(0.0f, 0.5f, 3.0f), vec3(0, 0, 1)), false, 0.0f }
+		};
+
+		bool axisRaysCorrect = true;
+		for (auto& axisRay : axisRays)
+		{
+			float distance;
+			bool hit = SceneQuery::IntersectBox(axisRay.ray, 1.0f / axisRay.ray.direction, unitBox, FLT_MAX, distance);
+			axisRaysCorrect = axisRaysCorrect && hit == axisRay.hit && (!hit || distance == axisRay.distance);
+		}
+
+		fout << "Axis-aligned rays correct: " << (axisRaysCorrect ? "yes" : "NO") << std::endl;
+
+		for (int size : { 10, 47 })
+		{
+			std::mt19937 random(size);
+			std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+			std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+			// Same layout as InitLowDetailTestCase()
+			float halfSize = size * 75.0f;
+			vec3 center = vec3(halfSize, -100.0f - halfSize, halfSize);
+
+			LooseOctree octree;
+			octree.Init(center, halfSize + 150.0f);
+			SceneQuery sceneQuery(&octree);
+
+			std::vector<Object*> objects;
+			for (int x = 0; x < size; x++)
+			{
+				for (int y = 0; y < size; y++)
+				{
+					for (int z = 0; z < size; z++)
+					{
+						Object* object = new Object(glm::vec3(x * 150, -100 - y * 150, z * 150));
+						object->SetRotation(vec3(angle(random), angle(random), angle(random)));
+						object->SetScale(glm::vec3(3.0f));
+						TransformSystem::GetDefault().Update(nullptr);
+						octree.Insert(object, cube.GetBoundingBox(), &cube);
+						objects.push_back(object);
+					}
+				}
+			}
+
+			// Picking rays from outside the grid towards random objects, spheres and boxes at random points in the grid
+			std::vector<Ray> rays(numQueries);
+			std::vector<vec3> points(numQueries);
+			for (int i = 0; i < numQueries; i++)
+			{
+				vec3 target = objects[random() % objects.size()]->GetPosition() + vec3(unit(random), unit(random), unit(random)) * 30.0f;
+				vec3 origin = center + normalize(vec3(unit(random), unit(random), unit(random))) * halfSize * 2.0f;
+				rays[i] = Ray(origin, target - origin);
+				points[i] = center + vec3(unit(random), unit(random), unit(random)) * halfSize;
+			}
+
+			const char* names[4] = { "Ray (bounds)", "Ray (exact)", "Sphere", "Box" };
+			std::function<int(int)> queries[4] = {
+				[&](int i) { RayHit hit; return (int)sceneQuery.RayCast(rays[i], hit); },
+				[&](int i) { RayHit hit; return (int)sceneQuery.RayCast(rays[i], hit, FLT_MAX, true); },
+				[&](int i) { std::vector<Object*> overlap; return sceneQuery.OverlapSphere(points[i], 200.0f, overlap); },
+				[&](int i) { std::vector<Object*> overlap; return sceneQuery.OverlapBox(BoundingBox(points[i] - vec3(200.0f), points[i] + vec3(200.0f)), overlap); }
+			};
+
+			int singleThreadResults[4] = { 0 };
+
+			for (int numThreads : { 1, (int)std::thread::hardware_concurrency() })
+			{
+				ThreadPool threadPool;
+				threadPool.setThreadCount(numThreads);
+
+				fout << "Objects: " << objects.size() << " Threads: " << numThreads << std::endl;
+
+				for (int q = 0; q < 4; q++)
+				{
+					std::vector<int> results(numThreads, 0);
+
+					auto begin = std::chrono::high_resolution_clock::now();
+
+					for (int t = 0; t < numThreads; t++)
+					{
+						int first = numQueries * t / numThreads;
+						int last = numQueries * (t + 1) / numThreads;
+
+						threadPool.threads[t]->addJob([&, t, first, last] {
+							for (int i = first; i < last; i++)
+								results[t] += queries[q](i);
+						});
+					}
+
+					threadPool.wait();
+
+					auto end = std::chrono::high_resolution_clock::now();
+					double time = std::chrono::duration<double, std::milli>(end - begin).count();
+
+					int result = 0;
+					for (int t = 0; t < numThreads; t++)
+						result += results[t];
+
+					if (numThreads == 1)
+						singleThreadResults[q] = result;
+
+					fout << names[q] << ": " << (int)(numQueries / (time / 1000.0)) << " queries/s [" << result << (q < 2 ? " hits" : " objects");
+					fout << ", identical: " << (result == singleThreadResults[q] ? "yes" : "NO") << "]" << std::endl;
+				}
+			}
+
+			// Detaches the objects so they don't remove themselves from the octree
+			octree.Cleanup();
+			for (auto object : objects)
+				delete object;
+		}
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Occlusion culling of the low detail grid seen from a camera that circles around it, once with the spacing of
+	// InitLowDetailTestCase() and once with the crates close together. Every crate is an occluder
+	// Then renders the low detail and teapot scenes with and without occlusion culling in the renderer
+	void Game::RunOcclusionBenchmark()
+	{
+		const int numFrames = 100;
+		const int size = 10;
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: Occlusion culling [" << numFrames << " frames]" << std::endl;
+
+		// The bounds of Crate.obj, the crate is a box so they are also its occluder
+		BoundingBox crateBounds = BoundingBox(vec3(-0.75f, 0.0f, -0.75f), vec3(0.75f, 1.5f, 0.75f));
+		OccluderMesh crateOccluder;
+		OcclusionCuller::CreateBoxOccluder(crateBounds, crateOccluder);
+
+		for (float spacing : { 150.0f, 6.0f })
+		{
+			std::vector<mat4> worlds;
+			std::vector<BoundingBox> bounds;
+			for (int x = 0; x < size; x++)
+			{
+				for (int y = 0; y < size; y++)
+				{
+					for (int z = 0; z < size; z++)
+					{
+						Object object(glm::vec3(x * spacing, -100 - y * spacing, z * spacing));
+						object.SetRotation(glm::vec3(180, 0, 0));
+						object.SetScale(glm::vec3(3.0f));
+						TransformSystem::GetDefault().Update(nullptr);
+						worlds.push_back(object.GetWorldMatrix());
+						bounds.push_back(crateBounds.Transform(object.GetWorldMatrix()));
+					}
+				}
+			}
+
+			vec3 center = vec3(spacing * (size - 1) * 0.5f, -100.0f - spacing * (size - 1) * 0.5f, spacing * (size - 1) * 0.5f);
+			float distance = spacing * size * 1.5f;
+
+			for (int numThreads : { 1, (int)std::thread::hardware_concurrency() })
+			{
+				OcclusionCuller culler;
+				culler.Init(320, 180, numThreads);
+
+				double rasterizeTime = 0.0, testTime = 0.0;
+				int numOccluded = 0;
+
+				for (int frame = 0; frame < numFrames; frame++)
+				{
+					float angle = glm::two_pi<float>() * frame / numFrames;
+					vec3 eye = center + vec3(cosf(angle), 0.5f, sinf(angle)) * distance;
+					culler.Begin(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 25600.0f) * glm::lookAt(eye, center, vec3(0, 1, 0)));
+
+					for (auto& world : worlds)
+						culler.AddOccluder(&crateOccluder, world);
+
+					culler.Rasterize();
+					rasterizeTime += culler.GetStats().rasterizeTime;
+
+					auto begin = std::chrono::high_resolution_clock::now();
+
+					for (auto& box : bounds)
+						numOccluded += culler.IsOccluded(box);
+
+					auto end = std::chrono::high_resolution_clock::now();
+					testTime += std::chrono::duration<double, std::milli>(end - begin).count();
+				}
+
+				fout << "Spacing: " << spacing << " Threads: " << culler.GetNumThreads() << " Occluded: " << numOccluded / numFrames << "/" << bounds.size();
+				fout << " [" << culler.GetStats().numTriangles << " triangles] Rasterize: " << rasterizeTime / numFrames << " ms Test: " << testTime / numFrames << " ms" << std::endl;
+			}
+		}
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+
+		// The same in the renderer, where the occluders are picked from the scene objects every frame
+		RendererSettings noCulling, occlusionCulling;
+		occlusionCulling.useOcclusionCulling = true;
+
+		int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+		RunRendererBenchmark("Occlusion culling in the renderer", { numThreads }, { { "No occlusion culling", noCulling }, { "Occlusion culling", occlusionCulling } });
+	}
+
+	// The scenes and the numbers of threads are the outer loops so the variants of a case are next to each other in the log
+	// Render() waits for the GPU every frame so the frame time includes the GPU work
+	void Game::RunRendererBenchmark(std::string testCase, const std::vector<int>& threadCounts, const std::vector<std::pair<std::string, RendererSettings>>& variants)
+	{
+		const int numFrames = 1000;
+
+		if (mRenderer != nullptr)
+		{
+			PrintBenchmark();
+			delete mRenderer;
+			mRenderer = nullptr;
+		}
+
+		std::ofstream fout;
+		fout.open("benchmark.txt", std::fstream::out | std::ofstream::app);
+		fout << "Test case: " << testCase << " [" << numFrames << " frames]" << std::endl;
+
+		for (int scene = 0; scene < 2; scene++)
+		{
+			for (int numThreads : threadCounts)
+			{
+				for (auto& variant : variants)
+				{
+					VulkanRenderer* renderer = new VulkanLib::VulkanRenderer(mWindow, numThreads, variant.second);
+					mRenderer = renderer;
+					mRenderer->SetCamera(mCamera);
+
+					if (scene == 0)
+						InitLowDetailTestCase();
+					else
+						InitTeapotTestCase();
+
+					// Also builds the instancing array and the static batches
+					mRenderer->Init();
+
+					// Otherwise the first frames are drawn with the fallback pipelines
+					renderer->WaitForPipelines();
+
+					// Not timed, the first frame renders the impostor atlases
+					mRenderer->Render();
+
+					auto begin = std::chrono::high_resolution_clock::now();
+
+					for (int frame = 0; frame < numFrames; frame++)
+					{
+						mRenderer->Update();
+						mRenderer->Render();
+					}
+
+					auto end = std::chrono::high_resolution_clock::now();
+					double frameTime = std::chrono::duration<double, std::milli>(end - begin).count() / numFrames;
+
+					fout << mTestCaseName << " Threads: " << numThreads << " [" << variant.first << "] Frame time: " << frameTime << " ms" << std::endl;
+					mRenderer->OutputLog(fout);
+
+					delete mRenderer;
+					mRenderer = nullptr;
+				}
+			}
+		}
+
+		fout << "-----------------------------------------------" << std::endl << std::endl;
+		fout.close();
+	}
+
+	// Renders the low detail and teapot scenes with the uber shader and with the specialized shader variants
+	void Game::RunShaderVariantBenchmark()
+	{
+		RendererSettings uberShader, specialized;
+		specialized.useShaderVariants = true;
+
+		RunRendererBenchmark("Shader variants", { 1 }, { { "Uber shader", uberShader }, { "Specialized", specialized } });
+	}
+
+	// Renders the low detail and teapot scenes with and without the depth pre-pass, recorded on one and all hardware threads
+	void Game::RunDepthPrepassBenchmark()
+	{
+		RendererSettings noPrepass, depthPrepass;
+		depthPrepass.useDepthPrepass = true;
+
+		int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+		RunRendererBenchmark("Depth pre-pass", { 1, numThreads }, { { "No pre-pass", noPrepass }, { "Depth pre-pass", depthPrepass } });
+	}
+
+	// Renders the low detail and teapot scenes from the default camera without contribution culling, with it and with the impostors
+	void Game::RunImpostorBenchmark()
+	{
+		RendererSettings noCulling, contributionCulling, impostors;
+		contributionCulling.useContributionCulling = true;
+		impostors.useContributionCulling = true;
+		impostors.useImpostors = true;
+
+		int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+		RunRendererBenchmark("Impostors", { numThreads }, { { "No contribution culling", noCulling }, { "Contribution culling", contributionCulling }, { "Impostors", impostors } });
+	}
+
+	// Renders the low detail and teapot scenes with and without the static batches
+	// None of the objects move, so with batching every object stays in its batch and the draws are per grid cell
+	void Game::RunStaticBatchingBenchmark()
+	{
+		RendererSettings noBatching, staticBatching;
+		staticBatching.useStaticBatching = true;
+
+		int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+		RunRendererBenchmark("Static batching", { numThreads }, { { "No batching", noBatching }, { "Static batching", staticBatching } });
+	}
+
+	// Renders the low detail and teapot scenes with and without the dynamic batches
+	// Only meshes up to DYNAMIC_BATCH_MAX_VERTICES can be batched, the others are recorded the same way in both runs
+	void Game::RunDynamicBatchingBenchmark()
+	{
+		RendererSettings noBatching, dynamicBatching;
+		dynamicBatching.useDynamicBatching = true;
+
+		int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+		RunRendererBenchmark("Dynamic batching", { numThreads }, { { "No batching", noBatching }, { "Dynamic batching", dynamicBatching } });
+	}
+
 	void Game::InitScene()
 	{
 		mRenderer->SetCamera(mCamera);
@@ -66,6 +704,7 @@ namespace VulkanLib
 		// Change depending on test case
 		InitLowDetailTestCase();	// [TODO] OpenGL still gets affected by pipeline state changes here
 		//InitPipelineTestCase();
+		//InitTextureTestCase();
 
 		// Creates the instancing array from all the objects
 		mRenderer->Init();
@@ -101,6 +740,33 @@ namespace VulkanLib
 		}
 	}
 
+	// Same as the low detail test case but with a lot more vertices per object
+	void Game::InitTeapotTestCase()
+	{
+		mTestCaseName = "Teapots";
+
+		// Add objects
+		int size = 10;
+		for (int x = 0; x < size; x++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int z = 0; z < size; z++)
+				{
+					Object* object = new Object(glm::vec3(x * 150, -100 - y * 150, z * 150));
+					object->SetModel("data/models/teapot.3ds");
+					object->SetColor(glm::vec3(1.0f, 0.0f, 0.0f));
+					object->SetId(OBJECT_ID_PROP);
+					object->SetRotation(glm::vec3(180, 0, 0));
+					object->SetScale(glm::vec3(3.0f));
+					object->SetPipeline(PipelineEnum::COLORED);
+
+					mRenderer->AddObject(object);
+				}
+			}
+		}
+	}
+
 	void Game::InitPipelineTestCase()
 	{
 		mTestCaseName = "Pipeline swapping";
@@ -136,6 +802,41 @@ namespace VulkanLib
 		}
 	}
 
+	void Game::InitTextureTestCase()
+	{
+		mTestCaseName = "Texture swapping";
+
+		// Add objects
+		int size = 10;
+		int i = 0;
+		for (int x = 0; x < size; x++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int z = 0; z < size; z++)
+				{
+					Object* object = new Object(glm::vec3(x * 150, -100 - y * 150, z * 150));
+					object->SetModel("data/models/Crate.obj");
+					object->SetColor(glm::vec3(1.0f, 0.0f, 0.0f));
+					object->SetId(OBJECT_ID_PROP);
+					object->SetRotation(glm::vec3(180, 0, 0));
+					object->SetScale(glm::vec3(40.0f));
+					object->SetPipeline(PipelineEnum::TEXTURED);
+
+					// Every other object has a different texture, with the texture array this only changes the pushed texture index
+					if (i % 2 == 0)
+						object->SetTexture("data/textures/crate_bc3.dds");
+					else
+						object->SetTexture("data/textures/bricks.dds");
+
+					mRenderer->AddObject(object);
+
+					i++;
+				}
+			}
+		}
+	}
+
 #if defined(_WIN32)
 	void Game::RenderLoop()
 	{
@@ -212,7 +913,9 @@ namespace VulkanLib
 				InitScene();*/
 			}	
 			else if (GetAsyncKeyState('6')) {
-				mRenderer = new VulkanLib::VulkanRenderer(mWindow, 1, true);
+				RendererSettings settings;
+				settings.useInstancing = true;
+				mRenderer = new VulkanLib::VulkanRenderer(mWindow, 1, settings);
 				InitScene();
 			}
 			else if (GetAsyncKeyState('7')) {
@@ -220,9 +923,51 @@ namespace VulkanLib
 				InitScene();
 			}
 			else if (GetAsyncKeyState('8')) {
-				mRenderer = new VulkanLib::VulkanRenderer(mWindow, 1, false, true);
+				RendererSettings settings;
+				settings.useStaticCommandBuffers = true;
+				mRenderer = new VulkanLib::VulkanRenderer(mWindow, 1, settings);
 				InitScene();
 			}
+			else if (GetAsyncKeyState('G')) {
+				RendererSettings settings;
+				settings.useInstancing = true;
+				settings.useGpuCulling = true;
+				mRenderer = new VulkanLib::VulkanRenderer(mWindow, 1, settings);
+				InitScene();
+			}
+			else if (GetAsyncKeyState('9')) {
+				RunTerrainBenchmark();
+			}
+			else if (GetAsyncKeyState('0')) {
+				RunTerrainStreamingBenchmark();
+			}
+			else if (GetAsyncKeyState('V')) {
+				RunShaderVariantBenchmark();
+			}
+			else if (GetAsyncKeyState('P')) {
+				RunDepthPrepassBenchmark();
+			}
+			else if (GetAsyncKeyState('I')) {
+				RunImpostorBenchmark();
+			}
+			else if (GetAsyncKeyState('M')) {
+				RunStaticBatchingBenchmark();
+			}
+			else if (GetAsyncKeyState('N')) {
+				RunDynamicBatchingBenchmark();
+			}
+			else if (GetAsyncKeyState('B')) {
+				RunBVHBenchmark();
+			}
+			else if (GetAsyncKeyState('Q')) {
+				RunSceneQueryBenchmark();
+			}
+			else if (GetAsyncKeyState('T')) {
+				RunTransformBenchmark();
+			}
+			else if (GetAsyncKeyState('O')) {
+				RunOcclusionBenchmark();
+			}
 		}
 	}
 #endif
@@ -246,7 +991,7 @@ namespace VulkanLib
 	//
 	bool Game::QueryRenderInitKeys()
 	{
-		return GetAsyncKeyState('1') || GetAsyncKeyState('2') || GetAsyncKeyState('3') || GetAsyncKeyState('4') || GetAsyncKeyState('5') || GetAsyncKeyState('6') || GetAsyncKeyState('7') || GetAsyncKeyState('8');
+		return GetAsyncKeyState('1') || GetAsyncKeyState('2') || GetAsyncKeyState('3') || GetAsyncKeyState('4') || GetAsyncKeyState('5') || GetAsyncKeyState('6') || GetAsyncKeyState('7') || GetAsyncKeyState('8') || GetAsyncKeyState('G');
 	}
 
 	std::string Game::GetPipelineStr()
@@ -2,12 +2,15 @@
 #include "Platform.h"
 #include "Timer.h"
 #include "Object.h"
+#include <vector>
+#include <utility>
 
 namespace VulkanLib
 {
 	class Renderer;
 	class Window;
 	class Camera;
+	struct RendererSettings;
 
 	/*
 		The starting point of the application
@@ -22,17 +25,33 @@ namespace VulkanLib
 		
 		void InitLowDetailTestCase();
 		void InitPipelineTestCase();
+		void InitTextureTestCase();
+		void InitTeapotTestCase();
 
 		void RenderLoop();
 
 		virtual void HandleMessages(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 		void PrintBenchmark();
+		void RunTerrainBenchmark();
+		void RunTerrainStreamingBenchmark();
+		void RunShaderVariantBenchmark();
+		void RunDepthPrepassBenchmark();
+		void RunImpostorBenchmark();
+		void RunStaticBatchingBenchmark();
+		void RunDynamicBatchingBenchmark();
+		void RunBVHBenchmark();
+		void RunSceneQueryBenchmark();
+		void RunTransformBenchmark();
+		void RunOcclusionBenchmark();
 	private:
 		void InitScene();	// Gets called when the Renderer is created
 		bool QueryRenderInitKeys();
 		std::string GetPipelineStr();
 
+		// Renders the low detail and teapot scenes with every thread count and labeled settings and writes the frame times
+		void RunRendererBenchmark(std::string testCase, const std::vector<int>& threadCounts, const std::vector<std::pair<std::string, RendererSettings>>& variants);
+
 		Renderer* mRenderer;
 		Window* mWindow;
 		Camera* mCamera;
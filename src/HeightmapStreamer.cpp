@@ -0,0 +1,274 @@
+#include "HeightmapStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace VulkanLib
+{
+	HeightmapStreamer::HeightmapStreamer()
+	{
+
+	}
+
+	HeightmapStreamer::~HeightmapStreamer()
+	{
+		Close();
+	}
+
+	bool HeightmapStreamer::Open(std::string filename, size_t memoryBudget)
+	{
+		Close();
+
+		if (!mHeightmap.Open(filename))
+			return false;
+
+		mMemoryBudget = memoryBudget;
+		mStopThread = false;
+		mThread = std::thread(&HeightmapStreamer::StreamingThread, this);
+
+		return true;
+	}
+
+	void HeightmapStreamer::Close()
+	{
+		if (mThread.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStopThread = true;
+			}
+
+			mCondition.notify_all();
+			mThread.join();
+		}
+
+		mResidentTiles.clear();
+		mRequests.clear();
+		mLoadingTile = -1;
+		mFrame = 0;
+		mResidentBytes = 0;
+		mPeakResidentBytes = 0;
+		mNumLoadedTiles = 0;
+		mNumEvictedTiles = 0;
+
+		mHeightmap.Close();
+	}
+
+	void HeightmapStreamer::Update(vec2 position, float radius)
+	{
+		const int tileSize = mHeightmap.GetTileSize();
+		const int minTileX = std::max(0, (int)floorf((position.x - radius) / tileSize));
+		const int minTileZ = std::max(0, (int)floorf((position.y - radius) / tileSize));
+		const int maxTileX = std::min(mHeightmap.GetNumTilesX() - 1, (int)floorf((position.x + radius) / tileSize));
+		const int maxTileZ = std::min(mHeightmap.GetNumTilesZ() - 1, (int)floorf((position.y + radius) / tileSize));
+
+		// Tiles that have any part inside the radius, sorted by distance
+		std::vector<std::pair<float, int>> wantedTiles;
+		for (int tz = minTileZ; tz <= maxTileZ; tz++)
+		{
+			for (int tx = minTileX; tx <= maxTileX; tx++)
+			{
+				vec2 tileMin = vec2(tx * tileSize, tz * tileSize);
+				vec2 closest = glm::clamp(position, tileMin, tileMin + vec2(tileSize));
+				float distance = glm::length(closest - position);
+
+				if (distance <= radius)
+					wantedTiles.push_back(std::make_pair(distance, GetTileKey(tx, tz)));
+			}
+		}
+
+		std::sort(wantedTiles.begin(), wantedTiles.end());
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mFrame++;
+
+			// Old requests that are outside the radius now are dropped
+			mRequests.clear();
+			for (auto& wanted : wantedTiles)
+			{
+				auto iter = mResidentTiles.find(wanted.second);
+				if (iter != mResidentTiles.end())
+					iter->second.lastUsedFrame = mFrame;
+				else if (wanted.second != mLoadingTile)
+					mRequests.push_back(wanted.second);
+			}
+		}
+
+		mCondition.notify_all();
+	}
+
+	void HeightmapStreamer::StreamingThread()
+	{
+		const size_t tileBytes = mHeightmap.GetDecodedTileSize();
+		const int numTilesX = mHeightmap.GetNumTilesX();
+
+		while (true)
+		{
+			int key;
+
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this] { return !mRequests.empty() || mStopThread; });
+
+				if (mStopThread)
+					break;
+
+				key = mRequests.front();
+				mRequests.pop_front();
+
+				if (mResidentTiles.find(key) != mResidentTiles.end())
+					continue;
+
+				// The requests are sorted, if the nearest one doesn't fit then neither do the rest
+				if (!EvictForTile(tileBytes))
+				{
+					mRequests.clear();
+					mCondition.notify_all();
+					continue;
+				}
+
+				// Reserve the memory before loading so the budget holds at all times
+				mResidentBytes += tileBytes;
+				mPeakResidentBytes = std::max(mPeakResidentBytes, mResidentBytes);
+				mLoadingTile = key;
+			}
+
+			// The file is read without holding the lock
+			std::shared_ptr<HeightTile> tile = std::make_shared<HeightTile>();
+			tile->x = key % numTilesX;
+			tile->z = key / numTilesX;
+			tile->minHeight = mHeightmap.GetTileInfo(tile->x, tile->z).minHeight;
+			tile->maxHeight = mHeightmap.GetTileInfo(tile->x, tile->z).maxHeight;
+			mHeightmap.ReadTile(tile->x, tile->z, tile->heights);
+
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				ResidentTile resident;
+				resident.tile = tile;
+				resident.lastUsedFrame = mFrame;
+				mResidentTiles[key] = resident;
+
+				mLoadingTile = -1;
+				mNumLoadedTiles++;
+			}
+
+			mCondition.notify_all();
+		}
+	}
+
+	// Evicts the least recently used tiles until there is room for a new one
+	// Linear search, the budget only fits a few hundred tiles so a sorted structure isn't worth it
+	bool HeightmapStreamer::EvictForTile(size_t tileBytes)
+	{
+		while (mResidentBytes + tileBytes > mMemoryBudget)
+		{
+			auto oldest = mResidentTiles.end();
+			for (auto iter = mResidentTiles.begin(); iter != mResidentTiles.end(); iter++)
+			{
+				if (oldest == mResidentTiles.end() || iter->second.lastUsedFrame < oldest->second.lastUsedFrame)
+					oldest = iter;
+			}
+
+			// Tiles used this frame are needed, better to not load the new tile
+			if (oldest == mResidentTiles.end() || oldest->second.lastUsedFrame >= mFrame)
+				return false;
+
+			mResidentTiles.erase(oldest);
+			mResidentBytes -= mHeightmap.GetDecodedTileSize();
+			mNumEvictedTiles++;
+		}
+
+		return true;
+	}
+
+	std::shared_ptr<const HeightTile> HeightmapStreamer::GetTile(int tileX, int tileZ)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto iter = mResidentTiles.find(GetTileKey(tileX, tileZ));
+		if (iter == mResidentTiles.end())
+			return nullptr;
+
+		return iter->second.tile;
+	}
+
+	bool HeightmapStreamer::GetHeight(int x, int z, float& height)
+	{
+		const int tileSize = mHeightmap.GetTileSize();
+		x = std::min(std::max(x, 0), mHeightmap.GetWidth() - 1);
+		z = std::min(std::max(z, 0), mHeightmap.GetHeight() - 1);
+
+		int tileX = std::min(x / tileSize, mHeightmap.GetNumTilesX() - 1);
+		int tileZ = std::min(z / tileSize, mHeightmap.GetNumTilesZ() - 1);
+
+		std::shared_ptr<const HeightTile> tile = GetTile(tileX, tileZ);
+		if (tile == nullptr)
+			return false;
+
+		int localX = x - tileX * tileSize;
+		int localZ = z - tileZ * tileSize;
+		height = tile->heights[localX + localZ * mHeightmap.GetTileSamples()];
+
+		return true;
+	}
+
+	void HeightmapStreamer::WaitForRequests()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mCondition.wait(lock, [this] { return (mRequests.empty() && mLoadingTile == -1) || mStopThread; });
+	}
+
+	void HeightmapStreamer::SetMemoryBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMemoryBudget = bytes;
+	}
+
+	TiledHeightmap& HeightmapStreamer::GetHeightmap()
+	{
+		return mHeightmap;
+	}
+
+	size_t HeightmapStreamer::GetResidentBytes()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mResidentBytes;
+	}
+
+	size_t HeightmapStreamer::GetPeakResidentBytes()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mPeakResidentBytes;
+	}
+
+	int HeightmapStreamer::GetNumResidentTiles()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mResidentTiles.size();
+	}
+
+	int HeightmapStreamer::GetNumPendingTiles()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mRequests.size() + (mLoadingTile != -1 ? 1 : 0);
+	}
+
+	int HeightmapStreamer::GetNumLoadedTiles()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mNumLoadedTiles;
+	}
+
+	int HeightmapStreamer::GetNumEvictedTiles()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mNumEvictedTiles;
+	}
+
+	int HeightmapStreamer::GetTileKey(int tileX, int tileZ)
+	{
+		return tileX + tileZ * mHeightmap.GetNumTilesX();
+	}
+}	// VulkanLib namespace
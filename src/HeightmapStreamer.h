@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "TiledHeightmap.h"
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	struct HeightTile
+	{
+		int x, z;						// Tile coordinates
+		float minHeight;
+		float maxHeight;
+		std::vector<float> heights;		// TiledHeightmap::GetTileSamples()^2 heights, row major
+	};
+
+	/*
+		Keeps the tiles of a TiledHeightmap that are close to the camera in memory
+
+		Update() is called once per frame with the camera position. Tiles inside the streaming radius that aren't
+		loaded are requested nearest first and a background thread reads them from the memory mapped file. Before a
+		tile is loaded the least recently used tiles are evicted until it fits in the memory budget. Tiles that were
+		requested in the current frame are never evicted, the remaining requests are dropped instead when they don't fit.
+
+		Tiles are handed out as shared pointers so a tile that is evicted while in use stays valid until it is released.
+	*/
+	class HeightmapStreamer
+	{
+	public:
+		HeightmapStreamer();
+		~HeightmapStreamer();
+
+		bool Open(std::string filename, size_t memoryBudget);
+		void Close();
+
+		// Position and radius in heightmap texels
+		void Update(vec2 position, float radius);
+
+		// Returns nullptr if the tile isn't loaded
+		std::shared_ptr<const HeightTile> GetTile(int tileX, int tileZ);
+
+		// Returns false if the tile containing the texel isn't loaded
+		bool GetHeight(int x, int z, float& height);
+
+		// Blocks until all the current requests are loaded or dropped
+		void WaitForRequests();
+
+		void SetMemoryBudget(size_t bytes);
+
+		TiledHeightmap& GetHeightmap();
+		size_t GetResidentBytes();
+		size_t GetPeakResidentBytes();
+		int GetNumResidentTiles();
+		int GetNumPendingTiles();
+		int GetNumLoadedTiles();		// Total since Open()
+		int GetNumEvictedTiles();		// Total since Open()
+
+	private:
+		struct ResidentTile
+		{
+			std::shared_ptr<const HeightTile> tile;
+			uint64_t lastUsedFrame;
+		};
+
+		void StreamingThread();
+		bool EvictForTile(size_t tileBytes);		// mMutex must be locked
+
+		int GetTileKey(int tileX, int tileZ);
+
+		TiledHeightmap							mHeightmap;
+
+		std::thread								mThread;
+		std::mutex								mMutex;
+		std::condition_variable					mCondition;
+		bool									mStopThread = false;
+
+		// Guarded by mMutex
+		std::unordered_map<int, ResidentTile>	mResidentTiles;
+		std::deque<int>							mRequests;			// Nearest first
+		int										mLoadingTile = -1;	// Key of the tile the thread is reading
+		uint64_t								mFrame = 0;
+		size_t									mMemoryBudget = 0;
+		size_t									mResidentBytes = 0;
+		size_t									mPeakResidentBytes = 0;
+		int										mNumLoadedTiles = 0;
+		int										mNumEvictedTiles = 0;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,434 @@
+#include "HiZCuller.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+#include "VulkanHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace VulkanLib
+{
+	void HiZCuller::Init(VulkanBase* vulkanBase, VkBuffer instanceBuffer, uint32_t numInstances, const BoundingBox& meshBounds, uint32_t numIndices, VkImage depthImage, VkFormat colorFormat, VkFormat depthFormat)
+	{
+		mVulkanBase = vulkanBase;
+		mDevice = vulkanBase->GetDevice();
+		mNumInstances = numInstances;
+		mNumIndices = numIndices;
+		mMeshBounds = meshBounds;
+		mWidth = vulkanBase->GetWindowWidth();
+		mHeight = vulkanBase->GetWindowHeight();
+		mFirstFrame = true;
+
+		CreateBuffers(instanceBuffer);
+		CreatePyramid(depthImage, depthFormat);
+		CreateLoadRenderPass(colorFormat, depthFormat);
+		CreateDescriptorSets(instanceBuffer);
+		CreatePipelines();
+	}
+
+	void HiZCuller::Cleanup()
+	{
+		if (mVulkanBase == nullptr)
+			return;
+
+		vkDestroyPipeline(mDevice, mCullPipeline, nullptr);
+		vkDestroyPipeline(mDevice, mReducePipeline, nullptr);
+		vkDestroyPipelineLayout(mDevice, mCullPipelineLayout, nullptr);
+		vkDestroyPipelineLayout(mDevice, mReducePipelineLayout, nullptr);
+		mCullDescriptorSet.Cleanup(mDevice);
+		mReduceLayout.Cleanup(mDevice);
+		mDescriptorPool.Cleanup(mDevice);
+
+		vkDestroyRenderPass(mDevice, mLoadRenderPass, nullptr);
+
+		vkDestroySampler(mDevice, mSampler, nullptr);
+		for (auto view : mLevelViews)
+			vkDestroyImageView(mDevice, view, nullptr);
+		vkDestroyImageView(mDevice, mPyramidView, nullptr);
+		vkDestroyImageView(mDevice, mDepthView, nullptr);
+		vkDestroyImage(mDevice, mPyramidImage, nullptr);
+		vkFreeMemory(mDevice, mPyramidMemory, nullptr);
+
+		vkUnmapMemory(mDevice, mDrawMemory);
+		vkDestroyBuffer(mDevice, mDrawBuffer, nullptr);
+		vkFreeMemory(mDevice, mDrawMemory, nullptr);
+		vkDestroyBuffer(mDevice, mUniformBuffer, nullptr);
+		vkFreeMemory(mDevice, mUniformMemory, nullptr);
+		vkDestroyBuffer(mDevice, mVisibilityBuffer, nullptr);
+		vkFreeMemory(mDevice, mVisibilityMemory, nullptr);
+		for (int i = 0; i < HIZ_NUM_PHASES; i++)
+		{
+			vkDestroyBuffer(mDevice, mPhaseBuffers[i], nullptr);
+			vkFreeMemory(mDevice, mPhaseMemory[i], nullptr);
+		}
+
+		mLevelViews.clear();
+		mLevelSizes.clear();
+		mReduceDescriptorSets.clear();
+		mVulkanBase = nullptr;
+	}
+
+	void HiZCuller::Update(const mat4& viewProjection)
+	{
+		Frustum frustum;
+		frustum.Extract(viewProjection);
+
+		CullUniforms uniforms;
+		uniforms.viewProjection = viewProjection;
+		for (int i = 0; i < Frustum::NUM_PLANES; i++)
+			uniforms.frustumPlanes[i] = frustum.planes[i];
+		uniforms.boundsCenter = vec4(mMeshBounds.GetCenter(), 0.0f);
+		uniforms.boundsExtents = vec4(mMeshBounds.GetExtents(), 0.0f);
+		uniforms.screenSize = vec2((float)mWidth, (float)mHeight);
+		uniforms.numInstances = mNumInstances;
+		uniforms.numLevels = mLevelSizes.size();
+
+		void* mapped;
+		VulkanDebug::ErrorCheck(vkMapMemory(mDevice, mUniformMemory, 0, sizeof(CullUniforms), 0, &mapped));
+		memcpy(mapped, &uniforms, sizeof(CullUniforms));
+		vkUnmapMemory(mDevice, mUniformMemory);
+	}
+
+	void HiZCuller::RecordCull(VkCommandBuffer commandBuffer, HiZPhase phase)
+	{
+		if (phase == HIZ_PHASE_VISIBLE_LAST_FRAME)
+		{
+			// Nothing was visible before the first frame, so everything is tested against the pyramid of an empty depth buffer
+			if (mFirstFrame)
+			{
+				vkCmdFillBuffer(commandBuffer, mVisibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+
+				VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)mLevelSizes.size(), 0, 1 };
+				vkTools::setImageLayout(commandBuffer, mPyramidImage, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, range);
+				mFirstFrame = false;
+			}
+
+			// The compute shader counts the instances of both phases from 0
+			VkDrawIndexedIndirectCommand draws[HIZ_NUM_PHASES] = {};
+			for (int i = 0; i < HIZ_NUM_PHASES; i++)
+				draws[i].indexCount = mNumIndices;
+
+			vkCmdUpdateBuffer(commandBuffer, mDrawBuffer, 0, sizeof(draws), (const uint32_t*)draws);
+
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		uint32_t pushPhase = phase;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipelineLayout, 0, 1, &mCullDescriptorSet.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, mCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &pushPhase);
+		vkCmdDispatch(commandBuffer, (mNumInstances + HIZ_CULL_GROUP_SIZE - 1) / HIZ_CULL_GROUP_SIZE, 1, 1);
+
+		// The draws read the instance counts and the compacted instances
+		ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	}
+
+	void HiZCuller::RecordDepthPyramid(VkCommandBuffer commandBuffer)
+	{
+		// Both aspects of a combined depth stencil image change layout together
+		VkImageMemoryBarrier depthBarrier = {};
+		depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.image = mDepthImage;
+		depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mReducePipeline);
+
+		// Every level reads the one above it, level 0 reads the depth buffer
+		for (int level = 0; level < mLevelSizes.size(); level++)
+		{
+			if (level != 0)
+				ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mReducePipelineLayout, 0, 1, &mReduceDescriptorSets[level].descriptorSet, 0, nullptr);
+
+			uint32_t groupsX = (mLevelSizes[level].width + HIZ_REDUCE_GROUP_SIZE - 1) / HIZ_REDUCE_GROUP_SIZE;
+			uint32_t groupsY = (mLevelSizes[level].height + HIZ_REDUCE_GROUP_SIZE - 1) / HIZ_REDUCE_GROUP_SIZE;
+			vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+		}
+
+		// The culling reads the pyramid, the second phase draws into the depth buffer again
+		ComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+	}
+
+	void HiZCuller::RecordDraw(VkCommandBuffer commandBuffer, HiZPhase phase, uint32_t instanceBinding)
+	{
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, instanceBinding, 1, &mPhaseBuffers[phase], offsets);
+		vkCmdDrawIndexedIndirect(commandBuffer, mDrawBuffer, phase * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	VkRenderPass HiZCuller::GetLoadRenderPass()
+	{
+		return mLoadRenderPass;
+	}
+
+	HiZStats HiZCuller::GetStats()
+	{
+		HiZStats stats = {};
+		stats.numInstances = mNumInstances;
+
+		if (mMappedDraws == nullptr)
+			return stats;
+
+		for (int i = 0; i < HIZ_NUM_PHASES; i++)
+			stats.numDrawn[i] = mMappedDraws[i].instanceCount;
+
+		stats.numCulled = mNumInstances - stats.numDrawn[HIZ_PHASE_VISIBLE_LAST_FRAME] - stats.numDrawn[HIZ_PHASE_DISOCCLUDED];
+		return stats;
+	}
+
+	void HiZCuller::CreateBuffers(VkBuffer instanceBuffer)
+	{
+		// Same layout as the instance buffer, see InstanceData
+		VkDeviceSize instanceSize = 9 * sizeof(float);
+
+		for (int i = 0; i < HIZ_NUM_PHASES; i++)
+		{
+			mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				std::max(mNumInstances, 1u) * instanceSize, nullptr, &mPhaseBuffers[i], &mPhaseMemory[i]);
+		}
+
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			std::max(mNumInstances, 1u) * sizeof(uint32_t), nullptr, &mVisibilityBuffer, &mVisibilityMemory);
+
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			HIZ_NUM_PHASES * sizeof(VkDrawIndexedIndirectCommand), nullptr, &mDrawBuffer, &mDrawMemory);
+
+		VulkanDebug::ErrorCheck(vkMapMemory(mDevice, mDrawMemory, 0, HIZ_NUM_PHASES * sizeof(VkDrawIndexedIndirectCommand), 0, (void**)&mMappedDraws));
+		memset(mMappedDraws, 0, HIZ_NUM_PHASES * sizeof(VkDrawIndexedIndirectCommand));
+
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			sizeof(CullUniforms), nullptr, &mUniformBuffer, &mUniformMemory);
+	}
+
+	void HiZCuller::CreatePyramid(VkImage depthImage, VkFormat depthFormat)
+	{
+		mDepthImage = depthImage;
+
+		// Level 0 is half the depth buffer, the odd sizes round up so the last texel covers the last row or column
+		uint32_t width = (mWidth + 1) / 2;
+		uint32_t height = (mHeight + 1) / 2;
+		while (true)
+		{
+			mLevelSizes.push_back({ width, height });
+			if (width == 1 && height == 1)
+				break;
+
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+		}
+
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageCreateInfo.extent = { mLevelSizes[0].width, mLevelSizes[0].height, 1 };
+		imageCreateInfo.mipLevels = mLevelSizes.size();
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &mPyramidImage));
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(mDevice, mPyramidImage, &memRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = vkTools::initializers::memoryAllocateInfo();
+		allocateInfo.allocationSize = memRequirements.size;
+		mVulkanBase->GetMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocateInfo.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &allocateInfo, nullptr, &mPyramidMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, mPyramidImage, mPyramidMemory, 0));
+
+		VkImageViewCreateInfo viewCreateInfo = vkTools::initializers::imageViewCreateInfo();
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewCreateInfo.image = mPyramidImage;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)mLevelSizes.size(), 0, 1 };
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &mPyramidView));
+
+		// The reduction writes one level and reads it as the input of the next
+		mLevelViews.resize(mLevelSizes.size());
+		for (int level = 0; level < mLevelSizes.size(); level++)
+		{
+			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)level, 1, 0, 1 };
+			VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &mLevelViews[level]));
+		}
+
+		// Only the depth aspect can be sampled
+		viewCreateInfo.image = depthImage;
+		viewCreateInfo.format = depthFormat;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &mDepthView));
+
+		// The shaders only use texelFetch()
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = VK_FILTER_NEAREST;
+		sampler.minFilter = VK_FILTER_NEAREST;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = (float)mLevelSizes.size();
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VulkanDebug::ErrorCheck(vkCreateSampler(mDevice, &sampler, nullptr, &mSampler));
+	}
+
+	void HiZCuller::CreateLoadRenderPass(VkFormat colorFormat, VkFormat depthFormat)
+	{
+		// Compatible with VulkanBase::SetupRenderPass() so the same frame buffers can be used
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		VkAttachmentDescription attachments[2] = {};
+		attachments[0].format = colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		attachments[1].format = depthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkRenderPassCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		createInfo.attachmentCount = 2;
+		createInfo.pAttachments = attachments;
+		createInfo.subpassCount = 1;
+		createInfo.pSubpasses = &subpass;
+
+		VulkanDebug::ErrorCheck(vkCreateRenderPass(mDevice, &createInfo, nullptr, &mLoadRenderPass));
+	}
+
+	void HiZCuller::CreateDescriptorSets(VkBuffer instanceBuffer)
+	{
+		mCullDescriptorSet.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// Camera and mesh bounds
+		mCullDescriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// All the instances
+		mCullDescriptorSet.AddLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// Visibility flags
+		mCullDescriptorSet.AddLayoutBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// First phase instances
+		mCullDescriptorSet.AddLayoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// Second phase instances
+		mCullDescriptorSet.AddLayoutBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);			// Indirect draw commands
+		mCullDescriptorSet.AddLayoutBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);	// Depth pyramid
+		mCullDescriptorSet.CreateLayout(mDevice);
+
+		mReduceLayout.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);		// The level above
+		mReduceLayout.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);				// The level that is written
+		mReduceLayout.CreateLayout(mDevice);
+
+		// [NOTE] DescriptorPool uses the number of sizes as the max number of sets, every set adds its own sizes
+		mDescriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+		mDescriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5);
+		mDescriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
+		for (int level = 0; level < mLevelSizes.size(); level++)
+		{
+			mDescriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
+			mDescriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1);
+		}
+		mDescriptorPool.CreatePool(mDevice);
+
+		VkDescriptorBufferInfo uniformInfo = { mUniformBuffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo instanceInfo = { instanceBuffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo visibilityInfo = { mVisibilityBuffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo phaseInfos[HIZ_NUM_PHASES];
+		for (int i = 0; i < HIZ_NUM_PHASES; i++)
+			phaseInfos[i] = { mPhaseBuffers[i], 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo drawInfo = { mDrawBuffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorImageInfo pyramidInfo = { mSampler, mPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+
+		mCullDescriptorSet.AllocateDescriptorSets(mDevice, mDescriptorPool.GetVkDescriptorPool());
+		mCullDescriptorSet.BindUniformBuffer(0, &uniformInfo);
+		mCullDescriptorSet.BindStorageBuffer(1, &instanceInfo);
+		mCullDescriptorSet.BindStorageBuffer(2, &visibilityInfo);
+		mCullDescriptorSet.BindStorageBuffer(3, &phaseInfos[HIZ_PHASE_VISIBLE_LAST_FRAME]);
+		mCullDescriptorSet.BindStorageBuffer(4, &phaseInfos[HIZ_PHASE_DISOCCLUDED]);
+		mCullDescriptorSet.BindStorageBuffer(5, &drawInfo);
+		mCullDescriptorSet.BindCombinedImage(6, &pyramidInfo);
+		mCullDescriptorSet.UpdateDescriptorSets(mDevice);
+
+		std::vector<VkDescriptorImageInfo> inputInfos(mLevelSizes.size());
+		std::vector<VkDescriptorImageInfo> outputInfos(mLevelSizes.size());
+		mReduceDescriptorSets.resize(mLevelSizes.size(), mReduceLayout);
+
+		for (int level = 0; level < mLevelSizes.size(); level++)
+		{
+			if (level == 0)
+				inputInfos[level] = { mSampler, mDepthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			else
+				inputInfos[level] = { mSampler, mLevelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL };
+
+			outputInfos[level] = { VK_NULL_HANDLE, mLevelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+
+			mReduceDescriptorSets[level].AllocateDescriptorSets(mDevice, mDescriptorPool.GetVkDescriptorPool());
+			mReduceDescriptorSets[level].BindCombinedImage(0, &inputInfos[level]);
+			mReduceDescriptorSets[level].BindStorageImage(1, &outputInfos[level]);
+			mReduceDescriptorSets[level].UpdateDescriptorSets(mDevice);
+		}
+	}
+
+	void HiZCuller::CreatePipelines()
+	{
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(uint32_t);		// The phase
+
+		VkPipelineLayoutCreateInfo layoutCreateInfo = CreateInfo::PipelineLayout(1, &mCullDescriptorSet.setLayout);
+		layoutCreateInfo.pushConstantRangeCount = 1;
+		layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		VulkanDebug::ErrorCheck(vkCreatePipelineLayout(mDevice, &layoutCreateInfo, nullptr, &mCullPipelineLayout));
+
+		layoutCreateInfo = CreateInfo::PipelineLayout(1, &mReduceLayout.setLayout);
+		VulkanDebug::ErrorCheck(vkCreatePipelineLayout(mDevice, &layoutCreateInfo, nullptr, &mReducePipelineLayout));
+
+		VkComputePipelineCreateInfo pipelineCreateInfo = vkTools::initializers::computePipelineCreateInfo(mCullPipelineLayout, 0);
+		pipelineCreateInfo.stage = mVulkanBase->LoadShader("data/shaders/hiz/hiz_cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VulkanDebug::ErrorCheck(vkCreateComputePipelines(mDevice, mVulkanBase->GetPipelineCache(), 1, &pipelineCreateInfo, nullptr, &mCullPipeline));
+
+		pipelineCreateInfo = vkTools::initializers::computePipelineCreateInfo(mReducePipelineLayout, 0);
+		pipelineCreateInfo.stage = mVulkanBase->LoadShader("data/shaders/hiz/hiz_reduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VulkanDebug::ErrorCheck(vkCreateComputePipelines(mDevice, mVulkanBase->GetPipelineCache(), 1, &pipelineCreateInfo, nullptr, &mReducePipeline));
+	}
+
+	void HiZCuller::ComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,131 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include "Frustum.h"
+#include "DescriptorSet.h"
+
+#define HIZ_CULL_GROUP_SIZE 64			// Instances per workgroup, local_size_x in hiz_cull.comp
+#define HIZ_REDUCE_GROUP_SIZE 8			// Texels per workgroup side, local_size_x and local_size_y in hiz_reduce.comp
+
+namespace VulkanLib
+{
+	class VulkanBase;
+
+	enum HiZPhase
+	{
+		HIZ_PHASE_VISIBLE_LAST_FRAME = 0,	// Drawn first, their depth is what the pyramid is built from
+		HIZ_PHASE_DISOCCLUDED = 1,			// Tested against the new pyramid and drawn after it
+		HIZ_NUM_PHASES
+	};
+
+	struct HiZStats
+	{
+		int						numInstances;
+		int						numDrawn[HIZ_NUM_PHASES];
+		int						numCulled;			// Outside the frustum or occluded
+	};
+
+	/*
+		GPU occlusion culling of instances with a hierarchical depth buffer (Hi-Z)
+
+		Every instance has a visibility flag that is the result of the last frame. A frame is drawn in two phases:
+
+			1. The instances that were visible in the last frame and are inside the frustum are compacted into the first
+			   instance buffer by a compute shader and drawn with vkCmdDrawIndexedIndirect().
+			2. The depth buffer is reduced into a pyramid where every texel is the max depth of the texels below it. Every
+			   instance in the frustum is tested against it, the flags are updated and the instances that weren't drawn
+			   in the first phase but are visible now are compacted into the second buffer and drawn on top.
+
+		The first phase draws most of the scene since the visibility changes little between frames, so the pyramid is
+		almost the full depth of the frame. Nothing that is visible is lost: an instance that became visible is drawn
+		in the second phase in the same frame it appeared.
+
+		An instance is tested by projecting its bounds, selecting the level where the screen rect covers at most 2x2
+		texels and comparing the closest depth of the bounds with the max of those texels. Bounds that cross the near
+		plane are always visible. The instance counts of the indirect commands are written by the compute shader so
+		the CPU never waits for the culling, GetStats() only reads the counts of the last finished frame.
+	*/
+	class HiZCuller
+	{
+	public:
+		// The instance buffer holds numInstances InstanceData and needs VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, the depth image needs VK_IMAGE_USAGE_SAMPLED_BIT
+		void Init(VulkanBase* vulkanBase, VkBuffer instanceBuffer, uint32_t numInstances, const BoundingBox& meshBounds, uint32_t numIndices, VkImage depthImage, VkFormat colorFormat, VkFormat depthFormat);
+		void Cleanup();
+
+		// The previous frame must be finished
+		void Update(const mat4& viewProjection);
+
+		// Outside of a render pass, HIZ_PHASE_DISOCCLUDED after RecordDepthPyramid()
+		void RecordCull(VkCommandBuffer commandBuffer, HiZPhase phase);
+		void RecordDepthPyramid(VkCommandBuffer commandBuffer);
+
+		// Binds the compacted instances and draws them, the other streams and the index buffer of the mesh must be bound
+		void RecordDraw(VkCommandBuffer commandBuffer, HiZPhase phase, uint32_t instanceBinding);
+
+		// Same attachments as the main render pass but loads them, HIZ_PHASE_DISOCCLUDED is drawn with it
+		VkRenderPass GetLoadRenderPass();
+		HiZStats GetStats();
+
+	private:
+		// std140, matches the UBO in hiz_cull.comp
+		struct CullUniforms
+		{
+			mat4			viewProjection;
+			vec4			frustumPlanes[Frustum::NUM_PLANES];
+			vec4			boundsCenter;			// Of the mesh, scaled and moved by the instance
+			vec4			boundsExtents;
+			vec2			screenSize;
+			uint32_t		numInstances;
+			uint32_t		numLevels;
+		};
+
+		void CreateBuffers(VkBuffer instanceBuffer);
+		void CreatePyramid(VkImage depthImage, VkFormat depthFormat);
+		void CreateLoadRenderPass(VkFormat colorFormat, VkFormat depthFormat);
+		void CreateDescriptorSets(VkBuffer instanceBuffer);
+		void CreatePipelines();
+		void ComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		VulkanBase*					mVulkanBase = nullptr;
+		VkDevice					mDevice = VK_NULL_HANDLE;
+
+		uint32_t					mNumInstances = 0;
+		uint32_t					mNumIndices = 0;
+		uint32_t					mWidth = 0;
+		uint32_t					mHeight = 0;
+		BoundingBox					mMeshBounds;
+		bool						mFirstFrame = true;		// The flags and the pyramid are cleared in the first RecordCull()
+
+		// Written by the compute shader, read by the draws
+		VkBuffer					mVisibilityBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory				mVisibilityMemory = VK_NULL_HANDLE;
+		VkBuffer					mPhaseBuffers[HIZ_NUM_PHASES] = {};
+		VkDeviceMemory				mPhaseMemory[HIZ_NUM_PHASES] = {};
+		VkBuffer					mDrawBuffer = VK_NULL_HANDLE;			// One VkDrawIndexedIndirectCommand per phase
+		VkDeviceMemory				mDrawMemory = VK_NULL_HANDLE;
+		VkDrawIndexedIndirectCommand* mMappedDraws = nullptr;			// Host coherent, only read for the stats
+		VkBuffer					mUniformBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory				mUniformMemory = VK_NULL_HANDLE;
+
+		// Max depth pyramid, level 0 is half the size of the depth buffer
+		VkImage						mDepthImage = VK_NULL_HANDLE;
+		VkImageView					mDepthView = VK_NULL_HANDLE;			// Only the depth aspect
+		VkImage						mPyramidImage = VK_NULL_HANDLE;
+		VkDeviceMemory				mPyramidMemory = VK_NULL_HANDLE;
+		VkImageView					mPyramidView = VK_NULL_HANDLE;			// All the levels, read by the culling
+		std::vector<VkImageView>	mLevelViews;
+		std::vector<VkExtent2D>		mLevelSizes;
+		VkSampler					mSampler = VK_NULL_HANDLE;
+
+		VkRenderPass				mLoadRenderPass = VK_NULL_HANDLE;
+
+		DescriptorPool				mDescriptorPool;
+		DescriptorSet				mCullDescriptorSet;
+		DescriptorSet				mReduceLayout;							// Only the layout, every level has a copy with its own set
+		std::vector<DescriptorSet>	mReduceDescriptorSets;
+		VkPipelineLayout			mCullPipelineLayout = VK_NULL_HANDLE;
+		VkPipelineLayout			mReducePipelineLayout = VK_NULL_HANDLE;
+		VkPipeline					mCullPipeline = VK_NULL_HANDLE;
+		VkPipeline					mReducePipeline = VK_NULL_HANDLE;
+	};
+}	// VulkanLib namespace
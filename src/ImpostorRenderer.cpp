@@ -0,0 +1,456 @@
+#include "ImpostorRenderer.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+#include "VulkanHelpers.h"
+#include "StaticModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+#define IMPOSTOR_MIN_INSTANCES 256		// The first size of the instance buffer
+
+namespace VulkanLib
+{
+	// The view at (azimuth, elevation) in the atlas looks at the mesh from this direction, same as in impostor.vert
+	static vec3 GetViewDirection(int azimuth, int elevation)
+	{
+		const float pi = glm::pi<float>();
+		float azimuthAngle = azimuth * 2.0f * pi / IMPOSTOR_AZIMUTHS;
+		float elevationAngle = -0.5f * pi + (elevation + 0.5f) * pi / IMPOSTOR_ELEVATIONS;
+
+		return vec3(cosf(elevationAngle) * sinf(azimuthAngle), sinf(elevationAngle), cosf(elevationAngle) * cosf(azimuthAngle));
+	}
+
+	void ImpostorRenderer::Init(VulkanBase* vulkanBase, PipelineStateCache* pipelineStates, VkRenderPass renderPass, VkFormat colorFormat, VkFormat depthFormat, VkDescriptorBufferInfo uniformBuffer)
+	{
+		mVulkanBase = vulkanBase;
+		mDevice = vulkanBase->GetDevice();
+		mPipelineStates = pipelineStates;
+		mColorFormat = colorFormat;
+		mUniformBuffer = uniformBuffer;
+
+		CreateRenderPass(colorFormat, depthFormat);
+		CreateDepthImage(depthFormat);
+		CreatePipeline(renderPass);
+	}
+
+	void ImpostorRenderer::Cleanup()
+	{
+		if (mVulkanBase == nullptr)
+			return;
+
+		for (auto& impostor : mImpostors)
+		{
+			impostor.descriptorPool.Cleanup(mDevice);
+			vkDestroyFramebuffer(mDevice, impostor.frameBuffer, nullptr);
+			vkDestroyImageView(mDevice, impostor.atlasView, nullptr);
+			vkDestroyImage(mDevice, impostor.atlas, nullptr);
+			vkFreeMemory(mDevice, impostor.atlasMemory, nullptr);
+		}
+
+		if (mMappedInstances != nullptr)
+			vkUnmapMemory(mDevice, mInstanceMemory);
+		vkDestroyBuffer(mDevice, mInstanceBuffer, nullptr);
+		vkFreeMemory(mDevice, mInstanceMemory, nullptr);
+
+		// The pipeline is destroyed by the PipelineStateCache
+		vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
+		mLayout.Cleanup(mDevice);
+
+		vkDestroySampler(mDevice, mSampler, nullptr);
+		vkDestroyImageView(mDevice, mDepthView, nullptr);
+		vkDestroyImage(mDevice, mDepthImage, nullptr);
+		vkFreeMemory(mDevice, mDepthMemory, nullptr);
+		vkDestroyRenderPass(mDevice, mCaptureRenderPass, nullptr);
+
+		mImpostors.clear();
+		mMappedInstances = nullptr;
+		mInstanceCapacity = 0;
+		mVulkanBase = nullptr;
+	}
+
+	int ImpostorRenderer::AddMesh(StaticModel* mesh)
+	{
+		for (int i = 0; i < mImpostors.size(); i++)
+		{
+			if (mImpostors[i].mesh == mesh)
+				return i;
+		}
+
+		Impostor impostor;
+		impostor.mesh = mesh;
+		impostor.sphere = mesh->GetBoundingSphere();
+		CreateAtlas(impostor);
+
+		mImpostors.push_back(impostor);
+		return mImpostors.size() - 1;
+	}
+
+	bool ImpostorRenderer::HasPendingCaptures()
+	{
+		for (auto& impostor : mImpostors)
+		{
+			if (!impostor.captured)
+				return true;
+		}
+
+		return false;
+	}
+
+	void ImpostorRenderer::Capture(DrawFunction drawMesh)
+	{
+		for (int i = 0; i < mImpostors.size(); i++)
+		{
+			if (!mImpostors[i].captured)
+				CaptureImpostor(i, drawMesh);
+		}
+	}
+
+	bool ImpostorRenderer::IsCaptured(int impostor)
+	{
+		return impostor >= 0 && impostor < mImpostors.size() && mImpostors[impostor].captured;
+	}
+
+	ImpostorInstance ImpostorRenderer::CreateInstance(const BoundingSphere& sphere, const mat4& world)
+	{
+		vec3 axisX = vec3(world[0]);
+		vec3 axisY = vec3(world[1]);
+		vec3 axisZ = vec3(world[2]);
+		float scale = std::max(glm::length(axisX), std::max(glm::length(axisY), glm::length(axisZ)));
+
+		ImpostorInstance instance;
+		instance.center = vec3(world * vec4(sphere.center, 1.0f));
+		instance.radius = sphere.radius * scale;
+		instance.axisX = glm::normalize(axisX);
+		instance.axisY = glm::normalize(axisY);
+		instance.axisZ = glm::normalize(axisZ);
+
+		return instance;
+	}
+
+	void ImpostorRenderer::BeginFrame()
+	{
+		for (auto& impostor : mImpostors)
+			impostor.frameInstances.clear();
+	}
+
+	void ImpostorRenderer::AddInstances(int impostor, const std::vector<ImpostorInstance>& instances)
+	{
+		auto& frameInstances = mImpostors[impostor].frameInstances;
+		frameInstances.insert(frameInstances.end(), instances.begin(), instances.end());
+	}
+
+	void ImpostorRenderer::RecordDraws(VkCommandBuffer commandBuffer)
+	{
+		uint32_t numInstances = 0;
+		for (auto& impostor : mImpostors)
+			numInstances += impostor.frameInstances.size();
+
+		mNumInstances = numInstances;
+		mNumDraws = 0;
+
+		if (numInstances == 0)
+			return;
+
+		ReserveInstances(numInstances);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates->GetPipeline(mPipeline));
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mInstanceBuffer, offsets);
+
+		// The instances of a mesh are next to each other, one draw per mesh
+		uint32_t firstInstance = 0;
+		for (auto& impostor : mImpostors)
+		{
+			uint32_t count = impostor.frameInstances.size();
+			if (count == 0)
+				continue;
+
+			memcpy(mMappedInstances + firstInstance, impostor.frameInstances.data(), count * sizeof(ImpostorInstance));
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &impostor.descriptorSet.descriptorSet, 0, nullptr);
+			vkCmdDraw(commandBuffer, 6, count, 0, firstInstance);
+
+			firstInstance += count;
+			mNumDraws++;
+		}
+	}
+
+	ImpostorStats ImpostorRenderer::GetStats()
+	{
+		ImpostorStats stats = {};
+		stats.numInstances = mNumInstances;
+		stats.numDraws = mNumDraws;
+
+		for (auto& impostor : mImpostors)
+		{
+			if (impostor.captured)
+				stats.numImpostors++;
+		}
+
+		return stats;
+	}
+
+	void ImpostorRenderer::CreateAtlas(Impostor& impostor)
+	{
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = mColorFormat;
+		imageCreateInfo.extent = { IMPOSTOR_AZIMUTHS * IMPOSTOR_TILE_SIZE, IMPOSTOR_ELEVATIONS * IMPOSTOR_TILE_SIZE, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &impostor.atlas));
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(mDevice, impostor.atlas, &memRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = vkTools::initializers::memoryAllocateInfo();
+		allocateInfo.allocationSize = memRequirements.size;
+		mVulkanBase->GetMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocateInfo.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &allocateInfo, nullptr, &impostor.atlasMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, impostor.atlas, impostor.atlasMemory, 0));
+
+		VkImageViewCreateInfo viewCreateInfo = vkTools::initializers::imageViewCreateInfo();
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = mColorFormat;
+		viewCreateInfo.image = impostor.atlas;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &impostor.atlasView));
+
+		VkImageView attachments[2] = { impostor.atlasView, mDepthView };
+
+		VkFramebufferCreateInfo frameBufferCreateInfo = vkTools::initializers::framebufferCreateInfo();
+		frameBufferCreateInfo.renderPass = mCaptureRenderPass;
+		frameBufferCreateInfo.attachmentCount = 2;
+		frameBufferCreateInfo.pAttachments = attachments;
+		frameBufferCreateInfo.width = IMPOSTOR_AZIMUTHS * IMPOSTOR_TILE_SIZE;
+		frameBufferCreateInfo.height = IMPOSTOR_ELEVATIONS * IMPOSTOR_TILE_SIZE;
+		frameBufferCreateInfo.layers = 1;
+		VulkanDebug::ErrorCheck(vkCreateFramebuffer(mDevice, &frameBufferCreateInfo, nullptr, &impostor.frameBuffer));
+
+		// Only read after Capture() has moved the atlas to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		impostor.descriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
+		impostor.descriptorPool.AddDescriptor(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1);
+		impostor.descriptorPool.CreatePool(mDevice);
+
+		VkDescriptorImageInfo atlasInfo = { mSampler, impostor.atlasView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+		impostor.descriptorSet = mLayout;
+		impostor.descriptorSet.AllocateDescriptorSets(mDevice, impostor.descriptorPool.GetVkDescriptorPool());
+		impostor.descriptorSet.BindUniformBuffer(0, &mUniformBuffer);
+		impostor.descriptorSet.BindCombinedImage(1, &atlasInfo);
+		impostor.descriptorSet.UpdateDescriptorSets(mDevice);
+	}
+
+	void ImpostorRenderer::CaptureImpostor(int index, DrawFunction drawMesh)
+	{
+		Impostor& impostor = mImpostors[index];
+		float radius = std::max(impostor.sphere.radius, 0.001f);
+
+		// Orthographic with the depth from 0 to 1, the sphere is between the near and far plane and fills the tile
+		float nearPlane = radius;
+		float farPlane = 3.0f * radius;
+		mat4 projection = mat4(1.0f);
+		projection[0][0] = 1.0f / radius;
+		projection[1][1] = 1.0f / radius;
+		projection[2][2] = -1.0f / (farPlane - nearPlane);
+		projection[3][2] = -nearPlane / (farPlane - nearPlane);
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };		// Alpha 0 is discarded by impostor.frag
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		// drawMesh writes the camera to the uniform buffer, so every view is its own submit
+		for (int elevation = 0; elevation < IMPOSTOR_ELEVATIONS; elevation++)
+		{
+			for (int azimuth = 0; azimuth < IMPOSTOR_AZIMUTHS; azimuth++)
+			{
+				vec3 direction = GetViewDirection(azimuth, elevation);
+				vec3 eyePos = impostor.sphere.center + direction * 2.0f * radius;
+				mat4 view = glm::lookAt(eyePos, impostor.sphere.center, vec3(0.0f, 1.0f, 0.0f));
+
+				if (mVulkanBase->GetSetupCommandBuffer() == VK_NULL_HANDLE)
+					mVulkanBase->CreateSetupCommandBuffer();
+
+				VkCommandBuffer commandBuffer = mVulkanBase->GetSetupCommandBuffer();
+
+				if (elevation == 0 && azimuth == 0)
+					vkTools::setImageLayout(commandBuffer, impostor.atlas, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+				// The clear is limited to the render area so the other views are kept
+				VkRect2D tile = {};
+				tile.offset.x = azimuth * IMPOSTOR_TILE_SIZE;
+				tile.offset.y = elevation * IMPOSTOR_TILE_SIZE;
+				tile.extent.width = IMPOSTOR_TILE_SIZE;
+				tile.extent.height = IMPOSTOR_TILE_SIZE;
+
+				VkRenderPassBeginInfo renderPassBeginInfo = vkTools::initializers::renderPassBeginInfo();
+				renderPassBeginInfo.renderPass = mCaptureRenderPass;
+				renderPassBeginInfo.framebuffer = impostor.frameBuffer;
+				renderPassBeginInfo.renderArea = tile;
+				renderPassBeginInfo.clearValueCount = 2;
+				renderPassBeginInfo.pClearValues = clearValues;
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+				VkViewport viewport = {};
+				viewport.x = (float)tile.offset.x;
+				viewport.y = (float)tile.offset.y;
+				viewport.width = (float)IMPOSTOR_TILE_SIZE;
+				viewport.height = (float)IMPOSTOR_TILE_SIZE;
+				viewport.minDepth = 0.0f;
+				viewport.maxDepth = 1.0f;
+				vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &tile);
+
+				drawMesh(commandBuffer, index, view, projection, eyePos);
+
+				vkCmdEndRenderPass(commandBuffer);
+
+				if (elevation == IMPOSTOR_ELEVATIONS - 1 && azimuth == IMPOSTOR_AZIMUTHS - 1)
+					vkTools::setImageLayout(commandBuffer, impostor.atlas, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+				mVulkanBase->ExecuteSetupCommandBuffer();
+			}
+		}
+
+		impostor.captured = true;
+	}
+
+	void ImpostorRenderer::CreateRenderPass(VkFormat colorFormat, VkFormat depthFormat)
+	{
+		// Compatible with VulkanBase::SetupRenderPass() so the object pipelines can draw the views
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorReference;
+		subpass.pDepthStencilAttachment = &depthReference;
+
+		VkAttachmentDescription attachments[2] = {};
+		attachments[0].format = colorFormat;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		attachments[1].format = depthFormat;
+		attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkRenderPassCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		createInfo.attachmentCount = 2;
+		createInfo.pAttachments = attachments;
+		createInfo.subpassCount = 1;
+		createInfo.pSubpasses = &subpass;
+
+		VulkanDebug::ErrorCheck(vkCreateRenderPass(mDevice, &createInfo, nullptr, &mCaptureRenderPass));
+	}
+
+	void ImpostorRenderer::CreateDepthImage(VkFormat depthFormat)
+	{
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = depthFormat;
+		imageCreateInfo.extent = { IMPOSTOR_AZIMUTHS * IMPOSTOR_TILE_SIZE, IMPOSTOR_ELEVATIONS * IMPOSTOR_TILE_SIZE, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &mDepthImage));
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(mDevice, mDepthImage, &memRequirements);
+
+		VkMemoryAllocateInfo allocateInfo = vkTools::initializers::memoryAllocateInfo();
+		allocateInfo.allocationSize = memRequirements.size;
+		mVulkanBase->GetMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocateInfo.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &allocateInfo, nullptr, &mDepthMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, mDepthImage, mDepthMemory, 0));
+
+		VkImageViewCreateInfo viewCreateInfo = vkTools::initializers::imageViewCreateInfo();
+		viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCreateInfo.format = depthFormat;
+		viewCreateInfo.image = mDepthImage;
+		viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 0, 1, 0, 1 };
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &viewCreateInfo, nullptr, &mDepthView));
+	}
+
+	void ImpostorRenderer::CreatePipeline(VkRenderPass renderPass)
+	{
+		// Linear inside a view, the vertex shader keeps the texture coordinates half a texel from the edges of the tile
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = VK_FILTER_LINEAR;
+		sampler.minFilter = VK_FILTER_LINEAR;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = 0.0f;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+		VulkanDebug::ErrorCheck(vkCreateSampler(mDevice, &sampler, nullptr, &mSampler));
+
+		mLayout.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);				// Camera
+		mLayout.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);	// Atlas
+		mLayout.CreateLayout(mDevice);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = CreateInfo::PipelineLayout(1, &mLayout.setLayout);
+		VulkanDebug::ErrorCheck(vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo, nullptr, &mPipelineLayout));
+
+		// The quad is generated from gl_VertexIndex, the only stream is the instances
+		mVertexDescription.AddBinding<ImpostorInstanceLayout>(0, VK_VERTEX_INPUT_RATE_INSTANCE);	// Location 0-4 : Center, radius and rotation
+
+		// Both sides, the quad always faces the camera
+		PipelineState state;
+		state.vertexShader = "data/shaders/impostor/impostor.vert.spv";
+		state.fragmentShader = "data/shaders/impostor/impostor.frag.spv";
+		state.cullMode = VK_CULL_MODE_NONE;
+		state.vertexDescription = &mVertexDescription;
+		state.layout = mPipelineLayout;
+		state.renderPass = renderPass;
+		mPipeline = mPipelineStates->Create(state);
+	}
+
+	void ImpostorRenderer::ReserveInstances(uint32_t numInstances)
+	{
+		if (numInstances <= mInstanceCapacity)
+			return;
+
+		// The last frame is finished before the next one is recorded, so the old buffer isn't in use
+		if (mMappedInstances != nullptr)
+		{
+			vkUnmapMemory(mDevice, mInstanceMemory);
+			vkDestroyBuffer(mDevice, mInstanceBuffer, nullptr);
+			vkFreeMemory(mDevice, mInstanceMemory, nullptr);
+		}
+
+		mInstanceCapacity = std::max(numInstances, std::max(2 * mInstanceCapacity, (uint32_t)IMPOSTOR_MIN_INSTANCES));
+		VkDeviceSize bufferSize = mInstanceCapacity * sizeof(ImpostorInstance);
+
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			bufferSize, nullptr, &mInstanceBuffer, &mInstanceMemory);
+
+		VulkanDebug::ErrorCheck(vkMapMemory(mDevice, mInstanceMemory, 0, bufferSize, 0, (void**)&mMappedInstances));
+	}
+}	// VulkanLib namespace
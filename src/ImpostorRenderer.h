@@ -0,0 +1,138 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <functional>
+#include "Frustum.h"
+#include "DescriptorSet.h"
+#include "VertexDescription.h"
+#include "PipelineStateCache.h"
+
+#define IMPOSTOR_AZIMUTHS 8				// Views around the up axis, IMPOSTOR_AZIMUTHS in impostor.vert
+#define IMPOSTOR_ELEVATIONS 4			// Views from below to above, IMPOSTOR_ELEVATIONS in impostor.vert
+#define IMPOSTOR_TILE_SIZE 128			// Pixels, the size of every view in the atlas
+
+namespace VulkanLib
+{
+	class VulkanBase;
+	class StaticModel;
+
+	// One billboard, the rotation of the object selects the view in the atlas
+	struct ImpostorInstance
+	{
+		vec3 center;			// Of the bounding sphere in world space
+		float radius;
+		vec3 axisX;				// The rotation of the object without the scale
+		vec3 axisY;
+		vec3 axisZ;
+	};
+
+	typedef VertexLayout<ImpostorInstance,
+		VERTEX_MEMBER(ImpostorInstance, center),
+		VERTEX_MEMBER(ImpostorInstance, radius),
+		VERTEX_MEMBER(ImpostorInstance, axisX),
+		VERTEX_MEMBER(ImpostorInstance, axisY),
+		VERTEX_MEMBER(ImpostorInstance, axisZ)> ImpostorInstanceLayout;
+
+	struct ImpostorStats
+	{
+		int						numImpostors;		// Meshes with an atlas
+		int						numInstances;		// Billboards drawn in the last frame
+		int						numDraws;
+	};
+
+	/*
+		Camera facing billboards that replace objects that are too small on screen to show their geometry
+
+		Every mesh gets an atlas with IMPOSTOR_AZIMUTHS x IMPOSTOR_ELEVATIONS views of it, rendered once with an
+		orthographic camera that fits the bounding sphere. The views are taken in the local space of the mesh so the
+		rotation of an object only changes which view is selected. The atlas is rendered with the same pipelines
+		as the objects, so the textures and the lighting look the same from far away (the lighting is baked).
+
+		The vertex shader rotates the direction to the camera into the local space of the object, picks the closest
+		view and builds a quad that faces the camera. The fragment shader discards the texels where nothing was drawn.
+		All the billboards of a mesh are one instanced draw of 6 vertices per instance, the instances are written to
+		a mapped buffer every frame.
+	*/
+	class ImpostorRenderer
+	{
+	public:
+		// Records the mesh of an impostor, the view, projection and viewport are set by Capture()
+		typedef std::function<void(VkCommandBuffer commandBuffer, int impostor, const mat4& view, const mat4& projection, vec3 eyePos)> DrawFunction;
+
+		// The render pass and the formats are the ones the objects are drawn with, so their pipelines can draw into the atlas
+		void Init(VulkanBase* vulkanBase, PipelineStateCache* pipelineStates, VkRenderPass renderPass, VkFormat colorFormat, VkFormat depthFormat, VkDescriptorBufferInfo uniformBuffer);
+		void Cleanup();
+
+		// Returns the impostor of the mesh, the same mesh always gets the same impostor
+		int AddMesh(StaticModel* mesh);
+
+		// Renders the atlas of every mesh added since the last call, waits for the GPU
+		bool HasPendingCaptures();
+		void Capture(DrawFunction drawMesh);
+		bool IsCaptured(int impostor);
+
+		static ImpostorInstance CreateInstance(const BoundingSphere& sphere, const mat4& world);
+
+		// Called once per frame before AddInstances()
+		void BeginFrame();
+		void AddInstances(int impostor, const std::vector<ImpostorInstance>& instances);
+
+		// Copies the instances to the GPU and draws them, the viewport and the scissor must be set
+		void RecordDraws(VkCommandBuffer commandBuffer);
+
+		ImpostorStats GetStats();
+
+	private:
+		struct Impostor
+		{
+			StaticModel*		mesh;
+			BoundingSphere		sphere;				// Local space, fitted by the orthographic camera
+			bool				captured = false;
+
+			VkImage				atlas = VK_NULL_HANDLE;
+			VkDeviceMemory		atlasMemory = VK_NULL_HANDLE;
+			VkImageView			atlasView = VK_NULL_HANDLE;
+			VkFramebuffer		frameBuffer = VK_NULL_HANDLE;
+			DescriptorPool		descriptorPool;
+			DescriptorSet		descriptorSet;
+
+			std::vector<ImpostorInstance> frameInstances;
+		};
+
+		void CreateAtlas(Impostor& impostor);
+		void CaptureImpostor(int index, DrawFunction drawMesh);
+		void CreateRenderPass(VkFormat colorFormat, VkFormat depthFormat);
+		void CreateDepthImage(VkFormat depthFormat);
+		void CreatePipeline(VkRenderPass renderPass);
+		void ReserveInstances(uint32_t numInstances);
+
+		VulkanBase*					mVulkanBase = nullptr;
+		VkDevice					mDevice = VK_NULL_HANDLE;
+		PipelineStateCache*			mPipelineStates = nullptr;
+		VkFormat					mColorFormat = VK_FORMAT_UNDEFINED;
+		VkDescriptorBufferInfo		mUniformBuffer = {};
+
+		std::vector<Impostor>		mImpostors;
+
+		// The views are rendered with the clear restricted to the tile, the depth is shared by all the atlases
+		VkRenderPass				mCaptureRenderPass = VK_NULL_HANDLE;
+		VkImage						mDepthImage = VK_NULL_HANDLE;
+		VkDeviceMemory				mDepthMemory = VK_NULL_HANDLE;
+		VkImageView					mDepthView = VK_NULL_HANDLE;
+		VkSampler					mSampler = VK_NULL_HANDLE;
+
+		DescriptorSet				mLayout;								// Only the layout, every impostor has a copy with its own set
+		VkPipelineLayout			mPipelineLayout = VK_NULL_HANDLE;
+		VertexDescription			mVertexDescription;
+		PipelineHandle				mPipeline = nullptr;
+
+		// Host coherent and mapped, grows when a frame has more instances
+		VkBuffer					mInstanceBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory				mInstanceMemory = VK_NULL_HANDLE;
+		ImpostorInstance*			mMappedInstances = nullptr;
+		uint32_t					mInstanceCapacity = 0;
+
+		int							mNumInstances = 0;
+		int							mNumDraws = 0;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,346 @@
+#include "LooseOctree.h"
+#include "Object.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+
+namespace VulkanLib
+{
+	LooseOctree::LooseOctree()
+	{
+
+	}
+
+	void LooseOctree::Init(vec3 center, float halfSize)
+	{
+		Cleanup();
+		AllocateNode(-1, center, halfSize);
+	}
+
+	void LooseOctree::Cleanup()
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+
+		for (auto& entry : mEntries)
+		{
+			if (entry.node != -1)
+				entry.data.object->SetSpatialIndex(nullptr, -1);
+		}
+
+		mNodes.clear();
+		mFreeNodes.clear();
+		mEntries.clear();
+		mFreeEntries.clear();
+		mMovedEntries.clear();
+		mNumEntries = 0;
+	}
+
+	int LooseOctree::Insert(Object* object, const BoundingBox& localBounds, StaticModel* mesh)
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+
+		int handle;
+		if (mFreeEntries.size() != 0)
+		{
+			handle = mFreeEntries.back();
+			mFreeEntries.pop_back();
+		}
+		else
+		{
+			handle = mEntries.size();
+			mEntries.push_back(Entry());
+		}
+
+		Entry& entry = mEntries[handle];
+		entry.data.object = object;
+		entry.data.mesh = mesh;
+		entry.data.world = object->GetWorldMatrix();
+		entry.data.worldBounds = localBounds.Transform(entry.data.world);
+		entry.localBounds = localBounds;
+		entry.moved = false;
+
+		AddToNode(handle, FindNode(entry.data.worldBounds));
+		mNumEntries++;
+
+		object->SetSpatialIndex(this, handle);
+
+		return handle;
+	}
+
+	void LooseOctree::Remove(int handle)
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+
+		assert(mEntries[handle].node != -1);
+
+		// A moved entry that is removed is skipped in UpdateMoved()
+		RemoveFromNode(mEntries[handle].node, mEntries[handle].indexInNode);
+		mEntries[handle].node = -1;
+		mEntries[handle].data.object->SetSpatialIndex(nullptr, -1);
+		mEntries[handle].data.object = nullptr;
+		mFreeEntries.push_back(handle);
+		mNumEntries--;
+	}
+
+	void LooseOctree::Update(int handle)
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+		UpdateEntry(handle);
+	}
+
+	void LooseOctree::UpdateEntry(int handle)
+	{
+		Entry& entry = mEntries[handle];
+		entry.data.world = entry.data.object->GetWorldMatrix();
+		entry.data.worldBounds = entry.localBounds.Transform(entry.data.world);
+
+		// Most of the time the object is still in the same cell and only the world bounds change
+		int oldNode = entry.node;
+		int newNode = FindNode(entry.data.worldBounds);
+
+		if (newNode != oldNode)
+		{
+			// Added first so the nodes that both cells share don't become empty and get freed in between
+			int oldIndex = entry.indexInNode;
+			AddToNode(handle, newNode);
+			RemoveFromNode(oldNode, oldIndex);
+			mNumRelocated++;
+		}
+	}
+
+	void LooseOctree::MarkMoved(int handle)
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+
+		if (!mEntries[handle].moved)
+		{
+			mEntries[handle].moved = true;
+			mMovedEntries.push_back(handle);
+		}
+	}
+
+	void LooseOctree::UpdateMoved()
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(mMutex);
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		mNumMoved = 0;
+		mNumRelocated = 0;
+
+		for (int handle : mMovedEntries)
+		{
+			Entry& entry = mEntries[handle];
+			if (!entry.moved)
+				continue;
+
+			entry.moved = false;
+
+			if (entry.node != -1)
+			{
+				UpdateEntry(handle);
+				mNumMoved++;
+			}
+		}
+
+		mMovedEntries.clear();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mMaintenanceTime = std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	void LooseOctree::CullFrustum(const Frustum& frustum, std::vector<int>& visible)
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(mMutex);
+		visible.clear();
+
+		if (mNodes.size() == 0)
+			return;
+
+		// The root also holds the objects outside of the root cell so its own bounds aren't tested
+		std::vector<int> stack;
+		stack.push_back(0);
+
+		while (stack.size() != 0)
+		{
+			int nodeIndex = stack.back();
+			stack.pop_back();
+
+			const Node& node = mNodes[nodeIndex];
+
+			if (nodeIndex != 0)
+			{
+				FrustumResult result = frustum.TestBox(GetLooseBounds(node));
+
+				if (result == FRUSTUM_OUTSIDE)
+					continue;
+
+				if (result == FRUSTUM_INSIDE)
+				{
+					AddSubtree(nodeIndex, visible);
+					continue;
+				}
+			}
+
+			for (int handle : node.entries)
+			{
+				if (frustum.Intersects(mEntries[handle].data.worldBounds))
+					visible.push_back(handle);
+			}
+
+			for (int i = 0; i < 8; i++)
+			{
+				if (node.children[i] != -1)
+					stack.push_back(node.children[i]);
+			}
+		}
+	}
+
+	int LooseOctree::FindNode(const BoundingBox& bounds)
+	{
+		vec3 center = bounds.GetCenter();
+		vec3 extents = bounds.GetExtents();
+		float size = std::max(extents.x, std::max(extents.y, extents.z));
+
+		int nodeIndex = 0;
+
+		for (int depth = 0; depth < OCTREE_MAX_DEPTH; depth++)
+		{
+			vec3 nodeCenter = mNodes[nodeIndex].center;
+			float halfSize = mNodes[nodeIndex].halfSize;
+			float childHalfSize = halfSize * 0.5f;
+
+			// A child cell is too small or the center is outside of the root cell
+			if (size > childHalfSize || glm::any(glm::greaterThan(glm::abs(center - nodeCenter), vec3(halfSize))))
+				break;
+
+			int octant = (center.x >= nodeCenter.x ? 1 : 0) | (center.y >= nodeCenter.y ? 2 : 0) | (center.z >= nodeCenter.z ? 4 : 0);
+			int child = mNodes[nodeIndex].children[octant];
+
+			if (child == -1)
+			{
+				vec3 offset = vec3((octant & 1) ? 1.0f : -1.0f, (octant & 2) ? 1.0f : -1.0f, (octant & 4) ? 1.0f : -1.0f) * childHalfSize;
+				child = AllocateNode(nodeIndex, nodeCenter + offset, childHalfSize);
+				mNodes[nodeIndex].children[octant] = child;
+			}
+
+			nodeIndex = child;
+		}
+
+		return nodeIndex;
+	}
+
+	void LooseOctree::AddToNode(int handle, int node)
+	{
+		Entry& entry = mEntries[handle];
+		entry.node = node;
+		entry.indexInNode = mNodes[node].entries.size();
+		mNodes[node].entries.push_back(handle);
+
+		for (int parent = node; parent != -1; parent = mNodes[parent].parent)
+			mNodes[parent].numSubtreeEntries++;
+	}
+
+	void LooseOctree::RemoveFromNode(int node, int indexInNode)
+	{
+		// Swap with the last entry of the node
+		std::vector<int>& entries = mNodes[node].entries;
+		if (indexInNode != entries.size() - 1)
+		{
+			entries[indexInNode] = entries.back();
+			mEntries[entries[indexInNode]].indexInNode = indexInNode;
+		}
+
+		entries.pop_back();
+
+		// Free the nodes that became empty, the root is always kept
+		for (int nodeIndex = node; nodeIndex != -1; )
+		{
+			int parent = mNodes[nodeIndex].parent;
+			mNodes[nodeIndex].numSubtreeEntries--;
+
+			if (mNodes[nodeIndex].numSubtreeEntries == 0 && parent != -1)
+			{
+				for (int i = 0; i < 8; i++)
+				{
+					if (mNodes[parent].children[i] == nodeIndex)
+						mNodes[parent].children[i] = -1;
+				}
+
+				mFreeNodes.push_back(nodeIndex);
+			}
+
+			nodeIndex = parent;
+		}
+	}
+
+	int LooseOctree::AllocateNode(int parent, vec3 center, float halfSize)
+	{
+		int nodeIndex;
+		if (mFreeNodes.size() != 0)
+		{
+			nodeIndex = mFreeNodes.back();
+			mFreeNodes.pop_back();
+		}
+		else
+		{
+			nodeIndex = mNodes.size();
+			mNodes.push_back(Node());
+		}
+
+		Node& node = mNodes[nodeIndex];
+		node.center = center;
+		node.halfSize = halfSize;
+		node.parent = parent;
+		node.numSubtreeEntries = 0;
+		node.entries.clear();
+
+		for (int i = 0; i < 8; i++)
+			node.children[i] = -1;
+
+		return nodeIndex;
+	}
+
+	BoundingBox LooseOctree::GetLooseBounds(const Node& node)
+	{
+		vec3 extents = vec3(node.halfSize * OCTREE_LOOSENESS);
+		return BoundingBox(node.center - extents, node.center + extents);
+	}
+
+	void LooseOctree::AddSubtree(int node, std::vector<int>& visible)
+	{
+		visible.insert(visible.end(), mNodes[node].entries.begin(), mNodes[node].entries.end());
+
+		for (int i = 0; i < 8; i++)
+		{
+			if (mNodes[node].children[i] != -1)
+				AddSubtree(mNodes[node].children[i], visible);
+		}
+	}
+
+	Object* LooseOctree::GetObjectFromHandle(int handle)
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(mMutex);
+		return mEntries[handle].data.object;
+	}
+
+	BoundingBox LooseOctree::GetWorldBounds(int handle)
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(mMutex);
+		return mEntries[handle].data.worldBounds;
+	}
+
+	OctreeStats LooseOctree::GetStats()
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(mMutex);
+
+		OctreeStats stats;
+		stats.numEntries = mNumEntries;
+		stats.numNodes = mNodes.size() - mFreeNodes.size();
+		stats.numMoved = mNumMoved;
+		stats.numRelocated = mNumRelocated;
+		stats.maintenanceTime = mMaintenanceTime;
+
+		return stats;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,155 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include "Frustum.h"
+
+#define OCTREE_LOOSENESS 2.0f		// The bounds of a node are this much larger than its cell
+#define OCTREE_MAX_DEPTH 8
+
+namespace VulkanLib
+{
+	class Object;
+	class StaticModel;
+
+	struct OctreeStats
+	{
+		int						numEntries;
+		int						numNodes;
+		int						numMoved;			// Last UpdateMoved()
+		int						numRelocated;		// Moved to another node in the last UpdateMoved()
+		double					maintenanceTime;	// Milliseconds spent in the last UpdateMoved()
+	};
+
+	// What the queries see of an object, copied when the object is inserted or updated
+	struct OctreeObject
+	{
+		Object*					object;
+		StaticModel*			mesh;				// Can be null, only used by the exact queries
+		mat4					world;
+		BoundingBox				worldBounds;
+	};
+
+	/*
+		Loose octree for objects that move
+
+		Every node covers a cubic cell but its bounds are OCTREE_LOOSENESS times larger, so an object only has to fit
+		with its center inside a cell. The depth of an object follows directly from its size: the deepest level where
+		the half size of a cell is at least the largest extent of the object. Inserting and moving an object is then
+		a walk down from the root to that cell, the cost doesn't depend on how many other objects there are.
+
+		Insert() registers the octree with Object::SetSpatialIndex(), when the transform of the object changes it
+		calls MarkMoved() and only the moved objects are updated in the next UpdateMoved(). An object that stays in the same cell only
+		gets its world bounds updated, the node bounds never change so nothing has to be refitted.
+
+		Empty nodes are freed so the tree only has nodes where there are objects.
+
+		Any number of threads can run queries at the same time, the changes to the tree wait for them to finish.
+	*/
+	class LooseOctree
+	{
+	public:
+		LooseOctree();
+
+		// The root cell, objects outside of it are stored in the root
+		void Init(vec3 center, float halfSize);
+		void Cleanup();		// Removes all the objects and the nodes
+
+		// Returns the handle of the object, the local bounds are transformed with the world matrix of the object
+		int Insert(Object* object, const BoundingBox& localBounds, StaticModel* mesh = nullptr);
+		void Remove(int handle);
+		void Update(int handle);
+
+		// Queues the object for the next UpdateMoved(), called by Object when its transform changes
+		void MarkMoved(int handle);
+		void UpdateMoved();
+
+		// The handles of the objects that are at least partially inside
+		void CullFrustum(const Frustum& frustum, std::vector<int>& visible);
+
+		// Visits the nodes and objects where BoxTest(const BoundingBox&) is true with Visitor(int handle, const OctreeObject&)
+		template<typename BoxTest, typename Visitor>
+		void Query(BoxTest boxTest, Visitor visitor);
+
+		Object* GetObjectFromHandle(int handle);
+		BoundingBox GetWorldBounds(int handle);
+		OctreeStats GetStats();
+
+	private:
+		struct Node
+		{
+			vec3		center;
+			float		halfSize;				// Of the cell, the loose bounds are OCTREE_LOOSENESS times larger
+			int			parent;
+			int			children[8];
+			int			numSubtreeEntries;		// Including the children, empty subtrees are skipped and freed
+			std::vector<int> entries;
+		};
+
+		struct Entry
+		{
+			OctreeObject data;
+			BoundingBox	localBounds;
+			int			node;					// -1 for free entries
+			int			indexInNode;			// Into Node::entries
+			bool		moved;
+		};
+
+		void UpdateEntry(int handle);
+		int FindNode(const BoundingBox& bounds);
+		void AddToNode(int handle, int node);
+		void RemoveFromNode(int node, int indexInNode);
+		int AllocateNode(int parent, vec3 center, float halfSize);
+		BoundingBox GetLooseBounds(const Node& node);
+		void AddSubtree(int node, std::vector<int>& visible);
+
+		std::vector<Node>		mNodes;				// mNodes[0] is the root
+		std::vector<int>		mFreeNodes;
+		std::vector<Entry>		mEntries;
+		std::vector<int>		mFreeEntries;
+		std::vector<int>		mMovedEntries;
+
+		int						mNumEntries = 0;
+		int						mNumMoved = 0;
+		int						mNumRelocated = 0;
+		double					mMaintenanceTime = 0.0;
+
+		std::shared_timed_mutex	mMutex;				// Shared by the queries, exclusive for the changes
+	};
+
+	template<typename BoxTest, typename Visitor>
+	void LooseOctree::Query(BoxTest boxTest, Visitor visitor)
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(mMutex);
+
+		if (mNodes.size() == 0)
+			return;
+
+		// The root also holds the objects outside of the root cell so its own bounds aren't tested
+		std::vector<int> stack;
+		stack.push_back(0);
+
+		while (stack.size() != 0)
+		{
+			int nodeIndex = stack.back();
+			stack.pop_back();
+
+			const Node& node = mNodes[nodeIndex];
+			if (nodeIndex != 0 && !boxTest(GetLooseBounds(node)))
+				continue;
+
+			for (int handle : node.entries)
+			{
+				if (boxTest(mEntries[handle].data.worldBounds))
+					visitor(handle, mEntries[handle].data);
+			}
+
+			for (int i = 0; i < 8; i++)
+			{
+				if (node.children[i] != -1)
+					stack.push_back(node.children[i]);
+			}
+		}
+	}
+}	// VulkanLib namespace
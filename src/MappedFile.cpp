@@ -0,0 +1,156 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace VulkanLib
+{
+	static size_t GetPageSize()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		return systemInfo.dwPageSize;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+
+	MappedFile::MappedFile()
+	{
+
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(std::string filename)
+	{
+		Close();
+
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		mFile = file;
+		mMapping = mapping;
+		mData = (const uint8_t*)data;
+		mSize = (size_t)fileSize.QuadPart;
+#else
+		int file = open(filename.c_str(), O_RDONLY);
+		if (file == -1)
+			return false;
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(file);
+			return false;
+		}
+
+		void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if (data == MAP_FAILED)
+		{
+			close(file);
+			return false;
+		}
+
+		// The tiles are read in a random order
+		madvise(data, (size_t)fileStat.st_size, MADV_RANDOM);
+
+		mFile = file;
+		mData = (const uint8_t*)data;
+		mSize = (size_t)fileStat.st_size;
+#endif
+
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (!IsOpen())
+			return;
+
+#if defined(_WIN32)
+		UnmapViewOfFile(mData);
+		CloseHandle((HANDLE)mMapping);
+		CloseHandle((HANDLE)mFile);
+		mMapping = nullptr;
+		mFile = nullptr;
+#else
+		munmap((void*)mData, mSize);
+		close(mFile);
+		mFile = -1;
+#endif
+
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	void MappedFile::Discard(size_t offset, size_t size)
+	{
+		if (!IsOpen() || offset >= mSize)
+			return;
+
+		// Only whole pages inside the range can be dropped
+		const size_t pageSize = GetPageSize();
+		size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+		size_t end = (offset + size < mSize) ? (offset + size) / pageSize * pageSize : mSize;
+
+		if (begin >= end)
+			return;
+
+#if defined(_WIN32)
+		// Unlocking pages that aren't locked removes them from the working set
+		VirtualUnlock((LPVOID)(mData + begin), end - begin);
+#else
+		madvise((void*)(mData + begin), end - begin, MADV_DONTNEED);
+#endif
+	}
+
+	const uint8_t* MappedFile::GetData() const
+	{
+		return mData;
+	}
+
+	size_t MappedFile::GetSize() const
+	{
+		return mSize;
+	}
+
+	bool MappedFile::IsOpen() const
+	{
+		return mData != nullptr;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace VulkanLib
+{
+	/*
+		Read only memory mapped file
+
+		The OS pages the file in on demand when the data is accessed, so only the parts that actually are read
+		take up memory. Uses CreateFileMapping() on Windows and mmap() everywhere else.
+	*/
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(std::string filename);
+		void Close();
+
+		// Tells the OS that a range won't be read for a while so the pages can be dropped from the working set
+		// The file is read only so the pages are clean and are simply read from disk again if needed
+		void Discard(size_t offset, size_t size);
+
+		const uint8_t* GetData() const;
+		size_t GetSize() const;
+		bool IsOpen() const;
+
+	private:
+		// Not copyable, the mapping can only have one owner
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const uint8_t*	mData = nullptr;
+		size_t			mSize = 0;
+
+#if defined(_WIN32)
+		void*			mFile = nullptr;		// HANDLE
+		void*			mMapping = nullptr;		// HANDLE
+#else
+		int				mFile = -1;
+#endif
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,265 @@
+#include "MaterialLibrary.h"
+#include "TextureStreamer.h"
+#include "TextureFile.h"
+#include "TextureCompiler.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+
+#include <cstring>
+
+namespace VulkanLib
+{
+	MaterialLibrary::MaterialLibrary()
+	{
+
+	}
+
+	void MaterialLibrary::Init(VulkanBase* vulkanBase, TextureStreamer* textureStreamer, TextureArrayMode mode)
+	{
+		mVulkanBase = vulkanBase;
+		mTextureStreamer = textureStreamer;
+		mMode = mode;
+	}
+
+	void MaterialLibrary::Cleanup()
+	{
+		// The streamed textures are owned by the texture streamer
+		if (mLayeredTexture.image != VK_NULL_HANDLE)
+		{
+			VkDevice device = mVulkanBase->GetDevice();
+			vkDestroyImageView(device, mLayeredTexture.view, nullptr);
+			vkDestroyImage(device, mLayeredTexture.image, nullptr);
+			vkDestroySampler(device, mLayeredTexture.sampler, nullptr);
+			vkFreeMemory(device, mLayeredTexture.deviceMemory, nullptr);
+			mLayeredTexture = {};
+		}
+
+		mTextureIndices.clear();
+		mStreamedTextureIds.clear();
+		mDescriptorInfos.clear();
+		mNumLayers = 0;
+	}
+
+	int MaterialLibrary::AddTexture(std::string filename, VkFormat format)
+	{
+		auto iter = mTextureIndices.find(filename);
+		if (iter != mTextureIndices.end())
+			return iter->second;
+
+		if (GetNumTextures() >= MAX_MATERIAL_TEXTURES)
+		{
+			VulkanDebug::ConsolePrint("Material library is full, can't add: " + filename);
+			return -1;
+		}
+
+		// Uncompressed sources are block compressed once and cached next to the source
+		std::string path = filename;
+		if (!TextureCompiler::IsCompressedFile(path))
+		{
+			path = TextureCompiler::GetCachedTexture(path, format);
+			if (path == "")
+				return -1;
+		}
+
+		int textureIndex = -1;
+		if (mMode == TEXTURE_ARRAY_DESCRIPTORS)
+		{
+			int textureId = mTextureStreamer->AddTexture(path, format);
+			if (textureId != -1)
+			{
+				mStreamedTextureIds.push_back(textureId);
+				textureIndex = mStreamedTextureIds.size() - 1;
+			}
+		}
+		else
+		{
+			textureIndex = AddLayer(path, format);
+		}
+
+		if (textureIndex != -1)
+		{
+			mTextureIndices[filename] = textureIndex;
+			UpdateDescriptorInfos();
+		}
+
+		return textureIndex;
+	}
+
+	void MaterialLibrary::RequestTexture(int textureIndex, float screenSize)
+	{
+		if (mMode == TEXTURE_ARRAY_DESCRIPTORS)
+			mTextureStreamer->RequestTexture(mStreamedTextureIds[textureIndex], screenSize);
+	}
+
+	void MaterialLibrary::UpdateDescriptorInfos()
+	{
+		mDescriptorInfos.resize(GetDescriptorCount());
+
+		if (mMode == TEXTURE_ARRAY_LAYERS)
+		{
+			mDescriptorInfos[0] = { mLayeredTexture.sampler, mLayeredTexture.view, mLayeredTexture.imageLayout };
+			return;
+		}
+
+		if (mStreamedTextureIds.empty())
+			return;
+
+		for (uint32_t i = 0; i < mDescriptorInfos.size(); i++)
+		{
+			int textureId = mStreamedTextureIds[i < mStreamedTextureIds.size() ? i : 0];
+			vkTools::VulkanTexture& texture = mTextureStreamer->GetTexture(textureId);
+			mDescriptorInfos[i] = { texture.sampler, texture.view, texture.imageLayout };
+		}
+	}
+
+	int MaterialLibrary::AddLayer(std::string filename, VkFormat format)
+	{
+		TextureFile file;
+		if (!file.Open(filename))
+		{
+			VulkanDebug::ConsolePrint("Error loading material texture: " + filename);
+			return -1;
+		}
+
+		const uint32_t width = file.GetWidth();
+		const uint32_t height = file.GetHeight();
+		const uint32_t mipLevels = file.GetNumMips();
+
+		if (mLayeredTexture.image == VK_NULL_HANDLE)
+		{
+			CreateLayeredImage(width, height, mipLevels, format);
+		}
+		else if (width != mLayeredTexture.width || height != mLayeredTexture.height || mipLevels != mLayeredTexture.mipLevels || format != mLayerFormat)
+		{
+			VulkanDebug::ConsolePrint("Material texture doesn't match the texture array layers: " + filename);
+			return -1;
+		}
+
+		const uint32_t layer = mNumLayers;
+
+		// All the mips of the layer are packed in one staging buffer
+		std::vector<VkBufferImageCopy> copyRegions;
+		std::vector<uint8_t> staging;
+		for (uint32_t mip = 0; mip < mipLevels; mip++)
+		{
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.bufferOffset = (staging.size() + 15) & ~(VkDeviceSize)15;
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, layer, 1 };
+			copyRegion.imageExtent = { file.GetMipWidth(mip), file.GetMipHeight(mip), 1 };
+			copyRegions.push_back(copyRegion);
+
+			staging.resize(copyRegion.bufferOffset + file.GetMipSize(mip));
+			memcpy(staging.data() + copyRegion.bufferOffset, file.GetMipData(0, mip), file.GetMipSize(mip));
+		}
+
+		VkDevice device = mVulkanBase->GetDevice();
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, staging.size(), staging.data(), &stagingBuffer, &stagingMemory);
+
+		mVulkanBase->CreateSetupCommandBuffer();
+		VkCommandBuffer cmdBuffer = mVulkanBase->GetSetupCommandBuffer();
+
+		// Only the new layer changes layout, the other layers can stay readable
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, layer, 1 };
+		vkTools::setImageLayout(cmdBuffer, mLayeredTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		vkCmdCopyBufferToImage(cmdBuffer, stagingBuffer, mLayeredTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+		vkTools::setImageLayout(cmdBuffer, mLayeredTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mLayeredTexture.imageLayout, subresourceRange);
+
+		mVulkanBase->ExecuteSetupCommandBuffer();
+
+		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		vkFreeMemory(device, stagingMemory, nullptr);
+
+		mNumLayers++;
+
+		return layer;
+	}
+
+	// Allocates all the layers up front, the layers that aren't used yet are transitioned so the whole view is valid
+	void MaterialLibrary::CreateLayeredImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format)
+	{
+		VkDevice device = mVulkanBase->GetDevice();
+
+		mLayerFormat = format;
+		mLayeredTexture.width = width;
+		mLayeredTexture.height = height;
+		mLayeredTexture.mipLevels = mipLevels;
+		mLayeredTexture.layerCount = MAX_MATERIAL_TEXTURES;
+		mLayeredTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = format;
+		imageCreateInfo.extent = { width, height, 1 };
+		imageCreateInfo.mipLevels = mipLevels;
+		imageCreateInfo.arrayLayers = MAX_MATERIAL_TEXTURES;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(device, &imageCreateInfo, nullptr, &mLayeredTexture.image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, mLayeredTexture.image, &memReqs);
+
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		mVulkanBase->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(device, &memAlloc, nullptr, &mLayeredTexture.deviceMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(device, mLayeredTexture.image, mLayeredTexture.deviceMemory, 0));
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, MAX_MATERIAL_TEXTURES };
+
+		mVulkanBase->CreateSetupCommandBuffer();
+		vkTools::setImageLayout(mVulkanBase->GetSetupCommandBuffer(), mLayeredTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, mLayeredTexture.imageLayout, subresourceRange);
+		mVulkanBase->ExecuteSetupCommandBuffer();
+
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = VK_FILTER_LINEAR;
+		sampler.minFilter = VK_FILTER_LINEAR;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.mipLodBias = 0.0f;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = (float)mipLevels;
+		sampler.maxAnisotropy = 8;
+		sampler.anisotropyEnable = mVulkanBase->GetEnabledFeatures().samplerAnisotropy;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VulkanDebug::ErrorCheck(vkCreateSampler(device, &sampler, nullptr, &mLayeredTexture.sampler));
+
+		VkImageViewCreateInfo view = {};
+		view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		view.format = format;
+		view.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		view.subresourceRange = subresourceRange;
+		view.image = mLayeredTexture.image;
+		VulkanDebug::ErrorCheck(vkCreateImageView(device, &view, nullptr, &mLayeredTexture.view));
+	}
+
+	TextureArrayMode MaterialLibrary::GetMode()
+	{
+		return mMode;
+	}
+
+	uint32_t MaterialLibrary::GetDescriptorCount()
+	{
+		return (mMode == TEXTURE_ARRAY_DESCRIPTORS) ? MAX_MATERIAL_TEXTURES : 1;
+	}
+
+	VkDescriptorImageInfo* MaterialLibrary::GetDescriptorInfos()
+	{
+		return mDescriptorInfos.data();
+	}
+
+	int MaterialLibrary::GetNumTextures()
+	{
+		return (mMode == TEXTURE_ARRAY_DESCRIPTORS) ? mStreamedTextureIds.size() : mNumLayers;
+	}
+}	// VulkanLib namespace
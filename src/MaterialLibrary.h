@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <vulkan/vulkan.h>
+#include "base/vulkanTextureLoader.hpp"
+
+#define MAX_MATERIAL_TEXTURES 16		// Must match the array size in textured.frag
+
+namespace VulkanLib
+{
+	class VulkanBase;
+	class TextureStreamer;
+
+	enum TextureArrayMode
+	{
+		TEXTURE_ARRAY_DESCRIPTORS,		// sampler2D[MAX_MATERIAL_TEXTURES], needs shaderSampledImageArrayDynamicIndexing
+		TEXTURE_ARRAY_LAYERS			// One sampler2DArray, all textures must have the same size, format and number of mips
+	};
+
+	/*
+		Collects the textures of all the materials so they can be bound once per frame instead of once per draw
+
+		Vulkan 1.0 has no descriptor indexing, but an array of combined image samplers can be indexed with a dynamically
+		uniform value when the device supports shaderSampledImageArrayDynamicIndexing. The texture index is pushed with
+		the draw so the index is the same for every invocation of the draw. The textures are streamed by the
+		TextureStreamer in this mode. Unused array elements point to the first texture since every element of the
+		array counts as used by the shader.
+
+		Devices without dynamic indexing use a single image with one layer per texture instead. The layers are
+		allocated up front and the whole image is uploaded when the texture is added, so there is no streaming.
+
+		AddTexture() returns the index that is sent to the shader, adding the same file twice returns the same index.
+		Files that aren't DDS or KTX are compressed to the format with TextureCompiler the first time they are used.
+	*/
+	class MaterialLibrary
+	{
+	public:
+		MaterialLibrary();
+
+		void Init(VulkanBase* vulkanBase, TextureStreamer* textureStreamer, TextureArrayMode mode);
+		void Cleanup();
+
+		// Returns the texture index, -1 if the texture couldn't be loaded or the library is full
+		int AddTexture(std::string filename, VkFormat format);
+
+		// Forwards the projected size to the texture streamer, does nothing in TEXTURE_ARRAY_LAYERS mode
+		void RequestTexture(int textureIndex, float screenSize);
+
+		// Must be called when the streamed image views have changed
+		void UpdateDescriptorInfos();
+
+		TextureArrayMode GetMode();
+		uint32_t GetDescriptorCount();							// Size of the combined image sampler array
+		VkDescriptorImageInfo* GetDescriptorInfos();			// GetDescriptorCount() elements, valid until the next change
+		int GetNumTextures();
+
+	private:
+		int AddLayer(std::string filename, VkFormat format);
+		void CreateLayeredImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format);
+
+		VulkanBase*							mVulkanBase = nullptr;
+		TextureStreamer*					mTextureStreamer = nullptr;
+		TextureArrayMode					mMode = TEXTURE_ARRAY_DESCRIPTORS;
+
+		std::map<std::string, int>			mTextureIndices;
+		std::vector<int>					mStreamedTextureIds;	// Per texture index in TEXTURE_ARRAY_DESCRIPTORS mode
+		std::vector<VkDescriptorImageInfo>	mDescriptorInfos;
+
+		vkTools::VulkanTexture				mLayeredTexture = {};	// TEXTURE_ARRAY_LAYERS mode
+		VkFormat							mLayerFormat = VK_FORMAT_UNDEFINED;
+		int									mNumLayers = 0;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,240 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#define KAISER_TAPS 8
+#define KAISER_ALPHA 4.0f
+#define KAISER_WIDTH 2.0f		// Half width of the window in destination texels
+
+namespace VulkanLib
+{
+	// Modified Bessel function of the first kind, the series converges quickly for the small arguments used here
+	static float BesselI0(float x)
+	{
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x * 0.5f) / k;
+			sum += term * term;
+		}
+		return sum;
+	}
+
+	// Destination texel x is centered between source texels 2x and 2x + 1, tap t reads source texel 2x + t - 3
+	struct KaiserWeights
+	{
+		float weights[KAISER_TAPS];
+
+		KaiserWeights()
+		{
+			const float pi = 3.14159265f;
+			float sum = 0.0f;
+
+			for (int t = 0; t < KAISER_TAPS; t++)
+			{
+				float distance = ((t - 3) - 0.5f) * 0.5f;		// In destination texels
+				float sinc = sinf(pi * distance) / (pi * distance);
+				float window = distance / KAISER_WIDTH;
+				float kaiser = BesselI0(KAISER_ALPHA * sqrtf(std::max(1.0f - window * window, 0.0f))) / BesselI0(KAISER_ALPHA);
+
+				weights[t] = sinc * kaiser;
+				sum += weights[t];
+			}
+
+			for (int t = 0; t < KAISER_TAPS; t++)
+				weights[t] /= sum;
+		}
+	};
+
+	static const KaiserWeights gKaiserWeights;
+
+	void MipGenerator::Generate(const RGBAImage& image, MipFilter filter, std::vector<RGBAImage>& mips)
+	{
+		mips.resize(GetNumMips(image.width, image.height));
+		mips[0] = image;
+
+		for (uint32_t mip = 1; mip < mips.size(); mip++)
+			Downsample(mips[mip - 1], filter, mips[mip]);
+	}
+
+	void MipGenerator::Downsample(const RGBAImage& source, MipFilter filter, RGBAImage& mip)
+	{
+		mip.width = std::max(source.width / 2, 1u);
+		mip.height = std::max(source.height / 2, 1u);
+		mip.texels.resize(mip.width * mip.height * 4);
+
+		if (filter == MIP_FILTER_KAISER)
+			DownsampleKaiser(source, mip);
+		else
+			DownsampleBox(source, mip);
+	}
+
+	uint32_t MipGenerator::GetNumMips(uint32_t width, uint32_t height)
+	{
+		uint32_t numMips = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+			numMips++;
+		}
+
+		return numMips;
+	}
+
+	void MipGenerator::DownsampleBox(const RGBAImage& source, RGBAImage& mip)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+
+		for (uint32_t y = 0; y < mip.height; y++)
+		{
+			const uint8_t* row0 = &source.texels[std::min(y * 2, source.height - 1) * source.width * 4];
+			const uint8_t* row1 = &source.texels[std::min(y * 2 + 1, source.height - 1) * source.width * 4];
+			uint8_t* out = &mip.texels[y * mip.width * 4];
+
+			// 4 destination texels from 8 source texels in each row
+			uint32_t x = 0;
+			for (; x + 4 <= mip.width && x * 2 + 8 <= source.width; x += 4)
+			{
+				__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+				__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+				__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+				__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+				// Two horizontally adjacent texels per register with 16 bits per channel, both rows added
+				__m128i sum01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				__m128i sum23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				__m128i sum45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				__m128i sum67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+				// Adds the high texel to the low one
+				sum01 = _mm_add_epi16(sum01, _mm_srli_si128(sum01, 8));
+				sum23 = _mm_add_epi16(sum23, _mm_srli_si128(sum23, 8));
+				sum45 = _mm_add_epi16(sum45, _mm_srli_si128(sum45, 8));
+				sum67 = _mm_add_epi16(sum67, _mm_srli_si128(sum67, 8));
+
+				__m128i texels01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sum01, sum23), two), 2);
+				__m128i texels23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sum45, sum67), two), 2);
+				_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(texels01, texels23));
+			}
+
+			// The remaining texels and the clamped odd edges
+			for (; x < mip.width; x++)
+			{
+				uint32_t x0 = std::min(x * 2, source.width - 1) * 4;
+				uint32_t x1 = std::min(x * 2 + 1, source.width - 1) * 4;
+
+				for (int c = 0; c < 4; c++)
+					out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+
+	void MipGenerator::DownsampleKaiser(const RGBAImage& source, RGBAImage& mip)
+	{
+		__m128 tapWeights[KAISER_TAPS];
+		for (int t = 0; t < KAISER_TAPS; t++)
+			tapWeights[t] = _mm_set1_ps(gKaiserWeights.weights[t]);
+
+		// Horizontal pass into a float image that is the destination width and the source height
+		std::vector<float> horizontal(mip.width * source.height * 4);
+		std::vector<float> row(source.width * 4);
+
+		for (uint32_t y = 0; y < source.height; y++)
+		{
+			const uint8_t* sourceRow = &source.texels[y * source.width * 4];
+			for (uint32_t i = 0; i < source.width * 4; i++)
+				row[i] = sourceRow[i];
+
+			for (uint32_t x = 0; x < mip.width; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int t = 0; t < KAISER_TAPS; t++)
+				{
+					int sourceX = std::min(std::max((int)(x * 2) + t - 3, 0), (int)source.width - 1);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&row[sourceX * 4]), tapWeights[t]));
+				}
+
+				_mm_storeu_ps(&horizontal[(y * mip.width + x) * 4], sum);
+			}
+		}
+
+		// Vertical pass, the negative lobes of the sinc can overshoot so the result is clamped
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 max = _mm_set1_ps(255.0f);
+
+		for (uint32_t y = 0; y < mip.height; y++)
+		{
+			const float* rows[KAISER_TAPS];
+			for (int t = 0; t < KAISER_TAPS; t++)
+			{
+				int sourceY = std::min(std::max((int)(y * 2) + t - 3, 0), (int)source.height - 1);
+				rows[t] = &horizontal[sourceY * mip.width * 4];
+			}
+
+			uint8_t* out = &mip.texels[y * mip.width * 4];
+			for (uint32_t x = 0; x < mip.width; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int t = 0; t < KAISER_TAPS; t++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + x * 4), tapWeights[t]));
+
+				__m128i texel = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(sum, zero), max));		// Rounds to nearest
+				texel = _mm_packs_epi32(texel, texel);
+				texel = _mm_packus_epi16(texel, texel);
+
+				uint32_t packed = (uint32_t)_mm_cvtsi128_si32(texel);
+				memcpy(out + x * 4, &packed, 4);
+			}
+		}
+	}
+
+	void MipGenerator::RecordBlitChain(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t numMips, uint32_t numLayers, VkImageLayout finalLayout)
+	{
+		auto transition = [&](uint32_t mip, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = newLayout;
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, numLayers };
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		};
+
+		for (uint32_t mip = 1; mip < numMips; mip++)
+		{
+			// The previous level has been written by the upload or the previous blit
+			transition(mip - 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			transition(mip, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			VkImageBlit blit = {};
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - 1, 0, numLayers };
+			blit.srcOffsets[1] = { (int32_t)std::max(width >> (mip - 1), 1u), (int32_t)std::max(height >> (mip - 1), 1u), 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, numLayers };
+			blit.dstOffsets[1] = { (int32_t)std::max(width >> mip, 1u), (int32_t)std::max(height >> mip, 1u), 1 };
+			vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+			transition(mip - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, finalLayout, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+		}
+
+		transition(numMips - 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+	}
+
+	bool MipGenerator::SupportsBlit(VkPhysicalDevice physicalDevice, VkFormat format)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+		const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		return (properties.optimalTilingFeatures & required) == required;
+	}
+}	// VulkanLib namespace
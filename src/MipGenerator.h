@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace VulkanLib
+{
+	// RGBA8, tightly packed and the top row first
+	struct RGBAImage
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> texels;
+	};
+
+	enum MipFilter
+	{
+		MIP_FILTER_BOX,			// 2x2 average, fast
+		MIP_FILTER_KAISER		// 8x8 Kaiser windowed sinc, sharper distant textures
+	};
+
+	/*
+		Builds mip chains on the CPU or records them on the GPU
+
+		On the CPU every level is half the size of the previous one, odd edges are clamped. The box filter averages
+		2x2 texels with SSE 4 output texels at a time and gives the same result as the scalar version. The Kaiser
+		filter is separable and filters all 4 channels of a texel at once in one SSE register. The filtering is done
+		on the stored values, sRGB textures aren't converted to linear first.
+
+		RecordBlitChain() is the GPU version, each level is blitted from the previous one with a linear filter. It
+		only needs level 0 uploaded but the format must support blits, see SupportsBlit().
+	*/
+	class MipGenerator
+	{
+	public:
+		// mips[0] is a copy of the image, followed by every level down to 1x1
+		static void Generate(const RGBAImage& image, MipFilter filter, std::vector<RGBAImage>& mips);
+
+		static void Downsample(const RGBAImage& source, MipFilter filter, RGBAImage& mip);
+
+		static uint32_t GetNumMips(uint32_t width, uint32_t height);
+
+		// Level 0 must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and the other levels in any layout
+		// All levels are in finalLayout afterwards
+		static void RecordBlitChain(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t numMips, uint32_t numLayers, VkImageLayout finalLayout);
+
+		// Optimal tiling must support being both the source and destination of a linear blit
+		static bool SupportsBlit(VkPhysicalDevice physicalDevice, VkFormat format);
+
+	private:
+		static void DownsampleBox(const RGBAImage& source, RGBAImage& mip);
+		static void DownsampleKaiser(const RGBAImage& source, RGBAImage& mip);
+	};
+}	// VulkanLib namespace
@@ -1,9 +1,10 @@
 #include "ModelLoader.h"
 #include "StaticModel.h"
 #include "VulkanBase.h"
-#include "LoadTGA.h"
+#include "TerrainBuilder.h"
 
 #include <vector>
+#include <cassert>
 
 // TODO: Note that the format should be #include <assimp/Importer.hpp> but something in the project settings is wrong
 #include "../external/assimp/assimp/Importer.hpp"
@@ -111,113 +112,20 @@ namespace VulkanLib
 		if (mModelMap.find(filename) != mModelMap.end())
 			return mModelMap[filename];
 
-		// Load the terrain froma .tga file
-		TextureData texture;
-		LoadTGATextureData((char*)filename.c_str(), &texture);
-
-		StaticModel* terrain = new StaticModel;
-		Mesh mesh;
-
-		int vertexCount = texture.width * texture.height;
-		int triangleCount = (texture.width - 1) * (texture.height - 1) * 2;
-		int x, z;
-
-		mesh.vertices.resize(vertexCount);
-		mesh.indices.resize(triangleCount * 3);
-
-		printf("bpp %d\n", texture.bpp);
-		for (x = 0; x < texture.width; x++)
-			for (z = 0; z < texture.height; z++)
-			{
-				// Vertex array. You need to scale this properly
-				float height = texture.imageData[(x + z * texture.width) * (texture.bpp / 8)] / 15.0f;
-
-				vec3 pos = vec3(x / 1.0, height, z / 1.0);
-				vec3 normal = vec3(0, 0, 0);
-				vec2 uv = vec2(x / (float)texture.width, z / (float)texture.height);
-
-				Vertex vertex = Vertex(pos, normal, uv, vec3(0, 0, 0), vec3(1.0, 1.0, 1.0));
-				mesh.vertices[x + z * texture.width] = vertex;
-			}
-
-		// Normal vectors. You need to calculate these.
-		for (x = 0; x < texture.width; x++)
+		// Load the terrain from a .tga file
+		HeightField heightField;
+		if (!TerrainBuilder::LoadHeightField(filename, heightField))
 		{
-			for (z = 0; z < texture.height; z++)
-			{
-				vec3 p1, p2, p3;
-				vec3 edge = { 0.0f, 0.0f, 0.0f };
-				int i1;
-
-				// p1 [x-1][z-1]
-				if (x < 1 && z < 1)
-					i1 = (x + 1 + (z + 1) * texture.width);
-				else
-					i1 = (x - 1 + (z - 1) * texture.width);
-
-				// TODO: NOTE: HAX
-				if (i1 < 0)
-					i1 = 0;
-
-				p1 = mesh.vertices[i1].Pos;
-
-				// p1 [x-1][z] (if on the edge use [x+1] instead of [x-1])
-				int i2;
-				if (x < 1)
-					i2 = (x + 1 + (z)* texture.width);
-				else
-					i2 = (x - 1 + (z)* texture.width);
-
-				p2 = mesh.vertices[i2].Pos;
-
-				// p1 [x][z-1]
-				int i3;
-				if (z < 1)
-					i3 = (x + (z + 1) * texture.width);
-				else
-					i3 = (x + (z - 1) * texture.width);
-
-				p3 = mesh.vertices[i3].Pos;
-
-				vec3 e1 = p2 - p1;
-				vec3 e2 = p3 - p1;
-				vec3 normal = glm::cross(e2, e1);
-
-				if (normal != vec3(0, 0, 0))
-					int asda = 1;
-
-				normal = glm::normalize(normal);
-
-				//i = (x + 1 + (z + 1) * texture.width);
-				mesh.vertices[i1].Normal += normal;
-				mesh.vertices[i2].Normal += normal;
-				mesh.vertices[i3].Normal += normal;
-
-				// NOTE: Testing
-				//mesh.vertices[i].Normal = vec3(0, 0, 0);
-			}
+			assert(false && "GenerateTerrain() failed to load the heightmap");
+			return nullptr;
 		}
 
-		for (x = 0; x < texture.width - 1; x++)
-		{
-			for (z = 0; z < texture.height - 1; z++)
-			{
-				// Triangle 1
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 0] = x + z * texture.width;
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 1] = x + (z + 1) * texture.width;
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 2] = x + 1 + z * texture.width;
-				// Triangle 2
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 3] = x + 1 + z * texture.width;
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 4] = x + (z + 1) * texture.width;
-				mesh.indices[(x + z * (texture.width - 1)) * 6 + 5] = x + 1 + (z + 1) * texture.width;
-			}
-		}
+		StaticModel* terrain = new StaticModel;
+		Mesh mesh;
 
-		// Now loop through each vertex vector, and average out all the normals stored.
-		for (int i = 0; i < mesh.vertices.size(); ++i)
-		{
-			mesh.vertices[i].Normal = glm::normalize(mesh.vertices[i].Normal);
-		}
+		// Positions, normals and indices are built in parallel directly from the height grid
+		TerrainBuilder builder;
+		builder.BuildMesh(heightField, mesh);
 
 		terrain->AddMesh(mesh);
 		terrain->BuildBuffers(vulkanBase);
@@ -1,14 +1,20 @@
 #include "Object.h"
-
-#include <glm/gtc/matrix_transform.hpp>
+#include "LooseOctree.h"
+#include "StaticBatcher.h"
+#include "TransformSystem.h"
 
 namespace VulkanLib
 {
 	Object::Object(vec3 position)
 	{
+		mSpatialIndex = nullptr;
+		mSpatialHandle = -1;
+		mStaticBatch = nullptr;
+		mStaticBatchHandle = -1;
+
+		// Starts with no rotation and a scale of 1
+		mTransform = TransformSystem::GetDefault().Create();
 		SetPosition(position);
-		SetRotation(vec3(0, 0, 0));
-		SetScale(vec3(1.0f, 1.0f, 1.0f));
 		SetColor(vec3(1.0f, 1.0f, 1.0f));
 		//SetModel(nullptr);
 		SetPipeline(PipelineEnum::TEXTURED);		// Must be assigned later
@@ -17,6 +23,13 @@ namespace VulkanLib
 
 	Object::~Object()
 	{
+		if (mSpatialIndex != nullptr)
+			mSpatialIndex->Remove(mSpatialHandle);
+
+		if (mStaticBatch != nullptr)
+			mStaticBatch->Remove(mStaticBatchHandle);
+
+		TransformSystem::GetDefault().Destroy(mTransform);
 	}
 
 	void Object::SetModel(std::string modelSource)
@@ -24,22 +37,27 @@ namespace VulkanLib
 		mModelSource = modelSource;
 	}
 
+	void Object::SetTexture(std::string textureSource)
+	{
+		mTextureSource = textureSource;
+	}
+
 	void Object::SetPosition(vec3 position)
 	{
-		mPosition = position;
-		RebuildWorldMatrix();
+		TransformSystem::GetDefault().SetPosition(mTransform, position);
+		MarkMoved();
 	}
 
 	void Object::SetRotation(vec3 rotation)
 	{
-		mRotation = rotation;
-		RebuildWorldMatrix();
+		TransformSystem::GetDefault().SetRotation(mTransform, rotation);
+		MarkMoved();
 	}
 
 	void Object::SetScale(vec3 scale)
 	{
-		mScale = scale;
-		RebuildWorldMatrix();
+		TransformSystem::GetDefault().SetScale(mTransform, scale);
+		MarkMoved();
 	}
 
 	void Object::SetColor(vec3 color)
@@ -54,8 +72,7 @@ namespace VulkanLib
 
 	void Object::AddRotation(float x, float y, float z)
 	{
-		mRotation += vec3(x, y, z);
-		RebuildWorldMatrix();
+		SetRotation(GetRotation() + vec3(x, y, z));
 	}
 
 	void Object::SetPipeline(PipelineEnum pipeline)
@@ -63,24 +80,41 @@ namespace VulkanLib
 		mPipeline = pipeline;
 	}
 
+	void Object::SetSpatialIndex(LooseOctree* spatialIndex, int handle)
+	{
+		mSpatialIndex = spatialIndex;
+		mSpatialHandle = handle;
+	}
+
+	void Object::SetStaticBatch(StaticBatcher* staticBatch, int handle)
+	{
+		mStaticBatch = staticBatch;
+		mStaticBatchHandle = handle;
+	}
+
 	std::string Object::GetModel()
 	{
 		return mModelSource;
 	}
 
+	std::string Object::GetTexture()
+	{
+		return mTextureSource;
+	}
+
 	vec3 Object::GetPosition()
 	{
-		return mPosition;
+		return TransformSystem::GetDefault().GetPosition(mTransform);
 	}
 
 	vec3 Object::GetRotation()
 	{
-		return mRotation;
+		return TransformSystem::GetDefault().GetRotation(mTransform);
 	}
 
 	vec3 Object::GetScale()
 	{
-		return mScale;
+		return TransformSystem::GetDefault().GetScale(mTransform);
 	}
 
 	vec3 Object::GetColor()
@@ -90,7 +124,7 @@ namespace VulkanLib
 
 	mat4 Object::GetWorldMatrix()
 	{
-		return mWorld;
+		return TransformSystem::GetDefault().GetWorldMatrix(mTransform);
 	}
 
 	int Object::GetId()
@@ -98,20 +132,22 @@ namespace VulkanLib
 		return mId;
 	}
 
+	int Object::GetTransform()
+	{
+		return mTransform;
+	}
+
 	PipelineEnum Object::GetPipeline()
 	{
 		return mPipeline;
 	}
-	void Object::RebuildWorldMatrix()
+	// The world matrix is rebuilt by TransformSystem::Update() or when it's read
+	void Object::MarkMoved()
 	{
-		mat4 world;
-
-		world = glm::translate(world, mPosition);
-		world = glm::rotate(world, glm::radians(mRotation.x), vec3(1.0f, 0.0f, 0.0f));
-		world = glm::rotate(world, glm::radians(mRotation.y), vec3(0.0f, 1.0f, 0.0f));
-		world = glm::rotate(world, glm::radians(mRotation.z), vec3(0.0f, 0.0f, 1.0f));
-		world = glm::scale(world, mScale);
+		if (mSpatialIndex != nullptr)
+			mSpatialIndex->MarkMoved(mSpatialHandle);
 
-		mWorld = world;
+		if (mStaticBatch != nullptr)
+			mStaticBatch->MarkMoved(mStaticBatchHandle);
 	}
 }	// VulkanLib namespace
\ No newline at end of file
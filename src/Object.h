@@ -17,14 +17,22 @@ enum PipelineEnum {
 namespace VulkanLib
 {
 	class StaticModel;
+	class LooseOctree;
+	class StaticBatcher;
 
+	// The transform is stored in TransformSystem::GetDefault(), the object only keeps its handle
 	class Object
 	{
 	public:
 		Object(vec3 position);
 		~Object();
 
+		// The handle can't be shared
+		Object(const Object&) = delete;
+		Object& operator=(const Object&) = delete;
+
 		void SetModel(std::string modelSource);
+		void SetTexture(std::string textureSource);		// DDS, uses the default texture if not set
 		void SetPosition(vec3 position);
 		void SetRotation(vec3 rotation);
 		void SetScale(vec3 scale);
@@ -35,28 +43,40 @@ namespace VulkanLib
 
 		void SetPipeline(PipelineEnum pipeline);
 
+		// Set by LooseOctree::Insert(), the octree is told when the transform changes
+		void SetSpatialIndex(LooseOctree* spatialIndex, int handle);
+
+		// Set by StaticBatcher::Add(), the object leaves its batch when the transform changes
+		void SetStaticBatch(StaticBatcher* staticBatch, int handle);
+
 
 		std::string GetModel();
+		std::string GetTexture();
 		vec3 GetPosition();
 		vec3 GetRotation();
 		vec3 GetScale();
 		vec3 GetColor();
-		mat4 GetWorldMatrix();
+		mat4 GetWorldMatrix();		// As of the last TransformSystem::Update()
 		int GetId();
+		int GetTransform();		// The handle in TransformSystem::GetDefault()
 
 		PipelineEnum GetPipeline();
 	private:
-		void RebuildWorldMatrix();
+		void MarkMoved();
 
 	//	StaticModel* mModel;
 		std::string mModelSource;
-		mat4 mWorld;
-		vec3 mPosition;
-		vec3 mRotation;
-		vec3 mScale;
+		std::string mTextureSource;
+		int mTransform;
 		vec3 mColor;
 		int mId; 
 
 		PipelineEnum mPipeline;		
+
+		LooseOctree* mSpatialIndex;
+		int mSpatialHandle;
+
+		StaticBatcher* mStaticBatch;
+		int mStaticBatchHandle;
 	};
 }	// VulkanLib namespace
\ No newline at end of file
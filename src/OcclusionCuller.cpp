@@ -0,0 +1,422 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace VulkanLib
+{
+	// Signed distance to the clip planes, near first so the side planes only see positive w
+	static float ClipDistance(const vec4& vertex, int plane)
+	{
+		switch (plane)
+		{
+		case 0: return vertex.w - OCCLUSION_NEAR;
+		case 1: return vertex.w + vertex.x;
+		case 2: return vertex.w - vertex.x;
+		case 3: return vertex.w + vertex.y;
+		default: return vertex.w - vertex.y;
+		}
+	}
+
+	OcclusionCuller::OcclusionCuller()
+	{
+
+	}
+
+	void OcclusionCuller::Init(int width, int height, int numThreads)
+	{
+		mTilesX = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+		mTilesY = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+		mWidth = mTilesX * OCCLUSION_TILE_SIZE;
+		mHeight = mTilesY * OCCLUSION_TILE_SIZE;
+		mBlocksX = mWidth / OCCLUSION_BLOCK_SIZE;
+
+		mDepth.assign(mWidth * mHeight, FLT_MAX);
+		mBlockMaxDepth.assign(mBlocksX * (mHeight / OCCLUSION_BLOCK_SIZE), FLT_MAX);
+
+		mNumThreads = numThreads;
+
+		if (mNumThreads <= 0)
+			mNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		// The calling thread does the work itself when there only is one thread
+		if (mNumThreads > 1)
+			mThreadPool.setThreadCount(mNumThreads);
+
+		mThreadBins.resize(mNumThreads);
+		for (auto& bins : mThreadBins)
+			bins.tiles.resize(mTilesX * mTilesY);
+	}
+
+	void OcclusionCuller::Begin(const mat4& viewProjection)
+	{
+		mViewProjection = viewProjection;
+		mOccluders.clear();
+	}
+
+	void OcclusionCuller::AddOccluder(const OccluderMesh* mesh, const mat4& world)
+	{
+		mOccluders.push_back({ mesh, world });
+	}
+
+	void OcclusionCuller::Rasterize()
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		// Every thread sets up a contiguous range of the occluders into its own bins
+		RunOnThreads([=](int thread) {
+			ThreadBins& bins = mThreadBins[thread];
+			bins.triangles.clear();
+			for (auto& tile : bins.tiles)
+				tile.clear();
+
+			int first = mOccluders.size() * thread / mNumThreads;
+			int last = mOccluders.size() * (thread + 1) / mNumThreads;
+
+			for (int i = first; i < last; i++)
+				SetupOccluder(mOccluders[i], bins);
+		});
+
+		// The tiles are interleaved between the threads since the occluders are usually in the lower part of the screen
+		RunOnThreads([=](int thread) {
+			for (int tile = thread; tile < mTilesX * mTilesY; tile += mNumThreads)
+				RasterizeTile(tile);
+		});
+
+		mNumTriangles = 0;
+		for (auto& bins : mThreadBins)
+			mNumTriangles += bins.triangles.size();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mRasterizeTime = std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	void OcclusionCuller::RunOnThreads(std::function<void(int thread)> job)
+	{
+		if (mNumThreads == 1)
+		{
+			job(0);
+			return;
+		}
+
+		for (int t = 0; t < mNumThreads; t++)
+			mThreadPool.threads[t]->addJob([=] { job(t); });
+
+		mThreadPool.wait();
+	}
+
+	void OcclusionCuller::SetupOccluder(const Occluder& occluder, ThreadBins& bins)
+	{
+		mat4 transform = mViewProjection * occluder.world;
+		const OccluderMesh& mesh = *occluder.mesh;
+
+		bins.clipVertices.resize(mesh.vertices.size());
+		for (int i = 0; i < mesh.vertices.size(); i++)
+			bins.clipVertices[i] = transform * vec4(mesh.vertices[i], 1.0f);
+
+		for (int i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			// Sutherland-Hodgman against the near and the side planes, a triangle becomes at most 8 vertices
+			vec4 polygon[2][8];
+			int numVertices = 3;
+			int current = 0;
+
+			polygon[0][0] = bins.clipVertices[mesh.indices[i + 0]];
+			polygon[0][1] = bins.clipVertices[mesh.indices[i + 1]];
+			polygon[0][2] = bins.clipVertices[mesh.indices[i + 2]];
+
+			for (int plane = 0; plane < 5 && numVertices >= 3; plane++)
+			{
+				int numClipped = 0;
+
+				// Most triangles are completely on one side of the plane
+				int numInside = 0;
+				for (int v = 0; v < numVertices; v++)
+					numInside += ClipDistance(polygon[current][v], plane) >= 0.0f;
+
+				if (numInside == numVertices)
+					continue;
+
+				if (numInside == 0)
+				{
+					numVertices = 0;
+					break;
+				}
+
+				for (int v = 0; v < numVertices; v++)
+				{
+					const vec4& a = polygon[current][v];
+					const vec4& b = polygon[current][(v + 1) % numVertices];
+					float distanceA = ClipDistance(a, plane);
+					float distanceB = ClipDistance(b, plane);
+
+					if (distanceA >= 0.0f)
+						polygon[1 - current][numClipped++] = a;
+
+					if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+						polygon[1 - current][numClipped++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+				}
+
+				numVertices = numClipped;
+				current = 1 - current;
+			}
+
+			if (numVertices < 3)
+				continue;
+
+			// Screen position and 1 / w, the only value that is linear in screen space
+			vec3 screen[8];
+			for (int v = 0; v < numVertices; v++)
+			{
+				const vec4& clip = polygon[current][v];
+				float invW = 1.0f / clip.w;
+				screen[v] = vec3((clip.x * invW * 0.5f + 0.5f) * mWidth, (clip.y * invW * 0.5f + 0.5f) * mHeight, invW);
+			}
+
+			for (int v = 1; v + 1 < numVertices; v++)
+				SetupTriangle(screen[0], screen[v], screen[v + 1], bins);
+		}
+	}
+
+	void OcclusionCuller::SetupTriangle(vec3 v0, vec3 v1, vec3 v2, ThreadBins& bins)
+	{
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area == 0.0f)
+			return;
+
+		// Both sides are rasterized, the edge functions are flipped so the inside is positive
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		// The pixel centers inside the bounds
+		ScreenTriangle triangle;
+		triangle.minX = std::max(0, (int)ceilf(std::min(v0.x, std::min(v1.x, v2.x)) - 0.5f));
+		triangle.minY = std::max(0, (int)ceilf(std::min(v0.y, std::min(v1.y, v2.y)) - 0.5f));
+		triangle.maxX = std::min(mWidth - 1, (int)floorf(std::max(v0.x, std::max(v1.x, v2.x)) - 0.5f));
+		triangle.maxY = std::min(mHeight - 1, (int)floorf(std::max(v0.y, std::max(v1.y, v2.y)) - 0.5f));
+
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return;
+
+		// Edge i is opposite of vertex i so it's also the barycentric weight of vertex i
+		const vec3* vertices[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; i++)
+		{
+			const vec3& a = *vertices[(i + 1) % 3];
+			const vec3& b = *vertices[(i + 2) % 3];
+			triangle.edgeA[i] = a.y - b.y;
+			triangle.edgeB[i] = b.x - a.x;
+			triangle.edgeC[i] = -triangle.edgeA[i] * a.x - triangle.edgeB[i] * a.y;
+		}
+
+		triangle.invWA = (triangle.edgeA[0] * v0.z + triangle.edgeA[1] * v1.z + triangle.edgeA[2] * v2.z) / area;
+		triangle.invWB = (triangle.edgeB[0] * v0.z + triangle.edgeB[1] * v1.z + triangle.edgeB[2] * v2.z) / area;
+		triangle.invWC = (triangle.edgeC[0] * v0.z + triangle.edgeC[1] * v1.z + triangle.edgeC[2] * v2.z) / area;
+
+		// The furthest depth in the pixel instead of the depth at the center
+		triangle.invWC -= (fabsf(triangle.invWA) + fabsf(triangle.invWB)) * 0.5f;
+
+		int index = bins.triangles.size();
+		bins.triangles.push_back(triangle);
+
+		for (int tileY = triangle.minY / OCCLUSION_TILE_SIZE; tileY <= triangle.maxY / OCCLUSION_TILE_SIZE; tileY++)
+		{
+			for (int tileX = triangle.minX / OCCLUSION_TILE_SIZE; tileX <= triangle.maxX / OCCLUSION_TILE_SIZE; tileX++)
+				bins.tiles[tileX + tileY * mTilesX].push_back(index);
+		}
+	}
+
+	void OcclusionCuller::RasterizeTile(int tile)
+	{
+		int tileX = tile % mTilesX;
+		int tileY = tile / mTilesX;
+
+		for (int y = tileY * OCCLUSION_TILE_SIZE; y < (tileY + 1) * OCCLUSION_TILE_SIZE; y++)
+			std::fill_n(&mDepth[tileX * OCCLUSION_TILE_SIZE + y * mWidth], OCCLUSION_TILE_SIZE, FLT_MAX);
+
+		// In the order the threads binned them, the depth test makes the order irrelevant anyway
+		for (auto& bins : mThreadBins)
+		{
+			for (int index : bins.tiles[tile])
+				RasterizeTriangle(bins.triangles[index], tileX, tileY);
+		}
+
+		// The coarse level of the hierarchy
+		const int blocksPerTile = OCCLUSION_TILE_SIZE / OCCLUSION_BLOCK_SIZE;
+
+		for (int blockY = tileY * blocksPerTile; blockY < (tileY + 1) * blocksPerTile; blockY++)
+		{
+			for (int blockX = tileX * blocksPerTile; blockX < (tileX + 1) * blocksPerTile; blockX++)
+			{
+				__m128 maxDepth = _mm_setzero_ps();
+
+				for (int y = blockY * OCCLUSION_BLOCK_SIZE; y < (blockY + 1) * OCCLUSION_BLOCK_SIZE; y++)
+				{
+					for (int x = blockX * OCCLUSION_BLOCK_SIZE; x < (blockX + 1) * OCCLUSION_BLOCK_SIZE; x += 4)
+						maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(&mDepth[x + y * mWidth]));
+				}
+
+				float depths[4];
+				_mm_storeu_ps(depths, maxDepth);
+				mBlockMaxDepth[blockX + blockY * mBlocksX] = std::max(std::max(depths[0], depths[1]), std::max(depths[2], depths[3]));
+			}
+		}
+	}
+
+	void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int tileX, int tileY)
+	{
+		// Rows of 4 pixels, the tiles are a multiple of 4 wide so aligning down stays inside the tile
+		int minX = std::max(triangle.minX, tileX * OCCLUSION_TILE_SIZE) & ~3;
+		int maxX = std::min(triangle.maxX, (tileX + 1) * OCCLUSION_TILE_SIZE - 1);
+		int minY = std::max(triangle.minY, tileY * OCCLUSION_TILE_SIZE);
+		int maxY = std::min(triangle.maxY, (tileY + 1) * OCCLUSION_TILE_SIZE - 1);
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);		// The pixel centers
+
+		const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+		const __m128 invWA = _mm_set1_ps(triangle.invWA);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			float centerY = y + 0.5f;
+
+			// The part of the functions that is constant for the row
+			__m128 row0 = _mm_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+			__m128 row1 = _mm_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+			__m128 row2 = _mm_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+			__m128 rowInvW = _mm_set1_ps(triangle.invWB * centerY + triangle.invWC);
+
+			float* depthRow = &mDepth[y * mWidth];
+
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				__m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+				__m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, centerX), row0);
+				__m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, centerX), row1);
+				__m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, centerX), row2);
+
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 depth = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(invWA, centerX), rowInvW));
+				__m128 current = _mm_loadu_ps(&depthRow[x]);
+				depth = _mm_min_ps(depth, current);
+
+				// Only the pixels inside get the new depth
+				_mm_storeu_ps(&depthRow[x], _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+
+	bool OcclusionCuller::IsOccluded(const BoundingBox& worldBounds) const
+	{
+		float nearest = FLT_MAX;
+		vec2 screenMin = vec2(FLT_MAX);
+		vec2 screenMax = vec2(-FLT_MAX);
+
+		for (int i = 0; i < 8; i++)
+		{
+			vec3 corner = vec3(i & 1 ? worldBounds.max.x : worldBounds.min.x, i & 2 ? worldBounds.max.y : worldBounds.min.y, i & 4 ? worldBounds.max.z : worldBounds.min.z);
+			vec4 clip = mViewProjection * vec4(corner, 1.0f);
+
+			// Crosses the near plane, the screen bounds can't be computed
+			if (clip.w < OCCLUSION_NEAR)
+				return false;
+
+			vec2 screen = vec2((clip.x / clip.w * 0.5f + 0.5f) * mWidth, (clip.y / clip.w * 0.5f + 0.5f) * mHeight);
+			screenMin = glm::min(screenMin, screen);
+			screenMax = glm::max(screenMax, screen);
+			nearest = std::min(nearest, clip.w);
+		}
+
+		if (screenMax.x < 0.0f || screenMax.y < 0.0f || screenMin.x >= mWidth || screenMin.y >= mHeight)
+			return false;
+
+		// Every pixel the bounds touch
+		int minX = std::max(0, (int)screenMin.x);
+		int minY = std::max(0, (int)screenMin.y);
+		int maxX = std::min(mWidth - 1, (int)screenMax.x);
+		int maxY = std::min(mHeight - 1, (int)screenMax.y);
+
+		// Occluded where nearest > depth * OCCLUSION_DEPTH_BIAS
+		float nearestBiased = nearest / OCCLUSION_DEPTH_BIAS;
+		const __m128 nearestDepth = _mm_set1_ps(nearestBiased);
+
+		for (int blockY = minY / OCCLUSION_BLOCK_SIZE; blockY <= maxY / OCCLUSION_BLOCK_SIZE; blockY++)
+		{
+			for (int blockX = minX / OCCLUSION_BLOCK_SIZE; blockX <= maxX / OCCLUSION_BLOCK_SIZE; blockX++)
+			{
+				// Everything in the block is in front
+				if (nearestBiased > mBlockMaxDepth[blockX + blockY * mBlocksX])
+					continue;
+
+				// The pixels that are both in the block and the bounds, the extra pixels from aligning to 4 only make it more visible
+				int x0 = std::max(minX, blockX * OCCLUSION_BLOCK_SIZE) & ~3;
+				int x1 = std::min(maxX, (blockX + 1) * OCCLUSION_BLOCK_SIZE - 1);
+				int y0 = std::max(minY, blockY * OCCLUSION_BLOCK_SIZE);
+				int y1 = std::min(maxY, (blockY + 1) * OCCLUSION_BLOCK_SIZE - 1);
+
+				for (int y = y0; y <= y1; y++)
+				{
+					for (int x = x0; x <= x1; x += 4)
+					{
+						if (_mm_movemask_ps(_mm_cmple_ps(nearestDepth, _mm_loadu_ps(&mDepth[x + y * mWidth]))) != 0)
+							return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void OcclusionCuller::CreateBoxOccluder(const BoundingBox& box, OccluderMesh& mesh)
+	{
+		mesh.vertices.clear();
+		for (int i = 0; i < 8; i++)
+			mesh.vertices.push_back(vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z));
+
+		const uint32_t faces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+		mesh.indices.assign(faces, faces + 36);
+	}
+
+	float OcclusionCuller::GetDepth(int x, int y) const
+	{
+		return mDepth[x + y * mWidth];
+	}
+
+	int OcclusionCuller::GetWidth() const
+	{
+		return mWidth;
+	}
+
+	int OcclusionCuller::GetHeight() const
+	{
+		return mHeight;
+	}
+
+	int OcclusionCuller::GetNumThreads() const
+	{
+		return mNumThreads;
+	}
+
+	OcclusionStats OcclusionCuller::GetStats() const
+	{
+		OcclusionStats stats;
+		stats.numOccluders = mOccluders.size();
+		stats.numTriangles = mNumTriangles;
+		stats.rasterizeTime = mRasterizeTime;
+		return stats;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "Frustum.h"
+#include "ThreadPool.h"
+
+#define OCCLUSION_TILE_SIZE 32			// Pixels, the triangles are binned into tiles and every tile is rasterized by one thread
+#define OCCLUSION_BLOCK_SIZE 8			// Pixels, the max depth of every block is the coarse level of the hierarchy
+#define OCCLUSION_DEPTH_BIAS 1.001f		// An object must be this much further away than the occluders, hides the rounding of the depth
+#define OCCLUSION_NEAR 0.01f			// View space distance where the occluders are clipped
+
+namespace VulkanLib
+{
+	// Positions and indices of an occluder, a simplified mesh or a box that is inside of the object it belongs to
+	struct OccluderMesh
+	{
+		std::vector<vec3>		vertices;
+		std::vector<uint32_t>	indices;
+	};
+
+	struct OcclusionStats
+	{
+		int						numOccluders;
+		int						numTriangles;		// Inside the screen and in front of the camera
+		double					rasterizeTime;		// Milliseconds spent in the last Rasterize()
+	};
+
+	/*
+		Software occlusion culling with a low resolution depth buffer
+
+		The occluders of a frame are transformed and set up on the worker threads. The triangles are clipped to the
+		frustum so the edge functions stay precise close to the camera and then binned into the OCCLUSION_TILE_SIZE
+		tiles their screen bounds overlap. Each thread then rasterizes whole tiles, a tile is only written by one
+		thread so there are no locks. The edge functions and the depth of 4 pixels are evaluated at once with SSE and
+		the depth is the view space distance (w) so it has the same precision near and far.
+
+		When a tile is done the max depth of every OCCLUSION_BLOCK_SIZE block is stored. An object is occluded when its
+		closest point is further away than the max depth of all the pixels its screen bounds cover. The blocks are
+		tested first and only the blocks where an occluder isn't clearly in front are tested pixel by pixel.
+
+		Objects that cross the near plane or that are outside the screen are never occluded. The coverage is sampled
+		at the pixel centers like on the GPU while the depth is the furthest depth of the triangle in the pixel, so an
+		object can only be culled wrongly where it's visible through a gap that is smaller than a pixel. The occluders
+		must be inside the objects they belong to.
+
+		IsOccluded() only reads the depth so any number of threads can test objects after Rasterize().
+	*/
+	class OcclusionCuller
+	{
+	public:
+		OcclusionCuller();
+
+		// The size is rounded up to whole tiles
+		void Init(int width, int height, int numThreads = 0);		// 0 = one thread per hardware thread
+
+		// Clears the occluders, the mesh must be valid until Rasterize()
+		void Begin(const mat4& viewProjection);
+		void AddOccluder(const OccluderMesh* mesh, const mat4& world);
+		void Rasterize();
+
+		bool IsOccluded(const BoundingBox& worldBounds) const;
+
+		// 12 triangles, can be used as the occluder of objects that are boxes
+		static void CreateBoxOccluder(const BoundingBox& box, OccluderMesh& mesh);
+
+		float GetDepth(int x, int y) const;		// FLT_MAX where nothing was drawn
+		int GetWidth() const;
+		int GetHeight() const;
+		int GetNumThreads() const;
+		OcclusionStats GetStats() const;
+
+	private:
+		struct Occluder
+		{
+			const OccluderMesh*	mesh;
+			mat4				world;
+		};
+
+		// Edge functions e(x, y) = a * x + b * y + c are >= 0 inside, the depth is 1 / (invW(x, y))
+		struct ScreenTriangle
+		{
+			float				edgeA[3], edgeB[3], edgeC[3];
+			float				invWA, invWB, invWC;
+			int					minX, minY, maxX, maxY;		// Pixels, inclusive
+		};
+
+		// Everything one thread binned, the tiles read the bins of all the threads
+		struct ThreadBins
+		{
+			std::vector<ScreenTriangle>		triangles;
+			std::vector<std::vector<int>>	tiles;
+			std::vector<vec4>				clipVertices;
+		};
+
+		// Runs the job once for every thread and waits for all of them
+		void RunOnThreads(std::function<void(int thread)> job);
+
+		void SetupOccluder(const Occluder& occluder, ThreadBins& bins);
+		void SetupTriangle(vec3 v0, vec3 v1, vec3 v2, ThreadBins& bins);
+		void RasterizeTile(int tile);
+		void RasterizeTriangle(const ScreenTriangle& triangle, int tileX, int tileY);
+
+		int						mWidth = 0;
+		int						mHeight = 0;
+		int						mTilesX = 0;
+		int						mTilesY = 0;
+		int						mBlocksX = 0;
+
+		mat4					mViewProjection;
+		std::vector<Occluder>	mOccluders;
+		std::vector<ThreadBins>	mThreadBins;
+		std::vector<float>		mDepth;				// Row major, view space distance
+		std::vector<float>		mBlockMaxDepth;
+
+		int						mNumTriangles = 0;
+		double					mRasterizeTime = 0.0;
+
+		ThreadPool				mThreadPool;
+		int						mNumThreads = 1;
+	};
+}	// VulkanLib namespace
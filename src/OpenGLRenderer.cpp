@@ -1,6 +1,7 @@
 #include "OpenGLRenderer.h"
 #include "Window.h"
 #include "Camera.h"
+#include "TransformSystem.h"
 #include <GL/glew.h>
 #include <gl/glu.h>
 #include <glm/glm.hpp>
@@ -44,6 +45,7 @@ namespace VulkanLib
 	void OpenGLRenderer::Init()
 	{
 		// Create a mat4 array with every objects world matrix
+		TransformSystem::GetDefault().Update(nullptr);
 		std::vector<glm::mat4> modelMatrices;
 		for (int i = 0; i < mModels.size(); i++)
 			modelMatrices.push_back(mModels[i].object->GetWorldMatrix());
@@ -94,6 +96,9 @@ namespace VulkanLib
 		// clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// The world matrices of the objects that moved
+		TransformSystem::GetDefault().Update(nullptr);
+
 		glm::mat4 world = glm::mat4();
 		glUniformMatrix4fv(glGetUniformLocation(program, "gWorld"), 1, GL_FALSE, glm::value_ptr(world));							// World
 		glUniformMatrix4fv(glGetUniformLocation(program, "gView"), 1, GL_FALSE, glm::value_ptr(mCamera->GetView()));				// View
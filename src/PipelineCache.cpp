@@ -0,0 +1,144 @@
+#include "PipelineCache.h"
+#include "MappedFile.h"
+#include "VulkanDebug.h"
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+// The header that is first in the data from vkGetPipelineCacheData(), see VkPipelineCacheHeaderVersion
+#define PIPELINE_CACHE_HEADER_SIZE (16 + VK_UUID_SIZE)
+
+namespace VulkanLib
+{
+	PipelineCache::PipelineCache()
+	{
+
+	}
+
+	void PipelineCache::Init(VkDevice device, VkPhysicalDevice physicalDevice, std::string filename)
+	{
+		mDevice = device;
+		mFilename = filename;
+		vkGetPhysicalDeviceProperties(physicalDevice, &mDeviceProperties);
+
+		// The mapping only has to live until vkCreatePipelineCache() has copied the data
+		MappedFile file;
+		mWarm = file.Open(filename) && IsCompatible(file.GetData(), file.GetSize());
+
+		VkPipelineCacheCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = mWarm ? file.GetSize() : 0;
+		createInfo.pInitialData = mWarm ? file.GetData() : nullptr;
+
+		VkResult result = vkCreatePipelineCache(mDevice, &createInfo, nullptr, &mPipelineCache);
+
+		// The driver can still reject the data, start with an empty cache instead
+		if (result != VK_SUCCESS && mWarm)
+		{
+			VulkanDebug::ConsolePrint("Pipeline cache data rejected by the driver: " + filename);
+			mWarm = false;
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			result = vkCreatePipelineCache(mDevice, &createInfo, nullptr, &mPipelineCache);
+		}
+
+		VulkanDebug::ErrorCheck(result);
+
+		if (!mWarm)
+			VulkanDebug::ConsolePrint("Pipeline cache is cold: " + filename);
+	}
+
+	void PipelineCache::Cleanup()
+	{
+		if (mPipelineCache == VK_NULL_HANDLE)
+			return;
+
+		Save();
+
+		vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
+		mPipelineCache = VK_NULL_HANDLE;
+	}
+
+	bool PipelineCache::Save()
+	{
+		size_t size = 0;
+		if (vkGetPipelineCacheData(mDevice, mPipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+			return false;
+
+		std::vector<uint8_t> data(size);
+		if (vkGetPipelineCacheData(mDevice, mPipelineCache, &size, data.data()) != VK_SUCCESS)
+			return false;
+
+		std::string tempFilename = mFilename + ".tmp";
+		FILE* file = fopen(tempFilename.c_str(), "wb");
+		if (file == nullptr)
+		{
+			VulkanDebug::ConsolePrint("Error saving pipeline cache: " + tempFilename);
+			return false;
+		}
+
+		bool written = fwrite(data.data(), 1, size, file) == size;
+		written = (fclose(file) == 0) && written;
+
+		// Replacing the file with a rename is atomic, either the old or the new cache is on disk
+#if defined(_WIN32)
+		bool renamed = written && MoveFileExA(tempFilename.c_str(), mFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		bool renamed = written && rename(tempFilename.c_str(), mFilename.c_str()) == 0;
+#endif
+
+		if (!renamed)
+		{
+			remove(tempFilename.c_str());
+			VulkanDebug::ConsolePrint("Error saving pipeline cache: " + mFilename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool PipelineCache::IsCompatible(const uint8_t* data, size_t size)
+	{
+		if (size < PIPELINE_CACHE_HEADER_SIZE)
+			return false;
+
+		// Every field is a little endian uint32_t followed by the UUID
+		uint32_t header[4];
+		memcpy(header, data, sizeof(header));
+
+		const uint32_t headerLength = header[0];
+		const uint32_t headerVersion = header[1];
+		const uint32_t vendorID = header[2];
+		const uint32_t deviceID = header[3];
+
+		if (headerLength < PIPELINE_CACHE_HEADER_SIZE || headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+		{
+			VulkanDebug::ConsolePrint("Pipeline cache has an unknown header: " + mFilename);
+			return false;
+		}
+
+		if (vendorID != mDeviceProperties.vendorID || deviceID != mDeviceProperties.deviceID ||
+			memcmp(data + 16, mDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			VulkanDebug::ConsolePrint("Pipeline cache is from another device or driver: " + mFilename);
+			return false;
+		}
+
+		return true;
+	}
+
+	VkPipelineCache PipelineCache::GetVkPipelineCache()
+	{
+		return mPipelineCache;
+	}
+
+	bool PipelineCache::IsWarm()
+	{
+		return mWarm;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace VulkanLib
+{
+	/*
+		VkPipelineCache that is stored on disk between runs
+
+		Without a cache the driver compiles every shader to machine code each time a pipeline is created. Init()
+		creates the cache from the file written by the previous run so the compiled pipelines can be reused. The
+		data is only used if the header matches the vendor, device and pipelineCacheUUID of the physical device,
+		a new driver version changes the UUID so an old file is simply replaced.
+
+		Save() writes the cache to a temporary file and then renames it over the old one, so a crash while saving
+		never leaves a half written cache behind.
+	*/
+	class PipelineCache
+	{
+	public:
+		PipelineCache();
+
+		void Init(VkDevice device, VkPhysicalDevice physicalDevice, std::string filename);
+		void Cleanup();		// Calls Save()
+
+		bool Save();
+
+		VkPipelineCache GetVkPipelineCache();
+
+		// True if valid data was loaded from the file
+		bool IsWarm();
+
+	private:
+		bool IsCompatible(const uint8_t* data, size_t size);
+
+		VkDevice						mDevice = VK_NULL_HANDLE;
+		VkPipelineCache					mPipelineCache = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties		mDeviceProperties;
+		std::string						mFilename;
+		bool							mWarm = false;
+	};
+}	// VulkanLib namespace
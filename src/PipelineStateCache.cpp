@@ -0,0 +1,332 @@
+#include "PipelineStateCache.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+namespace VulkanLib
+{
+	static void HashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+
+	template <typename T>
+	static void HashValue(uint64_t& hash, const T& value)
+	{
+		HashBytes(hash, &value, sizeof(T));
+	}
+
+	uint64_t PipelineState::GetHash() const
+	{
+		uint64_t hash = FNV_OFFSET_BASIS;
+
+		// The length keeps "ab" + "c" and "a" + "bc" apart
+		HashValue(hash, vertexShader.size());
+		HashBytes(hash, vertexShader.data(), vertexShader.size());
+		HashValue(hash, fragmentShader.size());
+		HashBytes(hash, fragmentShader.data(), fragmentShader.size());
+
+		HashValue(hash, polygonMode);
+		HashValue(hash, cullMode);
+		HashValue(hash, frontFace);
+		HashValue(hash, depthTest);
+		HashValue(hash, depthWrite);
+		HashValue(hash, depthCompareOp);
+		HashValue(hash, colorWrite);
+		HashValue(hash, blendEnable);
+		HashValue(hash, srcBlendFactor);
+		HashValue(hash, dstBlendFactor);
+
+		HashValue(hash, specialization.size());
+		HashBytes(hash, specialization.data(), specialization.size() * sizeof(uint32_t));
+
+		if (vertexDescription != nullptr)
+		{
+			VkPipelineVertexInputStateCreateInfo inputState = vertexDescription->GetInputState();
+			for (uint32_t i = 0; i < inputState.vertexBindingDescriptionCount; i++)
+			{
+				const VkVertexInputBindingDescription& binding = inputState.pVertexBindingDescriptions[i];
+				HashValue(hash, binding.binding);
+				HashValue(hash, binding.stride);
+				HashValue(hash, binding.inputRate);
+			}
+
+			for (uint32_t i = 0; i < inputState.vertexAttributeDescriptionCount; i++)
+			{
+				const VkVertexInputAttributeDescription& attribute = inputState.pVertexAttributeDescriptions[i];
+				HashValue(hash, attribute.location);
+				HashValue(hash, attribute.binding);
+				HashValue(hash, attribute.format);
+				HashValue(hash, attribute.offset);
+			}
+		}
+
+		HashValue(hash, layout);
+		HashValue(hash, renderPass);
+
+		return hash;
+	}
+
+	PipelineStateCache::PipelineStateCache()
+	{
+
+	}
+
+	void PipelineStateCache::Init(VulkanBase* vulkanBase, int numThreads)
+	{
+		mVulkanBase = vulkanBase;
+		mDevice = vulkanBase->GetDevice();
+
+		if (numThreads <= 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		mThreadPool.setThreadCount(numThreads);
+	}
+
+	void PipelineStateCache::Cleanup()
+	{
+		// The worker threads can't be using the device when the pipelines are destroyed
+		mThreadPool.wait();
+		mThreadPool.setThreadCount(0);
+
+		for (auto& cachedPipeline : mPipelines)
+			vkDestroyPipeline(mDevice, cachedPipeline.second->pipeline, nullptr);
+
+		mPipelines.clear();
+		mShaderStages.clear();		// The shader modules are destroyed by VulkanBase
+	}
+
+	PipelineHandle PipelineStateCache::Request(const PipelineState& state, PipelineHandle fallback)
+	{
+		bool added = false;
+		CachedPipeline* cachedPipeline = FindOrAdd(state, added);
+
+		if (added)
+		{
+			cachedPipeline->fallback = fallback;
+			mNumPending++;
+
+			mThreadPool.threads[mNextThread]->addJob([=] { Compile(cachedPipeline); });
+			mNextThread = (mNextThread + 1) % mThreadPool.threads.size();
+		}
+
+		return cachedPipeline;
+	}
+
+	PipelineHandle PipelineStateCache::Create(const PipelineState& state)
+	{
+		bool added = false;
+		CachedPipeline* cachedPipeline = FindOrAdd(state, added);
+
+		if (added)
+		{
+			mNumPending++;
+			Compile(cachedPipeline);
+		}
+		else if (cachedPipeline->pipeline == VK_NULL_HANDLE)
+		{
+			// Already requested on a worker thread
+			Wait();
+		}
+
+		return cachedPipeline;
+	}
+
+	VkPipeline PipelineStateCache::GetPipeline(PipelineHandle handle)
+	{
+		VkPipeline pipeline = handle->pipeline.load(std::memory_order_acquire);
+
+		if (pipeline == VK_NULL_HANDLE && handle->fallback != nullptr)
+			pipeline = handle->fallback->pipeline.load(std::memory_order_acquire);
+
+		return pipeline;
+	}
+
+	bool PipelineStateCache::IsReady(PipelineHandle handle)
+	{
+		return handle->pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+	}
+
+	void PipelineStateCache::Wait()
+	{
+		mThreadPool.wait();
+	}
+
+	int PipelineStateCache::GetNumPipelines()
+	{
+		return mPipelines.size();
+	}
+
+	int PipelineStateCache::GetNumPending()
+	{
+		return mNumPending;
+	}
+
+	CachedPipeline* PipelineStateCache::FindOrAdd(const PipelineState& state, bool& added)
+	{
+		// 64 bit hashes, a collision is unlikely enough to be ignored
+		uint64_t hash = state.GetHash();
+
+		auto iter = mPipelines.find(hash);
+		if (iter != mPipelines.end())
+		{
+			added = false;
+			return iter->second.get();
+		}
+
+		CachedPipeline* cachedPipeline = new CachedPipeline();
+		cachedPipeline->state = state;
+		cachedPipeline->hash = hash;
+
+		auto loadShader = [&](std::string filename, VkShaderStageFlagBits stage) {
+			auto shaderIter = mShaderStages.find(filename);
+			if (shaderIter != mShaderStages.end())
+				return shaderIter->second;
+
+			VkPipelineShaderStageCreateInfo shaderStage = mVulkanBase->LoadShader(filename, stage);
+			mShaderStages[filename] = shaderStage;
+			return shaderStage;
+		};
+
+		cachedPipeline->shaderStages[0] = loadShader(state.vertexShader, VK_SHADER_STAGE_VERTEX_BIT);
+		if (!state.fragmentShader.empty())
+			cachedPipeline->shaderStages[1] = loadShader(state.fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		mPipelines[hash] = std::unique_ptr<CachedPipeline>(cachedPipeline);
+
+		added = true;
+		return cachedPipeline;
+	}
+
+	void PipelineStateCache::Compile(CachedPipeline* cachedPipeline)
+	{
+		const PipelineState& state = cachedPipeline->state;
+
+		// Input assembly state
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+		inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		// Rasterization state
+		VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+		rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizationState.polygonMode = state.polygonMode;
+		rasterizationState.cullMode = state.cullMode;
+		rasterizationState.frontFace = state.frontFace;
+		rasterizationState.depthClampEnable = VK_FALSE;
+		rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+		rasterizationState.depthBiasEnable = VK_FALSE;
+		rasterizationState.lineWidth = 1.0f;
+
+		// Color blend state
+		VkPipelineColorBlendAttachmentState blendAttachmentState = {};
+		blendAttachmentState.colorWriteMask = state.colorWrite ? 0xf : 0;
+		blendAttachmentState.blendEnable = state.blendEnable ? VK_TRUE : VK_FALSE;
+		blendAttachmentState.srcColorBlendFactor = state.srcBlendFactor;
+		blendAttachmentState.dstColorBlendFactor = state.dstBlendFactor;
+		blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+		blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+		VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+		colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlendState.attachmentCount = 1;
+		colorBlendState.pAttachments = &blendAttachmentState;
+
+		// Viewport state, set dynamically
+		VkPipelineViewportStateCreateInfo viewportState = {};
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		VkDynamicState dynamicStateEnables[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamicState = {};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.pDynamicStates = dynamicStateEnables;
+		dynamicState.dynamicStateCount = 2;
+
+		// Depth and stencil state
+		VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+		depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencilState.depthTestEnable = state.depthTest ? VK_TRUE : VK_FALSE;
+		depthStencilState.depthWriteEnable = state.depthWrite ? VK_TRUE : VK_FALSE;
+		depthStencilState.depthCompareOp = state.depthCompareOp;
+		depthStencilState.depthBoundsTestEnable = VK_FALSE;
+		depthStencilState.back.failOp = VK_STENCIL_OP_KEEP;
+		depthStencilState.back.passOp = VK_STENCIL_OP_KEEP;
+		depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
+		depthStencilState.stencilTestEnable = VK_FALSE;			// Stencil disabled
+		depthStencilState.front = depthStencilState.back;
+
+		// Multi sampling state
+		VkPipelineMultisampleStateCreateInfo multisampleState = {};
+		multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;		// Multi sampling not used
+
+		VkPipelineVertexInputStateCreateInfo vertexInputState = state.vertexDescription->GetInputState();
+
+		// Lets the driver compile the variant as if the constants were written in the shader
+		std::vector<VkSpecializationMapEntry> specializationEntries(state.specialization.size());
+		for (uint32_t i = 0; i < specializationEntries.size(); i++)
+		{
+			specializationEntries[i].constantID = i;
+			specializationEntries[i].offset = i * sizeof(uint32_t);
+			specializationEntries[i].size = sizeof(uint32_t);
+		}
+
+		VkSpecializationInfo specializationInfo = {};
+		specializationInfo.mapEntryCount = specializationEntries.size();
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = state.specialization.size() * sizeof(uint32_t);
+		specializationInfo.pData = state.specialization.data();
+
+		VkPipelineShaderStageCreateInfo shaderStages[2] = { cachedPipeline->shaderStages[0], cachedPipeline->shaderStages[1] };
+		if (!state.specialization.empty())
+		{
+			shaderStages[0].pSpecializationInfo = &specializationInfo;
+			shaderStages[1].pSpecializationInfo = &specializationInfo;
+		}
+
+		VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineCreateInfo.layout = state.layout;
+		pipelineCreateInfo.renderPass = state.renderPass;
+		pipelineCreateInfo.pVertexInputState = &vertexInputState;
+		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+		pipelineCreateInfo.pRasterizationState = &rasterizationState;
+		pipelineCreateInfo.pColorBlendState = &colorBlendState;
+		pipelineCreateInfo.pViewportState = &viewportState;
+		pipelineCreateInfo.pDynamicState = &dynamicState;
+		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+		pipelineCreateInfo.pMultisampleState = &multisampleState;
+		pipelineCreateInfo.stageCount = state.fragmentShader.empty() ? 1 : 2;
+		pipelineCreateInfo.pStages = shaderStages;
+
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VulkanDebug::ErrorCheck(vkCreateGraphicsPipelines(mDevice, mVulkanBase->GetPipelineCache(), 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+		auto end = std::chrono::high_resolution_clock::now();
+		cachedPipeline->compileTime = std::chrono::duration<double, std::milli>(end - begin).count();
+
+		cachedPipeline->pipeline.store(pipeline, std::memory_order_release);
+		mNumPending--;
+
+		// Several worker threads can finish at the same time
+		char hash[17];
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)cachedPipeline->hash);
+
+		std::lock_guard<std::mutex> lock(mPrintMutex);
+		VulkanDebug::ConsolePrint("Pipeline " + std::string(hash) + " compiled in " + std::to_string(cachedPipeline->compileTime) + " ms (" + state.vertexShader + ", " + state.fragmentShader + ")");
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include "ThreadPool.h"
+#include "VertexDescription.h"
+
+namespace VulkanLib
+{
+	class VulkanBase;
+
+	// Everything that differs between the graphics pipelines, the rest of the states are the same for all of them
+	struct PipelineState
+	{
+		std::string				vertexShader;
+		std::string				fragmentShader;			// Empty for depth only pipelines
+
+		// Rasterization
+		VkPolygonMode			polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags			cullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace				frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		// Depth
+		bool					depthTest = true;
+		bool					depthWrite = true;
+		VkCompareOp				depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+		// Blending of the color attachment
+		bool					colorWrite = true;		// Must be false without a fragment shader
+		bool					blendEnable = false;
+		VkBlendFactor			srcBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		VkBlendFactor			dstBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+
+		// Specialization constants of both shader stages, constant_id i is set to specialization[i]
+		// bool constants are VkBool32 so every constant is 4 bytes
+		std::vector<uint32_t>	specialization;
+
+		VertexDescription*		vertexDescription = nullptr;	// Must outlive the pipeline creation
+		VkPipelineLayout		layout = VK_NULL_HANDLE;
+		VkRenderPass			renderPass = VK_NULL_HANDLE;
+
+		// FNV-1a of all the fields, the vertex layout is hashed by its bindings and attributes and not by the pointer
+		uint64_t GetHash() const;
+	};
+
+	struct CachedPipeline
+	{
+		PipelineState					state;
+		uint64_t						hash = 0;
+		std::atomic<VkPipeline>			pipeline{ VK_NULL_HANDLE };	// Until compiled
+		const CachedPipeline*			fallback = nullptr;
+		double							compileTime = 0.0;	// Milliseconds
+
+		// Loaded on the thread that requested the pipeline, VulkanBase::LoadShader() isn't thread safe
+		VkPipelineShaderStageCreateInfo	shaderStages[2];
+	};
+
+	typedef const CachedPipeline* PipelineHandle;
+
+	/*
+		Creates graphics pipelines on demand from a PipelineState
+
+		The states are hashed and every unique state is only created once, asking for the same state again returns
+		the same handle. Request() returns right away and compiles the pipeline on one of the worker threads, until
+		it's done GetPipeline() returns the fallback pipeline so the frames keep being drawn with a simpler shader
+		instead of stalling. The fallback has to be created with Create() since it must be valid right away, and it
+		must use the same layout and vertex format as the pipelines that fall back to it.
+
+		All pipelines are created with the pipeline cache of VulkanBase, VkPipelineCache is internally synchronized
+		so the worker threads share it. The compile time of every pipeline is printed when it's ready.
+
+		Request() and Create() must be called from the same thread, GetPipeline() can be called from any thread.
+	*/
+	class PipelineStateCache
+	{
+	public:
+		PipelineStateCache();
+
+		void Init(VulkanBase* vulkanBase, int numThreads = 0);		// 0 = one thread per hardware thread
+		void Cleanup();
+
+		// Compiles the pipeline on a worker thread if it doesn't exist
+		PipelineHandle Request(const PipelineState& state, PipelineHandle fallback);
+
+		// Compiles the pipeline on the calling thread if it doesn't exist
+		PipelineHandle Create(const PipelineState& state);
+
+		// The compiled pipeline or the fallback if it isn't ready yet
+		VkPipeline GetPipeline(PipelineHandle handle);
+
+		bool IsReady(PipelineHandle handle);
+
+		// Waits for all requested pipelines to be compiled, used before recording command buffers that are never recorded again
+		void Wait();
+
+		int GetNumPipelines();
+		int GetNumPending();
+
+	private:
+		CachedPipeline* FindOrAdd(const PipelineState& state, bool& added);
+		void Compile(CachedPipeline* cachedPipeline);
+
+		VulkanBase*														mVulkanBase = nullptr;
+		VkDevice														mDevice = VK_NULL_HANDLE;
+
+		std::unordered_map<uint64_t, std::unique_ptr<CachedPipeline>>	mPipelines;
+		std::map<std::string, VkPipelineShaderStageCreateInfo>			mShaderStages;		// Every shader file is only loaded once
+
+		ThreadPool														mThreadPool;
+		int																mNextThread = 0;
+		std::atomic<int>												mNumPending{ 0 };
+		std::mutex														mPrintMutex;
+	};
+}	// VulkanLib namespace
@@ -14,7 +14,7 @@ namespace VulkanLib
 	{
 	public:
 		Renderer();
-		~Renderer();
+		virtual ~Renderer();
 		
 		virtual void Cleanup() = 0;
 		virtual void SetupMultithreading(int numThreads) = 0;
@@ -0,0 +1,196 @@
+#include "SceneQuery.h"
+#include "LooseOctree.h"
+#include "StaticModel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace VulkanLib
+{
+	SceneQuery::SceneQuery(LooseOctree* octree)
+	{
+		mOctree = octree;
+	}
+
+	bool SceneQuery::RayCast(const Ray& ray, RayHit& hit, float maxDistance, bool exact)
+	{
+		struct Candidate
+		{
+			float			distance;		// Where the ray enters the bounds
+			OctreeObject	object;
+		};
+
+		vec3 inverseDirection = 1.0f / ray.direction;
+		float closest = maxDistance;
+		std::vector<Candidate> candidates;
+
+		hit = RayHit();
+
+		// The closest distance shrinks with every hit so the nodes and objects further away are skipped
+		mOctree->Query([&](const BoundingBox& box) {
+			float distance;
+			return IntersectBox(ray, inverseDirection, box, closest, distance);
+		}, [&](int handle, const OctreeObject& object) {
+			float distance;
+			if (!IntersectBox(ray, inverseDirection, object.worldBounds, closest, distance))
+				return;
+
+			if (exact && object.mesh != nullptr)
+			{
+				candidates.push_back({ distance, object });
+			}
+			else if (distance < closest)
+			{
+				closest = distance;
+				hit.object = object.object;
+			}
+		});
+
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+			return a.distance < b.distance;
+		});
+
+		for (auto& candidate : candidates)
+		{
+			// The rest of the candidates are entered after the closest hit
+			if (candidate.distance >= closest)
+				break;
+
+			float distance;
+			int triangle;
+			if (IntersectMesh(candidate.object, ray, closest, distance, triangle))
+			{
+				closest = distance;
+				hit.object = candidate.object.object;
+				hit.triangle = triangle;
+			}
+		}
+
+		if (hit.object == nullptr)
+			return false;
+
+		hit.distance = closest;
+		hit.position = ray.origin + ray.direction * closest;
+		return true;
+	}
+
+	int SceneQuery::OverlapSphere(vec3 center, float radius, std::vector<Object*>& objects)
+	{
+		objects.clear();
+
+		mOctree->Query([&](const BoundingBox& box) {
+			vec3 closestPoint = glm::clamp(center, box.min, box.max);
+			return dot(closestPoint - center, closestPoint - center) <= radius * radius;
+		}, [&](int handle, const OctreeObject& object) {
+			objects.push_back(object.object);
+		});
+
+		return objects.size();
+	}
+
+	int SceneQuery::OverlapBox(const BoundingBox& box, std::vector<Object*>& objects)
+	{
+		objects.clear();
+
+		mOctree->Query([&](const BoundingBox& other) {
+			return box.min.x <= other.max.x && box.max.x >= other.min.x &&
+				box.min.y <= other.max.y && box.max.y >= other.min.y &&
+				box.min.z <= other.max.z && box.max.z >= other.min.z;
+		}, [&](int handle, const OctreeObject& object) {
+			objects.push_back(object.object);
+		});
+
+		return objects.size();
+	}
+
+	bool SceneQuery::IntersectBox(const Ray& ray, vec3 inverseDirection, const BoundingBox& box, float maxDistance, float& distance)
+	{
+		float enter = 0.0f;
+		float exit = maxDistance;
+		distance = maxDistance;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// Parallel to the slab, 0 * inf would be NaN when the origin is on one of its planes
+			if (ray.direction[axis] == 0.0f)
+			{
+				if (ray.origin[axis] < box.min[axis] || ray.origin[axis] > box.max[axis])
+					return false;
+
+				continue;
+			}
+
+			float t0 = (box.min[axis] - ray.origin[axis]) * inverseDirection[axis];
+			float t1 = (box.max[axis] - ray.origin[axis]) * inverseDirection[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+
+		distance = enter;
+		return enter <= exit;
+	}
+
+	bool SceneQuery::IntersectTriangle(vec3 origin, vec3 direction, vec3 v0, vec3 v1, vec3 v2, float maxDistance, float& distance)
+	{
+		vec3 edge1 = v1 - v0;
+		vec3 edge2 = v2 - v0;
+		vec3 p = cross(direction, edge2);
+		float determinant = dot(edge1, p);
+
+		// The ray is parallel to the triangle
+		if (fabsf(determinant) < FLT_EPSILON * FLT_EPSILON)
+			return false;
+
+		float inverseDeterminant = 1.0f / determinant;
+		vec3 t = origin - v0;
+		float u = dot(t, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		vec3 q = cross(t, edge1);
+		float v = dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		float hitDistance = dot(edge2, q) * inverseDeterminant;
+		if (hitDistance < 0.0f || hitDistance >= maxDistance)
+			return false;
+
+		distance = hitDistance;
+		return true;
+	}
+
+	bool SceneQuery::IntersectMesh(const OctreeObject& object, const Ray& ray, float maxDistance, float& distance, int& triangle)
+	{
+		// The local direction isn't normalized so the distances stay in world units
+		mat4 inverseWorld = inverse(object.world);
+		vec3 origin = vec3(inverseWorld * vec4(ray.origin, 1.0f));
+		vec3 direction = vec3(inverseWorld * vec4(ray.direction, 0.0f));
+
+		bool found = false;
+		int firstTriangle = 0;
+
+		for (auto& mesh : object.mesh->mMeshes)
+		{
+			for (int i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				const vec3& v0 = mesh.vertices[mesh.indices[i + 0]].Pos;
+				const vec3& v1 = mesh.vertices[mesh.indices[i + 1]].Pos;
+				const vec3& v2 = mesh.vertices[mesh.indices[i + 2]].Pos;
+
+				float hitDistance;
+				if (IntersectTriangle(origin, direction, v0, v1, v2, maxDistance, hitDistance))
+				{
+					maxDistance = hitDistance;
+					distance = hitDistance;
+					triangle = firstTriangle + i / 3;
+					found = true;
+				}
+			}
+
+			firstTriangle += mesh.indices.size() / 3;
+		}
+
+		return found;
+	}
+}	// VulkanLib namespace
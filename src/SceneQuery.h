@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <cfloat>
+#include "Frustum.h"
+
+namespace VulkanLib
+{
+	class Object;
+	class LooseOctree;
+	struct OctreeObject;
+
+	struct Ray
+	{
+		Ray() : origin(0.0f), direction(0.0f, 0.0f, 1.0f) {}
+		Ray(vec3 origin, vec3 direction) : origin(origin), direction(normalize(direction)) {}
+
+		vec3 origin;
+		vec3 direction;		// Normalized
+	};
+
+	struct RayHit
+	{
+		Object*		object = nullptr;
+		float		distance = FLT_MAX;		// Along the ray
+		vec3		position;
+		int			triangle = -1;			// Counted over all the meshes of the model, -1 when only the bounds were tested
+	};
+
+	/*
+		Ray casts and overlap queries against the objects in a LooseOctree
+
+		The octree nodes are tested first so only the objects in the nodes the query touches are tested. RayCast() tests
+		the world bounds of the objects and can then test the triangles of the meshes exactly. For the exact test the ray
+		is transformed to the local space of the object instead of transforming every vertex to world space, an affine
+		transform keeps the ray parameter so the local hit distance is the world hit distance.
+
+		The exact candidates are sorted by where the ray enters their bounds, when the next candidate is entered further
+		away than the closest triangle hit the rest can't be closer and are skipped.
+
+		SceneQuery has no state of its own and the octree allows any number of queries at the same time, so every
+		thread can query through the same SceneQuery. The triangle tests run after the octree is unlocked.
+	*/
+	class SceneQuery
+	{
+	public:
+		SceneQuery(LooseOctree* octree);
+
+		// Returns true if the ray hits an object closer than maxDistance, exact tests the triangles of the objects that have a mesh
+		bool RayCast(const Ray& ray, RayHit& hit, float maxDistance = FLT_MAX, bool exact = false);
+
+		// The objects with world bounds that overlap, returns the number of objects
+		int OverlapSphere(vec3 center, float radius, std::vector<Object*>& objects);
+		int OverlapBox(const BoundingBox& box, std::vector<Object*>& objects);
+
+		// Slab test, distance is where the ray enters the box or 0 if the origin is inside
+		// An axis the ray is parallel to only checks that the origin is between the planes
+		static bool IntersectBox(const Ray& ray, vec3 inverseDirection, const BoundingBox& box, float maxDistance, float& distance);
+
+		// Moller-Trumbore, both sides of the triangle are hit
+		static bool IntersectTriangle(vec3 origin, vec3 direction, vec3 v0, vec3 v1, vec3 v2, float maxDistance, float& distance);
+
+	private:
+		bool IntersectMesh(const OctreeObject& object, const Ray& ray, float maxDistance, float& distance, int& triangle);
+
+		LooseOctree* mOctree;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,224 @@
+#include "StaticBatcher.h"
+#include "VulkanBase.h"
+#include "StaticModel.h"
+#include "Object.h"
+
+#include <map>
+#include <tuple>
+
+namespace VulkanLib
+{
+	StaticBatcher::StaticBatcher()
+	{
+	}
+
+	void StaticBatcher::Init(VulkanBase* vulkanBase)
+	{
+		mVulkanBase = vulkanBase;
+	}
+
+	void StaticBatcher::Cleanup()
+	{
+		for (auto& entry : mEntries)
+		{
+			if (entry.object != nullptr)
+				entry.object->SetStaticBatch(nullptr, -1);
+		}
+
+		for (auto& batch : mBatches)
+		{
+			vkDestroyBuffer(mVulkanBase->GetDevice(), batch.model->vertices.buffer, nullptr);
+			vkFreeMemory(mVulkanBase->GetDevice(), batch.model->vertices.memory, nullptr);
+			vkDestroyBuffer(mVulkanBase->GetDevice(), batch.model->indices.buffer, nullptr);
+			vkFreeMemory(mVulkanBase->GetDevice(), batch.model->indices.memory, nullptr);
+			delete batch.model;
+		}
+
+		mEntries.clear();
+		mMovedEntries.clear();
+		mBatches.clear();
+		mNumLeft = 0;
+	}
+
+	int StaticBatcher::Add(Object* object, StaticModel* mesh, int material)
+	{
+		Entry entry;
+		entry.object = object;
+		entry.mesh = mesh;
+		entry.material = material;
+		entry.batch = -1;
+		entry.firstIndex = 0;
+		entry.numIndices = 0;
+		entry.batched = false;
+		entry.moved = false;
+
+		int handle = mEntries.size();
+		mEntries.push_back(entry);
+
+		object->SetStaticBatch(this, handle);
+
+		return handle;
+	}
+
+	void StaticBatcher::Remove(int handle)
+	{
+		LeaveBatch(handle);
+	}
+
+	void StaticBatcher::Build()
+	{
+		// Every material in every cell is its own batch
+		std::map<std::tuple<int, int, int, int>, std::vector<int>> groups;
+
+		for (int handle = 0; handle < mEntries.size(); handle++)
+		{
+			Entry& entry = mEntries[handle];
+			if (entry.object == nullptr || entry.batch != -1)
+				continue;
+
+			vec3 center = entry.mesh->GetBoundingBox().Transform(entry.object->GetWorldMatrix()).GetCenter();
+			ivec3 cell = ivec3(glm::floor(center / STATIC_BATCH_CELL_SIZE));
+			groups[std::make_tuple(entry.material, cell.x, cell.y, cell.z)].push_back(handle);
+		}
+
+		// Models without normals or tangents have zero vectors
+		auto safeNormalize = [](vec3 v) {
+			float length = glm::length(v);
+			return length > 0.0f ? v / length : v;
+		};
+
+		for (auto& group : groups)
+		{
+			StaticBatch batch;
+			batch.material = std::get<0>(group.first);
+			batch.model = new StaticModel();
+			batch.objects = group.second;
+
+			Mesh merged;
+			for (int handle : group.second)
+			{
+				Entry& entry = mEntries[handle];
+				mat4 world = entry.object->GetWorldMatrix();
+				mat3 rotation = mat3(world);
+				mat3 normalMatrix = glm::transpose(glm::inverse(rotation));
+
+				entry.batch = mBatches.size();
+				entry.firstIndex = merged.indices.size();
+				entry.batched = true;
+
+				for (auto& mesh : entry.mesh->mMeshes)
+				{
+					uint32_t firstVertex = merged.vertices.size();
+					for (Vertex vertex : mesh.vertices)
+					{
+						vertex.Pos = vec3(world * vec4(vertex.Pos, 1.0f));
+						vertex.Normal = safeNormalize(normalMatrix * vertex.Normal);
+						vertex.Tangent = vec4(safeNormalize(rotation * vec3(vertex.Tangent)), vertex.Tangent.w);
+						merged.vertices.push_back(vertex);
+					}
+
+					for (auto index : mesh.indices)
+						merged.indices.push_back(firstVertex + index);
+				}
+
+				entry.numIndices = merged.indices.size() - entry.firstIndex;
+			}
+
+			batch.model->AddMesh(merged);
+			batch.model->BuildBuffers(mVulkanBase);
+			batch.worldBounds = batch.model->GetBoundingBox();
+
+			// The buffers and the bounds are all that is needed to draw the batch
+			batch.model->mMeshes.clear();
+
+			BuildRanges(batch);
+			mBatches.push_back(batch);
+		}
+	}
+
+	void StaticBatcher::MarkMoved(int handle)
+	{
+		if (!mEntries[handle].moved)
+		{
+			mEntries[handle].moved = true;
+			mMovedEntries.push_back(handle);
+		}
+	}
+
+	void StaticBatcher::UpdateMoved()
+	{
+		for (int handle : mMovedEntries)
+			LeaveBatch(handle);
+
+		mMovedEntries.clear();
+	}
+
+	bool StaticBatcher::IsBatched(int handle) const
+	{
+		return handle >= 0 && handle < mEntries.size() && mEntries[handle].batched;
+	}
+
+	int StaticBatcher::GetNumBatches() const
+	{
+		return mBatches.size();
+	}
+
+	const StaticBatch& StaticBatcher::GetBatch(int index) const
+	{
+		return mBatches[index];
+	}
+
+	StaticBatchStats StaticBatcher::GetStats() const
+	{
+		StaticBatchStats stats = {};
+		stats.numBatches = mBatches.size();
+		stats.numLeft = mNumLeft;
+
+		for (auto& entry : mEntries)
+		{
+			if (entry.batched)
+				stats.numBatchedObjects++;
+		}
+
+		for (auto& batch : mBatches)
+			stats.numRanges += batch.ranges.size();
+
+		return stats;
+	}
+
+	void StaticBatcher::LeaveBatch(int handle)
+	{
+		Entry& entry = mEntries[handle];
+
+		// The object isn't told about the batcher again, it's drawn on its own from now on
+		if (entry.object != nullptr)
+			entry.object->SetStaticBatch(nullptr, -1);
+
+		entry.object = nullptr;
+
+		if (entry.batched)
+		{
+			entry.batched = false;
+			mNumLeft++;
+			BuildRanges(mBatches[entry.batch]);
+		}
+	}
+
+	void StaticBatcher::BuildRanges(StaticBatch& batch)
+	{
+		batch.ranges.clear();
+
+		// Neighbours in the index buffer are merged into one range
+		for (int handle : batch.objects)
+		{
+			const Entry& entry = mEntries[handle];
+			if (!entry.batched)
+				continue;
+
+			if (batch.ranges.size() != 0 && batch.ranges.back().firstIndex + batch.ranges.back().numIndices == entry.firstIndex)
+				batch.ranges.back().numIndices += entry.numIndices;
+			else
+				batch.ranges.push_back({ entry.firstIndex, entry.numIndices });
+		}
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Frustum.h"
+
+#define STATIC_BATCH_CELL_SIZE 512.0f		// Objects are only merged with objects in the same grid cell, so the batches can be culled
+
+namespace VulkanLib
+{
+	class VulkanBase;
+	class Object;
+	class StaticModel;
+
+	// A run of indices of objects that are next to each other in the index buffer, one vkCmdDrawIndexed()
+	struct StaticBatchRange
+	{
+		uint32_t				firstIndex;
+		uint32_t				numIndices;
+	};
+
+	// The objects of one material in one grid cell, pre-transformed to world space
+	struct StaticBatch
+	{
+		int						material;			// From Add()
+		StaticModel*			model;				// Only the buffers and the bounds, the vertices are freed after Build()
+		BoundingBox				worldBounds;		// Of all the objects, also the ones that left
+		std::vector<int>		objects;			// Handles, in the order of their indices
+		std::vector<StaticBatchRange> ranges;		// The objects that are still in the batch
+	};
+
+	struct StaticBatchStats
+	{
+		int						numBatches;
+		int						numBatchedObjects;	// Still in a batch
+		int						numRanges;			// Draws if every batch is visible
+		int						numLeft;			// Moved out of their batch
+	};
+
+	/*
+		Merges static objects with the same material into one vertex and index buffer per grid cell
+
+		Add() registers the objects and Build() groups them by material and by the STATIC_BATCH_CELL_SIZE cell the
+		center of their bounds is in. The vertices of every group are transformed to world space once and the batch
+		is drawn with an identity world matrix, so a cell of hundreds of objects is one draw. Keeping the cells small
+		enough lets the frustum and occlusion culling still skip the batches that aren't visible.
+
+		Add() registers the batcher with Object::SetStaticBatch(), when an object moves it calls MarkMoved() and the
+		object leaves its batch in the next UpdateMoved(). The vertices stay in the buffers, the batch just stops
+		drawing their indices: every batch keeps the runs of indices of the objects that are left, so a batch with a
+		few objects that left is a few more draws. An object that left is drawn on its own again.
+
+		IsBatched() and the batches can be read from any thread, the changes must not run at the same time.
+	*/
+	class StaticBatcher
+	{
+	public:
+		StaticBatcher();
+
+		void Init(VulkanBase* vulkanBase);
+		void Cleanup();		// Destroys the batches, the objects are drawn on their own again
+
+		// Returns the handle of the object, objects with the same material can be merged
+		int Add(Object* object, StaticModel* mesh, int material);
+		void Remove(int handle);
+
+		// Merges the objects that were added since the last call
+		void Build();
+
+		// Queues the object to leave its batch, called by Object when its transform changes
+		void MarkMoved(int handle);
+		void UpdateMoved();
+
+		bool IsBatched(int handle) const;
+
+		int GetNumBatches() const;
+		const StaticBatch& GetBatch(int index) const;
+		StaticBatchStats GetStats() const;
+
+	private:
+		struct Entry
+		{
+			Object*				object;				// Null after Remove()
+			StaticModel*		mesh;
+			int					material;
+			int					batch;				// -1 until Build()
+			uint32_t			firstIndex;			// Into the index buffer of the batch
+			uint32_t			numIndices;
+			bool				batched;
+			bool				moved;
+		};
+
+		void LeaveBatch(int handle);
+		void BuildRanges(StaticBatch& batch);
+
+		VulkanBase*				mVulkanBase = nullptr;
+
+		std::vector<Entry>		mEntries;
+		std::vector<int>		mMovedEntries;
+		std::vector<StaticBatch> mBatches;
+
+		int						mNumLeft = 0;
+	};
+}	// VulkanLib namespace
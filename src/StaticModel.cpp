@@ -36,7 +36,12 @@ namespace VulkanLib
 				indexVector.push_back(mMeshes[meshId].indices[i]);
 		}
 
-		uint32_t vertexBufferSize = vertexVector.size() * sizeof(Vertex);
+		ComputeBounds();
+
+		std::vector<uint8_t> vertexData;
+		mAttributeOffset = SplitStreams(vertexVector, vertexData);
+
+		uint32_t vertexBufferSize = vertexData.size();
 		uint32_t indexBufferSize = indexVector.size() * sizeof(uint32_t);
 
 		mIndicesCount = indexVector.size();	// NOTE maybe not smart
@@ -62,7 +67,7 @@ namespace VulkanLib
 		vulkanBase->GetMemoryType(memoryRequirments.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memoryAllocation.memoryTypeIndex);		// Get memory type
 		VulkanDebug::ErrorCheck(vkAllocateMemory(vulkanBase->GetDevice(), &memoryAllocation, nullptr, &vertices.memory));							// Allocate device memory
 		VulkanDebug::ErrorCheck(vkMapMemory(vulkanBase->GetDevice(), vertices.memory, 0, memoryAllocation.allocationSize, 0, &data));				// Map device memory so the host can access it through data
-		memcpy(data, vertexVector.data(), vertexBufferSize);																						// Copy buffer data to the mapped data pointer
+		memcpy(data, vertexData.data(), vertexBufferSize);																							// Copy buffer data to the mapped data pointer
 		vkUnmapMemory(vulkanBase->GetDevice(), vertices.memory);																					// Unmap memory
 		VulkanDebug::ErrorCheck(vkBindBufferMemory(vulkanBase->GetDevice(), vertices.buffer, vertices.memory, 0));									// Bind the buffer to the allocated device memory
 
@@ -89,6 +94,37 @@ namespace VulkanLib
 		// The mMeshes vector with all the vertices and indices can now actually be destroyed, no need for it any more
 	}
 
+	void StaticModel::BindStreams(VkCommandBuffer commandBuffer, VertexDescription& vertexDescription)
+	{
+		// The streams have consecutive bindings so both are bound with one call
+		VkBuffer buffers[VERTEX_STREAM_COUNT] = { vertices.buffer, vertices.buffer };
+		VkDeviceSize offsets[VERTEX_STREAM_COUNT] = { 0, mAttributeOffset };
+		uint32_t numStreams = vertexDescription.HasBinding(VERTEX_STREAM_ATTRIBUTES) ? 2 : 1;
+
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_STREAM_POSITION, numStreams, buffers, offsets);
+	}
+
+	VkDeviceSize StaticModel::SplitStreams(const std::vector<Vertex>& vertices, std::vector<uint8_t>& data)
+	{
+		// The attribute stream starts 16 byte aligned
+		VkDeviceSize attributeOffset = (vertices.size() * sizeof(VertexPosition) + 15) & ~(VkDeviceSize)15;
+		data.resize(attributeOffset + vertices.size() * sizeof(VertexAttributes));
+
+		VertexPosition* positions = (VertexPosition*)data.data();
+		VertexAttributes* attributes = (VertexAttributes*)(data.data() + attributeOffset);
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			positions[i].Pos = vertices[i].Pos;
+			attributes[i].Color = vertices[i].Color;
+			attributes[i].Normal = vertices[i].Normal;
+			attributes[i].Tex = vertices[i].Tex;
+			attributes[i].Tangent = vertices[i].Tangent;
+		}
+
+		return attributeOffset;
+	}
+
 	int StaticModel::GetNumIndices()
 	{
 		return mIndicesCount;
@@ -98,4 +134,35 @@ namespace VulkanLib
 	{
 		return mVerticesCount;
 	}
+
+	void StaticModel::ComputeBounds()
+	{
+		// The sphere is centered in the box with the radius to the furthest vertex, tighter than the half diagonal
+		mBoundingBox = BoundingBox();
+		for (auto& mesh : mMeshes)
+		{
+			for (auto& vertex : mesh.vertices)
+				mBoundingBox.Add(vertex.Pos);
+		}
+
+		vec3 center = mBoundingBox.GetCenter();
+		float radiusSquared = 0.0f;
+		for (auto& mesh : mMeshes)
+		{
+			for (auto& vertex : mesh.vertices)
+				radiusSquared = glm::max(radiusSquared, glm::dot(vertex.Pos - center, vertex.Pos - center));
+		}
+
+		mBoundingSphere = BoundingSphere(center, sqrtf(radiusSquared));
+	}
+
+	const BoundingBox& StaticModel::GetBoundingBox()
+	{
+		return mBoundingBox;
+	}
+
+	const BoundingSphere& StaticModel::GetBoundingSphere()
+	{
+		return mBoundingSphere;
+	}
 }	// VulkanLib namespace
\ No newline at end of file
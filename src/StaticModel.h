@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <vulkan\vulkan.h>
 #include "base/vulkanTextureLoader.hpp"
+#include "VertexDescription.h"
+#include "Frustum.h"
 
 using namespace glm;
 
@@ -30,6 +32,30 @@ namespace VulkanLib
 		vec4 Tangent;
 	};
 
+	// Everything in Vertex except the position
+	struct VertexAttributes
+	{
+		vec3 Color;
+		vec3 Normal;
+		vec2 Tex;
+		vec4 Tangent;
+	};
+
+	typedef VertexLayout<VertexAttributes,
+		VERTEX_MEMBER(VertexAttributes, Color),
+		VERTEX_MEMBER(VertexAttributes, Normal),
+		VERTEX_MEMBER(VertexAttributes, Tex),
+		VERTEX_MEMBER(VertexAttributes, Tangent)> VertexAttributesLayout;
+
+	// The binding of each stream, the vertex buffer stores all the positions first and then all the attributes
+	// A pass that only needs the positions (depth, shadows, occlusion) fetches 12 bytes per vertex instead of 60
+	enum VertexStream
+	{
+		VERTEX_STREAM_POSITION,			// VertexPosition, tightly packed
+		VERTEX_STREAM_ATTRIBUTES,		// VertexAttributes
+		VERTEX_STREAM_COUNT
+	};
+
 	struct Mesh
 	{
 		std::vector<Vertex> vertices;
@@ -45,6 +71,12 @@ namespace VulkanLib
 		void AddMesh(Mesh& mesh);
 		void BuildBuffers(VulkanBase* vulkanBase);		// Gets called in ModelLoader::LoadModel()
 
+		// Only binds the streams that the pipeline with the vertex description reads
+		void BindStreams(VkCommandBuffer commandBuffer, VertexDescription& vertexDescription);
+
+		// Writes the position stream followed by the attribute stream, returns the offset of the attribute stream
+		static VkDeviceSize SplitStreams(const std::vector<Vertex>& vertices, std::vector<uint8_t>& data);
+
 		struct {
 			VkBuffer buffer;
 			VkDeviceMemory memory;
@@ -58,6 +90,13 @@ namespace VulkanLib
 		int GetNumIndices();
 		int GetNumVertics();
 
+		// Local space bounds of all the meshes, BuildBuffers() calls it but it doesn't need the device
+		void ComputeBounds();
+
+		// Local space, computed from the vertices in BuildBuffers()
+		const BoundingBox& GetBoundingBox();
+		const BoundingSphere& GetBoundingSphere();
+
 		vkTools::VulkanTexture* texture;
 
 		std::vector<Mesh> mMeshes;
@@ -65,5 +104,8 @@ namespace VulkanLib
 		
 		uint32_t mIndicesCount;
 		uint32_t mVerticesCount;
+		VkDeviceSize mAttributeOffset;	// Into the vertex buffer
+		BoundingBox mBoundingBox;
+		BoundingSphere mBoundingSphere;
 	};
 }	// VulkanLib namespace
\ No newline at end of file
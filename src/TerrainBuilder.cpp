@@ -0,0 +1,220 @@
+#include "TerrainBuilder.h"
+#include "StaticModel.h"
+#include "LoadTGA.h"
+
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace VulkanLib
+{
+	float HeightField::Get(int x, int z) const
+	{
+		x = std::min(std::max(x, 0), width - 1);
+		z = std::min(std::max(z, 0), height - 1);
+		return heights[x + z * width];
+	}
+
+	TerrainBuilder::TerrainBuilder(int numThreads)
+	{
+		mNumThreads = numThreads;
+
+		if (mNumThreads <= 0)
+			mNumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		// The calling thread does the work itself when there only is one thread
+		if (mNumThreads > 1)
+			mThreadPool.setThreadCount(mNumThreads);
+	}
+
+	bool TerrainBuilder::LoadHeightField(std::string filename, HeightField& heightField, float heightScale)
+	{
+		TextureData texture;
+		if (!LoadTGATextureData((char*)filename.c_str(), &texture))
+			return false;
+
+		int bytesPerPixel = texture.bpp / 8;
+
+		heightField.width = texture.width;
+		heightField.height = texture.height;
+		heightField.heights.resize(texture.width * texture.height);
+
+		// Only the first channel is used
+		for (int i = 0; i < heightField.heights.size(); i++)
+			heightField.heights[i] = texture.imageData[i * bytesPerPixel] * heightScale;
+
+		free(texture.imageData);
+
+		return true;
+	}
+
+	void TerrainBuilder::ParallelRows(int numRows, std::function<void(int firstRow, int lastRow)> job)
+	{
+		if (mNumThreads == 1 || numRows < mNumThreads)
+		{
+			job(0, numRows);
+			return;
+		}
+
+		int rowsPerThread = (numRows + mNumThreads - 1) / mNumThreads;
+		for (int t = 0; t < mNumThreads; t++)
+		{
+			int firstRow = t * rowsPerThread;
+			int lastRow = std::min(firstRow + rowsPerThread, numRows);
+
+			if (firstRow < lastRow)
+				mThreadPool.threads[t]->addJob([=] { job(firstRow, lastRow); });
+		}
+
+		mThreadPool.wait();
+	}
+
+	// Writes the normals of row z as three separate arrays (SoA) so the inner loop can work on 4 vertices at a time
+	// The normal is the cross product of the central differences in x and z, n = (h(x+1) - h(x-1), -2, h(z+1) - h(z-1))
+	// which points in the same direction as the face normals that the old GenerateTerrain() accumulated
+	void TerrainBuilder::BuildNormalRow(const HeightField& heightField, int z, float* nx, float* ny, float* nz)
+	{
+		const int width = heightField.width;
+		const float* row = &heightField.heights[z * width];
+		const float* rowUp = (z > 0) ? row - width : row;							// Clamped at the edges
+		const float* rowDown = (z < heightField.height - 1) ? row + width : row;
+
+		// The scalar version must do the exact same operations in the same order as the SSE version
+		auto scalarNormal = [&](int x) {
+			float dx = row[std::min(x + 1, width - 1)] - row[std::max(x - 1, 0)];
+			float dz = rowDown[x] - rowUp[x];
+			float length = sqrtf((dx * dx + 4.0f) + dz * dz);
+			nx[x] = dx / length;
+			ny[x] = -2.0f / length;
+			nz[x] = dz / length;
+		};
+
+		scalarNormal(0);
+
+		const __m128 four = _mm_set1_ps(4.0f);
+		const __m128 minusTwo = _mm_set1_ps(-2.0f);
+
+		// x - 1 and x + 4 must be inside the row
+		int x = 1;
+		for (; x + 4 <= width - 1; x += 4)
+		{
+			__m128 left = _mm_loadu_ps(row + x - 1);
+			__m128 right = _mm_loadu_ps(row + x + 1);
+			__m128 up = _mm_loadu_ps(rowUp + x);
+			__m128 down = _mm_loadu_ps(rowDown + x);
+
+			__m128 dx = _mm_sub_ps(right, left);
+			__m128 dz = _mm_sub_ps(down, up);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), four), _mm_mul_ps(dz, dz)));
+
+			_mm_storeu_ps(nx + x, _mm_div_ps(dx, length));
+			_mm_storeu_ps(ny + x, _mm_div_ps(minusTwo, length));
+			_mm_storeu_ps(nz + x, _mm_div_ps(dz, length));
+		}
+
+		// Remaining vertices and the last edge vertex
+		for (; x < width; x++)
+			scalarNormal(x);
+	}
+
+	void TerrainBuilder::BuildNormals(const HeightField& heightField, std::vector<glm::vec3>& normals)
+	{
+		const int width = heightField.width;
+		normals.resize(width * heightField.height);
+
+		ParallelRows(heightField.height, [&](int firstRow, int lastRow) {
+			std::vector<float> nx(width), ny(width), nz(width);
+
+			for (int z = firstRow; z < lastRow; z++)
+			{
+				BuildNormalRow(heightField, z, nx.data(), ny.data(), nz.data());
+
+				glm::vec3* out = &normals[z * width];
+				for (int x = 0; x < width; x++)
+					out[x] = glm::vec3(nx[x], ny[x], nz[x]);
+			}
+		});
+	}
+
+	// Same index order as before: quad (x, z) writes 6 indices starting at (x + z * (width - 1)) * 6
+	void TerrainBuilder::BuildIndices(int width, int height, std::vector<uint32_t>& indices)
+	{
+		const int quadsPerRow = width - 1;
+		indices.resize(quadsPerRow * (height - 1) * 6);
+
+		if (quadsPerRow <= 0 || height <= 1)
+			return;
+
+		// The indices of quad x are x + z * width + { 0, width, 1, 1, width, width + 1 }
+		// 4 quads produce 24 indices, precompute their offsets so each group of 4 quads is 6 adds and 6 stores
+		const uint32_t quadOffsets[6] = { 0, (uint32_t)width, 1, 1, (uint32_t)width, (uint32_t)width + 1 };
+		__m128i pattern[6];
+		for (int i = 0; i < 6; i++)
+		{
+			uint32_t values[4];
+			for (int j = 0; j < 4; j++)
+			{
+				int element = i * 4 + j;
+				values[j] = element / 6 + quadOffsets[element % 6];
+			}
+			pattern[i] = _mm_loadu_si128((const __m128i*)values);
+		}
+
+		ParallelRows(height - 1, [&](int firstRow, int lastRow) {
+			for (int z = firstRow; z < lastRow; z++)
+			{
+				uint32_t* out = &indices[z * quadsPerRow * 6];
+
+				int x = 0;
+				for (; x + 4 <= quadsPerRow; x += 4)
+				{
+					__m128i base = _mm_set1_epi32(x + z * width);
+					for (int i = 0; i < 6; i++)
+						_mm_storeu_si128((__m128i*)(out + x * 6 + i * 4), _mm_add_epi32(pattern[i], base));
+				}
+
+				for (; x < quadsPerRow; x++)
+				{
+					uint32_t base = x + z * width;
+					for (int i = 0; i < 6; i++)
+						out[x * 6 + i] = base + quadOffsets[i];
+				}
+			}
+		});
+	}
+
+	void TerrainBuilder::BuildMesh(const HeightField& heightField, Mesh& mesh)
+	{
+		const int width = heightField.width;
+		const int height = heightField.height;
+
+		mesh.vertices.resize(width * height);
+
+		ParallelRows(height, [&](int firstRow, int lastRow) {
+			std::vector<float> nx(width), ny(width), nz(width);
+
+			for (int z = firstRow; z < lastRow; z++)
+			{
+				BuildNormalRow(heightField, z, nx.data(), ny.data(), nz.data());
+
+				const float* row = &heightField.heights[z * width];
+				Vertex* out = &mesh.vertices[z * width];
+
+				for (int x = 0; x < width; x++)
+				{
+					vec3 pos = vec3((float)x, row[x], (float)z);
+					vec3 normal = vec3(nx[x], ny[x], nz[x]);
+					vec2 uv = vec2(x / (float)width, z / (float)height);
+
+					out[x] = Vertex(pos, normal, uv, vec3(0, 0, 0), vec3(1.0, 1.0, 1.0));
+				}
+			}
+		});
+
+		BuildIndices(width, height, mesh.indices);
+	}
+
+	int TerrainBuilder::GetNumThreads()
+	{
+		return mNumThreads;
+	}
+}	// VulkanLib namespace
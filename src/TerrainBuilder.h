@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+
+namespace VulkanLib
+{
+	struct Mesh;
+
+	/*
+		Grid of terrain heights, one float for each heightmap texel
+		Row major, index = x + z * width
+	*/
+	struct HeightField
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<float> heights;
+
+		// Clamps the coordinates to the edges of the grid
+		float Get(int x, int z) const;
+	};
+
+	/*
+		Builds terrain meshes from a HeightField
+
+		Normals are computed with central differences directly from the height grid and the indices are generated
+		analytically from the quad index. The rows are split across the worker threads and the inner loops process
+		4 vertices at a time with SSE. A vertex only depends on its neighbours in the height grid, so the result is
+		bit identical no matter how many threads are used.
+	*/
+	class TerrainBuilder
+	{
+	public:
+		TerrainBuilder(int numThreads = 0);		// 0 = one thread per hardware thread
+
+		// Loads the first channel of a .tga file and scales it to world heights
+		static bool LoadHeightField(std::string filename, HeightField& heightField, float heightScale = 1.0f / 15.0f);
+
+		void BuildNormals(const HeightField& heightField, std::vector<glm::vec3>& normals);
+		void BuildIndices(int width, int height, std::vector<uint32_t>& indices);
+		void BuildMesh(const HeightField& heightField, Mesh& mesh);
+
+		int GetNumThreads();
+	private:
+		// Splits [0, numRows) into one contiguous range per thread and waits for all of them
+		void ParallelRows(int numRows, std::function<void(int firstRow, int lastRow)> job);
+
+		void BuildNormalRow(const HeightField& heightField, int z, float* nx, float* ny, float* nz);
+
+		ThreadPool	mThreadPool;
+		int			mNumThreads;
+	};
+}	// VulkanLib namespace
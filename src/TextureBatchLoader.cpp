@@ -0,0 +1,310 @@
+#include "TextureBatchLoader.h"
+#include "TextureFile.h"
+#include "TextureCompiler.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+
+#include <cstring>
+
+namespace VulkanLib
+{
+	TextureBatchLoader::TextureBatchLoader()
+	{
+
+	}
+
+	void TextureBatchLoader::Init(VulkanBase* vulkanBase, VkDeviceSize stagingSize)
+	{
+		mVulkanBase = vulkanBase;
+		mDevice = vulkanBase->GetDevice();
+		CreateStagingBuffer(stagingSize);
+	}
+
+	void TextureBatchLoader::Cleanup()
+	{
+		if (mVulkanBase == nullptr)
+			return;
+
+		Flush();
+		DestroyStagingBuffer();
+	}
+
+	bool TextureBatchLoader::AddTexture(std::string filename, VkFormat format, vkTools::VulkanTexture* texture, MipMode mipMode)
+	{
+		if (!TextureCompiler::IsCompressedFile(filename))
+		{
+			// Uploaded as it is with mips from the mip mode
+			if (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB)
+			{
+				RGBAImage image;
+				return TextureCompiler::LoadSource(filename, image) && AddImage(image, format, mipMode, texture);
+			}
+
+			// Uncompressed sources are block compressed once and cached next to the source
+			filename = TextureCompiler::GetCachedTexture(filename, format);
+			if (filename == "")
+				return false;
+		}
+
+		TextureFile file;
+		if (!file.Open(filename))
+			return false;
+
+		if (format == VK_FORMAT_UNDEFINED)
+			format = file.GetFormat();
+
+		// The mips are copied as they are, so a different format must have the same block layout
+		uint32_t blockSize, blockBytes, fileBlockSize, fileBlockBytes;
+		TextureFile::GetBlockInfo(file.GetFormat(), fileBlockSize, fileBlockBytes);
+		if (!TextureFile::GetBlockInfo(format, blockSize, blockBytes) || blockSize != fileBlockSize || blockBytes != fileBlockBytes)
+		{
+			VulkanDebug::ConsolePrint("Texture format doesn't match the file: " + filename);
+			return false;
+		}
+
+		// Every region is aligned for the block size, the worst case is 15 bytes of padding per region
+		const uint32_t numRegions = file.GetNumMips() * file.GetNumLayers();
+		ReserveStaging(file.GetDataSize() + numRegions * 15);
+
+		texture->width = file.GetWidth();
+		texture->height = file.GetHeight();
+		texture->mipLevels = file.GetNumMips();
+		texture->layerCount = file.GetNumLayers();
+
+		VkCommandBuffer cmdBuffer = CreateTexture(format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, texture);
+
+		// The only copy on the CPU, from the file mapping to the staging buffer
+		std::vector<VkBufferImageCopy> copyRegions;
+		for (uint32_t layer = 0; layer < file.GetNumLayers(); layer++)
+		{
+			for (uint32_t mip = 0; mip < file.GetNumMips(); mip++)
+			{
+				VkBufferImageCopy copyRegion = {};
+				copyRegion.bufferOffset = CopyToStaging(file.GetMipData(layer, mip), file.GetMipSize(mip));
+				copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, layer, 1 };
+				copyRegion.imageExtent = { file.GetMipWidth(mip), file.GetMipHeight(mip), 1 };
+				copyRegions.push_back(copyRegion);
+			}
+		}
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels, 0, texture->layerCount };
+		vkCmdCopyBufferToImage(cmdBuffer, mStagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+		vkTools::setImageLayout(cmdBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->imageLayout, subresourceRange);
+
+		mUploadedBytes += file.GetDataSize();
+
+		return true;
+	}
+
+	bool TextureBatchLoader::AddImage(const RGBAImage& image, VkFormat format, MipMode mipMode, vkTools::VulkanTexture* texture)
+	{
+		if (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB)
+		{
+			VulkanDebug::ConsolePrint("Only RGBA8 images can be uploaded without compression");
+			return false;
+		}
+
+		if (mipMode == MIP_MODE_GPU_BLIT && !MipGenerator::SupportsBlit(mVulkanBase->GetPhysicalDevice(), format))
+			mipMode = MIP_MODE_CPU_BOX;
+
+		// The levels that are copied from the staging buffer, the blit chain only needs the base level
+		std::vector<RGBAImage> generatedMips;
+		std::vector<const RGBAImage*> levels;
+
+		if (mipMode == MIP_MODE_CPU_BOX || mipMode == MIP_MODE_CPU_KAISER)
+		{
+			MipGenerator::Generate(image, (mipMode == MIP_MODE_CPU_KAISER) ? MIP_FILTER_KAISER : MIP_FILTER_BOX, generatedMips);
+			for (const RGBAImage& mip : generatedMips)
+				levels.push_back(&mip);
+		}
+		else
+		{
+			levels.push_back(&image);
+		}
+
+		VkDeviceSize dataSize = 0;
+		for (const RGBAImage* level : levels)
+			dataSize += level->texels.size();
+
+		ReserveStaging(dataSize + levels.size() * 15);
+
+		texture->width = image.width;
+		texture->height = image.height;
+		texture->mipLevels = (mipMode == MIP_MODE_NONE) ? 1 : MipGenerator::GetNumMips(image.width, image.height);
+		texture->layerCount = 1;
+
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (mipMode == MIP_MODE_GPU_BLIT)
+			usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+		VkCommandBuffer cmdBuffer = CreateTexture(format, usage, texture);
+
+		std::vector<VkBufferImageCopy> copyRegions;
+		for (uint32_t mip = 0; mip < levels.size(); mip++)
+		{
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.bufferOffset = CopyToStaging(levels[mip]->texels.data(), levels[mip]->texels.size());
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1 };
+			copyRegion.imageExtent = { levels[mip]->width, levels[mip]->height, 1 };
+			copyRegions.push_back(copyRegion);
+		}
+
+		vkCmdCopyBufferToImage(cmdBuffer, mStagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+
+		if (mipMode == MIP_MODE_GPU_BLIT)
+		{
+			MipGenerator::RecordBlitChain(cmdBuffer, texture->image, texture->width, texture->height, texture->mipLevels, 1, texture->imageLayout);
+		}
+		else
+		{
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels, 0, 1 };
+			vkTools::setImageLayout(cmdBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->imageLayout, subresourceRange);
+		}
+
+		mUploadedBytes += dataSize;
+
+		return true;
+	}
+
+	void TextureBatchLoader::Flush()
+	{
+		if (mStagingOffset == 0)
+			return;
+
+		mVulkanBase->ExecuteSetupCommandBuffer();	// Waits for the queue to be idle
+		mStagingOffset = 0;
+		mNumSubmits++;
+	}
+
+	bool TextureBatchLoader::LoadTexture(std::string filename, VkFormat format, vkTools::VulkanTexture* texture, MipMode mipMode)
+	{
+		if (!AddTexture(filename, format, texture, mipMode))
+			return false;
+
+		Flush();
+		return true;
+	}
+
+	void TextureBatchLoader::DestroyTexture(vkTools::VulkanTexture& texture)
+	{
+		vkDestroyImageView(mDevice, texture.view, nullptr);
+		vkDestroyImage(mDevice, texture.image, nullptr);
+		vkDestroySampler(mDevice, texture.sampler, nullptr);
+		vkFreeMemory(mDevice, texture.deviceMemory, nullptr);
+	}
+
+	void TextureBatchLoader::ReserveStaging(VkDeviceSize size)
+	{
+		if (mStagingOffset + size <= mStagingSize)
+			return;
+
+		Flush();
+
+		if (size > mStagingSize)
+		{
+			DestroyStagingBuffer();
+			CreateStagingBuffer(size);
+		}
+	}
+
+	VkDeviceSize TextureBatchLoader::CopyToStaging(const void* data, size_t size)
+	{
+		VkDeviceSize offset = (mStagingOffset + 15) & ~(VkDeviceSize)15;
+		memcpy(mStagingData + offset, data, size);
+		mStagingOffset = offset + size;
+		return offset;
+	}
+
+	VkCommandBuffer TextureBatchLoader::CreateTexture(VkFormat format, VkImageUsageFlags usage, vkTools::VulkanTexture* texture)
+	{
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = format;
+		imageCreateInfo.extent = { texture->width, texture->height, 1 };
+		imageCreateInfo.mipLevels = texture->mipLevels;
+		imageCreateInfo.arrayLayers = texture->layerCount;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = usage;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &texture->image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(mDevice, texture->image, &memReqs);
+
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		mVulkanBase->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &memAlloc, nullptr, &texture->deviceMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, texture->image, texture->deviceMemory, 0));
+
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = VK_FILTER_LINEAR;
+		sampler.minFilter = VK_FILTER_LINEAR;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.mipLodBias = 0.0f;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = (float)texture->mipLevels;
+		sampler.maxAnisotropy = 8;
+		sampler.anisotropyEnable = mVulkanBase->GetEnabledFeatures().samplerAnisotropy;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VulkanDebug::ErrorCheck(vkCreateSampler(mDevice, &sampler, nullptr, &texture->sampler));
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels, 0, texture->layerCount };
+
+		VkImageViewCreateInfo view = {};
+		view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view.viewType = (texture->layerCount > 1) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		view.format = format;
+		view.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		view.subresourceRange = subresourceRange;
+		view.image = texture->image;
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &view, nullptr, &texture->view));
+
+		// Other code that uses the setup command buffer may have submitted it already
+		if (mVulkanBase->GetSetupCommandBuffer() == VK_NULL_HANDLE)
+			mVulkanBase->CreateSetupCommandBuffer();
+
+		VkCommandBuffer cmdBuffer = mVulkanBase->GetSetupCommandBuffer();
+		texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkTools::setImageLayout(cmdBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+		return cmdBuffer;
+	}
+
+	void TextureBatchLoader::CreateStagingBuffer(VkDeviceSize size)
+	{
+		// Coherent memory, no flush is needed before the copies are submitted
+		mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size, nullptr, &mStagingBuffer, &mStagingMemory);
+		VulkanDebug::ErrorCheck(vkMapMemory(mDevice, mStagingMemory, 0, size, 0, (void**)&mStagingData));
+		mStagingSize = size;
+		mStagingOffset = 0;
+	}
+
+	void TextureBatchLoader::DestroyStagingBuffer()
+	{
+		vkUnmapMemory(mDevice, mStagingMemory);
+		vkDestroyBuffer(mDevice, mStagingBuffer, nullptr);
+		vkFreeMemory(mDevice, mStagingMemory, nullptr);
+		mStagingBuffer = VK_NULL_HANDLE;
+		mStagingMemory = VK_NULL_HANDLE;
+		mStagingData = nullptr;
+		mStagingSize = 0;
+	}
+
+	int TextureBatchLoader::GetNumSubmits()
+	{
+		return mNumSubmits;
+	}
+
+	VkDeviceSize TextureBatchLoader::GetUploadedBytes()
+	{
+		return mUploadedBytes;
+	}
+}	// VulkanLib namespace
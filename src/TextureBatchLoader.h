@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <vulkan/vulkan.h>
+#include "base/vulkanTextureLoader.hpp"
+#include "MipGenerator.h"
+
+#define TEXTURE_STAGING_SIZE (16 * 1024 * 1024)		// Grows if a single texture is larger
+
+namespace VulkanLib
+{
+	class VulkanBase;
+
+	// How the mips of an uncompressed texture are created
+	enum MipMode
+	{
+		MIP_MODE_NONE,				// Only the base level
+		MIP_MODE_GPU_BLIT,			// vkCmdBlitImage chain after the upload, falls back to MIP_MODE_CPU_BOX if the format can't be blitted
+		MIP_MODE_CPU_BOX,			// MipGenerator before the upload
+		MIP_MODE_CPU_KAISER
+	};
+
+	/*
+		Uploads DDS and KTX textures with as few copies and submits as possible
+
+		vkTools::VulkanTextureLoader reads the file into a gli texture and then copies every mip to its own linear
+		image before copying that to the optimal image. Here the file is memory mapped and the mips are copied
+		straight from the mapping to one persistently mapped staging buffer, and each texture is uploaded with a
+		single vkCmdCopyBufferToImage that has one region per mip and layer.
+
+		AddTexture() only records the copy, any number of textures are uploaded in one submit when Flush() is called
+		or when the staging buffer is full. The commands are recorded to the setup command buffer of VulkanBase. The
+		image, view and sampler are created right away but the texel data is only valid after Flush().
+
+		Uncompressed RGBA8 textures are added with AddImage(), or AddTexture() with a .tga file and an RGBA8 format.
+		Their mips are generated according to the MipMode of each texture.
+	*/
+	class TextureBatchLoader
+	{
+	public:
+		TextureBatchLoader();
+
+		void Init(VulkanBase* vulkanBase, VkDeviceSize stagingSize = TEXTURE_STAGING_SIZE);
+		void Cleanup();
+
+		// VK_FORMAT_UNDEFINED uses the format in the file, a .tga file is compressed to the format first (see TextureCompiler)
+		// unless the format is RGBA8, then it's uploaded as it is with mips from mipMode. Returns false if the file can't be used
+		bool AddTexture(std::string filename, VkFormat format, vkTools::VulkanTexture* texture, MipMode mipMode = MIP_MODE_GPU_BLIT);
+
+		// The format must be VK_FORMAT_R8G8B8A8_UNORM or VK_FORMAT_R8G8B8A8_SRGB
+		bool AddImage(const RGBAImage& image, VkFormat format, MipMode mipMode, vkTools::VulkanTexture* texture);
+
+		// Submits the recorded copies and waits for them to finish
+		void Flush();
+
+		// AddTexture() and Flush()
+		bool LoadTexture(std::string filename, VkFormat format, vkTools::VulkanTexture* texture, MipMode mipMode = MIP_MODE_GPU_BLIT);
+
+		void DestroyTexture(vkTools::VulkanTexture& texture);
+
+		int GetNumSubmits();				// Since Init()
+		VkDeviceSize GetUploadedBytes();	// Since Init()
+
+	private:
+		void CreateStagingBuffer(VkDeviceSize size);
+		void DestroyStagingBuffer();
+
+		// Flushes if the bytes don't fit in what is left of the staging buffer and grows it if they don't fit at all
+		void ReserveStaging(VkDeviceSize size);
+
+		// Returns the offset of the data in the staging buffer, every region is aligned for the block size
+		VkDeviceSize CopyToStaging(const void* data, size_t size);
+
+		// Creates the image, memory, sampler and view and records the transition of all levels to TRANSFER_DST
+		VkCommandBuffer CreateTexture(VkFormat format, VkImageUsageFlags usage, vkTools::VulkanTexture* texture);
+
+		VulkanBase*							mVulkanBase = nullptr;
+		VkDevice							mDevice = VK_NULL_HANDLE;
+
+		VkBuffer							mStagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory						mStagingMemory = VK_NULL_HANDLE;
+		uint8_t*							mStagingData = nullptr;			// Persistently mapped
+		VkDeviceSize						mStagingSize = 0;
+		VkDeviceSize						mStagingOffset = 0;				// Used by the recorded copies
+
+		int									mNumSubmits = 0;
+		VkDeviceSize						mUploadedBytes = 0;
+	};
+}	// VulkanLib namespace
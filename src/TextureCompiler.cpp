@@ -0,0 +1,199 @@
+#include "TextureCompiler.h"
+#include "TextureFile.h"
+#include "MappedFile.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <sys/stat.h>
+
+// TGA image types
+#define TGA_TYPE_COLOR 2
+#define TGA_TYPE_GRAY 3
+#define TGA_TYPE_RLE_COLOR 10
+#define TGA_TYPE_RLE_GRAY 11
+
+#define TGA_HEADER_SIZE 18
+#define TGA_DESCRIPTOR_TOP_LEFT 0x20
+
+namespace VulkanLib
+{
+	static std::string GetExtension(std::string filename)
+	{
+		size_t dot = filename.find_last_of('.');
+		size_t slash = filename.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return "";
+
+		std::string extension = filename.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+		return extension;
+	}
+
+	TextureCompiler::TextureCompiler(int numThreads)
+		: mCompressor(numThreads)
+	{
+
+	}
+
+	bool TextureCompiler::Compile(std::string source, std::string destination, VkFormat format, MipFilter mipFilter)
+	{
+		if (!BlockCompressor::IsSupported(format))
+		{
+			VulkanDebug::ConsolePrint("Texture compression only supports BC1, BC3 and BC7: " + source);
+			return false;
+		}
+
+		RGBAImage image;
+		if (!LoadSource(source, image))
+			return false;
+
+		std::vector<RGBAImage> levels;
+		MipGenerator::Generate(image, mipFilter, levels);
+
+		std::vector<std::vector<uint8_t>> mips(levels.size());
+		for (size_t mip = 0; mip < levels.size(); mip++)
+			mCompressor.Compress(levels[mip].texels.data(), levels[mip].width, levels[mip].height, format, mips[mip]);
+
+		return TextureFile::WriteDDS(destination, format, image.width, image.height, mips);
+	}
+
+	std::string TextureCompiler::GetCachedTexture(std::string source, VkFormat format)
+	{
+		std::string cachePath = GetCachePath(source, format);
+
+		struct stat sourceStat, cacheStat;
+		if (stat(source.c_str(), &sourceStat) != 0)
+		{
+			VulkanDebug::ConsolePrint("Error opening texture: " + source);
+			return "";
+		}
+
+		if (stat(cachePath.c_str(), &cacheStat) == 0 && cacheStat.st_mtime >= sourceStat.st_mtime)
+			return cachePath;
+
+		// Only pays for the worker threads when something has to be compressed
+		VulkanDebug::ConsolePrint("Compressing texture: " + source);
+		TextureCompiler compiler;
+		if (!compiler.Compile(source, cachePath, format))
+			return "";
+
+		return cachePath;
+	}
+
+	std::string TextureCompiler::GetCachePath(std::string source, VkFormat format)
+	{
+		std::string suffix;
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK: suffix = ".bc1.dds"; break;
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK: suffix = ".bc1_srgb.dds"; break;
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: suffix = ".bc1a.dds"; break;
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: suffix = ".bc1a_srgb.dds"; break;
+		case VK_FORMAT_BC3_UNORM_BLOCK: suffix = ".bc3.dds"; break;
+		case VK_FORMAT_BC3_SRGB_BLOCK: suffix = ".bc3_srgb.dds"; break;
+		case VK_FORMAT_BC7_UNORM_BLOCK: suffix = ".bc7.dds"; break;
+		case VK_FORMAT_BC7_SRGB_BLOCK: suffix = ".bc7_srgb.dds"; break;
+		default: suffix = ".dds"; break;
+		}
+
+		std::string extension = GetExtension(source);
+		return source.substr(0, source.size() - extension.size()) + suffix;
+	}
+
+	bool TextureCompiler::IsCompressedFile(std::string filename)
+	{
+		std::string extension = GetExtension(filename);
+		return extension == ".dds" || extension == ".ktx";
+	}
+
+	bool TextureCompiler::LoadSource(std::string filename, RGBAImage& image)
+	{
+		if (GetExtension(filename) != ".tga")
+		{
+			VulkanDebug::ConsolePrint("Only .tga textures can be compressed: " + filename);
+			return false;
+		}
+
+		MappedFile file;
+		if (!file.Open(filename) || file.GetSize() < TGA_HEADER_SIZE)
+		{
+			VulkanDebug::ConsolePrint("Error opening texture: " + filename);
+			return false;
+		}
+
+		const uint8_t* header = file.GetData();
+		const uint8_t idLength = header[0];
+		const uint8_t colorMapType = header[1];
+		const uint8_t imageType = header[2];
+		const uint32_t width = header[12] | (header[13] << 8);
+		const uint32_t height = header[14] | (header[15] << 8);
+		const uint32_t bytesPerTexel = header[16] / 8;
+		const bool topLeft = (header[17] & TGA_DESCRIPTOR_TOP_LEFT) != 0;
+
+		const bool rle = (imageType == TGA_TYPE_RLE_COLOR || imageType == TGA_TYPE_RLE_GRAY);
+		const bool gray = (imageType == TGA_TYPE_GRAY || imageType == TGA_TYPE_RLE_GRAY);
+
+		if (colorMapType != 0 || (!gray && imageType != TGA_TYPE_COLOR && imageType != TGA_TYPE_RLE_COLOR) ||
+			(gray && bytesPerTexel != 1) || (!gray && bytesPerTexel != 3 && bytesPerTexel != 4) || width == 0 || height == 0)
+		{
+			VulkanDebug::ConsolePrint("Unsupported .tga format: " + filename);
+			return false;
+		}
+
+		image.width = width;
+		image.height = height;
+		image.texels.resize(width * height * 4);
+
+		const uint8_t* data = file.GetData() + TGA_HEADER_SIZE + idLength;
+		const uint8_t* end = file.GetData() + file.GetSize();
+
+		// Texels are BGR(A) or gray, the rows are stored from the bottom unless the origin is top left
+		auto writeTexel = [&](uint32_t index, const uint8_t* texel) {
+			uint32_t row = index / width;
+			uint32_t y = topLeft ? row : height - 1 - row;
+			uint8_t* out = &image.texels[(y * width + index % width) * 4];
+
+			out[0] = gray ? texel[0] : texel[2];
+			out[1] = gray ? texel[0] : texel[1];
+			out[2] = texel[0];
+			out[3] = (bytesPerTexel == 4) ? texel[3] : 255;
+		};
+
+		const uint32_t numTexels = width * height;
+		uint32_t index = 0;
+		while (index < numTexels)
+		{
+			uint32_t count = 1;
+			bool repeat = false;
+
+			if (rle)
+			{
+				if (data >= end)
+					break;
+
+				count = std::min((*data & 0x7f) + 1u, numTexels - index);
+				repeat = (*data & 0x80) != 0;
+				data++;
+			}
+
+			size_t bytes = repeat ? bytesPerTexel : count * bytesPerTexel;
+			if ((size_t)(end - data) < bytes)
+				break;
+
+			for (uint32_t i = 0; i < count; i++)
+				writeTexel(index + i, repeat ? data : data + i * bytesPerTexel);
+
+			index += count;
+			data += bytes;
+		}
+
+		if (index < numTexels)
+		{
+			VulkanDebug::ConsolePrint(".tga texel data is truncated: " + filename);
+			return false;
+		}
+
+		return true;
+	}
+}	// VulkanLib namespace
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+#include "BlockCompressor.h"
+#include "MipGenerator.h"
+
+namespace VulkanLib
+{
+	/*
+		Compresses uncompressed source textures to block compressed DDS files
+
+		Compile() loads the source, builds the full mip chain with MipGenerator and compresses every level with
+		BlockCompressor. GetCachedTexture() is the optional load time step, it returns a compressed copy of the source
+		that is stored next to it and only compiles it again when the copy is missing or older than the source.
+		tools/TextureCompressor is the offline version that calls Compile() directly.
+
+		The sources can be uncompressed or RLE .tga files with 8, 24 or 32 bits per texel.
+	*/
+	class TextureCompiler
+	{
+	public:
+		TextureCompiler(int numThreads = 0);		// 0 = one thread per hardware thread
+
+		bool Compile(std::string source, std::string destination, VkFormat format, MipFilter mipFilter = MIP_FILTER_KAISER);
+
+		// Returns the path of the compressed texture or "" if the source can't be compiled
+		static std::string GetCachedTexture(std::string source, VkFormat format);
+
+		// "data/textures/grass.tga" -> "data/textures/grass.bc7.dds"
+		static std::string GetCachePath(std::string source, VkFormat format);
+
+		// .dds and .ktx files are loaded as they are
+		static bool IsCompressedFile(std::string filename);
+
+		static bool LoadSource(std::string filename, RGBAImage& image);
+
+	private:
+		BlockCompressor mCompressor;
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,478 @@
+#include "TextureFile.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+// DDSHeader::caps2
+#define DDS_CAPS2_CUBEMAP 0x200
+#define DDS_CAPS2_VOLUME 0x200000
+
+// DDSHeader::flags and DDSHeader::caps, only used when writing
+#define DDS_HEADER_FLAGS_TEXTURE 0x1007		// DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT
+#define DDS_HEADER_FLAGS_MIPMAP 0x20000
+#define DDS_HEADER_FLAGS_LINEARSIZE 0x80000
+#define DDS_CAPS_TEXTURE 0x1000
+#define DDS_CAPS_COMPLEX_MIPMAP 0x400008
+
+// DDSPixelFormat::flags
+#define DDS_PIXEL_FOURCC 0x4
+#define DDS_PIXEL_RGB 0x40
+
+// DDSHeaderDX10
+#define DDS_DIMENSION_TEXTURE2D 3
+#define DDS_MISC_TEXTURECUBE 0x4
+
+#define KTX_ENDIANNESS 0x04030201
+
+namespace VulkanLib
+{
+	static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	static uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24);
+	}
+
+	static VkFormat GetFormatFromDXGI(uint32_t dxgiFormat)
+	{
+		switch (dxgiFormat)
+		{
+		case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+		case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+		case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+		case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+		case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+		case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+		case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+		case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+		case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+		case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+		case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+		case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+		case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	static uint32_t GetDXGIFromFormat(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM: return 28;
+		case VK_FORMAT_R8G8B8A8_SRGB: return 29;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK: return 71;		// DXGI has no BC1 without alpha
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: return 71;
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK: return 72;
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: return 72;
+		case VK_FORMAT_BC2_UNORM_BLOCK: return 74;
+		case VK_FORMAT_BC2_SRGB_BLOCK: return 75;
+		case VK_FORMAT_BC3_UNORM_BLOCK: return 77;
+		case VK_FORMAT_BC3_SRGB_BLOCK: return 78;
+		case VK_FORMAT_BC4_UNORM_BLOCK: return 80;
+		case VK_FORMAT_BC5_UNORM_BLOCK: return 83;
+		case VK_FORMAT_B8G8R8A8_UNORM: return 87;
+		case VK_FORMAT_B8G8R8A8_SRGB: return 91;
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK: return 95;
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK: return 96;
+		case VK_FORMAT_BC7_UNORM_BLOCK: return 98;
+		case VK_FORMAT_BC7_SRGB_BLOCK: return 99;
+		default: return 0;
+		}
+	}
+
+	static VkFormat GetFormatFromGL(uint32_t glInternalFormat)
+	{
+		switch (glInternalFormat)
+		{
+		case 0x8058: return VK_FORMAT_R8G8B8A8_UNORM;				// GL_RGBA8
+		case 0x8C43: return VK_FORMAT_R8G8B8A8_SRGB;				// GL_SRGB8_ALPHA8
+		case 0x83F0: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;			// GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+		case 0x83F1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;			// GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+		case 0x83F2: return VK_FORMAT_BC2_UNORM_BLOCK;				// GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+		case 0x83F3: return VK_FORMAT_BC3_UNORM_BLOCK;				// GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		case 0x8C4D: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;			// GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+		case 0x8C4F: return VK_FORMAT_BC3_SRGB_BLOCK;				// GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+		case 0x8E8C: return VK_FORMAT_BC7_UNORM_BLOCK;				// GL_COMPRESSED_RGBA_BPTC_UNORM
+		case 0x8E8D: return VK_FORMAT_BC7_SRGB_BLOCK;				// GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+		case 0x8D64: return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;		// GL_ETC1_RGB8_OES, ETC2 decoders read ETC1
+		case 0x9274: return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;		// GL_COMPRESSED_RGB8_ETC2
+		case 0x9278: return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;	// GL_COMPRESSED_RGBA8_ETC2_EAC
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	TextureFile::TextureFile()
+	{
+
+	}
+
+	bool TextureFile::Open(std::string filename)
+	{
+		Close();
+
+		if (!mFile.Open(filename))
+		{
+			VulkanDebug::ConsolePrint("Error opening texture: " + filename);
+			return false;
+		}
+
+		mFilename = filename;
+
+		bool parsed = false;
+		if (mFile.GetSize() >= sizeof(uint32_t) && *(const uint32_t*)mFile.GetData() == DDS_MAGIC)
+			parsed = ParseDDS();
+		else if (mFile.GetSize() >= sizeof(KTX_IDENTIFIER) && memcmp(mFile.GetData(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0)
+			parsed = ParseKTX();
+		else
+			VulkanDebug::ConsolePrint("Texture isn't a DDS or KTX file: " + filename);
+
+		if (!parsed)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void TextureFile::Close()
+	{
+		mFile.Close();
+		mFormat = VK_FORMAT_UNDEFINED;
+		mWidth = mHeight = 0;
+		mNumMips = mNumLayers = 0;
+		mMipSizes.clear();
+		mOffsets.clear();
+	}
+
+	bool TextureFile::ParseDDS()
+	{
+		size_t offset = sizeof(uint32_t) + sizeof(DDSHeader);
+		if (mFile.GetSize() < offset)
+		{
+			VulkanDebug::ConsolePrint("DDS header is truncated: " + mFilename);
+			return false;
+		}
+
+		const DDSHeader* header = (const DDSHeader*)(mFile.GetData() + sizeof(uint32_t));
+		if (header->caps2 & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME))
+		{
+			VulkanDebug::ConsolePrint("DDS cubemaps and volume textures aren't supported: " + mFilename);
+			return false;
+		}
+
+		mWidth = header->width;
+		mHeight = header->height;
+		mNumMips = std::max(header->mipMapCount, 1u);
+		mNumLayers = 1;
+
+		const DDSPixelFormat& pixelFormat = header->pixelFormat;
+		if ((pixelFormat.flags & DDS_PIXEL_FOURCC) && pixelFormat.fourCC == DDS_FOURCC_DX10)
+		{
+			if (mFile.GetSize() < offset + sizeof(DDSHeaderDX10))
+			{
+				VulkanDebug::ConsolePrint("DDS header is truncated: " + mFilename);
+				return false;
+			}
+
+			const DDSHeaderDX10* headerDX10 = (const DDSHeaderDX10*)(mFile.GetData() + offset);
+			offset += sizeof(DDSHeaderDX10);
+
+			if (headerDX10->resourceDimension != DDS_DIMENSION_TEXTURE2D || (headerDX10->miscFlag & DDS_MISC_TEXTURECUBE))
+			{
+				VulkanDebug::ConsolePrint("Only 2D DDS textures are supported: " + mFilename);
+				return false;
+			}
+
+			mFormat = GetFormatFromDXGI(headerDX10->dxgiFormat);
+			mNumLayers = std::max(headerDX10->arraySize, 1u);
+		}
+		else if (pixelFormat.flags & DDS_PIXEL_FOURCC)
+		{
+			if (pixelFormat.fourCC == MakeFourCC('D', 'X', 'T', '1'))
+				mFormat = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			else if (pixelFormat.fourCC == MakeFourCC('D', 'X', 'T', '3'))
+				mFormat = VK_FORMAT_BC2_UNORM_BLOCK;
+			else if (pixelFormat.fourCC == MakeFourCC('D', 'X', 'T', '5'))
+				mFormat = VK_FORMAT_BC3_UNORM_BLOCK;
+			else if (pixelFormat.fourCC == MakeFourCC('A', 'T', 'I', '1') || pixelFormat.fourCC == MakeFourCC('B', 'C', '4', 'U'))
+				mFormat = VK_FORMAT_BC4_UNORM_BLOCK;
+			else if (pixelFormat.fourCC == MakeFourCC('A', 'T', 'I', '2') || pixelFormat.fourCC == MakeFourCC('B', 'C', '5', 'U'))
+				mFormat = VK_FORMAT_BC5_UNORM_BLOCK;
+		}
+		else if ((pixelFormat.flags & DDS_PIXEL_RGB) && pixelFormat.rgbBitCount == 32)
+		{
+			if (pixelFormat.rBitMask == 0x000000ff)
+				mFormat = VK_FORMAT_R8G8B8A8_UNORM;
+			else if (pixelFormat.rBitMask == 0x00ff0000)
+				mFormat = VK_FORMAT_B8G8R8A8_UNORM;
+		}
+
+		if (!SetupMips())
+			return false;
+
+		// Every layer has its full mip chain before the next layer starts
+		for (uint32_t layer = 0; layer < mNumLayers; layer++)
+		{
+			for (uint32_t mip = 0; mip < mNumMips; mip++)
+			{
+				mOffsets.push_back(offset);
+				offset += mMipSizes[mip];
+			}
+		}
+
+		if (offset > mFile.GetSize())
+		{
+			VulkanDebug::ConsolePrint("DDS texel data is truncated: " + mFilename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool TextureFile::ParseKTX()
+	{
+		size_t offset = sizeof(KTX_IDENTIFIER) + sizeof(KTXHeader);
+		if (mFile.GetSize() < offset)
+		{
+			VulkanDebug::ConsolePrint("KTX header is truncated: " + mFilename);
+			return false;
+		}
+
+		const KTXHeader* header = (const KTXHeader*)(mFile.GetData() + sizeof(KTX_IDENTIFIER));
+		if (header->endianness != KTX_ENDIANNESS)
+		{
+			VulkanDebug::ConsolePrint("Big endian KTX files aren't supported: " + mFilename);
+			return false;
+		}
+
+		if (header->pixelDepth > 1 || header->numberOfFaces != 1)
+		{
+			VulkanDebug::ConsolePrint("KTX cubemaps and volume textures aren't supported: " + mFilename);
+			return false;
+		}
+
+		mFormat = GetFormatFromGL(header->glInternalFormat);
+		mWidth = header->pixelWidth;
+		mHeight = header->pixelHeight;
+		mNumMips = std::max(header->numberOfMipmapLevels, 1u);
+		mNumLayers = std::max(header->numberOfArrayElements, 1u);
+
+		if (!SetupMips())
+			return false;
+
+		offset += header->bytesOfKeyValueData;
+		mOffsets.resize(mNumLayers * mNumMips);
+
+		// Every mip starts with its size and has all the layers, the mips are padded to 4 bytes
+		for (uint32_t mip = 0; mip < mNumMips; mip++)
+		{
+			if (offset + sizeof(uint32_t) > mFile.GetSize())
+			{
+				VulkanDebug::ConsolePrint("KTX texel data is truncated: " + mFilename);
+				return false;
+			}
+
+			uint32_t imageSize = *(const uint32_t*)(mFile.GetData() + offset);
+			offset += sizeof(uint32_t);
+
+			if (imageSize != mMipSizes[mip] * mNumLayers)
+			{
+				VulkanDebug::ConsolePrint("KTX mip size doesn't match the format: " + mFilename);
+				return false;
+			}
+
+			for (uint32_t layer = 0; layer < mNumLayers; layer++)
+			{
+				mOffsets[layer * mNumMips + mip] = offset;
+				offset += mMipSizes[mip];
+			}
+
+			offset = (offset + 3) & ~(size_t)3;
+		}
+
+		if (offset > mFile.GetSize())
+		{
+			VulkanDebug::ConsolePrint("KTX texel data is truncated: " + mFilename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool TextureFile::SetupMips()
+	{
+		uint32_t blockSize, blockBytes;
+		if (!GetBlockInfo(mFormat, blockSize, blockBytes))
+		{
+			VulkanDebug::ConsolePrint("Texture format isn't supported: " + mFilename);
+			return false;
+		}
+
+		if (mWidth == 0 || mHeight == 0)
+		{
+			VulkanDebug::ConsolePrint("Texture has no texels: " + mFilename);
+			return false;
+		}
+
+		for (uint32_t mip = 0; mip < mNumMips; mip++)
+		{
+			size_t blocksX = (GetMipWidth(mip) + blockSize - 1) / blockSize;
+			size_t blocksY = (GetMipHeight(mip) + blockSize - 1) / blockSize;
+			mMipSizes.push_back(blocksX * blocksY * blockBytes);
+		}
+
+		return true;
+	}
+
+	bool TextureFile::GetBlockInfo(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			blockSize = 1;
+			blockBytes = 4;
+			return true;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+			blockSize = 4;
+			blockBytes = 8;
+			return true;
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+			blockSize = 4;
+			blockBytes = 16;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool TextureFile::WriteDDS(std::string filename, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips)
+	{
+		uint32_t dxgiFormat = GetDXGIFromFormat(format);
+		if (dxgiFormat == 0 || mips.empty())
+		{
+			VulkanDebug::ConsolePrint("Can't write the texture format to a DDS file: " + filename);
+			return false;
+		}
+
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (file == nullptr)
+		{
+			VulkanDebug::ConsolePrint("Error creating texture: " + filename);
+			return false;
+		}
+
+		// Always has the DX10 header since the legacy header can't describe BC7 or sRGB
+		DDSHeader header = {};
+		header.size = sizeof(DDSHeader);
+		header.flags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP | DDS_HEADER_FLAGS_LINEARSIZE;
+		header.width = width;
+		header.height = height;
+		header.pitchOrLinearSize = (uint32_t)mips[0].size();
+		header.depth = 1;
+		header.mipMapCount = (uint32_t)mips.size();
+		header.pixelFormat.size = sizeof(DDSPixelFormat);
+		header.pixelFormat.flags = DDS_PIXEL_FOURCC;
+		header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+		header.caps = DDS_CAPS_TEXTURE | (mips.size() > 1 ? DDS_CAPS_COMPLEX_MIPMAP : 0);
+
+		DDSHeaderDX10 headerDX10 = {};
+		headerDX10.dxgiFormat = dxgiFormat;
+		headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+		headerDX10.arraySize = 1;
+
+		const uint32_t magic = DDS_MAGIC;
+		bool written = fwrite(&magic, sizeof(magic), 1, file) == 1;
+		written = written && fwrite(&header, sizeof(header), 1, file) == 1;
+		written = written && fwrite(&headerDX10, sizeof(headerDX10), 1, file) == 1;
+
+		for (const std::vector<uint8_t>& mip : mips)
+			written = written && fwrite(mip.data(), 1, mip.size(), file) == mip.size();
+
+		fclose(file);
+
+		if (!written)
+		{
+			VulkanDebug::ConsolePrint("Error writing texture: " + filename);
+			remove(filename.c_str());
+		}
+
+		return written;
+	}
+
+	const uint8_t* TextureFile::GetMipData(uint32_t layer, uint32_t mip) const
+	{
+		return mFile.GetData() + mOffsets[layer * mNumMips + mip];
+	}
+
+	size_t TextureFile::GetMipSize(uint32_t mip) const
+	{
+		return mMipSizes[mip];
+	}
+
+	uint32_t TextureFile::GetMipWidth(uint32_t mip) const
+	{
+		return std::max(mWidth >> mip, 1u);
+	}
+
+	uint32_t TextureFile::GetMipHeight(uint32_t mip) const
+	{
+		return std::max(mHeight >> mip, 1u);
+	}
+
+	VkFormat TextureFile::GetFormat() const
+	{
+		return mFormat;
+	}
+
+	uint32_t TextureFile::GetWidth() const
+	{
+		return mWidth;
+	}
+
+	uint32_t TextureFile::GetHeight() const
+	{
+		return mHeight;
+	}
+
+	uint32_t TextureFile::GetNumMips() const
+	{
+		return mNumMips;
+	}
+
+	uint32_t TextureFile::GetNumLayers() const
+	{
+		return mNumLayers;
+	}
+
+	size_t TextureFile::GetDataSize() const
+	{
+		size_t size = 0;
+		for (size_t mipSize : mMipSizes)
+			size += mipSize;
+
+		return size * mNumLayers;
+	}
+}	// VulkanLib namespace
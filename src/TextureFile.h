@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+#include "MappedFile.h"
+
+#define DDS_MAGIC 0x20534444			// "DDS "
+#define DDS_FOURCC_DX10 0x30315844		// "DX10", a DDSHeaderDX10 follows the header
+
+namespace VulkanLib
+{
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	// Follows the magic number
+	struct DDSHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	// Follows the 12 byte identifier
+	struct KTXHeader
+	{
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	/*
+		Memory mapped DDS or KTX file
+
+		Only the header is parsed when the file is opened, the mip levels are pointers straight into the mapping so
+		the texel data can be copied to a staging buffer without reading the file into memory first. Only 2D textures
+		and 2D texture arrays in the formats that GetBlockInfo() knows are supported, cubemaps and volume textures are
+		rejected. DDS files store the layers one after another with all their mips, KTX files store the mips one after
+		another with all their layers, so GetMipData() is used instead of assuming a layout.
+	*/
+	class TextureFile
+	{
+	public:
+		TextureFile();
+
+		bool Open(std::string filename);
+		void Close();
+
+		const uint8_t* GetMipData(uint32_t layer, uint32_t mip) const;
+		size_t GetMipSize(uint32_t mip) const;			// Bytes of one layer
+		uint32_t GetMipWidth(uint32_t mip) const;
+		uint32_t GetMipHeight(uint32_t mip) const;
+
+		VkFormat GetFormat() const;
+		uint32_t GetWidth() const;
+		uint32_t GetHeight() const;
+		uint32_t GetNumMips() const;
+		uint32_t GetNumLayers() const;
+		size_t GetDataSize() const;						// All the mips of all the layers
+
+		// Texels per block side and bytes per block, 1x1 blocks for uncompressed formats. Returns false for unknown formats
+		static bool GetBlockInfo(VkFormat format, uint32_t& blockSize, uint32_t& blockBytes);
+
+		// Writes a 2D texture with one layer, mips[0] is the full size level
+		static bool WriteDDS(std::string filename, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips);
+
+	private:
+		bool ParseDDS();
+		bool ParseKTX();
+
+		// Fills in the mip sizes from the format and dimensions, returns false if the format is unknown
+		bool SetupMips();
+
+		MappedFile					mFile;
+		std::string					mFilename;
+
+		VkFormat					mFormat = VK_FORMAT_UNDEFINED;
+		uint32_t					mWidth = 0;
+		uint32_t					mHeight = 0;
+		uint32_t					mNumMips = 0;
+		uint32_t					mNumLayers = 0;
+
+		std::vector<size_t>			mMipSizes;
+		std::vector<size_t>			mOffsets;			// From the start of the file, layer * mNumMips + mip
+	};
+}	// VulkanLib namespace
@@ -0,0 +1,455 @@
+#include "TextureStreamer.h"
+#include "TextureFile.h"
+#include "VulkanBase.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace VulkanLib
+{
+	static uint32_t GetMipSize(uint32_t size, uint32_t mip)
+	{
+		return std::max(size >> mip, 1u);
+	}
+
+	TextureStreamer::TextureStreamer()
+	{
+
+	}
+
+	void TextureStreamer::Init(VulkanBase* vulkanBase, VkDeviceSize memoryBudget, int numThreads)
+	{
+		mVulkanBase = vulkanBase;
+		mDevice = vulkanBase->GetDevice();
+		mMemoryBudget = memoryBudget;
+		mThreadPool.setThreadCount(numThreads);
+	}
+
+	void TextureStreamer::Cleanup()
+	{
+		// The threads finish their current loads before they are destroyed
+		mThreadPool.setThreadCount(0);
+		mLoadedMips.clear();
+		mNumPendingRequests = 0;
+		mReservedBytes = 0;
+
+		for (auto& texture : mTextures)
+		{
+			vkDestroyImageView(mDevice, texture.texture.view, nullptr);
+			vkDestroyImage(mDevice, texture.texture.image, nullptr);
+			vkDestroySampler(mDevice, texture.texture.sampler, nullptr);
+			vkFreeMemory(mDevice, texture.texture.deviceMemory, nullptr);
+		}
+
+		mTextures.clear();
+		mResidentBytes = 0;
+	}
+
+	int TextureStreamer::AddTexture(std::string filename, VkFormat format)
+	{
+		TextureFile file;
+		if (!file.Open(filename))
+		{
+			VulkanDebug::ConsolePrint("Error loading streamed texture: " + filename);
+			return -1;
+		}
+
+		StreamedTexture texture = {};
+		texture.filename = filename;
+		texture.format = format;
+		texture.width = file.GetWidth();
+		texture.height = file.GetHeight();
+		texture.numMips = file.GetNumMips();
+		texture.residentMip = texture.numMips;		// Nothing is resident yet
+
+		// The tail starts at the first mip that is small enough, a texture without a mip chain is all tail
+		texture.tailMip = texture.numMips - 1;
+		for (uint32_t mip = 0; mip < texture.numMips; mip++)
+		{
+			if (std::max(GetMipSize(texture.width, mip), GetMipSize(texture.height, mip)) <= MIP_TAIL_SIZE)
+			{
+				texture.tailMip = mip;
+				break;
+			}
+		}
+
+		texture.wantedMip = texture.tailMip;
+
+		// The sampler covers the whole chain, the mips that aren't resident are simply missing from the image
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = VK_FILTER_LINEAR;
+		sampler.minFilter = VK_FILTER_LINEAR;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler.mipLodBias = 0.0f;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = (float)texture.numMips;
+		sampler.maxAnisotropy = 8;
+		sampler.anisotropyEnable = mVulkanBase->GetEnabledFeatures().samplerAnisotropy;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VulkanDebug::ErrorCheck(vkCreateSampler(mDevice, &sampler, nullptr, &texture.texture.sampler));
+
+		std::vector<std::vector<uint8_t>> tailMips;
+		for (uint32_t mip = texture.tailMip; mip < texture.numMips; mip++)
+		{
+			const uint8_t* data = file.GetMipData(0, mip);
+			tailMips.push_back(std::vector<uint8_t>(data, data + file.GetMipSize(mip)));
+		}
+
+		VkMemoryRequirements memReqs;
+		VkImage image = CreateImage(texture, texture.tailMip, memReqs);
+		ChangeResidentMips(texture, texture.tailMip, image, memReqs, &tailMips);
+		ExecuteCommands();
+
+		mTextures.push_back(texture);
+
+		return mTextures.size() - 1;
+	}
+
+	void TextureStreamer::RequestTexture(int textureId, float screenSize)
+	{
+		StreamedTexture& texture = mTextures[textureId];
+
+		if (texture.lastUsedFrame != mFrame)
+			texture.screenSize = 0.0f;
+
+		texture.screenSize = std::max(texture.screenSize, screenSize);
+		texture.lastUsedFrame = mFrame;
+	}
+
+	bool TextureStreamer::Update()
+	{
+		bool changed = false;
+		mStats.numLoadedMips = 0;
+		mStats.numEvictedMips = 0;
+
+		// The mip with about one texel per pixel, textures that weren't used this frame only need their tail
+		for (auto& texture : mTextures)
+		{
+			texture.wantedMip = texture.tailMip;
+
+			if (texture.lastUsedFrame == mFrame && texture.screenSize > 0.0f)
+			{
+				float texels = (float)std::max(texture.width, texture.height);
+				float mip = floorf(log2f(texels / std::min(texture.screenSize, texels)));
+				texture.wantedMip = std::min((uint32_t)mip, texture.tailMip);
+			}
+		}
+
+		std::vector<LoadedMip> loadedMips;
+		{
+			std::lock_guard<std::mutex> lock(mLoadedMutex);
+			loadedMips.swap(mLoadedMips);
+		}
+
+		for (auto& loaded : loadedMips)
+		{
+			StreamedTexture& texture = mTextures[loaded.textureId];
+			texture.loading = false;
+			mReservedBytes -= texture.reservedBytes;
+			texture.reservedBytes = 0;
+			mNumPendingRequests--;
+
+			// The texture may have been evicted while the mip was loading, or it isn't needed anymore
+			if (loaded.data.empty() || loaded.mip + 1 != texture.residentMip || loaded.mip < texture.wantedMip)
+				continue;
+
+			VkMemoryRequirements memReqs;
+			VkImage image = CreateImage(texture, loaded.mip, memReqs);
+
+			// The memory was reserved when the load was issued, it only fails if the budget was lowered since then
+			if (!EvictForMip(memReqs.size - texture.residentBytes))
+			{
+				vkDestroyImage(mDevice, image, nullptr);
+				continue;
+			}
+
+			std::vector<std::vector<uint8_t>> mips(1);
+			mips[0].swap(loaded.data);
+			ChangeResidentMips(texture, loaded.mip, image, memReqs, &mips);
+
+			mStats.numLoadedMips++;
+			changed = true;
+		}
+
+		// Gets back under the budget if it has been lowered
+		EvictForMip(0);
+
+		// Most undersampled textures first, then the ones that are largest on screen
+		std::vector<int> candidates;
+		for (int i = 0; i < (int)mTextures.size(); i++)
+		{
+			if (!mTextures[i].loading && mTextures[i].wantedMip < mTextures[i].residentMip)
+				candidates.push_back(i);
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+			uint32_t missingA = mTextures[a].residentMip - mTextures[a].wantedMip;
+			uint32_t missingB = mTextures[b].residentMip - mTextures[b].wantedMip;
+			return (missingA != missingB) ? missingA > missingB : mTextures[a].screenSize > mTextures[b].screenSize;
+		});
+
+		const int maxPendingRequests = (int)mThreadPool.threads.size() * MAX_PENDING_PER_THREAD;
+
+		for (int textureId : candidates)
+		{
+			if (mNumPendingRequests >= maxPendingRequests)
+				break;
+
+			StreamedTexture& texture = mTextures[textureId];
+			const uint32_t mip = texture.residentMip - 1;
+
+			// Reserve the memory before reading the file so the load isn't wasted when it arrives
+			VkMemoryRequirements memReqs;
+			VkImage image = CreateImage(texture, mip, memReqs);
+			vkDestroyImage(mDevice, image, nullptr);
+
+			VkDeviceSize bytes = memReqs.size - texture.residentBytes;
+			if (!EvictForMip(bytes))
+				continue;
+
+			texture.loading = true;
+			texture.reservedBytes = bytes;
+			mReservedBytes += bytes;
+			mNumPendingRequests++;
+
+			std::string filename = texture.filename;
+			mThreadPool.threads[mNextThread]->addJob([=] { LoadMip(textureId, filename, mip); });
+			mNextThread = (mNextThread + 1) % mThreadPool.threads.size();
+		}
+
+		// Evictions also change the image views
+		changed = changed || mStats.numEvictedMips > 0;
+
+		ExecuteCommands();
+
+		mStats.residentBytes = mResidentBytes;
+		mStats.memoryBudget = mMemoryBudget;
+		mStats.numPendingRequests = mNumPendingRequests;
+
+		mFrame++;
+
+		return changed;
+	}
+
+	void TextureStreamer::LoadMip(int textureId, std::string filename, uint32_t mip)
+	{
+		LoadedMip loaded;
+		loaded.textureId = textureId;
+		loaded.mip = mip;
+
+		// Only the pages of the requested level are read from the mapping
+		TextureFile file;
+		if (file.Open(filename) && mip < file.GetNumMips())
+		{
+			const uint8_t* data = file.GetMipData(0, mip);
+			loaded.data.assign(data, data + file.GetMipSize(mip));
+		}
+
+		std::lock_guard<std::mutex> lock(mLoadedMutex);
+		mLoadedMips.push_back(std::move(loaded));
+	}
+
+	VkImage TextureStreamer::CreateImage(StreamedTexture& texture, uint32_t firstMip, VkMemoryRequirements& memReqs)
+	{
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = texture.format;
+		imageCreateInfo.extent = { GetMipSize(texture.width, firstMip), GetMipSize(texture.height, firstMip), 1 };
+		imageCreateInfo.mipLevels = texture.numMips - firstMip;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkImage image;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &image));
+		vkGetImageMemoryRequirements(mDevice, image, &memReqs);
+
+		return image;
+	}
+
+	void TextureStreamer::ChangeResidentMips(StreamedTexture& texture, uint32_t firstMip, VkImage image, VkMemoryRequirements memReqs, const std::vector<std::vector<uint8_t>>* mips)
+	{
+		VkCommandBuffer cmdBuffer = GetCommandBuffer();
+		vkTools::VulkanTexture& oldTexture = texture.texture;
+
+		vkTools::VulkanTexture newTexture = oldTexture;
+		newTexture.image = image;
+		newTexture.width = GetMipSize(texture.width, firstMip);
+		newTexture.height = GetMipSize(texture.height, firstMip);
+		newTexture.mipLevels = texture.numMips - firstMip;
+		newTexture.layerCount = 1;
+
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		mVulkanBase->GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &memAlloc, nullptr, &newTexture.deviceMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, image, newTexture.deviceMemory, 0));
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, newTexture.mipLevels, 0, 1 };
+		vkTools::setImageLayout(cmdBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+		// The mips that are in both images are copied on the GPU
+		if (oldTexture.image != VK_NULL_HANDLE)
+		{
+			VkImageSubresourceRange oldSubresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, oldTexture.mipLevels, 0, 1 };
+			vkTools::setImageLayout(cmdBuffer, oldTexture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, oldSubresourceRange);
+
+			std::vector<VkImageCopy> copyRegions;
+			for (uint32_t mip = std::max(firstMip, texture.residentMip); mip < texture.numMips; mip++)
+			{
+				VkImageCopy copyRegion = {};
+				copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - texture.residentMip, 0, 1 };
+				copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - firstMip, 0, 1 };
+				copyRegion.extent = { GetMipSize(texture.width, mip), GetMipSize(texture.height, mip), 1 };
+				copyRegions.push_back(copyRegion);
+			}
+
+			vkCmdCopyImage(cmdBuffer, oldTexture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+		}
+
+		Garbage garbage = {};
+		garbage.texture = oldTexture;
+
+		// The new mips are packed in one staging buffer, the offsets are aligned for block compressed formats
+		if (mips != nullptr)
+		{
+			std::vector<VkBufferImageCopy> copyRegions;
+			std::vector<uint8_t> staging;
+
+			for (uint32_t i = 0; i < mips->size(); i++)
+			{
+				const uint32_t mip = firstMip + i;
+
+				VkBufferImageCopy copyRegion = {};
+				copyRegion.bufferOffset = (staging.size() + 15) & ~(VkDeviceSize)15;
+				copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+				copyRegion.imageExtent = { GetMipSize(texture.width, mip), GetMipSize(texture.height, mip), 1 };
+				copyRegions.push_back(copyRegion);
+
+				staging.resize(copyRegion.bufferOffset + (*mips)[i].size());
+				memcpy(staging.data() + copyRegion.bufferOffset, (*mips)[i].data(), (*mips)[i].size());
+			}
+
+			mVulkanBase->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, staging.size(), staging.data(), &garbage.stagingBuffer, &garbage.stagingMemory);
+			vkCmdCopyBufferToImage(cmdBuffer, garbage.stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+		}
+
+		newTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkTools::setImageLayout(cmdBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newTexture.imageLayout, subresourceRange);
+
+		VkImageViewCreateInfo view = {};
+		view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view.format = texture.format;
+		view.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		view.subresourceRange = subresourceRange;
+		view.image = image;
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &view, nullptr, &newTexture.view));
+
+		// The old image is still read by the copy, it's destroyed after the commands have executed
+		if (garbage.texture.image != VK_NULL_HANDLE || garbage.stagingBuffer != VK_NULL_HANDLE)
+			mGarbage.push_back(garbage);
+
+		mResidentBytes = mResidentBytes - texture.residentBytes + memReqs.size;
+		texture.residentBytes = memReqs.size;
+		texture.residentMip = firstMip;
+		texture.texture = newTexture;
+	}
+
+	// Drops the mips that textures don't need anymore until there is room for the new bytes
+	// The least recently used textures go first, mips that are needed this frame are never evicted
+	bool TextureStreamer::EvictForMip(VkDeviceSize bytes)
+	{
+		while (mResidentBytes + mReservedBytes + bytes > mMemoryBudget)
+		{
+			StreamedTexture* oldest = nullptr;
+			for (auto& texture : mTextures)
+			{
+				if (texture.residentMip < texture.wantedMip && (oldest == nullptr || texture.lastUsedFrame < oldest->lastUsedFrame))
+					oldest = &texture;
+			}
+
+			if (oldest == nullptr)
+				return false;
+
+			VkMemoryRequirements memReqs;
+			VkImage image = CreateImage(*oldest, oldest->wantedMip, memReqs);
+			mStats.numEvictedMips += oldest->wantedMip - oldest->residentMip;
+			ChangeResidentMips(*oldest, oldest->wantedMip, image, memReqs, nullptr);
+		}
+
+		return true;
+	}
+
+	VkCommandBuffer TextureStreamer::GetCommandBuffer()
+	{
+		if (!mRecording)
+		{
+			mVulkanBase->CreateSetupCommandBuffer();
+			mRecording = true;
+		}
+
+		return mVulkanBase->GetSetupCommandBuffer();
+	}
+
+	void TextureStreamer::ExecuteCommands()
+	{
+		if (!mRecording)
+			return;
+
+		mVulkanBase->ExecuteSetupCommandBuffer();	// Waits for the queue to be idle
+		mRecording = false;
+
+		// The sampler is shared with the new image
+		for (auto& garbage : mGarbage)
+		{
+			vkDestroyImageView(mDevice, garbage.texture.view, nullptr);
+			vkDestroyImage(mDevice, garbage.texture.image, nullptr);
+			vkFreeMemory(mDevice, garbage.texture.deviceMemory, nullptr);
+			vkDestroyBuffer(mDevice, garbage.stagingBuffer, nullptr);
+			vkFreeMemory(mDevice, garbage.stagingMemory, nullptr);
+		}
+
+		mGarbage.clear();
+	}
+
+	void TextureStreamer::WaitForRequests()
+	{
+		mThreadPool.wait();
+	}
+
+	void TextureStreamer::SetMemoryBudget(VkDeviceSize bytes)
+	{
+		mMemoryBudget = bytes;
+	}
+
+	vkTools::VulkanTexture& TextureStreamer::GetTexture(int textureId)
+	{
+		return mTextures[textureId].texture;
+	}
+
+	uint32_t TextureStreamer::GetResidentMip(int textureId)
+	{
+		return mTextures[textureId].residentMip;
+	}
+
+	TextureStreamingStats TextureStreamer::GetStats()
+	{
+		return mStats;
+	}
+
+	int TextureStreamer::GetNumTextures()
+	{
+		return mTextures.size();
+	}
+}	// VulkanLib namespace
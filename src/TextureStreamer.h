@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include "base/vulkanTextureLoader.hpp"
+#include "ThreadPool.h"
+
+#define MIP_TAIL_SIZE 64				// Mips this size and smaller are loaded when the texture is added and never evicted
+#define MAX_PENDING_PER_THREAD 2		// Outstanding mip loads per streaming thread
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	class VulkanBase;
+
+	struct StreamedTexture
+	{
+		std::string				filename;
+		VkFormat				format;
+		uint32_t				width, height;		// Of mip 0
+		uint32_t				numMips;			// In the file
+		uint32_t				tailMip;			// Most detailed mip that is always resident
+		uint32_t				residentMip;		// Most detailed mip in the image, the image holds residentMip..numMips-1
+		uint32_t				wantedMip;
+		float					screenSize;			// Largest projected size this frame, in pixels
+		uint64_t				lastUsedFrame;
+		bool					loading;
+		VkDeviceSize			residentBytes;
+		VkDeviceSize			reservedBytes;		// For the mip that is loading
+		vkTools::VulkanTexture	texture;
+	};
+
+	struct TextureStreamingStats
+	{
+		VkDeviceSize			residentBytes;
+		VkDeviceSize			memoryBudget;
+		int						numPendingRequests;
+		int						numLoadedMips;		// This frame
+		int						numEvictedMips;		// This frame
+	};
+
+	/*
+		Streams the mip levels of DDS textures in and out of GPU memory depending on how large they are on screen
+
+		AddTexture() only uploads the mip tail so the texture can be used right away. Every frame RequestTexture() is
+		called with the projected size of each object using the texture, and Update() turns the largest size into the
+		mip level that is needed. Missing mips are read on the streaming threads one level at a time, most undersampled
+		textures first, so textures sharpen progressively instead of waiting for the whole chain.
+
+		Vulkan 1.0 has no way to release single mips of an image, so adding or dropping mips creates a new image with
+		the new mip range and copies the mips that are already resident on the GPU. Mips are evicted from textures that
+		have more detail than they need, least recently used first, whenever a new mip doesn't fit in the budget.
+
+		Update() must be called when the GPU isn't using the textures. The image views change when mips are streamed,
+		so descriptor sets that use the textures have to be updated when it returns true.
+	*/
+	class TextureStreamer
+	{
+	public:
+		TextureStreamer();
+
+		void Init(VulkanBase* vulkanBase, VkDeviceSize memoryBudget, int numThreads);
+		void Cleanup();
+
+		// Returns the texture id
+		int AddTexture(std::string filename, VkFormat format);
+
+		// Can be called any number of times per frame, the largest size is used
+		void RequestTexture(int textureId, float screenSize);
+
+		// Uploads the loaded mips, evicts mips and issues new loads. Returns true if any image view changed
+		bool Update();
+
+		// Blocks until all the outstanding mip loads are finished
+		void WaitForRequests();
+
+		void SetMemoryBudget(VkDeviceSize bytes);
+
+		vkTools::VulkanTexture& GetTexture(int textureId);
+		uint32_t GetResidentMip(int textureId);
+		TextureStreamingStats GetStats();				// Of the last Update()
+		int GetNumTextures();
+
+	private:
+		struct LoadedMip
+		{
+			int textureId;
+			uint32_t mip;
+			std::vector<uint8_t> data;					// Empty if the file couldn't be read
+		};
+
+		void LoadMip(int textureId, std::string filename, uint32_t mip);
+
+		// Records the commands that move the texture to image, which holds the mips firstMip..numMips-1
+		// mips has the data of the mips from firstMip up to the current resident mip when mips are added
+		void ChangeResidentMips(StreamedTexture& texture, uint32_t firstMip, VkImage image, VkMemoryRequirements memReqs, const std::vector<std::vector<uint8_t>>* mips);
+
+		VkImage CreateImage(StreamedTexture& texture, uint32_t firstMip, VkMemoryRequirements& memReqs);
+		bool EvictForMip(VkDeviceSize bytes);
+
+		// The commands are recorded to the setup command buffer of VulkanBase
+		VkCommandBuffer GetCommandBuffer();
+		void ExecuteCommands();
+
+		VulkanBase*							mVulkanBase = nullptr;
+		VkDevice							mDevice = VK_NULL_HANDLE;
+		VkDeviceSize						mMemoryBudget = 0;
+		VkDeviceSize						mResidentBytes = 0;
+		VkDeviceSize						mReservedBytes = 0;
+		uint64_t							mFrame = 0;
+
+		std::vector<StreamedTexture>		mTextures;
+		TextureStreamingStats				mStats = {};
+		int									mNumPendingRequests = 0;
+
+		// Released after the setup command buffer has executed
+		struct Garbage
+		{
+			vkTools::VulkanTexture texture;
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingMemory;
+		};
+		std::vector<Garbage>				mGarbage;
+		bool								mRecording = false;
+
+		ThreadPool							mThreadPool;
+		int									mNextThread = 0;
+
+		// Guarded by mLoadedMutex, written by the streaming threads
+		std::mutex							mLoadedMutex;
+		std::vector<LoadedMip>				mLoadedMips;
+	};
+}	// VulkanLib namespace
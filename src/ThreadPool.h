@@ -6,11 +6,15 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
 #include <thread>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 
 namespace VulkanLib
 {
@@ -0,0 +1,235 @@
+#include "TiledHeightmap.h"
+#include "TerrainBuilder.h"
+#include "VulkanDebug.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+#define TILE_ALIGNMENT 4096
+
+namespace VulkanLib
+{
+	static uint64_t AlignOffset(uint64_t offset)
+	{
+		return (offset + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+	}
+
+	static size_t GetSampleSize(uint32_t format)
+	{
+		return (format == HEIGHT_FORMAT_UINT16) ? sizeof(uint16_t) : sizeof(float);
+	}
+
+	TiledHeightmap::TiledHeightmap()
+	{
+
+	}
+
+	bool TiledHeightmap::Write(std::string filename, int width, int height, int tileSize, HeightFormat format, std::function<float(int x, int z)> heightFunction)
+	{
+		assert(width > 1 && height > 1 && tileSize > 0);
+
+		std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+		if (!fout.is_open())
+			return false;
+
+		TiledHeightmapHeader header;
+		header.magic = TILED_HEIGHTMAP_MAGIC;
+		header.version = TILED_HEIGHTMAP_VERSION;
+		header.width = width;
+		header.height = height;
+		header.tileSize = tileSize;
+		header.format = format;
+		header.numTilesX = (width - 1 + tileSize - 1) / tileSize;
+		header.numTilesZ = (height - 1 + tileSize - 1) / tileSize;
+
+		const int samples = tileSize + 1;
+		const size_t tileBytes = samples * samples * GetSampleSize(format);
+		std::vector<TileInfo> tiles(header.numTilesX * header.numTilesZ);
+
+		uint64_t offset = AlignOffset(sizeof(TiledHeightmapHeader) + tiles.size() * sizeof(TileInfo));
+		std::vector<float> heights(samples * samples);
+		std::vector<uint8_t> data(tileBytes);
+		std::vector<char> padding(TILE_ALIGNMENT, 0);
+
+		// The tile table is written last, once the min and max heights are known
+		fout.seekp(offset);
+
+		for (uint32_t tz = 0; tz < header.numTilesZ; tz++)
+		{
+			for (uint32_t tx = 0; tx < header.numTilesX; tx++)
+			{
+				TileInfo& tile = tiles[tx + tz * header.numTilesX];
+				tile.offset = offset;
+				tile.minHeight = FLT_MAX;
+				tile.maxHeight = -FLT_MAX;
+
+				// Texels outside the heightmap are clamped to the edge
+				for (int z = 0; z < samples; z++)
+				{
+					for (int x = 0; x < samples; x++)
+					{
+						int texelX = std::min((int)tx * tileSize + x, width - 1);
+						int texelZ = std::min((int)tz * tileSize + z, height - 1);
+						float value = heightFunction(texelX, texelZ);
+
+						heights[x + z * samples] = value;
+						tile.minHeight = std::min(tile.minHeight, value);
+						tile.maxHeight = std::max(tile.maxHeight, value);
+					}
+				}
+
+				if (format == HEIGHT_FORMAT_UINT16)
+				{
+					float range = tile.maxHeight - tile.minHeight;
+					float scale = (range > 0.0f) ? 65535.0f / range : 0.0f;
+					uint16_t* out = (uint16_t*)data.data();
+
+					for (int i = 0; i < samples * samples; i++)
+						out[i] = (uint16_t)std::min(65535.0f, floorf((heights[i] - tile.minHeight) * scale + 0.5f));
+				}
+				else
+				{
+					memcpy(data.data(), heights.data(), tileBytes);
+				}
+
+				fout.write((const char*)data.data(), tileBytes);
+
+				uint64_t nextOffset = AlignOffset(offset + tileBytes);
+				fout.write(padding.data(), nextOffset - (offset + tileBytes));
+				offset = nextOffset;
+			}
+		}
+
+		fout.seekp(0);
+		fout.write((const char*)&header, sizeof(TiledHeightmapHeader));
+		fout.write((const char*)tiles.data(), tiles.size() * sizeof(TileInfo));
+
+		return fout.good();
+	}
+
+	bool TiledHeightmap::Write(std::string filename, const HeightField& heightField, int tileSize, HeightFormat format)
+	{
+		return Write(filename, heightField.width, heightField.height, tileSize, format, [&](int x, int z) {
+			return heightField.Get(x, z);
+		});
+	}
+
+	bool TiledHeightmap::Open(std::string filename)
+	{
+		Close();
+
+		if (!mFile.Open(filename))
+		{
+			VulkanDebug::ConsolePrint("Error opening tiled heightmap: " + filename);
+			return false;
+		}
+
+		const TiledHeightmapHeader* header = (const TiledHeightmapHeader*)mFile.GetData();
+		const size_t fileSize = mFile.GetSize();
+
+		bool valid = fileSize >= sizeof(TiledHeightmapHeader) && header->magic == TILED_HEIGHTMAP_MAGIC && header->version == TILED_HEIGHTMAP_VERSION &&
+			header->tileSize > 0 && (header->format == HEIGHT_FORMAT_UINT16 || header->format == HEIGHT_FORMAT_FLOAT);
+
+		if (valid)
+		{
+			size_t numTiles = (size_t)header->numTilesX * header->numTilesZ;
+			valid = numTiles > 0 && fileSize >= sizeof(TiledHeightmapHeader) + numTiles * sizeof(TileInfo);
+
+			const TileInfo* tiles = (const TileInfo*)(mFile.GetData() + sizeof(TiledHeightmapHeader));
+			const size_t tileBytes = (size_t)(header->tileSize + 1) * (header->tileSize + 1) * GetSampleSize(header->format);
+
+			for (size_t i = 0; valid && i < numTiles; i++)
+				valid = tiles[i].offset + tileBytes <= fileSize;
+		}
+
+		if (!valid)
+		{
+			VulkanDebug::ConsolePrint("Invalid tiled heightmap: " + filename);
+			mFile.Close();
+			return false;
+		}
+
+		mHeader = header;
+		mTiles = (const TileInfo*)(mFile.GetData() + sizeof(TiledHeightmapHeader));
+
+		return true;
+	}
+
+	void TiledHeightmap::Close()
+	{
+		mFile.Close();
+		mHeader = nullptr;
+		mTiles = nullptr;
+	}
+
+	void TiledHeightmap::ReadTile(int tileX, int tileZ, std::vector<float>& heights)
+	{
+		const TileInfo& tile = GetTileInfo(tileX, tileZ);
+		const int samples = GetTileSamples();
+		const size_t tileBytes = samples * samples * GetSampleSize(mHeader->format);
+		const uint8_t* data = mFile.GetData() + tile.offset;
+
+		heights.resize(samples * samples);
+
+		if (mHeader->format == HEIGHT_FORMAT_UINT16)
+		{
+			const uint16_t* in = (const uint16_t*)data;
+			const float scale = (tile.maxHeight - tile.minHeight) / 65535.0f;
+
+			for (int i = 0; i < samples * samples; i++)
+				heights[i] = tile.minHeight + in[i] * scale;
+		}
+		else
+		{
+			memcpy(heights.data(), data, tileBytes);
+		}
+
+		// The decoded copy is what gets kept, the mapped pages are not needed anymore
+		mFile.Discard(tile.offset, tileBytes);
+	}
+
+	const TileInfo& TiledHeightmap::GetTileInfo(int tileX, int tileZ) const
+	{
+		assert(tileX >= 0 && tileX < (int)mHeader->numTilesX && tileZ >= 0 && tileZ < (int)mHeader->numTilesZ);
+		return mTiles[tileX + tileZ * mHeader->numTilesX];
+	}
+
+	int TiledHeightmap::GetWidth() const
+	{
+		return mHeader->width;
+	}
+
+	int TiledHeightmap::GetHeight() const
+	{
+		return mHeader->height;
+	}
+
+	int TiledHeightmap::GetTileSize() const
+	{
+		return mHeader->tileSize;
+	}
+
+	int TiledHeightmap::GetTileSamples() const
+	{
+		return mHeader->tileSize + 1;
+	}
+
+	int TiledHeightmap::GetNumTilesX() const
+	{
+		return mHeader->numTilesX;
+	}
+
+	int TiledHeightmap::GetNumTilesZ() const
+	{
+		return mHeader->numTilesZ;
+	}
+
+	size_t TiledHeightmap::GetDecodedTileSize() const
+	{
+		return GetTileSamples() * GetTileSamples() * sizeof(float);
+	}
+}	// VulkanLib namespace
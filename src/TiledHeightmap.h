@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include "MappedFile.h"
+
+#define TILED_HEIGHTMAP_MAGIC 0x314d4854		// "THM1"
+#define TILED_HEIGHTMAP_VERSION 1
+
+namespace VulkanLib
+{
+	struct HeightField;
+
+	enum HeightFormat
+	{
+		HEIGHT_FORMAT_UINT16 = 0,		// Quantized between the min and max height of the tile
+		HEIGHT_FORMAT_FLOAT = 1
+	};
+
+	struct TiledHeightmapHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;				// Texels
+		uint32_t height;
+		uint32_t tileSize;			// Quads per tile side, a tile stores (tileSize + 1)^2 heights
+		uint32_t format;			// HeightFormat
+		uint32_t numTilesX;
+		uint32_t numTilesZ;
+	};
+
+	struct TileInfo
+	{
+		uint64_t offset;			// From the start of the file, page aligned
+		float minHeight;
+		float maxHeight;
+	};
+
+	/*
+		Heightmap split into square tiles that can be read independently of each other
+
+		File layout: TiledHeightmapHeader, one TileInfo per tile (row major) and then the tile data. Neighbouring tiles
+		share their border row and column so a tile can be used without its neighbours. The tile data starts on
+		4096 byte boundaries so the pages of a single tile can be dropped after it has been read.
+
+		The file is memory mapped, opening it only reads the header and tile table no matter how large it is.
+	*/
+	class TiledHeightmap
+	{
+	public:
+		TiledHeightmap();
+
+		// Writes a heightmap of any size, the heights are requested one tile at a time so it never needs to be in memory
+		static bool Write(std::string filename, int width, int height, int tileSize, HeightFormat format, std::function<float(int x, int z)> heightFunction);
+		static bool Write(std::string filename, const HeightField& heightField, int tileSize, HeightFormat format);
+
+		bool Open(std::string filename);
+		void Close();
+
+		// Decodes a tile to floats, can be called from any thread
+		void ReadTile(int tileX, int tileZ, std::vector<float>& heights);
+
+		const TileInfo& GetTileInfo(int tileX, int tileZ) const;
+		int GetWidth() const;
+		int GetHeight() const;
+		int GetTileSize() const;
+		int GetTileSamples() const;			// Heights per tile side
+		int GetNumTilesX() const;
+		int GetNumTilesZ() const;
+		size_t GetDecodedTileSize() const;	// Bytes
+
+	private:
+		MappedFile					mFile;
+		const TiledHeightmapHeader*	mHeader = nullptr;
+		const TileInfo*				mTiles = nullptr;
+	};
+}	// VulkanLib namespace
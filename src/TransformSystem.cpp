@@ -0,0 +1,228 @@
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+#include <glm/gtc/constants.hpp>
+
+namespace VulkanLib
+{
+	TransformSystem& TransformSystem::GetDefault()
+	{
+		static TransformSystem transformSystem;
+		return transformSystem;
+	}
+
+	int TransformSystem::Create()
+	{
+		int handle;
+
+		if (mFreeHandles.size() != 0)
+		{
+			handle = mFreeHandles.back();
+			mFreeHandles.pop_back();
+		}
+		else
+		{
+			handle = mWorld.size();
+
+			for (auto component : { &mPositionX, &mPositionY, &mPositionZ, &mRotationX, &mRotationY, &mRotationZ,
+				&mSinX, &mSinY, &mSinZ, &mCosX, &mCosY, &mCosZ, &mScaleX, &mScaleY, &mScaleZ })
+				component->push_back(0.0f);
+
+			mWorld.push_back(mat4());
+			mDirtyBits.resize(handle / 32 + 1, 0);
+		}
+
+		// The identity, no trigonometry needed
+		mPositionX[handle] = mPositionY[handle] = mPositionZ[handle] = 0.0f;
+		mRotationX[handle] = mRotationY[handle] = mRotationZ[handle] = 0.0f;
+		mSinX[handle] = mSinY[handle] = mSinZ[handle] = 0.0f;
+		mCosX[handle] = mCosY[handle] = mCosZ[handle] = 1.0f;
+		mScaleX[handle] = mScaleY[handle] = mScaleZ[handle] = 1.0f;
+		mWorld[handle] = mat4(1.0f);
+
+		mNumTransforms++;
+
+		return handle;
+	}
+
+	void TransformSystem::Destroy(int handle)
+	{
+		mDirtyBits[handle / 32] &= ~(1u << (handle % 32));
+		mFreeHandles.push_back(handle);
+		mNumTransforms--;
+	}
+
+	void TransformSystem::SetPosition(int handle, vec3 position)
+	{
+		mPositionX[handle] = position.x;
+		mPositionY[handle] = position.y;
+		mPositionZ[handle] = position.z;
+		SetDirty(handle);
+	}
+
+	void TransformSystem::SetRotation(int handle, vec3 rotation)
+	{
+		mRotationX[handle] = rotation.x;
+		mRotationY[handle] = rotation.y;
+		mRotationZ[handle] = rotation.z;
+
+		vec3 radians = glm::radians(rotation);
+		mSinX[handle] = sinf(radians.x);
+		mSinY[handle] = sinf(radians.y);
+		mSinZ[handle] = sinf(radians.z);
+		mCosX[handle] = cosf(radians.x);
+		mCosY[handle] = cosf(radians.y);
+		mCosZ[handle] = cosf(radians.z);
+		SetDirty(handle);
+	}
+
+	void TransformSystem::SetScale(int handle, vec3 scale)
+	{
+		mScaleX[handle] = scale.x;
+		mScaleY[handle] = scale.y;
+		mScaleZ[handle] = scale.z;
+		SetDirty(handle);
+	}
+
+	vec3 TransformSystem::GetPosition(int handle) const
+	{
+		return vec3(mPositionX[handle], mPositionY[handle], mPositionZ[handle]);
+	}
+
+	vec3 TransformSystem::GetRotation(int handle) const
+	{
+		return vec3(mRotationX[handle], mRotationY[handle], mRotationZ[handle]);
+	}
+
+	vec3 TransformSystem::GetScale(int handle) const
+	{
+		return vec3(mScaleX[handle], mScaleY[handle], mScaleZ[handle]);
+	}
+
+	const mat4& TransformSystem::GetWorldMatrix(int handle) const
+	{
+		return mWorld[handle];
+	}
+
+	void TransformSystem::Update(ThreadPool* threadPool)
+	{
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		// Clearing the bit also skips the handles that are queued twice, so no two threads write the same matrix
+		mRebuildHandles.clear();
+		for (int handle : mDirtyHandles)
+		{
+			uint32_t bit = 1u << (handle % 32);
+			if (mDirtyBits[handle / 32] & bit)
+			{
+				mRebuildHandles.push_back(handle);
+				mDirtyBits[handle / 32] &= ~bit;
+			}
+		}
+
+		mDirtyHandles.clear();
+
+		int numDirty = mRebuildHandles.size();
+		int numThreads = threadPool != nullptr ? threadPool->threads.size() : 0;
+
+		if (numDirty < TRANSFORM_PARALLEL_MIN || numThreads == 0)
+			RebuildMatrices(mRebuildHandles.data(), numDirty);
+		else
+		{
+			// Every thread gets a run of handles that is a multiple of 4
+			int perThread = ((numDirty + numThreads - 1) / numThreads + 3) & ~3;
+			for (int t = 0; t < numThreads; t++)
+			{
+				int first = std::min(t * perThread, numDirty);
+				int count = std::min(perThread, numDirty - first);
+				if (count > 0)
+					threadPool->threads[t]->addJob([=] { RebuildMatrices(mRebuildHandles.data() + first, count); });
+			}
+
+			threadPool->wait();
+		}
+
+		mNumRebuilt = numDirty;
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mUpdateTime = std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	TransformStats TransformSystem::GetStats() const
+	{
+		TransformStats stats = {};
+		stats.numTransforms = mNumTransforms;
+		stats.numRebuilt = mNumRebuilt;
+		stats.updateTime = mUpdateTime;
+		return stats;
+	}
+
+	void TransformSystem::SetDirty(int handle)
+	{
+		uint32_t bit = 1u << (handle % 32);
+		if ((mDirtyBits[handle / 32] & bit) == 0)
+		{
+			mDirtyBits[handle / 32] |= bit;
+			mDirtyHandles.push_back(handle);
+		}
+	}
+
+	void TransformSystem::RebuildMatrices(const int* handles, int numHandles)
+	{
+		// Same as translate * rotate(x) * rotate(y) * rotate(z) * scale, every lane of the registers is one transform
+		for (int i = 0; i < numHandles; i += 4)
+		{
+			// The last group repeats its last handle
+			int h[4];
+			for (int lane = 0; lane < 4; lane++)
+				h[lane] = handles[std::min(i + lane, numHandles - 1)];
+
+			#define TRANSFORM_LOAD(component) _mm_setr_ps(component[h[0]], component[h[1]], component[h[2]], component[h[3]])
+
+			__m128 sx = TRANSFORM_LOAD(mSinX), sy = TRANSFORM_LOAD(mSinY), sz = TRANSFORM_LOAD(mSinZ);
+			__m128 cx = TRANSFORM_LOAD(mCosX), cy = TRANSFORM_LOAD(mCosY), cz = TRANSFORM_LOAD(mCosZ);
+			__m128 scaleX = TRANSFORM_LOAD(mScaleX), scaleY = TRANSFORM_LOAD(mScaleY), scaleZ = TRANSFORM_LOAD(mScaleZ);
+			__m128 px = TRANSFORM_LOAD(mPositionX), py = TRANSFORM_LOAD(mPositionY), pz = TRANSFORM_LOAD(mPositionZ);
+
+			#undef TRANSFORM_LOAD
+
+			__m128 sxsy = _mm_mul_ps(sx, sy);
+			__m128 cxsy = _mm_mul_ps(cx, sy);
+
+			// The rotation, rXY is row X and column Y
+			__m128 r00 = _mm_mul_ps(cy, cz);
+			__m128 r01 = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(cy, sz));
+			__m128 r02 = sy;
+			__m128 r10 = _mm_add_ps(_mm_mul_ps(sxsy, cz), _mm_mul_ps(cx, sz));
+			__m128 r11 = _mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz));
+			__m128 r12 = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sx, cy));
+			__m128 r20 = _mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz));
+			__m128 r21 = _mm_add_ps(_mm_mul_ps(cxsy, sz), _mm_mul_ps(sx, cz));
+			__m128 r22 = _mm_mul_ps(cx, cy);
+
+			// The columns of the world matrices, transposed so every register is one column of one transform
+			__m128 column0[4] = { _mm_mul_ps(r00, scaleX), _mm_mul_ps(r10, scaleX), _mm_mul_ps(r20, scaleX), _mm_setzero_ps() };
+			__m128 column1[4] = { _mm_mul_ps(r01, scaleY), _mm_mul_ps(r11, scaleY), _mm_mul_ps(r21, scaleY), _mm_setzero_ps() };
+			__m128 column2[4] = { _mm_mul_ps(r02, scaleZ), _mm_mul_ps(r12, scaleZ), _mm_mul_ps(r22, scaleZ), _mm_setzero_ps() };
+			__m128 column3[4] = { px, py, pz, _mm_set1_ps(1.0f) };
+
+			_MM_TRANSPOSE4_PS(column0[0], column0[1], column0[2], column0[3]);
+			_MM_TRANSPOSE4_PS(column1[0], column1[1], column1[2], column1[3]);
+			_MM_TRANSPOSE4_PS(column2[0], column2[1], column2[2], column2[3]);
+			_MM_TRANSPOSE4_PS(column3[0], column3[1], column3[2], column3[3]);
+
+			for (int lane = 0; lane < 4; lane++)
+			{
+				mat4& world = mWorld[h[lane]];
+				_mm_storeu_ps(&world[0][0], column0[lane]);
+				_mm_storeu_ps(&world[1][0], column1[lane]);
+				_mm_storeu_ps(&world[2][0], column2[lane]);
+				_mm_storeu_ps(&world[3][0], column3[lane]);
+			}
+		}
+	}
+}	// VulkanLib namespace
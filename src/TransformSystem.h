@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#define TRANSFORM_PARALLEL_MIN 2048		// Fewer dirty transforms than this are rebuilt on the calling thread
+
+using namespace glm;
+
+namespace VulkanLib
+{
+	class ThreadPool;
+
+	struct TransformStats
+	{
+		int						numTransforms;
+		int						numRebuilt;			// In the last Update()
+		double					updateTime;			// Milliseconds
+	};
+
+	/*
+		The position, rotation, scale and world matrix of every Object, stored as structure of arrays
+
+		Every component is its own array indexed by the handle from Create(), so the rebuild only touches the data it
+		needs. The setters only store the value and set the dirty bit of the handle, SetRotation() also stores the sine
+		and cosine of the angles so the trigonometry runs once per rotation change instead of once per rebuild.
+
+		Update() rebuilds the world matrix of every dirty transform with SSE, 4 transforms at a time, and splits them
+		over the threads of the pool when there are more than TRANSFORM_PARALLEL_MIN. The dirty handles are queued by
+		the setters so an Update() after a few changes only touches those.
+
+		GetWorldMatrix() only reads, so any number of threads can call it. It returns the matrix of the last Update(),
+		which the renderer calls before the frame is recorded and code that reads a matrix outside of the frame calls
+		after changing the transforms. The transforms must not change while other threads read them.
+	*/
+	class TransformSystem
+	{
+	public:
+		// Every Object lives in this one
+		static TransformSystem& GetDefault();
+
+		int Create();
+		void Destroy(int handle);
+
+		void SetPosition(int handle, vec3 position);
+		void SetRotation(int handle, vec3 rotation);		// Degrees, applied in the order x, y, z
+		void SetScale(int handle, vec3 scale);
+
+		vec3 GetPosition(int handle) const;
+		vec3 GetRotation(int handle) const;
+		vec3 GetScale(int handle) const;
+		const mat4& GetWorldMatrix(int handle) const;		// As of the last Update()
+
+		// Rebuilds the dirty world matrices, the pool can be null
+		void Update(ThreadPool* threadPool);
+
+		TransformStats GetStats() const;
+
+	private:
+		void SetDirty(int handle);
+		void RebuildMatrices(const int* handles, int numHandles);
+
+		// One entry per handle
+		std::vector<float>		mPositionX, mPositionY, mPositionZ;
+		std::vector<float>		mRotationX, mRotationY, mRotationZ;		// Degrees, only returned by GetRotation()
+		std::vector<float>		mSinX, mSinY, mSinZ;
+		std::vector<float>		mCosX, mCosY, mCosZ;
+		std::vector<float>		mScaleX, mScaleY, mScaleZ;
+		std::vector<mat4>		mWorld;
+
+		std::vector<uint32_t>	mDirtyBits;			// One bit per handle
+		std::vector<int>		mDirtyHandles;		// Queued by SetDirty(), can contain destroyed handles
+		std::vector<int>		mRebuildHandles;	// The handles in mDirtyHandles that are still dirty, collected by Update()
+		std::vector<int>		mFreeHandles;
+
+		int						mNumTransforms = 0;
+		int						mNumRebuilt = 0;
+		double					mUpdateTime = 0.0;
+	};
+}	// VulkanLib namespace
@@ -1,46 +1,97 @@
 #pragma once
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 
 namespace VulkanLib
 {
 	/*
-		Interface for all the different vertex attribute
-		Extend it with new vertex attributes whenever needed
+		The VkFormat of every type that can be used as a vertex attribute
+		Using a type without a specialization is a compile error, add new ones whenever needed
 	*/
-	class VertexAttribute
+	template<typename T> struct VertexFormat;
+
+	template<> struct VertexFormat<float>			{ static const VkFormat format = VK_FORMAT_R32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec2>		{ static const VkFormat format = VK_FORMAT_R32G32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec3>		{ static const VkFormat format = VK_FORMAT_R32G32B32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec4>		{ static const VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; };
+	template<> struct VertexFormat<uint32_t>		{ static const VkFormat format = VK_FORMAT_R32_UINT; };
+	template<> struct VertexFormat<glm::u8vec4>		{ static const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM; };	// Packed colors
+	template<> struct VertexFormat<glm::i8vec4>		{ static const VkFormat format = VK_FORMAT_R8G8B8A8_SNORM; };	// Packed normals and tangents
+
+	// One member of a vertex struct, use VERTEX_MEMBER() to get the type and offset from the struct
+	template<typename T, uint32_t Offset>
+	struct VertexMember
 	{
-	public:
-		virtual VkFormat GetFormat() = 0;
-		virtual uint32_t GetSize() = 0;
+		typedef T Type;
+		static const uint32_t offset = Offset;
+		static const VkFormat format = VertexFormat<T>::format;
 	};
 
-	class Vec2Attribute : public VertexAttribute
+	#define VERTEX_MEMBER(Vertex, member) VulkanLib::VertexMember<decltype(Vertex::member), offsetof(Vertex, member)>
+
+	// Walks the members at compile time, each member has to start where the previous one ended
+	template<uint32_t Offset, typename... Members>
+	struct VertexMemberList
 	{
-	public:
-		virtual VkFormat GetFormat() { return VK_FORMAT_R32G32_SFLOAT; }
-		virtual uint32_t GetSize() { return sizeof(glm::vec2); }
+		static const uint32_t end = Offset;
 	};
 
-	class Vec3Attribute : public VertexAttribute
+	template<uint32_t Offset, typename Member, typename... Rest>
+	struct VertexMemberList<Offset, Member, Rest...>
 	{
-	public:
-		virtual VkFormat GetFormat() { return VK_FORMAT_R32G32B32_SFLOAT; }
-		virtual uint32_t GetSize() { return sizeof(glm::vec3); }
+		static_assert(Member::offset == Offset, "Vertex members must be listed in declaration order and the struct can't have padding");
+		static_assert(Member::offset % 4 == 0, "Vertex attributes must be 4 byte aligned");
+
+		static const uint32_t end = VertexMemberList<Offset + sizeof(typename Member::Type), Rest...>::end;
+	};
+
+	/*
+		Compile time description of a vertex struct, the members are listed right after the struct:
+
+			struct VertexAttributes { vec3 Color; vec3 Normal; ... };
+			typedef VertexLayout<VertexAttributes, VERTEX_MEMBER(VertexAttributes, Color), VERTEX_MEMBER(VertexAttributes, Normal), ...> VertexAttributesLayout;
+
+		The stride comes from sizeof, the offsets from offsetof and the formats from the member types, so they can't
+		be out of sync with the struct. A member that is missing, out of order or separated by padding is a compile
+		error. The GLSL inputs still have to match, the locations are given in the order of the members.
+	*/
+	template<typename Vertex, typename... Members>
+	struct VertexLayout
+	{
+		static_assert(sizeof...(Members) > 0, "A vertex layout needs at least one member");
+		static_assert(VertexMemberList<0, Members...>::end == sizeof(Vertex), "Every member of the vertex struct must be in the layout");
+
+		static const uint32_t stride = sizeof(Vertex);
+		static const uint32_t numAttributes = sizeof...(Members);
+		static const VkFormat formats[sizeof...(Members)];
+		static const uint32_t offsets[sizeof...(Members)];
 	};
 
-	class Vec4Attribute : public VertexAttribute
+	template<typename Vertex, typename... Members>
+	const VkFormat VertexLayout<Vertex, Members...>::formats[sizeof...(Members)] = { Members::format... };
+
+	template<typename Vertex, typename... Members>
+	const uint32_t VertexLayout<Vertex, Members...>::offsets[sizeof...(Members)] = { Members::offset... };
+
+	// Single vec3 position, the position stream and the terrain patch grid
+	struct VertexPosition
 	{
-	public:
-		virtual VkFormat GetFormat() { return VK_FORMAT_R32G32B32A32_SFLOAT; }
-		virtual uint32_t GetSize() { return sizeof(glm::vec4); }
+		glm::vec3 Pos;
 	};
 
+	typedef VertexLayout<VertexPosition, VERTEX_MEMBER(VertexPosition, Pos)> VertexPositionLayout;
+
 	/*
 		Contains the binding information used to bind the vertex data in C++ to GLSL
-		Make sure you add attributes with a format that corresponds to  your vertex format
-		VertexDescription format = C++ vertex format = GLSL vertex format, otherwise undefined behaviour!
+		The bindings are added from a VertexLayout so the formats and offsets always correspond to the vertex struct
+		The GLSL inputs must still match the layout, otherwise undefined behaviour!
+
+		Every binding is a separate vertex stream, a pipeline only fetches from the bindings in its description
+		The attribute locations keep counting up across the bindings in the order they are added
 	*/
 	class VertexDescription
 	{
@@ -54,42 +105,50 @@ namespace VulkanLib
 			// When creating a graphics pipeline a VkPipelineVertexInputStateCreateInfo structure is sent as an argument and this structure
 			// contains the VkVertexInputBindingDescription and VkVertexInputAttributeDescription
 			// The last thing to do is to assign the binding and attribute descriptions
-			// This is done in AddBinding() and AddAttribute()
+			// This is done in AddBinding()
 		}
 
-		void AddBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate)
+		// Adds a binding with one attribute for each member of the layout
+		// Note: The ordering determines the location
+		template<typename Layout>
+		void AddBinding(uint32_t binding, VkVertexInputRate inputRate)
 		{
 			VkVertexInputBindingDescription bindingDescription;
 
 			bindingDescription.binding = binding;
-			bindingDescription.stride = stride;
+			bindingDescription.stride = Layout::stride;
 			bindingDescription.inputRate = inputRate;
 
 			bindingDescriptions.push_back(bindingDescription);
 
-			// Update the binding count
-			inputState.vertexBindingDescriptionCount = bindingDescriptions.size();
-			inputState.pVertexBindingDescriptions = bindingDescriptions.data();
-		}
+			for (uint32_t i = 0; i < Layout::numAttributes; i++)
+			{
+				VkVertexInputAttributeDescription attributeDescription;
 
-		// Adds a attribute
-		// Note: The ordering determines the location
-		void AddAttribute(uint32_t binding, VertexAttribute& attribute)
-		{
-			VkVertexInputAttributeDescription attributeDescription;
+				attributeDescription.binding = binding;
+				attributeDescription.location = attributeDescriptions.size();
+				attributeDescription.format = Layout::formats[i];
+				attributeDescription.offset = Layout::offsets[i];
 
-			attributeDescription.binding = binding;
-			attributeDescription.location = attributeDescriptions.size();	
-			attributeDescription.format = attribute.GetFormat();
-			attributeDescription.offset = offsets[binding];
+				attributeDescriptions.push_back(attributeDescription);
+			}
 
-			attributeDescriptions.push_back(attributeDescription);
-
-			// Update the attribute count
+			// Update the binding and attribute counts
+			inputState.vertexBindingDescriptionCount = bindingDescriptions.size();
+			inputState.pVertexBindingDescriptions = bindingDescriptions.data();
 			inputState.vertexAttributeDescriptionCount = attributeDescriptions.size();
 			inputState.pVertexAttributeDescriptions = attributeDescriptions.data();
+		}
 
-			offsets[binding] += attribute.GetSize();
+		bool HasBinding(uint32_t binding)
+		{
+			for (auto& bindingDescription : bindingDescriptions)
+			{
+				if (bindingDescription.binding == binding)
+					return true;
+			}
+
+			return false;
 		}
 
 		VkPipelineVertexInputStateCreateInfo GetInputState()
@@ -101,7 +160,5 @@ namespace VulkanLib
 		VkPipelineVertexInputStateCreateInfo inputState;
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
-
-		std::map<int, int> offsets;		// Each binding have their own offset
 	};
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <time.h>
 #include <cstdlib>
 #include <thread>
+#include <chrono>
 
 #include "VulkanApp.h"
 #include "VulkanDebug.h"
@@ -11,23 +12,49 @@
 #include "LoadTGA.h"
 #include "VulkanHelpers.h"
 #include "Light.h"
+#include "ChunkedTerrain.h"
+#include "TransformSystem.h"
 
-#define VERTEX_BUFFER_BIND_ID 0
-#define INSTANCE_BUFFER_BIND_ID 1
+#include <algorithm>
+
+#define VERTEX_BUFFER_BIND_ID VERTEX_STREAM_POSITION
+#define ATTRIBUTE_BUFFER_BIND_ID VERTEX_STREAM_ATTRIBUTES
+#define INSTANCE_BUFFER_BIND_ID 2
+#define TERRAIN_PATCH_BIND_ID 0			// See ChunkedTerrain::Draw()
+#define TERRAIN_INSTANCE_BIND_ID 1
 #define VULKAN_ENABLE_VALIDATION false		// Debug validation layers toggle (affects performance a lot)
 
 #define NUM_OBJECTS 10 // 64 * 4 * 4 * 2
 
+#define TEXTURE_MEMORY_BUDGET (128 * 1024 * 1024)
+#define TEXTURE_STREAMING_THREADS 2
+#define PIPELINE_COMPILE_THREADS 2
+#define OCTREE_HALF_SIZE 16384.0f
+#define OCCLUSION_WIDTH 320
+#define OCCLUSION_HEIGHT 180
+#define OCCLUSION_THREADS 2
+#define OCCLUSION_MAX_OCCLUDERS 128
+#define OCCLUSION_MAX_OCCLUDER_TRIANGLES 256		// Models with more triangles are never occluders
+#define CONTRIBUTION_CULL_PIXELS 2.0f				// Objects with a smaller projected diameter aren't drawn
+#define IMPOSTOR_PIXELS 32.0f						// Objects with a smaller projected diameter are drawn as billboards
+
 namespace VulkanLib
 {
-	VulkanApp::VulkanApp() : VulkanBase(VULKAN_ENABLE_VALIDATION)
+	VulkanApp::VulkanApp() : VulkanBase(VULKAN_ENABLE_VALIDATION), mSceneQuery(&mOctree)
 	{
 		srand(time(NULL));
 		mCamera = nullptr;
+
+		mOctree.Init(vec3(0.0f), OCTREE_HALF_SIZE);
+		mOcclusionCuller.Init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, OCCLUSION_THREADS);
+		mStaticBatcher.Init(this);
 	}
 
 	VulkanApp::~VulkanApp()
 	{
+		mOctree.Cleanup();
+		mStaticBatcher.Cleanup();
+
 		mUniformBuffer.Cleanup(GetDevice());
 		mDescriptorPool.Cleanup(GetDevice());
 		mDescriptorSet.Cleanup(GetDevice());
@@ -35,30 +62,45 @@ namespace VulkanLib
 		// Cleanup pipeline layout
 		vkDestroyPipelineLayout(mDevice, mPipelineLayout, nullptr);
 
+		mTerrainDescriptorPool.Cleanup(GetDevice());
+		mTerrainDescriptorSet.Cleanup(GetDevice());
+		vkDestroyPipelineLayout(mDevice, mTerrainPipelineLayout, nullptr);
+
+		mHiZCuller.Cleanup();
+		mImpostorRenderer.Cleanup();
+
 		vkDestroyBuffer(mDevice, mInstanceBuffer.buffer, nullptr);
 		vkFreeMemory(mDevice, mInstanceBuffer.memory, nullptr);
 
-		vkDestroyPipeline(mDevice, mPipelines.textured, nullptr);
-		vkDestroyPipeline(mDevice, mPipelines.colored, nullptr);
-		vkDestroyPipeline(mDevice, mPipelines.starsphere, nullptr);
+		mPipelineStates.Cleanup();
 
 		// The model loader is responsible for cleaning up the model data
 		//mModelLoader.CleanupModels(mDevice);
 
-		// Free the testing texture
-		mTextureLoader->destroyTexture(mTestTexture);
-		mTextureLoader->destroyTexture(mTerrainTexture);
+		// Free the testing textures
+		mMaterialLibrary.Cleanup();
+		mTextureStreamer.Cleanup();
+		mTextureBatchLoader.DestroyTexture(mTerrainTexture);
+		mTextureBatchLoader.Cleanup();
 
 		for (int i = 0; i < mModels.size(); i++) {
 			delete mModels[i].object;
 		}
 
+		if (mTerrain != nullptr) {
+			mTerrain->Cleanup(mDevice);
+			delete mTerrain;
+			delete mTerrainModel.object;
+		}
+
 		// Cleanup the multithreading memory
 		for (int t = 0; t < mThreadData.size(); t++)
 		{
 			vkFreeCommandBuffers(mDevice, mThreadData[t].commandPool, 1, &mThreadData[t].commandBuffer);
+			vkFreeCommandBuffers(mDevice, mThreadData[t].commandPool, 1, &mThreadData[t].prepassCommandBuffer);
 			vkDestroyCommandPool(mDevice, mThreadData[t].commandPool, nullptr);
 			mThreadData[t].descriptorPool1.Cleanup(GetDevice());
+			mThreadData[t].batcher.Cleanup();
 
 			for (int i = 0; i < mThreadData[t].threadObjects.size(); i++)
 			{
@@ -80,10 +122,29 @@ namespace VulkanLib
 		vkCreateFence(mDevice, &fenceCreateInfo, NULL, &mRenderFence);
 
 		SetupVertexDescriptions();			// Custom
+
+		// Dynamic indexing of the texture array is optional in Vulkan 1.0, the fallback is one texture with a layer per texture
+		TextureArrayMode textureArrayMode = GetEnabledFeatures().shaderSampledImageArrayDynamicIndexing ? TEXTURE_ARRAY_DESCRIPTORS : TEXTURE_ARRAY_LAYERS;
+		mMaterialLibrary.Init(this, &mTextureStreamer, textureArrayMode);	// Must run before SetupDescriptorSetLayout() (Texture array size)
+
 		SetupDescriptorSetLayout();			// Must run before PreparePipelines() (VkPipelineLayout)
-		PreparePipelines();
+		PrepareUniformBuffers();			// Must run before PreparePipelines() (Light count) and SetupDescriptorSet() (Creates the uniform buffer)
+
+		uint32_t shaderVariant = 0;
+		if (mUseShaderVariants)
+		{
+			shaderVariant = SHADER_VARIANT_SPECIALIZED | ((uint32_t)mUniformBuffer.lights.size() << SHADER_VARIANT_LIGHTS_SHIFT);
+			if (mUseInstancing)
+				shaderVariant |= SHADER_VARIANT_INSTANCING;
+		}
+
+		PreparePipelines(shaderVariant);
+
+		// The views are rendered with the object pipelines so the atlases use the same render pass
+		if (mUseImpostors)
+			mImpostorRenderer.Init(this, &mPipelineStates, mRenderPass, mColorFormat, mDepthFormat, mUniformBuffer.GetDescriptor());
+
 		LoadModels();						// Must run before SetupDescriptorSet() (Loads textures)
-		PrepareUniformBuffers();			// Must run before SetupDescriptorSet() (Creates the uniform buffer)
 		SetupDescriptorPool();
 		SetupDescriptorSet();				
 		PrepareCommandBuffers();
@@ -101,6 +162,9 @@ namespace VulkanLib
 		// Create the secondary command buffer
 		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
 		VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mSecondaryCommandBuffer));
+		VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mImpostorCommandBuffer));
+		VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mBatchCommandBuffer));
+		VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mBatchPrepassCommandBuffer));
 
 		// Create the command buffers used in the static test case (1 for each frame buffer)
 		mStaticCommandBuffers.resize(mSwapChain.imageCount);
@@ -114,6 +178,10 @@ namespace VulkanLib
 		system("cd data/shaders/textured/ && generate-spirv.bat");
 		system("cd data/shaders/colored/ && generate-spirv.bat");
 		system("cd data/shaders/starsphere/ && generate-spirv.bat");
+		system("cd data/shaders/terrain/ && generate-spirv.bat");
+		system("cd data/shaders/hiz/ && generate-spirv.bat");
+		system("cd data/shaders/depth/ && generate-spirv.bat");
+		system("cd data/shaders/impostor/ && generate-spirv.bat");
 		//system("cls");
 	}
 
@@ -122,12 +190,127 @@ namespace VulkanLib
 		mCamera = camera;
 	}
 
+	void VulkanApp::SetTerrain(VulkanModel model, ChunkedTerrain* terrain)
+	{
+		mTerrainModel = model;
+		mTerrain = terrain;
+
+		// The heightmap texture only exists after the terrain is built, so the descriptor set is created here
+		if (mTerrain->GetMode() == TERRAIN_MODE_GPU_DISPLACED)
+		{
+			std::vector<VkDescriptorSetLayoutBinding> layoutBindings = mTerrainDescriptorSet.GetLayoutBindings();
+			mTerrainDescriptorPool.CreatePoolFromLayout(mDevice, layoutBindings);
+
+			VkDescriptorBufferInfo uniformBufferInfo = mUniformBuffer.GetDescriptor();
+			VkDescriptorImageInfo colorMapInfo = GetTextureDescriptorInfo(mTerrainTexture);
+			VkDescriptorImageInfo heightmapInfo = GetTextureDescriptorInfo(mTerrain->GetHeightmapTexture());
+
+			mTerrainDescriptorSet.AllocateDescriptorSets(mDevice, mTerrainDescriptorPool.GetVkDescriptorPool());
+			mTerrainDescriptorSet.BindUniformBuffer(0, &uniformBufferInfo);
+			mTerrainDescriptorSet.BindCombinedImage(1, &colorMapInfo);
+			mTerrainDescriptorSet.BindCombinedImage(2, &heightmapInfo);
+			mTerrainDescriptorSet.UpdateDescriptorSets(mDevice);
+		}
+	}
+
+	int VulkanApp::AddTexture(std::string filename, VkFormat format)
+	{
+		int numTextures = mMaterialLibrary.GetNumTextures();
+		int textureIndex = mMaterialLibrary.AddTexture(filename, format);
+
+		// A new texture fills an unused element of the array, or a layer that the descriptor sets already point to
+		if (mMaterialLibrary.GetNumTextures() != numTextures)
+			UpdateMaterialDescriptors();
+
+		return textureIndex;
+	}
+
 	void VulkanApp::AddModel(VulkanModel model)
 	{
+		// The octree reads the world matrix of the new object
+		TransformSystem::GetDefault().Update(nullptr);
+		mOctree.Insert(model.object, model.mesh->GetBoundingBox(), model.mesh);
+
 		if(mUseInstancing || mUseStaticCommandBuffer)
 			mModels.push_back(model);
 		else
 		{
+			// Simple models are used as occluders as they are, all their meshes in one
+			if (mOccluderMeshes.count(model.mesh) == 0 && model.mesh->GetNumIndices() / 3 <= OCCLUSION_MAX_OCCLUDER_TRIANGLES)
+			{
+				OccluderMesh& occluder = mOccluderMeshes[model.mesh];
+				for (auto& mesh : model.mesh->mMeshes)
+				{
+					uint32_t firstVertex = occluder.vertices.size();
+					for (auto& vertex : mesh.vertices)
+						occluder.vertices.push_back(vertex.Pos);
+					for (auto index : mesh.indices)
+						occluder.indices.push_back(firstVertex + index);
+				}
+			}
+
+			// Every mesh gets one impostor, its views are rendered with the pipeline and texture of the first object that uses it
+			if (mUseImpostors)
+			{
+				model.impostor = mImpostorRenderer.AddMesh(model.mesh);
+				if (model.impostor == mImpostorModels.size())
+					mImpostorModels.push_back(model);
+			}
+
+			// The pre-pass writes the depth of the object and the main pass only shades the fragments that are in front
+			if (mUseDepthPrepass)
+			{
+				PipelineState state = model.pipeline->state;
+
+				PipelineState depthState = state;
+				depthState.vertexShader = "data/shaders/depth/depth.vert.spv";
+				depthState.fragmentShader = "";
+				depthState.colorWrite = false;
+				depthState.specialization.clear();
+				depthState.vertexDescription = &mDepthVertexDescription;
+				model.depthPipeline = mPipelineStates.Request(depthState, mPipelines.depth);
+
+				// Falls back to the colored pipeline and not the one it's made from since that can still be compiling
+				state.depthWrite = false;
+				state.depthCompareOp = VK_COMPARE_OP_EQUAL;
+				model.pipeline = mPipelineStates.Request(state, mPipelines.colored);
+			}
+
+			// Objects with the same pipelines, texture and color can be drawn together by the static and the dynamic batches
+			if (mUseStaticBatching || mUseDynamicBatching)
+			{
+				auto material = std::find_if(mBatchMaterials.begin(), mBatchMaterials.end(), [&](const VulkanModel& other) {
+					return other.pipeline == model.pipeline && other.depthPipeline == model.depthPipeline && other.textureIndex == model.textureIndex && other.object->GetColor() == model.object->GetColor();
+				});
+
+				if (material == mBatchMaterials.end())
+					material = mBatchMaterials.insert(mBatchMaterials.end(), model);
+
+				model.batchMaterial = material - mBatchMaterials.begin();
+			}
+
+			// Merged by BuildStaticBatches() and drawn together until they move
+			if (mUseStaticBatching)
+				model.staticBatch = mStaticBatcher.Add(model.object, model.mesh, model.batchMaterial);
+
+			// Every small mesh is copied once to the layout the threads transform it from
+			if (mUseDynamicBatching)
+			{
+				if (mDynamicBatchMeshIndices.count(model.mesh) == 0)
+				{
+					DynamicBatchMesh mesh;
+					if (DynamicBatcher::CreateMesh(model.mesh, mesh))
+					{
+						mDynamicBatchMeshIndices[model.mesh] = mDynamicBatchMeshes.size();
+						mDynamicBatchMeshes.push_back(mesh);
+					}
+					else
+						mDynamicBatchMeshIndices[model.mesh] = -1;
+				}
+
+				model.dynamicMesh = mDynamicBatchMeshIndices[model.mesh];
+			}
+
 			mThreadData[mNextThreadId].threadObjects.push_back(model);
 
 			mNextThreadId++;
@@ -137,11 +320,95 @@ namespace VulkanLib
 		}
 	}
 
+	int VulkanApp::GetNumVisibleObjects()
+	{
+		int numVisible = 0;
+		for (auto& thread : mThreadData)
+			numVisible += thread.culler.GetNumVisible();
+
+		return numVisible;
+	}
+
+	int VulkanApp::GetNumCulledObjects()
+	{
+		int numCulled = 0;
+		for (auto& thread : mThreadData)
+			numCulled += thread.culler.GetNumCulled();
+
+		return numCulled;
+	}
+
+	int VulkanApp::GetNumOccludedObjects()
+	{
+		int numOccluded = 0;
+		for (auto& thread : mThreadData)
+			numOccluded += thread.numOccluded;
+
+		return numOccluded;
+	}
+
+	double VulkanApp::GetOcclusionTestTime()
+	{
+		double testTime = 0.0;
+		for (auto& thread : mThreadData)
+			testTime += thread.occlusionTestTime;
+
+		return testTime;
+	}
+
+	int VulkanApp::GetNumContributionCulledObjects()
+	{
+		int numCulled = 0;
+		for (auto& thread : mThreadData)
+			numCulled += thread.numContributionCulled;
+
+		return numCulled;
+	}
+
+	int VulkanApp::GetNumImpostorObjects()
+	{
+		int numImpostors = 0;
+		for (auto& thread : mThreadData)
+			numImpostors += thread.numImpostors;
+
+		return numImpostors;
+	}
+
+	DynamicBatchStats VulkanApp::GetDynamicBatchStats()
+	{
+		DynamicBatchStats stats = {};
+		for (auto& thread : mThreadData)
+		{
+			DynamicBatchStats threadStats = thread.batcher.GetStats();
+			stats.numObjects += threadStats.numObjects;
+			stats.numVertices += threadStats.numVertices;
+			stats.numDraws += threadStats.numDraws;
+			stats.buildTime += threadStats.buildTime;
+		}
+
+		return stats;
+	}
+
+	int VulkanApp::GetNumVisibleBatches()
+	{
+		return mNumVisibleBatches;
+	}
+
+	int VulkanApp::GetNumBatchDraws()
+	{
+		return mNumBatchDraws;
+	}
+
 	void VulkanApp::LoadModels()
 	{
-		// Load a random testing texture
-		mTextureLoader->loadTexture("data/textures/crate_bc3.dds", VK_FORMAT_BC3_UNORM_BLOCK, &mTestTexture);
-		mTextureLoader->loadTexture("data/textures/bricks.dds", VK_FORMAT_BC3_UNORM_BLOCK, &mTerrainTexture);
+		// The default texture gets index 0, only the mip tail is loaded here and the rest is streamed in when needed
+		mTextureStreamer.Init(this, TEXTURE_MEMORY_BUDGET, TEXTURE_STREAMING_THREADS);
+		mMaterialLibrary.AddTexture("data/textures/crate_bc3.dds", VK_FORMAT_BC3_UNORM_BLOCK);
+
+		// Textures that aren't streamed are uploaded together in one submit
+		mTextureBatchLoader.Init(this);
+		mTextureBatchLoader.AddTexture("data/textures/bricks.dds", VK_FORMAT_BC3_UNORM_BLOCK, &mTerrainTexture);
+		mTextureBatchLoader.Flush();
 	}
 
 	void VulkanApp::SetupMultithreading(int numThreads)
@@ -170,21 +437,20 @@ namespace VulkanLib
 			VkCommandBufferAllocateInfo allocateInfo = {};
 			allocateInfo = CreateInfo::CommandBuffer(mThreadData[t].commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
 			VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mThreadData[t].commandBuffer));
+			VulkanDebug::ErrorCheck(vkAllocateCommandBuffers(mDevice, &allocateInfo, &mThreadData[t].prepassCommandBuffer));
 
 			mThreadData[t].descriptorSet.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);					// Uniform buffer binding: 0
-			mThreadData[t].descriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);		// Combined image sampler binding: 1
+			mThreadData[t].descriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, mMaterialLibrary.GetDescriptorCount(), VK_SHADER_STAGE_FRAGMENT_BIT);		// Texture array binding: 1
 			mThreadData[t].descriptorSet.CreateLayout(mDevice);
 
 			mThreadData[t].descriptorPool1.CreatePoolFromLayout(mDevice, mDescriptorSet.GetLayoutBindings());
 
 			mThreadData[t].descriptorSet.AllocateDescriptorSets(mDevice, mThreadData[t].descriptorPool1.GetVkDescriptorPool());
 			mThreadData[t].descriptorSet.BindUniformBuffer(0, &mUniformBuffer.GetDescriptor());
-			mThreadData[t].descriptorSet.BindCombinedImage(1, &GetTextureDescriptorInfo(mTestTexture)); // NOTE: TODO: This feels really bad, only one texture can be used right now! LoadModel() must run before this!!
+			mThreadData[t].descriptorSet.BindCombinedImage(1, mMaterialLibrary.GetDescriptorInfos(), mMaterialLibrary.GetDescriptorCount());
 			mThreadData[t].descriptorSet.UpdateDescriptorSets(mDevice);
-			
-			// Let every thread have unique vertex and index buffer
-			mThreadData[t].model.mMeshes = mTestModel->mMeshes;
-			mThreadData[t].model.BuildBuffers(this);	
+
+			mThreadData[t].batcher.Init(this);
 		}
 
 		ExecuteSetupCommandBuffer();
@@ -195,6 +461,51 @@ namespace VulkanLib
 		mUseInstancing = useInstancing;
 	}
 
+	void VulkanApp::EnableShaderVariants(bool useShaderVariants)
+	{
+		mUseShaderVariants = useShaderVariants;
+	}
+
+	void VulkanApp::EnableGpuCulling(bool useGpuCulling)
+	{
+		mUseGpuCulling = useGpuCulling;
+	}
+
+	void VulkanApp::EnableDepthPrepass(bool useDepthPrepass)
+	{
+		mUseDepthPrepass = useDepthPrepass;
+	}
+
+	void VulkanApp::EnableImpostors(bool useImpostors)
+	{
+		mUseImpostors = useImpostors;
+	}
+
+	void VulkanApp::EnableContributionCulling(bool useContributionCulling)
+	{
+		mUseContributionCulling = useContributionCulling;
+	}
+
+	void VulkanApp::EnableOcclusionCulling(bool useOcclusionCulling)
+	{
+		mUseOcclusionCulling = useOcclusionCulling;
+	}
+
+	void VulkanApp::EnableStaticBatching(bool useStaticBatching)
+	{
+		mUseStaticBatching = useStaticBatching;
+	}
+
+	void VulkanApp::EnableDynamicBatching(bool useDynamicBatching)
+	{
+		mUseDynamicBatching = useDynamicBatching;
+	}
+
+	uint32_t VulkanApp::GetShaderVariant()
+	{
+		return mShaderVariant;
+	}
+
 	void VulkanApp::EnableStaticCommandBuffers(bool useStaticCommandBuffers)
 	{
 		mUseStaticCommandBuffer = useStaticCommandBuffers;
@@ -214,8 +525,9 @@ namespace VulkanLib
 
 		size_t bufferSize = instanceData.size() * sizeof(InstanceData);
 
+		// The GPU culling reads the instances in a compute shader
 		CreateBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
 			bufferSize,
 			instanceData.data(),
@@ -225,6 +537,46 @@ namespace VulkanLib
 		mInstanceBuffer.descriptor.range = bufferSize;
 		mInstanceBuffer.descriptor.buffer = mInstanceBuffer.buffer;
 		mInstanceBuffer.descriptor.offset = 0;
+
+		if (mUseInstancing && mUseGpuCulling)
+			mHiZCuller.Init(this, mInstanceBuffer.buffer, mModels.size(), mTestModel->GetBoundingBox(), mTestModel->GetNumIndices(), mDepthStencil.image, mColorFormat, mDepthFormat);
+	}
+
+	// The culling blocks of FrustumCuller are only small when the objects next to each other are close in space, the
+	// objects are spread over the threads so every thread orders its own along a Morton curve
+	void VulkanApp::SortThreadObjects()
+	{
+		for (auto& thread : mThreadData)
+		{
+			auto& objects = thread.threadObjects;
+
+			std::vector<vec3> centers(objects.size());
+			BoundingBox bounds;
+			for (int i = 0; i < objects.size(); i++)
+			{
+				centers[i] = objects[i].mesh->GetBoundingBox().Transform(objects[i].object->GetWorldMatrix()).GetCenter();
+				bounds.Add(centers[i]);
+			}
+
+			std::vector<std::pair<uint32_t, int>> codes(objects.size());
+			for (int i = 0; i < objects.size(); i++)
+				codes[i] = std::make_pair(FrustumCuller::GetMortonCode(centers[i], bounds), i);
+
+			std::sort(codes.begin(), codes.end());
+
+			std::vector<VulkanModel> sorted;
+			sorted.reserve(objects.size());
+			for (auto& code : codes)
+				sorted.push_back(objects[code.second]);
+
+			objects = sorted;
+		}
+	}
+
+	void VulkanApp::BuildStaticBatches()
+	{
+		if (mUseStaticBatching)
+			mStaticBatcher.Build();
 	}
 
 	void VulkanApp::PrepareUniformBuffers()
@@ -262,10 +614,51 @@ namespace VulkanLib
 		mUniformBuffer.UpdateMemory(GetDevice());
 	}
 
+	// Requests the mips of the object textures from how large the objects are on screen
+	void VulkanApp::UpdateTextureStreaming()
+	{
+		const float viewportHeight = (float)GetWindowHeight();
+
+		// [NOTE] The models are about unit size so the scale is used as the radius
+		auto requestTexture = [&](VulkanModel& model) {
+			vec3 scale = model.object->GetScale();
+			float radius = std::max(scale.x, std::max(scale.y, scale.z));
+			mMaterialLibrary.RequestTexture(model.textureIndex, mCamera->GetProjectedSize(model.object->GetPosition(), radius, viewportHeight));
+		};
+
+		for (auto& model : mModels)
+			requestTexture(model);
+
+		for (auto& thread : mThreadData)
+		{
+			for (auto& model : thread.threadObjects)
+				requestTexture(model);
+		}
+
+		// The image views change when mips are streamed in or out, the GPU is idle here so the descriptor sets can be written
+		if (mTextureStreamer.Update())
+		{
+			mMaterialLibrary.UpdateDescriptorInfos();
+			UpdateMaterialDescriptors();
+		}
+	}
+
+	// Writes the whole texture array to the descriptor sets, the GPU can't be using them
+	void VulkanApp::UpdateMaterialDescriptors()
+	{
+		mDescriptorSet.UpdateCombinedImage(mDevice, 1, mMaterialLibrary.GetDescriptorInfos(), mMaterialLibrary.GetDescriptorCount());
+
+		for (auto& thread : mThreadData)
+			thread.descriptorSet.UpdateCombinedImage(mDevice, 1, mMaterialLibrary.GetDescriptorInfos(), mMaterialLibrary.GetDescriptorCount());
+
+		// Writing the descriptor set invalidates the static command buffers that use it
+		RecordStaticCommandBuffers();
+	}
+
 	void VulkanApp::SetupDescriptorSetLayout()
 	{
 		mDescriptorSet.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);				// Uniform buffer binding: 0
-		mDescriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);		// Combined image sampler binding: 1
+		mDescriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, mMaterialLibrary.GetDescriptorCount(), VK_SHADER_STAGE_FRAGMENT_BIT);		// Texture array binding: 1
 		mDescriptorSet.CreateLayout(mDevice);
 
 		VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = CreateInfo::PipelineLayout(1, &mDescriptorSet.setLayout);
@@ -280,6 +673,15 @@ namespace VulkanLib
 		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRanges;
 
 		VulkanDebug::ErrorCheck(vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, nullptr, &mPipelineLayout));
+
+		// The terrain reads the heightmap in the vertex shader
+		mTerrainDescriptorSet.AddLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT);				// Uniform buffer binding: 0
+		mTerrainDescriptorSet.AddLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);	// Color map binding: 1
+		mTerrainDescriptorSet.AddLayoutBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_VERTEX_BIT);		// Heightmap binding: 2
+		mTerrainDescriptorSet.CreateLayout(mDevice);
+
+		pPipelineLayoutCreateInfo.pSetLayouts = &mTerrainDescriptorSet.setLayout;
+		VulkanDebug::ErrorCheck(vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, nullptr, &mTerrainPipelineLayout));
 	}
 
 	void VulkanApp::SetupDescriptorPool()
@@ -292,141 +694,120 @@ namespace VulkanLib
 	{
 		mDescriptorSet.AllocateDescriptorSets(mDevice, mDescriptorPool.GetVkDescriptorPool());
 		mDescriptorSet.BindUniformBuffer(0, &mUniformBuffer.GetDescriptor());
-		mDescriptorSet.BindCombinedImage(1, &GetTextureDescriptorInfo(mTestTexture));
+		mDescriptorSet.BindCombinedImage(1, mMaterialLibrary.GetDescriptorInfos(), mMaterialLibrary.GetDescriptorCount());
 		mDescriptorSet.UpdateDescriptorSets(mDevice);
 	}
 
-	void VulkanApp::PreparePipelines()
-	{
-		// The pipeline consists of many stages, where each stage can have different states
-		// Creating a pipeline is simply defining the state for every stage (and some more...)
-		// ...
-
-		// Input assembly state
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
-		inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-		// Rasterization state
-		VkPipelineRasterizationStateCreateInfo rasterizationState = {};
-		rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-		rasterizationState.depthClampEnable = VK_FALSE;
-		rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-		rasterizationState.depthBiasEnable = VK_FALSE;
-
-		// Color blend state
-		VkPipelineColorBlendStateCreateInfo colorBlendState = {};
-		colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		VkPipelineColorBlendAttachmentState blendAttachmentState[1] = {};
-		blendAttachmentState[0].colorWriteMask = 0xf;
-		blendAttachmentState[0].blendEnable = VK_FALSE;			// Blending disabled
-		colorBlendState.attachmentCount = 1;
-		colorBlendState.pAttachments = blendAttachmentState;
-
-		// Viewport state
-		VkPipelineViewportStateCreateInfo viewportState = {};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.scissorCount = 1;
-
-		// Dynamic state for the viewport so the pipeline don't have to be recreated when resizing the window
-		VkPipelineDynamicStateCreateInfo dynamicState = {};
-		std::vector<VkDynamicState> dynamicStateEnables;
-		dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);
-		dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.pDynamicStates = dynamicStateEnables.data();
-		dynamicState.dynamicStateCount = dynamicStateEnables.size();
-
-		// Depth and stencil state
-		VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
-		depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencilState.depthTestEnable = VK_TRUE;
-		depthStencilState.depthWriteEnable = VK_TRUE;
-		depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-		depthStencilState.depthBoundsTestEnable = VK_FALSE;
-		depthStencilState.back.failOp = VK_STENCIL_OP_KEEP;
-		depthStencilState.back.passOp = VK_STENCIL_OP_KEEP;
-		depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
-		depthStencilState.stencilTestEnable = VK_FALSE;			// Stencil disabled
-		depthStencilState.front = depthStencilState.back;
-
-		// Multi sampling state
-		VkPipelineMultisampleStateCreateInfo multisampleState = {};
-		multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampleState.pSampleMask = NULL;
-		multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;		// Multi sampling not used
-
-		// Load shader
-		std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-		shaderStages[0] = LoadShader("data/shaders/textured/textured.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = LoadShader("data/shaders/colored/colored.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		
+	void VulkanApp::PreparePipelines(uint32_t shaderVariant)
+	{
+		mShaderVariant = shaderVariant;
+		mPipelineStates.Init(this, PIPELINE_COMPILE_THREADS);
+
+		// Includes the driver compiling the shaders, which is mostly skipped when the pipeline cache is warm
+		auto begin = std::chrono::high_resolution_clock::now();
+
+		// The colored pipeline is the fallback while the other object pipelines are compiled, so it has to exist right away
+		mPipelines.colored = mPipelineStates.Create(GetPipelineState(PipelineEnum::COLORED));
+
+		// Create the GPU displaced terrain pipeline, same states as the textured pipeline but with its own vertex format, layout and the colored fragment shader
+		// It has no compatible fallback since the layout is different
+		PipelineState terrainState = GetPipelineState(PipelineEnum::TEXTURED);
+		terrainState.vertexShader = "data/shaders/terrain/terrain.vert.spv";
+		terrainState.fragmentShader = "data/shaders/colored/colored.frag.spv";
+		terrainState.vertexDescription = &mTerrainVertexDescription;
+		terrainState.layout = mTerrainPipelineLayout;
+		terrainState.specialization.clear();
+		mPipelines.terrain = mPipelineStates.Create(terrainState);
+
+		// The depth pre-pass only has a vertex shader that reads the positions
+		if (mUseDepthPrepass)
+		{
+			PipelineState depthState = GetPipelineState(PipelineEnum::COLORED);
+			depthState.vertexShader = "data/shaders/depth/depth.vert.spv";
+			depthState.fragmentShader = "";
+			depthState.colorWrite = false;
+			depthState.specialization.clear();
+			depthState.vertexDescription = &mDepthVertexDescription;
+			mPipelines.depth = mPipelineStates.Create(depthState);
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		double creationTime = std::chrono::duration<double, std::milli>(end - begin).count();
+		VulkanDebug::ConsolePrint("Pipeline creation: " + std::to_string(creationTime) + " ms (" + (mPipelineCache.IsWarm() ? "warm" : "cold") + " pipeline cache)");
 
-		// Assign all the states to the pipeline
-		// The states will be static and can't be changed after the pipeline is created
-		VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-		pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineCreateInfo.layout = mPipelineLayout;
-		pipelineCreateInfo.renderPass = mRenderPass;
-		pipelineCreateInfo.pVertexInputState = &mVertexDescription.GetInputState();		// From base - &vertices.inputState;
-		pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-		pipelineCreateInfo.pRasterizationState = &rasterizationState;
-		pipelineCreateInfo.pColorBlendState = &colorBlendState;
-		pipelineCreateInfo.pViewportState = &viewportState;
-		pipelineCreateInfo.pDynamicState = &dynamicState;
-		pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-		pipelineCreateInfo.pMultisampleState = &multisampleState;
-		pipelineCreateInfo.stageCount = shaderStages.size();
-		pipelineCreateInfo.pStages = shaderStages.data();
-
-		// Create the colored pipeline	
-		//rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
-		VulkanDebug::ErrorCheck(vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &mPipelines.colored));
-
-		// Create the textured pipeline
-		//shaderStages[1] = LoadShader("data/shaders/textured/textured.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-
-		// Add some extra state changes for the benchmarking comparison with OpenGL
-		rasterizationState.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
-
-		VulkanDebug::ErrorCheck(vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &mPipelines.textured));
-
-		// Create the starsphere pipeline
-		rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
-		depthStencilState.depthWriteEnable = VK_FALSE;
-		shaderStages[0] = LoadShader("data/shaders/starsphere/starsphere.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = LoadShader("data/shaders/starsphere/starsphere.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		vkTools::checkResult(vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &mPipelines.starsphere));
+		// The rest are compiled in parallel on the worker threads
+		mPipelines.textured = GetPipeline(PipelineEnum::TEXTURED);
+		mPipelines.starsphere = GetPipeline(PipelineEnum::STARSPHERE);
 	}
 
-	void VulkanApp::SetupVertexDescriptions()
+	PipelineState VulkanApp::GetPipelineState(PipelineEnum pipeline)
 	{
-		// First tell Vulkan about how large each vertex is, the binding ID and the inputRate
-		mVertexDescription.AddBinding(VERTEX_BUFFER_BIND_ID, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);					// Per vertex
-
-		if (mUseInstancing)
-			mVertexDescription.AddBinding(INSTANCE_BUFFER_BIND_ID, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE);	// Per instance
+		// Samples the material texture array with the pushed texture index
+		std::string texturedFragmentShader = "data/shaders/textured/textured.frag.spv";
+		if (mMaterialLibrary.GetMode() == TEXTURE_ARRAY_LAYERS)
+			texturedFragmentShader = "data/shaders/textured/textured_layers.frag.spv";
+
+		PipelineState state;
+		state.vertexShader = "data/shaders/textured/textured.vert.spv";
+		state.fragmentShader = "data/shaders/colored/colored.frag.spv";
+		state.vertexDescription = &mVertexDescription;
+		state.layout = mPipelineLayout;
+		state.renderPass = mRenderPass;
+
+		if (pipeline == PipelineEnum::TEXTURED)
+		{
+			state.fragmentShader = texturedFragmentShader;
 
-		// We need to tell Vulkan about the memory layout for each attribute
-		// 5 attributes: position, normal, texture coordinates, tangent and color
-		// See Vertex struct
-		mVertexDescription.AddAttribute(VERTEX_BUFFER_BIND_ID, Vec3Attribute());	// Location 0 : Position
-		mVertexDescription.AddAttribute(VERTEX_BUFFER_BIND_ID, Vec3Attribute());	// Location 1 : Color
-		mVertexDescription.AddAttribute(VERTEX_BUFFER_BIND_ID, Vec3Attribute());	// Location 2 : Normal
-		mVertexDescription.AddAttribute(VERTEX_BUFFER_BIND_ID, Vec2Attribute());	// Location 3 : Texture
-		mVertexDescription.AddAttribute(VERTEX_BUFFER_BIND_ID, Vec4Attribute());	// Location 4 : Tangent
+			// Add some extra state changes for the benchmarking comparison with OpenGL
+			state.frontFace = VK_FRONT_FACE_CLOCKWISE;
+			state.cullMode = VK_CULL_MODE_FRONT_BIT;
+		}
+		else if (pipeline == PipelineEnum::STARSPHERE)
+		{
+			state.vertexShader = "data/shaders/starsphere/starsphere.vert.spv";
+			state.fragmentShader = "data/shaders/starsphere/starsphere.frag.spv";
+			state.frontFace = VK_FRONT_FACE_CLOCKWISE;
+			state.cullMode = VK_CULL_MODE_FRONT_BIT;
+			state.depthWrite = false;
+			return state;
+		}
 
-		if (mUseInstancing)
+		// The constant_id values in textured.vert and textured.frag
+		if (mShaderVariant != 0)
 		{
-			mVertexDescription.AddAttribute(INSTANCE_BUFFER_BIND_ID, Vec3Attribute());	// Location 5 : Instance position
-			mVertexDescription.AddAttribute(INSTANCE_BUFFER_BIND_ID, Vec3Attribute());	// Location 6 : Instance scale
-			mVertexDescription.AddAttribute(INSTANCE_BUFFER_BIND_ID, Vec3Attribute());	// Location 7 : Instance color
+			uint32_t shaderVariant = mShaderVariant;
+			if (pipeline == PipelineEnum::TEXTURED)
+				shaderVariant |= SHADER_VARIANT_TEXTURING;
+
+			state.fragmentShader = texturedFragmentShader;
+			state.specialization.push_back(VK_TRUE);										// SPECIALIZED
+			state.specialization.push_back((shaderVariant & SHADER_VARIANT_INSTANCING) ? VK_TRUE : VK_FALSE);
+			state.specialization.push_back((shaderVariant >> SHADER_VARIANT_LIGHTS_SHIFT) & 0xff);	// NUM_LIGHTS
+			state.specialization.push_back((shaderVariant & SHADER_VARIANT_TEXTURING) ? VK_TRUE : VK_FALSE);
 		}
+
+		return state;
+	}
+
+	PipelineHandle VulkanApp::GetPipeline(PipelineEnum pipeline)
+	{
+		return mPipelineStates.Request(GetPipelineState(pipeline), mPipelines.colored);
+	}
+
+	void VulkanApp::SetupVertexDescriptions()
+	{
+		// Tell Vulkan about each binding, the stride, formats and offsets come from the VertexLayout of the vertex struct
+		// The positions and the other attributes are separate streams, see StaticModel::SplitStreams()
+		mVertexDescription.AddBinding<VertexPositionLayout>(VERTEX_BUFFER_BIND_ID, VK_VERTEX_INPUT_RATE_VERTEX);			// Location 0 : Position
+		mVertexDescription.AddBinding<VertexAttributesLayout>(ATTRIBUTE_BUFFER_BIND_ID, VK_VERTEX_INPUT_RATE_VERTEX);		// Location 1-4 : Color, normal, texture and tangent
+		mDepthVertexDescription.AddBinding<VertexPositionLayout>(VERTEX_BUFFER_BIND_ID, VK_VERTEX_INPUT_RATE_VERTEX);		// Location 0 : Position
+
+		if (mUseInstancing)
+			mVertexDescription.AddBinding<InstanceDataLayout>(INSTANCE_BUFFER_BIND_ID, VK_VERTEX_INPUT_RATE_INSTANCE);	// Location 5-7 : Instance position, scale and color
+
+		// GPU displaced terrain: shared grid patch + one TerrainInstance per node
+		mTerrainVertexDescription.AddBinding<VertexPositionLayout>(TERRAIN_PATCH_BIND_ID, VK_VERTEX_INPUT_RATE_VERTEX);			// Location 0 : Grid position + skirt flag
+		mTerrainVertexDescription.AddBinding<TerrainInstanceLayout>(TERRAIN_INSTANCE_BIND_ID, VK_VERTEX_INPUT_RATE_INSTANCE);	// Location 1-3 : Origin, step and skirt depth
 	}
 
 	void VulkanApp::RecordStaticCommandBuffers()
@@ -434,6 +815,9 @@ namespace VulkanLib
 		if (!mUseStaticCommandBuffer)
 			return;
 
+		// The command buffers aren't recorded again when the pipelines are ready, so they can't use the fallback
+		mPipelineStates.Wait();
+
 		VkCommandBufferBeginInfo beginInfo = {};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
@@ -463,23 +847,29 @@ namespace VulkanLib
 			VkRect2D scissor = vkTools::initializers::rect2D(GetWindowWidth(), GetWindowHeight(), 0, 0);
 			vkCmdSetScissor(mStaticCommandBuffers[i], 0, 1, &scissor);
 
+			// The descriptor set holds all the textures, it stays bound when the pipelines change since they share the layout
+			vkCmdBindDescriptorSets(mStaticCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+			VkPipeline boundPipeline = VK_NULL_HANDLE;
+
 			// RENDER
 			for (auto& object : mModels)
 			{
 				// Bind the rendering pipeline (including the shaders)
-				vkCmdBindPipeline(mStaticCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, object.pipeline);
-
-				// Bind descriptor sets describing shader binding points (must be called after vkCmdBindPipeline!)
-				vkCmdBindDescriptorSets(mStaticCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
-
-				// Push the world matrix constant
+				VkPipeline pipeline = mPipelineStates.GetPipeline(object.pipeline);
+				if (pipeline != boundPipeline)
+				{
+					vkCmdBindPipeline(mStaticCommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					boundPipeline = pipeline;
+				}
+
+				// Push the world matrix and the texture index
 				mPushConstants.world = object.object->GetWorldMatrix(); // camera->GetProjection() * camera->GetView() * 
 				mPushConstants.color = object.object->GetColor();
+				mPushConstants.textureIndex = object.textureIndex;
 				vkCmdPushConstants(mStaticCommandBuffers[i], mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
 
 				// Bind triangle vertices
-				VkDeviceSize offsets[1] = { 0 };
-				vkCmdBindVertexBuffers(mStaticCommandBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &object.mesh->vertices.buffer, offsets);		// [TODO] The renderer should group the same object models together
+				object.mesh->BindStreams(mStaticCommandBuffers[i], *object.pipeline->state.vertexDescription);		// [TODO] The renderer should group the same object models together
 				vkCmdBindIndexBuffer(mStaticCommandBuffers[i], object.mesh->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 
 				// Draw indexed triangle	
@@ -513,6 +903,14 @@ namespace VulkanLib
 
 		// Begin command buffer recording & the render pass
 		VulkanDebug::ErrorCheck(vkBeginCommandBuffer(mPrimaryCommandBuffer, &beginInfo));
+
+		// The GPU culling draws the instances that were visible in the last frame first, see HiZCuller
+		if (mUseGpuCulling)
+		{
+			mHiZCuller.Update(mCamera->GetProjection() * mCamera->GetView());
+			mHiZCuller.RecordCull(mPrimaryCommandBuffer, HIZ_PHASE_VISIBLE_LAST_FRAME);
+		}
+
 		vkCmdBeginRenderPass(mPrimaryCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		// Update dynamic viewport state
@@ -532,7 +930,7 @@ namespace VulkanLib
 		vkCmdSetScissor(mPrimaryCommandBuffer, 0, 1, &scissor);
 
 		// Bind the rendering pipeline (including the shaders)
-		vkCmdBindPipeline(mPrimaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelines.colored);
+		vkCmdBindPipeline(mPrimaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates.GetPipeline(mPipelines.colored));
 
 		// Bind descriptor sets describing shader binding points (must be called after vkCmdBindPipeline!)
 		vkCmdBindDescriptorSets(mPrimaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
@@ -540,23 +938,51 @@ namespace VulkanLib
 		// Push the world matrix constant
 		mPushConstants.world = glm::mat4();
 		mPushConstants.color = vec3(1, 1, 1);
+		mPushConstants.textureIndex = 0;
 		vkCmdPushConstants(mPrimaryCommandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
 
 		// Bind triangle vertices
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(mPrimaryCommandBuffer, VERTEX_BUFFER_BIND_ID, 1, &mTestModel->vertices.buffer, offsets);		// [NOTE][HACK] Note the use of mTestModel!!
-
-		// Binding point 1 : Instance data buffer
-		vkCmdBindVertexBuffers(mPrimaryCommandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &mInstanceBuffer.buffer, offsets);
+		mTestModel->BindStreams(mPrimaryCommandBuffer, mVertexDescription);		// [NOTE][HACK] Note the use of mTestModel!!
 
 		vkCmdBindIndexBuffer(mPrimaryCommandBuffer, mTestModel->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-		// Draw indexed triangle	
 		vkCmdSetLineWidth(mPrimaryCommandBuffer, 1.0f);
-		vkCmdDrawIndexed(mPrimaryCommandBuffer, mTestModel->GetNumIndices(), mModels.size(), 0, 0, 0);
 
-		// End command buffer recording & the render pass
+		if (mUseGpuCulling)
+		{
+			// Binding point 2 : The compacted instances, the instance count is written by the compute shader
+			mHiZCuller.RecordDraw(mPrimaryCommandBuffer, HIZ_PHASE_VISIBLE_LAST_FRAME, INSTANCE_BUFFER_BIND_ID);
+		}
+		else
+		{
+			// Binding point 2 : Instance data buffer
+			VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(mPrimaryCommandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &mInstanceBuffer.buffer, offsets);
+
+			// Draw indexed triangle	
+			vkCmdDrawIndexed(mPrimaryCommandBuffer, mTestModel->GetNumIndices(), mModels.size(), 0, 0, 0);
+		}
+
 		vkCmdEndRenderPass(mPrimaryCommandBuffer);
+
+		// The instances that became visible are tested against the depth of the first phase and drawn on top of it
+		if (mUseGpuCulling)
+		{
+			mHiZCuller.RecordDepthPyramid(mPrimaryCommandBuffer);
+			mHiZCuller.RecordCull(mPrimaryCommandBuffer, HIZ_PHASE_DISOCCLUDED);
+
+			renderPassBeginInfo.renderPass = mHiZCuller.GetLoadRenderPass();
+			vkCmdBeginRenderPass(mPrimaryCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			// The culling pushed its constants with the compute layout, so the graphics push constants aren't guaranteed
+			// to be kept. The pipeline and descriptor set are bound and pushed again, the streams and dynamic state are kept
+			vkCmdBindPipeline(mPrimaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates.GetPipeline(mPipelines.colored));
+			vkCmdBindDescriptorSets(mPrimaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+			vkCmdPushConstants(mPrimaryCommandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
+			mHiZCuller.RecordDraw(mPrimaryCommandBuffer, HIZ_PHASE_DISOCCLUDED, INSTANCE_BUFFER_BIND_ID);
+			vkCmdEndRenderPass(mPrimaryCommandBuffer);
+		}
+
+		// End command buffer recording
 		VulkanDebug::ErrorCheck(vkEndCommandBuffer(mPrimaryCommandBuffer));
 	}
 
@@ -617,22 +1043,27 @@ namespace VulkanLib
 		//
 		// Testing push constant rendering with different matrices
 		//
+		vkCmdBindDescriptorSets(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+
 		for (auto& object : mModels)
 		{
 			// Bind the rendering pipeline (including the shaders)
-			vkCmdBindPipeline(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, object.pipeline);
-
-			// Bind descriptor sets describing shader binding points (must be called after vkCmdBindPipeline!)
-			vkCmdBindDescriptorSets(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+			VkPipeline pipeline = mPipelineStates.GetPipeline(object.pipeline);
+			if (pipeline != boundPipeline)
+			{
+				vkCmdBindPipeline(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
 
-			// Push the world matrix constant
+			// Push the world matrix and the texture index
 			mPushConstants.world = object.object->GetWorldMatrix(); // camera->GetProjection() * camera->GetView() * 
 			mPushConstants.color = object.object->GetColor();
+			mPushConstants.textureIndex = object.textureIndex;
 			vkCmdPushConstants(mSecondaryCommandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
 		
 			// Bind triangle vertices
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(mSecondaryCommandBuffer, VERTEX_BUFFER_BIND_ID, 1, &object.mesh->vertices.buffer, offsets);		// [TODO] The renderer should group the same object models together
+			object.mesh->BindStreams(mSecondaryCommandBuffer, *object.pipeline->state.vertexDescription);		// [TODO] The renderer should group the same object models together
 			vkCmdBindIndexBuffer(mSecondaryCommandBuffer, object.mesh->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 
 			// Draw indexed triangle	
@@ -640,12 +1071,45 @@ namespace VulkanLib
 			vkCmdDrawIndexed(mSecondaryCommandBuffer, object.mesh->GetNumIndices(), 1, 0, 0, 0);
 		}
 
+		// The terrain selects its visible chunks for the current camera and draws one patch per chunk
+		if (mTerrain != nullptr)
+		{
+			mTerrain->Update(mCamera, mTerrainModel.object->GetWorldMatrix(), (float)GetWindowHeight());
+
+			VkPipelineLayout pipelineLayout = mPipelineLayout;
+
+			if (mTerrain->GetMode() == TERRAIN_MODE_GPU_DISPLACED)
+			{
+				pipelineLayout = mTerrainPipelineLayout;
+				vkCmdBindPipeline(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates.GetPipeline(mPipelines.terrain));
+				vkCmdBindDescriptorSets(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &mTerrainDescriptorSet.descriptorSet, 0, NULL);
+			}
+			else
+			{
+				vkCmdBindPipeline(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates.GetPipeline(mTerrainModel.pipeline));
+				vkCmdBindDescriptorSets(mSecondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+			}
+
+			mPushConstants.world = mTerrainModel.object->GetWorldMatrix();
+			mPushConstants.color = mTerrainModel.object->GetColor();
+			mPushConstants.textureIndex = mTerrainModel.textureIndex;
+			vkCmdPushConstants(mSecondaryCommandBuffer, pipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
+
+			mTerrain->Draw(mSecondaryCommandBuffer);
+		}
+
 		// End secondary command buffer
 		VulkanDebug::ErrorCheck(vkEndCommandBuffer(mSecondaryCommandBuffer));
 
 		std::vector<VkCommandBuffer> commandBuffers;
 		commandBuffers.push_back(mSecondaryCommandBuffer);
 
+		// Every thread culls its own objects against the same frustum and occlusion buffer
+		mFrustum.Extract(mCamera->GetProjection() * mCamera->GetView());
+
+		if (mUseOcclusionCulling)
+			RasterizeOccluders();
+
 		// Now let every thread generate their command buffer and then add it to the command buffer vector
 		for (int t = 0; t < mThreadData.size(); t++)
 		{
@@ -653,15 +1117,53 @@ namespace VulkanLib
 			//commandBuffers.push_back(mThreadData[t].commandBuffer);
 		}
 
+		// The batches are a handful of draws, they are recorded on this thread while the worker threads record the objects
+		if (mUseStaticBatching)
+		{
+			if (mUseDepthPrepass)
+				RecordBatchCommandBuffer(mBatchPrepassCommandBuffer, inheritanceInfo, true);
+
+			RecordBatchCommandBuffer(mBatchCommandBuffer, inheritanceInfo, false);
+		}
+
 		// [NOOOOOOOOOOOTE] Is this placement important?????
 		mThreadPool.wait();
 
+		// The billboards of all the threads are drawn together, one instanced draw per mesh
+		if (mUseImpostors)
+		{
+			mImpostorRenderer.BeginFrame();
+			for (auto& thread : mThreadData)
+			{
+				for (int i = 0; i < thread.impostorInstances.size(); i++)
+					mImpostorRenderer.AddInstances(i, thread.impostorInstances[i]);
+			}
+
+			RecordImpostorCommandBuffer(inheritanceInfo);
+		}
+
+		// All the depth is written before any object is shaded
+		if (mUseDepthPrepass)
+		{
+			if (mUseStaticBatching)
+				commandBuffers.push_back(mBatchPrepassCommandBuffer);
+
+			for (int t = 0; t < mThreadData.size(); t++)
+				commandBuffers.push_back(mThreadData[t].prepassCommandBuffer);
+		}
+
+		if (mUseStaticBatching)
+			commandBuffers.push_back(mBatchCommandBuffer);
+
 		for (int t = 0; t < mThreadData.size(); t++)
 		{
 			//mThreadPool.threads[t]->addJob([=] {ThreadRecordCommandBuffer(t, inheritanceInfo); });
 			commandBuffers.push_back(mThreadData[t].commandBuffer);
 		}
 
+		if (mUseImpostors)
+			commandBuffers.push_back(mImpostorCommandBuffer);
+
 		// Execute render commands from the secondary command buffer
 		vkCmdExecuteCommands(mPrimaryCommandBuffer, commandBuffers.size(), commandBuffers.data());
 
@@ -674,7 +1176,117 @@ namespace VulkanLib
 	{
 		ThreadData *thread = &mThreadData[threadId];		// For faster access
 		VkCommandBuffer commandBuffer = mThreadData[threadId].commandBuffer;
-		auto objects = mThreadData[threadId].threadObjects;
+		auto& objects = mThreadData[threadId].threadObjects;
+
+		// Cull the objects first so only the visible ones are recorded
+		if (thread->culler.GetNumObjects() != objects.size())
+			thread->culler.Resize(objects.size());
+
+		for (int i = 0; i < objects.size(); i++)
+			thread->culler.SetBounds(i, objects[i].mesh->GetBoundingBox(), objects[i].object->GetWorldMatrix());
+
+		thread->culler.Cull(mFrustum, thread->visibleObjects);
+
+		// The objects that are still in a static batch are drawn by the batch
+		if (mUseStaticBatching)
+		{
+			auto batched = std::remove_if(thread->visibleObjects.begin(), thread->visibleObjects.end(), [&](int index) {
+				return mStaticBatcher.IsBatched(objects[index].staticBatch);
+			});
+
+			thread->visibleObjects.erase(batched, thread->visibleObjects.end());
+		}
+
+		// Then the ones that are hidden behind the occluders
+		thread->numOccluded = 0;
+		thread->occlusionTestTime = 0.0;
+
+		if (mUseOcclusionCulling)
+		{
+			auto begin = std::chrono::high_resolution_clock::now();
+
+			auto occluded = std::remove_if(thread->visibleObjects.begin(), thread->visibleObjects.end(), [&](int index) {
+				return mOcclusionCuller.IsOccluded(objects[index].mesh->GetBoundingBox().Transform(objects[index].object->GetWorldMatrix()));
+			});
+
+			thread->numOccluded = thread->visibleObjects.end() - occluded;
+			thread->visibleObjects.erase(occluded, thread->visibleObjects.end());
+
+			auto end = std::chrono::high_resolution_clock::now();
+			thread->occlusionTestTime = std::chrono::duration<double, std::milli>(end - begin).count();
+		}
+
+		// Then the ones that are too small on screen to be worth drawing, the slightly larger ones become billboards if their mesh has an impostor
+		thread->numContributionCulled = 0;
+		thread->numImpostors = 0;
+		thread->impostorInstances.resize(mImpostorModels.size());
+		for (auto& instances : thread->impostorInstances)
+			instances.clear();
+
+		if (mUseContributionCulling || mUseImpostors)
+		{
+			float viewportHeight = (float)GetWindowHeight();
+
+			auto tooSmall = std::remove_if(thread->visibleObjects.begin(), thread->visibleObjects.end(), [&](int index) {
+				const VulkanModel& object = objects[index];
+				const BoundingSphere& sphere = object.mesh->GetBoundingSphere();
+				mat4 world = object.object->GetWorldMatrix();
+				vec3 scale = object.object->GetScale();
+				float radius = sphere.radius * std::max(scale.x, std::max(scale.y, scale.z));
+				float projectedSize = mCamera->GetProjectedSize(vec3(world * vec4(sphere.center, 1.0f)), radius, viewportHeight);
+
+				if (mUseContributionCulling && projectedSize < CONTRIBUTION_CULL_PIXELS)
+					return true;
+
+				if (mUseImpostors && projectedSize < IMPOSTOR_PIXELS && mImpostorRenderer.IsCaptured(object.impostor))
+				{
+					thread->impostorInstances[object.impostor].push_back(ImpostorRenderer::CreateInstance(sphere, world));
+					thread->numImpostors++;
+					return true;
+				}
+
+				return false;
+			});
+
+			thread->numContributionCulled = thread->visibleObjects.end() - tooSmall - thread->numImpostors;
+			thread->visibleObjects.erase(tooSmall, thread->visibleObjects.end());
+		}
+
+		// Then the small meshes with enough visible copies to be cheaper to transform than to draw one by one
+		if (mUseDynamicBatching)
+		{
+			thread->batcher.Begin();
+			thread->dynamicMeshCounts.assign(mDynamicBatchMeshes.size(), 0);
+
+			for (int index : thread->visibleObjects)
+			{
+				if (objects[index].dynamicMesh != -1)
+					thread->dynamicMeshCounts[objects[index].dynamicMesh]++;
+			}
+
+			auto batched = std::remove_if(thread->visibleObjects.begin(), thread->visibleObjects.end(), [&](int index) {
+				const VulkanModel& object = objects[index];
+				if (object.dynamicMesh == -1 || !DynamicBatcher::ShouldBatch(mDynamicBatchMeshes[object.dynamicMesh], thread->dynamicMeshCounts[object.dynamicMesh]))
+					return false;
+
+				thread->batcher.Add(&mDynamicBatchMeshes[object.dynamicMesh], object.batchMaterial, object.object->GetWorldMatrix());
+				return true;
+			});
+
+			thread->visibleObjects.erase(batched, thread->visibleObjects.end());
+			thread->batcher.Build();
+		}
+
+		// Both passes draw the same visible objects
+		if (mUseDepthPrepass)
+			ThreadRecordObjects(thread, thread->prepassCommandBuffer, inheritanceInfo, true);
+
+		ThreadRecordObjects(thread, commandBuffer, inheritanceInfo, false);
+	}
+
+	void VulkanApp::ThreadRecordObjects(ThreadData* thread, VkCommandBuffer commandBuffer, VkCommandBufferInheritanceInfo inheritanceInfo, bool depthPrepass)
+	{
+		auto& objects = thread->threadObjects;
 
 		// Secondary command buffer for the sky sphere
 		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
@@ -700,33 +1312,248 @@ namespace VulkanLib
 		scissor.offset.y = 0;
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		for (auto& object : objects)
+		// Objects with different textures only differ in the pushed texture index
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &thread->descriptorSet.descriptorSet, 0, NULL);
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		StaticModel* boundMesh = nullptr;
+
+		for (int index : thread->visibleObjects)
 		{
-			// Bind the rendering pipeline (including the shaders)
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, object.pipeline);
+			auto& object = objects[index];
+			PipelineHandle pipelineHandle = depthPrepass ? object.depthPipeline : object.pipeline;
 
-			// Bind descriptor sets describing shader binding points (must be called after vkCmdBindPipeline!)
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &thread->descriptorSet.descriptorSet, 0, NULL);
+			// Bind the rendering pipeline (including the shaders)
+			VkPipeline pipeline = mPipelineStates.GetPipeline(pipelineHandle);
+			if (pipeline != boundPipeline)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+				boundMesh = nullptr;	// The new pipeline can read other streams
+			}
 
-			// Push the world matrix constant
+			// Push the world matrix and the texture index
 			thread->pushConstants.world = object.object->GetWorldMatrix(); // camera->GetProjection() * camera->GetView() * 
 			thread->pushConstants.color = object.object->GetColor();
+			thread->pushConstants.textureIndex = object.textureIndex;
 			vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &thread->pushConstants);
 
-			VkDeviceSize offsets[1] = { 0 };
-			VkBuffer buffer = mThreadData[threadId].model.vertices.buffer;
-			vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &buffer, offsets);		// [TODO] The renderer should group the same object models together
-			vkCmdBindIndexBuffer(commandBuffer, mThreadData[threadId].model.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			// The depth pre-pass only binds the position stream
+			if (object.mesh != boundMesh)
+			{
+				object.mesh->BindStreams(commandBuffer, *pipelineHandle->state.vertexDescription);
+				vkCmdBindIndexBuffer(commandBuffer, object.mesh->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				boundMesh = object.mesh;
+			}
 
 			// Draw indexed triangle	
 			vkCmdSetLineWidth(commandBuffer, 1.0f);
-			vkCmdDrawIndexed(commandBuffer, mThreadData[threadId].model.GetNumIndices(), 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, object.mesh->GetNumIndices(), 1, 0, 0, 0);
+		}
+
+		// One draw per material for the dynamic batches, their vertices are already in world space
+		if (mUseDynamicBatching)
+		{
+			for (auto& batch : thread->batcher.GetBatches())
+			{
+				const VulkanModel& material = mBatchMaterials[batch.material];
+				PipelineHandle pipelineHandle = depthPrepass ? material.depthPipeline : material.pipeline;
+
+				VkPipeline pipeline = mPipelineStates.GetPipeline(pipelineHandle);
+				if (pipeline != boundPipeline)
+				{
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					boundPipeline = pipeline;
+				}
+
+				thread->pushConstants.world = mat4(1.0f);
+				thread->pushConstants.color = material.object->GetColor();
+				thread->pushConstants.textureIndex = material.textureIndex;
+				vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &thread->pushConstants);
+
+				thread->batcher.BindStreams(commandBuffer, *pipelineHandle->state.vertexDescription);
+				vkCmdSetLineWidth(commandBuffer, 1.0f);
+				vkCmdDrawIndexed(commandBuffer, batch.numIndices, 1, batch.firstIndex, 0, 0);
+			}
 		}
 
 		// End secondary command buffer
 		VulkanDebug::ErrorCheck(vkEndCommandBuffer(commandBuffer));
 	}
 
+	void VulkanApp::RecordImpostorCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo)
+	{
+		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VulkanDebug::ErrorCheck(vkBeginCommandBuffer(mImpostorCommandBuffer, &commandBufferBeginInfo));
+
+		// Update dynamic viewport state
+		VkViewport viewport = {};
+		viewport.width = (float)GetWindowWidth();
+		viewport.height = (float)GetWindowHeight();
+		viewport.minDepth = (float) 0.0f;
+		viewport.maxDepth = (float) 1.0f;
+		vkCmdSetViewport(mImpostorCommandBuffer, 0, 1, &viewport);
+
+		// Update dynamic scissor state
+		VkRect2D scissor = {};
+		scissor.extent.width = GetWindowWidth();
+		scissor.extent.height = GetWindowHeight();
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+		vkCmdSetScissor(mImpostorCommandBuffer, 0, 1, &scissor);
+
+		mImpostorRenderer.RecordDraws(mImpostorCommandBuffer);
+
+		VulkanDebug::ErrorCheck(vkEndCommandBuffer(mImpostorCommandBuffer));
+	}
+
+	void VulkanApp::RecordBatchCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferInheritanceInfo inheritanceInfo, bool depthPrepass)
+	{
+		VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+		commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		VulkanDebug::ErrorCheck(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+		// Update dynamic viewport state
+		VkViewport viewport = {};
+		viewport.width = (float)GetWindowWidth();
+		viewport.height = (float)GetWindowHeight();
+		viewport.minDepth = (float) 0.0f;
+		viewport.maxDepth = (float) 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		// Update dynamic scissor state
+		VkRect2D scissor = {};
+		scissor.extent.width = GetWindowWidth();
+		scissor.extent.height = GetWindowHeight();
+		scissor.offset.x = 0;
+		scissor.offset.y = 0;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+
+		int numVisible = 0;
+		int numDraws = 0;
+
+		for (int i = 0; i < mStaticBatcher.GetNumBatches(); i++)
+		{
+			// Culled like one large object
+			const StaticBatch& batch = mStaticBatcher.GetBatch(i);
+			if (batch.ranges.size() == 0 || !mFrustum.Intersects(batch.worldBounds) || (mUseOcclusionCulling && mOcclusionCuller.IsOccluded(batch.worldBounds)))
+				continue;
+
+			const VulkanModel& material = mBatchMaterials[batch.material];
+			PipelineHandle pipelineHandle = depthPrepass ? material.depthPipeline : material.pipeline;
+
+			VkPipeline pipeline = mPipelineStates.GetPipeline(pipelineHandle);
+			if (pipeline != boundPipeline)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
+
+			// The vertices are already in world space
+			mPushConstants.world = mat4(1.0f);
+			mPushConstants.color = material.object->GetColor();
+			mPushConstants.textureIndex = material.textureIndex;
+			vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
+
+			batch.model->BindStreams(commandBuffer, *pipelineHandle->state.vertexDescription);
+			vkCmdBindIndexBuffer(commandBuffer, batch.model->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdSetLineWidth(commandBuffer, 1.0f);
+
+			// One draw per run of objects that are still in the batch
+			for (auto& range : batch.ranges)
+				vkCmdDrawIndexed(commandBuffer, range.numIndices, 1, range.firstIndex, 0, 0);
+
+			numVisible++;
+			numDraws += batch.ranges.size();
+		}
+
+		VulkanDebug::ErrorCheck(vkEndCommandBuffer(commandBuffer));
+
+		if (!depthPrepass)
+		{
+			mNumVisibleBatches = numVisible;
+			mNumBatchDraws = numDraws;
+		}
+	}
+
+	// Renders the views of the impostors that were added since the last frame, in the local space of their meshes
+	// The camera in the uniform buffer is changed for every view, UpdateUniformBuffers() sets it back
+	void VulkanApp::CaptureImpostors()
+	{
+		// Otherwise the views would be rendered with the fallback pipeline
+		mPipelineStates.Wait();
+
+		mImpostorRenderer.Capture([&](VkCommandBuffer commandBuffer, int impostor, const mat4& view, const mat4& projection, vec3 eyePos) {
+			VulkanModel& model = mImpostorModels[impostor];
+
+			mUniformBuffer.camera.projectionMatrix = projection;
+			mUniformBuffer.camera.viewMatrix = view;
+			mUniformBuffer.camera.eyePos = eyePos;
+			mUniformBuffer.UpdateMemory(GetDevice());
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineStates.GetPipeline(model.pipeline));
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 1, &mDescriptorSet.descriptorSet, 0, NULL);
+
+			mPushConstants.world = mat4(1.0f);
+			mPushConstants.color = model.object->GetColor();
+			mPushConstants.textureIndex = model.textureIndex;
+			vkCmdPushConstants(commandBuffer, mPipelineLayout, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, sizeof(PushConstantBlock), &mPushConstants);
+
+			model.mesh->BindStreams(commandBuffer, *model.pipeline->state.vertexDescription);
+			vkCmdBindIndexBuffer(commandBuffer, model.mesh->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdSetLineWidth(commandBuffer, 1.0f);
+			vkCmdDrawIndexed(commandBuffer, model.mesh->GetNumIndices(), 1, 0, 0, 0);
+		});
+	}
+
+	// The objects that cover the most of the screen are the occluders, the radius of their bounding sphere over the distance
+	void VulkanApp::RasterizeOccluders()
+	{
+		mOcclusionCuller.Begin(mCamera->GetProjection() * mCamera->GetView());
+
+		std::vector<std::pair<float, const VulkanModel*>> candidates;
+		vec3 cameraPosition = mCamera->GetPosition();
+
+		for (auto& thread : mThreadData)
+		{
+			for (auto& model : thread.threadObjects)
+			{
+				if (mOccluderMeshes.count(model.mesh) == 0)
+					continue;
+
+				mat4 world = model.object->GetWorldMatrix();
+				if (!mFrustum.Intersects(model.mesh->GetBoundingBox().Transform(world)))
+					continue;
+
+				const BoundingSphere& sphere = model.mesh->GetBoundingSphere();
+				vec3 scale = model.object->GetScale();
+				float radius = sphere.radius * std::max(scale.x, std::max(scale.y, scale.z));
+				float distance = glm::length(vec3(world * vec4(sphere.center, 1.0f)) - cameraPosition);
+
+				candidates.push_back(std::make_pair(radius / std::max(distance, 1.0f), &model));
+			}
+		}
+
+		int numOccluders = std::min((int)candidates.size(), OCCLUSION_MAX_OCCLUDERS);
+		std::partial_sort(candidates.begin(), candidates.begin() + numOccluders, candidates.end(), [](const std::pair<float, const VulkanModel*>& a, const std::pair<float, const VulkanModel*>& b) {
+			return a.first > b.first;
+		});
+
+		for (int i = 0; i < numOccluders; i++)
+			mOcclusionCuller.AddOccluder(&mOccluderMeshes[candidates[i].second->mesh], candidates[i].second->object->GetWorldMatrix());
+
+		mOcclusionCuller.Rasterize();
+	}
+
 	void VulkanApp::Draw()
 	{
 		//
@@ -797,7 +1624,18 @@ namespace VulkanLib
 
 		// NOTE: TODO: TESTING
 		if (mPrepared) {
+			// The world matrices of the objects that moved are rebuilt before anything reads them, the recording threads only read
+			TransformSystem::GetDefault().Update(&mThreadPool);
+
+			UpdateTextureStreaming();
+
+			if (mUseImpostors && mImpostorRenderer.HasPendingCaptures())
+				CaptureImpostors();
+
 			UpdateUniformBuffers();
+
+			mOctree.UpdateMoved();
+			mStaticBatcher.UpdateMoved();
 			Draw();
 		}
 
@@ -9,10 +9,26 @@
 #include "UniformBuffer.h"
 #include "BigUniformBuffer.h"
 #include "DescriptorSet.h"
+#include "TextureStreamer.h"
+#include "MaterialLibrary.h"
+#include "TextureBatchLoader.h"
+#include "PipelineStateCache.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "HiZCuller.h"
+#include "ImpostorRenderer.h"
+#include "StaticBatcher.h"
+#include "DynamicBatcher.h"
+#include "LooseOctree.h"
+#include "SceneQuery.h"
+#include "Object.h"
+#include <map>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
+#define SHADER_VARIANT_LIGHTS_SHIFT 8		// The light count is stored in bits 8-15 of the shader variant key
+
 using namespace glm;
 
 namespace VulkanLib
@@ -22,6 +38,7 @@ namespace VulkanLib
 	class Object;
 	class TextureData;
 	class Light;
+	class ChunkedTerrain;
 
 	struct Buffer {
 		VkBuffer buffer;
@@ -35,27 +52,51 @@ namespace VulkanLib
 		vec3 color;
 	};
 
+	typedef VertexLayout<InstanceData,
+		VERTEX_MEMBER(InstanceData, position),
+		VERTEX_MEMBER(InstanceData, scale),
+		VERTEX_MEMBER(InstanceData, color)> InstanceDataLayout;
+
+	// Bits of the shader variant key, 0 is the uber shader that reads the settings from the uniform buffer at runtime
+	// The other keys set specialization constants so the shader compiler can remove the paths that aren't used
+	enum ShaderVariantFlags
+	{
+		SHADER_VARIANT_SPECIALIZED = 0x1,		// The other bits are only used when this is set
+		SHADER_VARIANT_INSTANCING = 0x2,
+		SHADER_VARIANT_TEXTURING = 0x4			// Set per pipeline, the colored variant is the textured shader without the texture
+	};
+
+	// Resolved with PipelineStateCache::GetPipeline() when recording
 	struct Pipelines {
-		VkPipeline textured;
-		VkPipeline colored;
-		VkPipeline starsphere;
-		VkPipeline instanced;
+		PipelineHandle textured = nullptr;
+		PipelineHandle colored = nullptr;		// The fallback
+		PipelineHandle starsphere = nullptr;
+		PipelineHandle terrain = nullptr;
+		PipelineHandle depth = nullptr;			// The fallback of the depth pre-pass pipelines
 	};
 
 	struct PushConstantBlock {
 		mat4 world;
 		vec3 color;
+		int textureIndex;		// Into the material texture array
 	};
 
 	struct VulkanModel
 	{
 		Object* object;
 		StaticModel* mesh;
-		VkPipeline pipeline;
+		PipelineHandle pipeline = nullptr;
+		PipelineHandle depthPipeline = nullptr;		// Only set when the depth pre-pass is used
+		int textureIndex = 0;	// From MaterialLibrary::AddTexture()
+		int impostor = -1;		// From ImpostorRenderer::AddMesh(), only set when impostors are used
+		int staticBatch = -1;	// From StaticBatcher::Add(), only set when static batching is used
+		int batchMaterial = -1;	// Into VulkanApp::mBatchMaterials, only set when static or dynamic batching is used
+		int dynamicMesh = -1;	// Into VulkanApp::mDynamicBatchMeshes, -1 if the mesh is too large to be batched
 	};
 
 	struct ThreadData {
 		VkCommandBuffer commandBuffer;
+		VkCommandBuffer prepassCommandBuffer;		// The depth pre-pass of the same objects, executed before all the commandBuffer
 		VkCommandPool commandPool;
 		std::vector<VulkanModel> threadObjects;
 
@@ -63,7 +104,20 @@ namespace VulkanLib
 		DescriptorSet descriptorSet;
 		PushConstantBlock pushConstants;
 
-		StaticModel model;
+		// Culled before recording, only the visible threadObjects are recorded
+		FrustumCuller culler;
+		std::vector<int> visibleObjects;
+		int numOccluded = 0;
+		double occlusionTestTime = 0.0;		// Milliseconds
+
+		// Visible but too small on screen, either skipped or drawn as billboards
+		int numContributionCulled = 0;
+		int numImpostors = 0;
+		std::vector<std::vector<ImpostorInstance>> impostorInstances;		// Indexed by VulkanModel::impostor
+
+		// The small meshes that are transformed into one stream and drawn once per material
+		DynamicBatcher batcher;
+		std::vector<int> dynamicMeshCounts;		// Visible objects of every mesh, indexed by VulkanModel::dynamicMesh
 	};
 
 	class VulkanApp : public VulkanBase
@@ -78,20 +132,40 @@ namespace VulkanLib
 		void SetupDescriptorSetLayout();
 		void SetupDescriptorPool();
 		void SetupDescriptorSet();
-		void PreparePipelines();
+		void PreparePipelines(uint32_t shaderVariant);		// 0 = uber shader, see ShaderVariantFlags
+		PipelineState GetPipelineState(PipelineEnum pipeline);
+		PipelineHandle GetPipeline(PipelineEnum pipeline);	// Compiled on demand, draws with mPipelines.colored until ready
 		void UpdateUniformBuffers();
+		void UpdateTextureStreaming();
+		void UpdateMaterialDescriptors();
 		void PrepareCommandBuffers();						// Custom
 		void SetupVertexDescriptions();
 
 		void SetupMultithreading(int numThreads);			// Custom
 		void EnableInstancing(bool useInstancing);
 		void EnableStaticCommandBuffers(bool useStaticCommandBuffers);
+		void EnableShaderVariants(bool useShaderVariants);	// Must be called before Prepare()
+		void EnableGpuCulling(bool useGpuCulling);			// Only used with instancing, must be called before PrepareInstancing()
+		void EnableDepthPrepass(bool useDepthPrepass);		// Only used by the basic pipeline, must be called before Prepare()
+		void EnableImpostors(bool useImpostors);			// Only used by the basic pipeline, must be called before Prepare()
+		void EnableContributionCulling(bool useContributionCulling);	// Only used by the basic pipeline
+		void EnableOcclusionCulling(bool useOcclusionCulling);		// Only used by the basic pipeline
+		void EnableStaticBatching(bool useStaticBatching);	// Only used by the basic pipeline, must be called before Prepare()
+		void EnableDynamicBatching(bool useDynamicBatching);	// Only used by the basic pipeline, must be called before Prepare()
+		uint32_t GetShaderVariant();
 		void PrepareInstancing();
+		void BuildStaticBatches();							// Must be called after all the objects are added
+		void SortThreadObjects();							// Must be called after all the objects are added
 
 		void RecordStaticCommandBuffers();
 		void BuildInstancingCommandBuffer(VkFramebuffer frameBuffer);
 		void RecordRenderingCommandBuffer(VkFramebuffer frameBuffer);
 		void ThreadRecordCommandBuffer(int threadId, VkCommandBufferInheritanceInfo inheritanceInfo);
+		void ThreadRecordObjects(ThreadData* thread, VkCommandBuffer commandBuffer, VkCommandBufferInheritanceInfo inheritanceInfo, bool depthPrepass);
+		void RecordImpostorCommandBuffer(VkCommandBufferInheritanceInfo inheritanceInfo);
+		void RecordBatchCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferInheritanceInfo inheritanceInfo, bool depthPrepass);
+		void RasterizeOccluders();
+		void CaptureImpostors();
 
 		virtual void Render();
 		virtual void Update();
@@ -107,13 +181,30 @@ namespace VulkanLib
 		void SetCamera(Camera* camera);
 
 		void AddModel(VulkanModel model);
+		void SetTerrain(VulkanModel model, ChunkedTerrain* terrain);		// Only drawn by the basic pipeline
+		int AddTexture(std::string filename, VkFormat format);			// Returns the texture index for VulkanModel
+
+		// Frustum culling stats of the last frame, only the basic pipeline culls
+		int GetNumVisibleObjects();
+		int GetNumCulledObjects();
+		int GetNumOccludedObjects();		// Inside the frustum but hidden behind the occluders
+		double GetOcclusionTestTime();
+		int GetNumContributionCulledObjects();	// Smaller than CONTRIBUTION_CULL_PIXELS on screen
+		int GetNumImpostorObjects();			// Drawn as billboards
+		int GetNumVisibleBatches();
+		int GetNumBatchDraws();
+		DynamicBatchStats GetDynamicBatchStats();	// Summed over the threads
 
 		Pipelines						mPipelines;
+		PipelineStateCache				mPipelineStates;
 		VkPipelineLayout				mPipelineLayout;
 
 		// This gets regenerated each frame so there is no need for command buffer per frame buffer
 		VkCommandBuffer					mPrimaryCommandBuffer;
 		VkCommandBuffer					mSecondaryCommandBuffer;
+		VkCommandBuffer					mImpostorCommandBuffer;				// The billboards of all the threads
+		VkCommandBuffer					mBatchCommandBuffer;				// The static batches, recorded while the threads record the objects
+		VkCommandBuffer					mBatchPrepassCommandBuffer;
 		std::vector<VkCommandBuffer>	mStaticCommandBuffers;				
 
 		VkFence							mRenderFence = {};
@@ -124,7 +215,9 @@ namespace VulkanLib
 
 		PushConstantBlock				mPushConstants;						// Gets updated with new push constants for each object
 	
-		vkTools::VulkanTexture			mTestTexture;						// NOTE: just for testing
+		TextureStreamer					mTextureStreamer;
+		MaterialLibrary					mMaterialLibrary;					// All the object textures, bound once per command buffer
+		TextureBatchLoader				mTextureBatchLoader;				// Textures that aren't streamed
 		vkTools::VulkanTexture			mTerrainTexture;					// Testing for the terrain
 		
 		bool							mPrepared = false;
@@ -132,8 +225,18 @@ namespace VulkanLib
 		Buffer							mInstanceBuffer;
 		bool							mUseInstancing = false;
 		bool							mUseStaticCommandBuffer = false;	
+		bool							mUseShaderVariants = false;
+		bool							mUseGpuCulling = false;
+		bool							mUseDepthPrepass = false;
+		bool							mUseImpostors = false;
+		bool							mUseContributionCulling = false;
+		bool							mUseOcclusionCulling = false;
+		bool							mUseStaticBatching = false;
+		bool							mUseDynamicBatching = false;
+		uint32_t						mShaderVariant = 0;					// Used by all the object pipelines
 
 		Camera*							mCamera;
+		Frustum							mFrustum;							// Extracted once per frame, read by all the recording threads
 
 		// Threads
 		std::vector<ThreadData>			mThreadData;
@@ -142,6 +245,33 @@ namespace VulkanLib
 		ThreadPool						mThreadPool;
 
 		std::vector<VulkanModel>		mModels;
+		LooseOctree						mOctree;							// Every object from AddModel(), updated when they move
+		SceneQuery						mSceneQuery;						// Picking and overlap queries over mOctree
+
+		OcclusionCuller					mOcclusionCuller;
+		std::map<StaticModel*, OccluderMesh> mOccluderMeshes;				// The models that are simple enough to be occluders
+
+		HiZCuller						mHiZCuller;							// Culls the instances on the GPU when mUseGpuCulling is set
+
+		ImpostorRenderer				mImpostorRenderer;					// Only initialized when mUseImpostors is set
+		std::vector<VulkanModel>		mImpostorModels;					// The model every impostor is captured from, indexed by VulkanModel::impostor
+
+		StaticBatcher					mStaticBatcher;						// Only used when mUseStaticBatching is set
+		std::vector<VulkanModel>		mBatchMaterials;					// The pipelines, texture and color of every batch, indexed by VulkanModel::batchMaterial
+		int								mNumVisibleBatches = 0;
+		int								mNumBatchDraws = 0;
+
+		std::vector<DynamicBatchMesh>	mDynamicBatchMeshes;				// Only used when mUseDynamicBatching is set, read by all the threads
+		std::map<StaticModel*, int>		mDynamicBatchMeshIndices;			// -1 for the meshes that are too large
+
+		ChunkedTerrain*					mTerrain = nullptr;
+		VulkanModel						mTerrainModel;						// mesh is unused, the terrain has its own buffers
+
+		// The GPU displaced terrain reads the heightmap in the vertex shader and has its own vertex format
+		VertexDescription				mTerrainVertexDescription;
+		VkPipelineLayout				mTerrainPipelineLayout;
+		DescriptorPool					mTerrainDescriptorPool;
+		DescriptorSet					mTerrainDescriptorSet;
 
 		int								mNextThreadId = 0;					// The thread to add new objects to
 
@@ -149,6 +279,7 @@ namespace VulkanLib
 		// inputState will have pointers to the binding and attribute descriptions after PrepareVertices()
 		// inputState is the pVertexInputState when creating the graphics pipeline
 		VertexDescription				mVertexDescription;
+		VertexDescription				mDepthVertexDescription;			// Only the position stream
 		BigUniformBuffer				mUniformBuffer;
 		DescriptorPool					mDescriptorPool;
 		DescriptorSet					mDescriptorSet;
@@ -11,6 +11,8 @@
 #include "base/vulkanTextureLoader.hpp"
 #include "Window.h"
 
+#define PIPELINE_CACHE_FILE "data/pipeline_cache.bin"
+
 /*
 	-	Right now this code assumes that queueFamilyIndex is = 0 in all places,
 		no looping is done to find a queue that have the proper support
@@ -36,6 +38,9 @@ namespace VulkanLib
 		// Gather physical device memory properties
 		vkGetPhysicalDeviceMemoryProperties(mPhysicalDevice, &mDeviceMemoryProperties);
 
+		// Reuse the pipelines compiled by the previous run
+		mPipelineCache.Init(mDevice, mPhysicalDevice, PIPELINE_CACHE_FILE);
+
 		// Setup function pointers for the swap chain
 		mSwapChain.connect(mInstance, mPhysicalDevice, mDevice);
 
@@ -71,6 +76,9 @@ namespace VulkanLib
 			vkDestroyShaderModule(mDevice, shaderModule, nullptr);
 		}
 
+		// Written back to disk for the next run
+		mPipelineCache.Cleanup();
+
 		vkDestroyDevice(mDevice, nullptr);
 
 		VulkanDebug::CleanupDebugging(mInstance);
@@ -181,6 +189,14 @@ namespace VulkanLib
 		queueInfo.pQueuePriorities = queuePriorities.data();
 		queueInfo.queueCount = 1;
 
+		// Only the features that are used are enabled, and only if the device supports them
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(mPhysicalDevice, &supportedFeatures);
+
+		mEnabledFeatures = {};
+		mEnabledFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;	// Material texture arrays
+		mEnabledFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+
 		std::vector<const char*> enabledExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 		VkDeviceCreateInfo deviceInfo = {};
 		deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -188,7 +204,7 @@ namespace VulkanLib
 		deviceInfo.flags = 0;
 		deviceInfo.queueCreateInfoCount = 1;
 		deviceInfo.pQueueCreateInfos = &queueInfo;
-		deviceInfo.pEnabledFeatures = nullptr;
+		deviceInfo.pEnabledFeatures = &mEnabledFeatures;
 		deviceInfo.enabledExtensionCount = enabledExtensions.size();			// Extensions
 		deviceInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
@@ -280,7 +296,7 @@ namespace VulkanLib
 		imageCreateInfo.arrayLayers = 1;
 		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;	// Sampled by HiZCuller
 
 		VkMemoryAllocateInfo allocateInfo = {};
 		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -546,8 +562,7 @@ namespace VulkanLib
 
 		vkGetBufferMemoryRequirements(mDevice, *buffer, &memReqs);
 		memAlloc.allocationSize = memReqs.size;
-		uint32_t tmp;
-		memAlloc.memoryTypeIndex = GetMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags, &tmp);
+		GetMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags, &memAlloc.memoryTypeIndex);
 		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &memAlloc, nullptr, memory));
 		if (data != nullptr)
 		{
@@ -561,6 +576,89 @@ namespace VulkanLib
 		return true;
 	}
 
+	void VulkanBase::CreateTexture(const void* data, VkDeviceSize size, uint32_t width, uint32_t height, VkFormat format, VkFilter filter, vkTools::VulkanTexture* texture)
+	{
+		texture->width = width;
+		texture->height = height;
+		texture->mipLevels = 1;
+		texture->layerCount = 1;
+
+		// Staging buffer with the texel data
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, size, (void*)data, &stagingBuffer, &stagingMemory);
+
+		// Optimal tiled image in device local memory
+		VkImageCreateInfo imageCreateInfo = vkTools::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = format;
+		imageCreateInfo.extent = { width, height, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VulkanDebug::ErrorCheck(vkCreateImage(mDevice, &imageCreateInfo, nullptr, &texture->image));
+
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(mDevice, texture->image, &memReqs);
+		VkMemoryAllocateInfo memAlloc = vkTools::initializers::memoryAllocateInfo();
+		memAlloc.allocationSize = memReqs.size;
+		GetMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAlloc.memoryTypeIndex);
+		VulkanDebug::ErrorCheck(vkAllocateMemory(mDevice, &memAlloc, nullptr, &texture->deviceMemory));
+		VulkanDebug::ErrorCheck(vkBindImageMemory(mDevice, texture->image, texture->deviceMemory, 0));
+
+		// Copy the staging buffer to the image and transition it for shader reads
+		CreateSetupCommandBuffer();
+
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkTools::setImageLayout(mSetupCmdBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+		VkBufferImageCopy copyRegion = {};
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.mipLevel = 0;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent = { width, height, 1 };
+		vkCmdCopyBufferToImage(mSetupCmdBuffer, stagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+
+		texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkTools::setImageLayout(mSetupCmdBuffer, texture->image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->imageLayout, subresourceRange);
+
+		ExecuteSetupCommandBuffer();	// Waits for the queue to be idle
+
+		vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
+		vkFreeMemory(mDevice, stagingMemory, nullptr);
+
+		// Sampler, clamped since textures created from data usually are lookup tables and not tiling images
+		VkSamplerCreateInfo sampler = {};
+		sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler.magFilter = filter;
+		sampler.minFilter = filter;
+		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler.compareOp = VK_COMPARE_OP_NEVER;
+		sampler.minLod = 0.0f;
+		sampler.maxLod = 0.0f;
+		sampler.maxAnisotropy = 1;
+		sampler.anisotropyEnable = VK_FALSE;
+		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		VulkanDebug::ErrorCheck(vkCreateSampler(mDevice, &sampler, nullptr, &texture->sampler));
+
+		VkImageViewCreateInfo view = {};
+		view.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view.format = format;
+		view.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+		view.subresourceRange = subresourceRange;
+		view.image = texture->image;
+		VulkanDebug::ErrorCheck(vkCreateImageView(mDevice, &view, nullptr, &texture->view));
+	}
+
 	void VulkanBase::BuildPresentCommandBuffers()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vkTools::initializers::commandBufferBeginInfo();
@@ -700,6 +798,26 @@ namespace VulkanLib
 		return mDevice;
 	}
 
+	VkPhysicalDevice VulkanBase::GetPhysicalDevice()
+	{
+		return mPhysicalDevice;
+	}
+
+	VkPipelineCache VulkanBase::GetPipelineCache()
+	{
+		return mPipelineCache.GetVkPipelineCache();
+	}
+
+	VkCommandBuffer VulkanBase::GetSetupCommandBuffer()
+	{
+		return mSetupCmdBuffer;
+	}
+
+	const VkPhysicalDeviceFeatures& VulkanBase::GetEnabledFeatures()
+	{
+		return mEnabledFeatures;
+	}
+
 	// Code from Vulkan samples and SaschaWillems
 	VkBool32 VulkanBase::GetMemoryType(uint32_t typeBits, VkFlags properties, uint32_t * typeIndex)
 	{
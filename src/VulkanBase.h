@@ -9,6 +9,7 @@
 #include "base/vulkanTextureLoader.hpp"
 #include "Window.h"
 #include "Timer.h"
+#include "PipelineCache.h"
 
 #include <vulkan/vulkan.h>
 
@@ -62,7 +63,6 @@ namespace VulkanLib
 		void SetupRenderPass();
 		void SetupFrameBuffer();
 		void BuildPresentCommandBuffers();
-		// Don't need pipeline cache
 
 		void InitSwapchain(Window* window);
 		void SetupSwapchain();
@@ -77,6 +77,9 @@ namespace VulkanLib
 
 		VkBool32 CreateBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, void * data, VkBuffer * buffer, VkDeviceMemory * memory);
 
+		// Creates a sampled 2D texture with one mip level from raw texel data, the data is uploaded with a staging buffer
+		void CreateTexture(const void* data, VkDeviceSize size, uint32_t width, uint32_t height, VkFormat format, VkFilter filter, vkTools::VulkanTexture* texture);
+
 		void PrepareFrame();
 		void SubmitFrame();
 
@@ -87,6 +90,10 @@ namespace VulkanLib
 		void RenderLoop();
 
 		VkDevice GetDevice();
+		VkPhysicalDevice GetPhysicalDevice();
+		VkPipelineCache GetPipelineCache();					// Pass to every vkCreate*Pipelines() call
+		VkCommandBuffer GetSetupCommandBuffer();		// Only valid between CreateSetupCommandBuffer() and ExecuteSetupCommandBuffer()
+		const VkPhysicalDeviceFeatures& GetEnabledFeatures();
 		int GetWindowWidth();
 		int GetWindowHeight();
 
@@ -139,6 +146,12 @@ namespace VulkanLib
 		// Stores all available memory (type) properties for the physical device
 		VkPhysicalDeviceMemoryProperties mDeviceMemoryProperties;
 
+		// The optional features that the device was created with
+		VkPhysicalDeviceFeatures		mEnabledFeatures			= {};
+
+		// Shared by all pipeline creation, loaded from and saved to PIPELINE_CACHE_FILE
+		PipelineCache					mPipelineCache;
+
 		// Group everything with the depth stencil together in a struct (as in Vulkan samples)
 		DepthStencil					mDepthStencil;
 
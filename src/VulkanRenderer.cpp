@@ -2,6 +2,12 @@
 #include "VulkanApp.h"
 #include "Object.h"
 #include "StaticModel.h"
+#include "ChunkedTerrain.h"
+#include "TransformSystem.h"
+#include <cassert>
+#include <algorithm>
+
+#define GPU_DISPLACED_TERRAIN true		// Displace a shared grid patch in the vertex shader instead of storing the terrain vertices
 
 namespace VulkanLib
 {
@@ -16,27 +22,57 @@ namespace VulkanLib
 		//mVulkanApp.RenderLoop();
 	}
 
-	VulkanRenderer::VulkanRenderer(Window* window, int numThreads, bool useInstancing, bool useStaticCommandBuffers)
+	VulkanRenderer::VulkanRenderer(Window* window, int numThreads, RendererSettings settings)
 	{
 		mVulkanApp = new VulkanApp();
 
 		//mVulkanApp->mTestModel = mModelLoader.LoadModel(mVulkanApp, "data/models/teapot.3ds");
 		mVulkanApp->mTestModel = mModelLoader.LoadModel(mVulkanApp, "data/models/Crate.obj");
 
-		mVulkanApp->EnableInstancing(useInstancing);	// [NOTE] The order is important, must be before Prepare()
-		mVulkanApp->EnableStaticCommandBuffers(useStaticCommandBuffers);
+		bool basicPipeline = !settings.useInstancing && !settings.useStaticCommandBuffers;
+
+		mUseInstancing = settings.useInstancing;
+		mUseStaticCommandBuffer = settings.useStaticCommandBuffers;
+		mUseGpuCulling = settings.useInstancing && settings.useGpuCulling;
+		mUseDepthPrepass = settings.useDepthPrepass && basicPipeline;
+		mUseImpostors = settings.useImpostors && basicPipeline;
+		mUseContributionCulling = settings.useContributionCulling && basicPipeline;
+		mUseOcclusionCulling = settings.useOcclusionCulling && basicPipeline;
+		mUseStaticBatching = settings.useStaticBatching && basicPipeline;
+		mUseDynamicBatching = settings.useDynamicBatching && basicPipeline;
+
+		mVulkanApp->EnableInstancing(mUseInstancing);	// [NOTE] The order is important, must be before Prepare()
+		mVulkanApp->EnableStaticCommandBuffers(mUseStaticCommandBuffer);
+		mVulkanApp->EnableShaderVariants(settings.useShaderVariants);
+		mVulkanApp->EnableGpuCulling(settings.useGpuCulling);
+		mVulkanApp->EnableDepthPrepass(mUseDepthPrepass);
+		mVulkanApp->EnableImpostors(mUseImpostors);
+		mVulkanApp->EnableContributionCulling(mUseContributionCulling);
+		mVulkanApp->EnableOcclusionCulling(mUseOcclusionCulling);
+		mVulkanApp->EnableStaticBatching(mUseStaticBatching);
+		mVulkanApp->EnableDynamicBatching(mUseDynamicBatching);
 		mVulkanApp->InitSwapchain(window);
 		mVulkanApp->Prepare();
 		
 		mVulkanApp->SetupMultithreading(numThreads);
+	}
 
-		mUseInstancing = useInstancing;
-		mUseStaticCommandBuffer = useStaticCommandBuffers;
+	VulkanRenderer::~VulkanRenderer()
+	{
+		// Nothing can be in use by the GPU when it's destroyed, ~VulkanBase() also saves the pipeline cache
+		vkDeviceWaitIdle(mVulkanApp->GetDevice());
+		Cleanup();
+
+		delete mVulkanApp;
 	}
 
 	void VulkanRenderer::Init()
 	{
+		// The objects can have moved after they were added
+		TransformSystem::GetDefault().Update(nullptr);
 		mVulkanApp->PrepareInstancing();
+		mVulkanApp->BuildStaticBatches();
+		mVulkanApp->SortThreadObjects();
 		mVulkanApp->RecordStaticCommandBuffers();	// [NOTE] Has to be called after all the objects are added!
 	}
 
@@ -75,12 +111,81 @@ namespace VulkanLib
 		fout << GetName() << "\n[" << GetNumVertices() << " vertices] [" << GetNumTriangles() << " triangles] [" << GetNumObjects() << " objects]" << std::endl;
 		fout << "Threads: " << GetNumThreads() << std::endl;
 
-		if(mUseInstancing)
+		if(mUseInstancing && mUseGpuCulling)
+			fout << "Pipeline: " << "Instancing with GPU occlusion culling" << std::endl;
+		else if(mUseInstancing)
 			fout << "Pipeline: " << "Instancing" << std::endl;
 		else if (mUseStaticCommandBuffer)
 			fout << "Pipeline: " << "Static command buffers" << std::endl;
+		else if (mUseDepthPrepass)
+			fout << "Pipeline: " << "Basic with depth pre-pass" << std::endl;
 		else
 			fout << "Pipeline: " << "Basic" << std::endl;
+
+		if (!mUseInstancing && !mUseStaticCommandBuffer)
+		{
+			fout << "Frustum culling: " << mVulkanApp->GetNumVisibleObjects() << " visible, " << mVulkanApp->GetNumCulledObjects() << " culled" << std::endl;
+		}
+
+		if (mUseOcclusionCulling)
+		{
+			OcclusionStats occlusionStats = mVulkanApp->mOcclusionCuller.GetStats();
+			fout << "Occlusion culling: " << mVulkanApp->GetNumOccludedObjects() << " occluded by " << occlusionStats.numOccluders << " occluders [" << occlusionStats.numTriangles << " triangles]";
+			fout << " rasterize " << occlusionStats.rasterizeTime << " ms, test " << mVulkanApp->GetOcclusionTestTime() << " ms" << std::endl;
+		}
+
+		if (mUseContributionCulling || mUseImpostors)
+		{
+			fout << "Contribution culling: " << mVulkanApp->GetNumContributionCulledObjects() << " too small, " << mVulkanApp->GetNumImpostorObjects() << " drawn as impostors" << std::endl;
+		}
+
+		if (mUseImpostors)
+		{
+			ImpostorStats impostorStats = mVulkanApp->mImpostorRenderer.GetStats();
+			fout << "Impostors: " << impostorStats.numInstances << " billboards in " << impostorStats.numDraws << " draws [" << impostorStats.numImpostors << " atlases]" << std::endl;
+		}
+
+		// The objects that moved are drawn on their own and counted as visible objects above
+		if (mUseStaticBatching)
+		{
+			StaticBatchStats batchStats = mVulkanApp->mStaticBatcher.GetStats();
+			fout << "Static batching: " << mVulkanApp->GetNumVisibleBatches() << " of " << batchStats.numBatches << " batches visible in " << mVulkanApp->GetNumBatchDraws() << " draws [" << batchStats.numBatchedObjects << " objects batched, " << batchStats.numLeft << " left]" << std::endl;
+		}
+
+		if (mUseDynamicBatching)
+		{
+			DynamicBatchStats dynamicStats = mVulkanApp->GetDynamicBatchStats();
+			fout << "Dynamic batching: " << dynamicStats.numObjects << " objects in " << dynamicStats.numDraws << " draws [" << dynamicStats.numVertices << " vertices transformed in " << dynamicStats.buildTime << " ms]" << std::endl;
+		}
+
+		// The counts of the last frame, read after its fence so the culling never waits for the CPU
+		if (mUseGpuCulling)
+		{
+			HiZStats hizStats = mVulkanApp->mHiZCuller.GetStats();
+			fout << "GPU occlusion culling: " << hizStats.numDrawn[HIZ_PHASE_VISIBLE_LAST_FRAME] << " drawn in the first phase, " << hizStats.numDrawn[HIZ_PHASE_DISOCCLUDED] << " disoccluded, " << hizStats.numCulled << " culled of " << hizStats.numInstances << std::endl;
+		}
+
+		TransformStats transformStats = TransformSystem::GetDefault().GetStats();
+		fout << "Transforms: " << transformStats.numRebuilt << " of " << transformStats.numTransforms << " rebuilt in " << transformStats.updateTime << " ms" << std::endl;
+
+		OctreeStats octreeStats = mVulkanApp->mOctree.GetStats();
+		fout << "Octree: " << octreeStats.numEntries << " objects, " << octreeStats.numNodes << " nodes [" << octreeStats.numMoved << " moved, " << octreeStats.numRelocated << " relocated in " << octreeStats.maintenanceTime << " ms]" << std::endl;
+
+		if (mVulkanApp->GetShaderVariant() != 0)
+			fout << "Shaders: Specialized [variant " << mVulkanApp->GetShaderVariant() << "]" << std::endl;
+		else
+			fout << "Shaders: Uber shader" << std::endl;
+
+		ChunkedTerrain* terrain = mVulkanApp->mTerrain;
+		if (terrain != nullptr)
+		{
+			fout << "Terrain chunks: " << terrain->GetNumSelectedNodes() << " drawn, " << terrain->GetNumCulledNodes() << " culled, " << terrain->GetNumNodes() << " total [" << terrain->GetNumSelectedTriangles() << " triangles]" << std::endl;
+			fout << "Terrain memory: " << terrain->GetMemoryUsage() / 1024 << " KB [" << (terrain->GetMode() == TERRAIN_MODE_GPU_DISPLACED ? "GPU displaced" : "Vertex buffers") << "]" << std::endl;
+		}
+
+		TextureStreamingStats textureStats = mVulkanApp->mTextureStreamer.GetStats();
+		fout << "Texture streaming: " << textureStats.residentBytes / 1024 << " KB resident of " << textureStats.memoryBudget / 1024 << " KB [" << textureStats.numPendingRequests << " pending requests]" << std::endl;
+		fout << "Pipelines: " << mVulkanApp->mPipelineStates.GetNumPipelines() << " [" << mVulkanApp->mPipelineStates.GetNumPending() << " compiling]" << std::endl;
 	}
 	void VulkanRenderer::SetCamera(Camera * camera)
 	{
@@ -91,19 +196,38 @@ namespace VulkanLib
 	{
 		VulkanModel model;
 		model.object = object;
+		model.mesh = nullptr;
+
+		model.pipeline = mVulkanApp->GetPipeline(object->GetPipeline());
+
+		// Objects without a texture use the default texture at index 0
+		if (object->GetTexture() != "")
+			model.textureIndex = std::max(mVulkanApp->AddTexture(object->GetTexture(), VK_FORMAT_BC3_UNORM_BLOCK), 0);
+
+		// The basic pipeline records its command buffers every frame and can use the chunked terrain
+		// Instancing and static command buffers keep drawing the full resolution mesh
+		if (object->GetId() == OBJECT_ID_TERRAIN && !mUseInstancing && !mUseStaticCommandBuffer)
+		{
+			ChunkedTerrain* terrain = new ChunkedTerrain(GPU_DISPLACED_TERRAIN ? TERRAIN_MODE_GPU_DISPLACED : TERRAIN_MODE_VERTEX_BUFFERS);
+			if (!terrain->Init(mVulkanApp, object->GetModel()))
+			{
+				assert(false && "AddObject() failed to load the terrain heightmap");
+				delete terrain;
+				return;
+			}
+
+			mVulkanApp->SetTerrain(model, terrain);
+
+			mNumVertices += terrain->GetNumVertices();
+			mNumObjects++;
+			return;
+		}
 
 		if(object->GetId() == OBJECT_ID_TERRAIN)
 			model.mesh = mModelLoader.GenerateTerrain(mVulkanApp, object->GetModel());
 		else
 			model.mesh = mModelLoader.LoadModel(mVulkanApp, object->GetModel());
 
-		if (object->GetPipeline() == PipelineEnum::COLORED)
-			model.pipeline = mVulkanApp->mPipelines.colored;		// [NOTE][HACK] mPipelines should be private!
-		else if (object->GetPipeline() == PipelineEnum::TEXTURED)
-			model.pipeline = mVulkanApp->mPipelines.textured;
-		else if (object->GetPipeline() == PipelineEnum::STARSPHERE)
-			model.pipeline = mVulkanApp->mPipelines.starsphere;
-
 		mVulkanApp->AddModel(model);
 
 		mNumVertices += model.mesh->GetNumVertics();
@@ -126,6 +250,11 @@ namespace VulkanLib
 		return mNumObjects;
 	}
 
+	void VulkanRenderer::WaitForPipelines()
+	{
+		mVulkanApp->mPipelineStates.Wait();
+	}
+
 	std::string VulkanRenderer::GetName()
 	{
 		return "Vulkan renderer 1.0";
@@ -140,4 +269,9 @@ namespace VulkanLib
 	{
 		return mCamera;
 	}
+
+	SceneQuery* VulkanRenderer::GetSceneQuery()
+	{
+		return &mVulkanApp->mSceneQuery;
+	}
 }
\ No newline at end of file
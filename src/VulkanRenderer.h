@@ -7,11 +7,27 @@ namespace VulkanLib
 {
 	class VulkanApp;
 
+	// The optional paths of VulkanRenderer, everything is off by default
+	struct RendererSettings
+	{
+		bool useInstancing = false;
+		bool useStaticCommandBuffers = false;
+		bool useShaderVariants = false;
+		bool useGpuCulling = false;				// Only with instancing
+		bool useDepthPrepass = false;			// The ones below only work in the basic pipeline, without instancing and static command buffers
+		bool useImpostors = false;
+		bool useContributionCulling = false;	// Objects below CONTRIBUTION_CULL_PIXELS on screen aren't drawn
+		bool useOcclusionCulling = false;		// Objects hidden behind the occluders in the CPU depth buffer aren't drawn
+		bool useStaticBatching = false;
+		bool useDynamicBatching = false;
+	};
+
 	class VulkanRenderer : public Renderer
 	{
 	public:
 		VulkanRenderer(Window* window, bool useIntancing = false);
-		VulkanRenderer(Window* window, int numThreads, bool useIntancing = false, bool useStaticCommandBuffers = false);
+		VulkanRenderer(Window* window, int numThreads, RendererSettings settings = RendererSettings());
+		~VulkanRenderer();
 
 		virtual void Cleanup();
 		virtual void SetupMultithreading(int numThreads);
@@ -36,6 +52,12 @@ namespace VulkanLib
 
 		Camera* GetCamera();
 
+		// Pipelines are compiled in the background and objects use the fallback until then
+		void WaitForPipelines();
+
+		// Ray casts and overlap queries against the objects, can be used from any thread
+		SceneQuery* GetSceneQuery();
+
 	private:
 		VulkanApp* mVulkanApp;
 		Camera* mCamera;
@@ -43,6 +65,13 @@ namespace VulkanLib
 
 		bool mUseInstancing = false;
 		bool mUseStaticCommandBuffer = false;
+		bool mUseGpuCulling = false;
+		bool mUseDepthPrepass = false;
+		bool mUseImpostors = false;
+		bool mUseContributionCulling = false;
+		bool mUseOcclusionCulling = false;
+		bool mUseStaticBatching = false;
+		bool mUseDynamicBatching = false;
 
 		int mNumVertices = 0;
 		int mNumTriangles = 0;
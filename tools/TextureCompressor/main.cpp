@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+#include "TextureCompiler.h"
+
+using namespace VulkanLib;
+
+/*
+	Offline texture compressor
+
+	TextureCompressor <source.tga> <destination.dds> [bc1 | bc1a | bc3 | bc7] [-srgb] [-box] [-threads N]
+
+	Writes the full mip chain, the default format is bc7 and the default mip filter is Kaiser. The same files are created at load time
+	by TextureCompiler::GetCachedTexture() when the source is newer than the compressed copy.
+*/
+static VkFormat GetFormat(std::string name, bool srgb)
+{
+	if (name == "bc1")
+		return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	else if (name == "bc1a")
+		return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	else if (name == "bc3")
+		return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+	else if (name == "bc7")
+		return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		printf("usage: TextureCompressor <source.tga> <destination.dds> [bc1 | bc1a | bc3 | bc7] [-srgb] [-box] [-threads N]\n");
+		return 1;
+	}
+
+	std::string formatName = "bc7";
+	bool srgb = false;
+	MipFilter mipFilter = MIP_FILTER_KAISER;
+	int numThreads = 0;
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-srgb") == 0)
+			srgb = true;
+		else if (strcmp(argv[i], "-box") == 0)
+			mipFilter = MIP_FILTER_BOX;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			numThreads = atoi(argv[++i]);
+		else
+			formatName = argv[i];
+	}
+
+	VkFormat format = GetFormat(formatName, srgb);
+	if (format == VK_FORMAT_UNDEFINED)
+	{
+		printf("unknown format %s\n", formatName.c_str());
+		return 1;
+	}
+
+	auto begin = std::chrono::high_resolution_clock::now();
+
+	TextureCompiler compiler(numThreads);
+	if (!compiler.Compile(argv[1], argv[2], format, mipFilter))
+		return 1;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("%s -> %s (%s) in %.1f ms\n", argv[1], argv[2], formatName.c_str(), std::chrono::duration<float, std::milli>(end - begin).count());
+
+	return 0;
+}